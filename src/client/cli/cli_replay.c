@@ -0,0 +1,82 @@
+/*
+ * cli_replay.c - Terminal replay viewer
+ *
+ * Shows a recorded game through the CLI callbacks; the user steps through
+ * it shot by shot or jumps anywhere.
+ */
+
+#include "client_api.h"
+#include "client_replay.h"
+#include "client_state.h"
+#include "client_ui.h"
+#include "cli_callbacks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void on_replay_end(int winner_id) {
+    if (player_names[winner_id][0]) {
+        print_utf8(player_names[winner_id]);
+        printf(" wins\n");
+    } else {
+        printf("Player %d wins\n", winner_id);
+    }
+}
+
+static void replay_help(void) {
+    printf("\n=== Replay Commands ===\n");
+    printf("  ENTER or N  - Next shot\n");
+    printf("  B           - Back one shot\n");
+    printf("  G n         - Go to the position after n shots\n");
+    printf("  F / L       - First / last position\n");
+    printf("  SHOW        - Display both grids\n");
+    printf("  Q           - Quit\n");
+    printf("=======================\n\n");
+}
+
+int replay_run(const char *path, int index, int seat) {
+    ClientCallbacks callbacks = *cli_get_callbacks();
+    callbacks.on_game_end = on_replay_end;
+    client_set_callbacks(&callbacks);
+
+    if (client_replay_open(path, index, seat) != 0) {
+        fprintf(stderr, "Cannot load a replay from %s\n", path);
+        return 1;
+    }
+    printf("Replay of %s: %d shots, seen from player %d\n", path, client_replay_length(), seat);
+    replay_help();
+    show_grids();
+
+    char line[64];
+    for (;;) {
+        printf("[%d/%d] > ", client_replay_position(), client_replay_length());
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) break;
+
+        char cmd = line[0];
+        if (cmd >= 'a' && cmd <= 'z') cmd = (char)(cmd - 'a' + 'A');
+        if (cmd == '\n' || cmd == 'N') {
+            if (client_replay_position() == client_replay_length()) printf("End of game\n");
+            else client_replay_step();
+        } else if (strncmp(line, "SHOW", 4) == 0 || strncmp(line, "show", 4) == 0) {
+            show_grids();
+        } else if (cmd == 'B') {
+            client_replay_seek(client_replay_position() - 1);
+            show_grids();
+        } else if (cmd == 'G') {
+            client_replay_seek(atoi(line + 1));
+            show_grids();
+        } else if (cmd == 'F') {
+            client_replay_seek(0);
+            show_grids();
+        } else if (cmd == 'L') {
+            client_replay_seek(client_replay_length());
+            show_grids();
+        } else if (cmd == 'Q') {
+            break;
+        } else {
+            replay_help();
+        }
+    }
+    return 0;
+}
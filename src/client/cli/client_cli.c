@@ -123,24 +123,8 @@ int client_run(const char *host, int port) {
     /* Seed RNG for random placement */
     srand((unsigned)time(NULL));
 
-    if (sock_init() != 0) {
-        fprintf(stderr, "Winsock init failed\n");
-        return 1;
-    }
-
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == SOCKET_INVALID) {
-        perror("socket");
-        return 1;
-    }
-
-    struct sockaddr_in srv = {0};
-    srv.sin_family = AF_INET;
-    srv.sin_port = htons(port);
-    inet_pton(AF_INET, host, &srv.sin_addr);
-
-    if (connect(sockfd, (struct sockaddr *)&srv, sizeof(srv)) < 0) {
-        perror("connect");
+    /* client_api remembers the address so a dropped game can be resumed */
+    if (client_open(host, port) != 0) {
         return 1;
     }
     printf("Connected to %s:%d\n", host, port);
@@ -149,7 +133,7 @@ int client_run(const char *host, int port) {
     char tmp[MAX_LINE];
     ssize_t rn = read_line(sockfd, tmp, sizeof(tmp));
     if (rn > 0) {
-        if (sscanf(tmp, "ASSIGN %d", &my_id) == 1) {
+        if (sscanf(tmp, "ASSIGN %d %63s", &my_id, resume_token) >= 1) {
             printf("Assigned id %d\n", my_id);
             init_grids();
 
@@ -285,6 +269,14 @@ int client_run(const char *host, int port) {
             continue;
         }
 
+        if (strcmp(cmd, "CLOCK") == 0) {
+            char *args = p + i;
+            while (*args == ' ' || *args == '\t')
+                args++;
+            handle_clock_command(args);
+            continue;
+        }
+
         if (strcmp(cmd, "HELP") == 0) {
             handle_help_command();
             continue;
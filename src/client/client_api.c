@@ -28,25 +28,24 @@
 static ClientCallbacks g_callbacks = {0};
 static pthread_t recv_tid;
 
+/* Where client_open connected, for client_resume */
+static char server_host[256];
+static int server_port;
+
 /* Forward declaration for recv_thread (defined in client_recv.c) */
 void *recv_thread(void *arg);
+void api_callback_message(const char *msg);
 
 /* ==================== Connection ==================== */
 
-int client_connect(const char *host, int port) {
+static sock_t connect_tcp(const char *host, int port) {
     struct sockaddr_in server_addr;
     
-    /* Initialize network */
-    if (sock_init() != 0) {
-        fprintf(stderr, "Network initialization failed\n");
-        return -1;
-    }
-    
     /* Create socket */
-    sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sockfd == SOCKET_INVALID) {
+    sock_t fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == SOCKET_INVALID) {
         fprintf(stderr, "Failed to create socket\n");
-        return -1;
+        return SOCKET_INVALID;
     }
     
     /* Setup server address */
@@ -57,21 +56,75 @@ int client_connect(const char *host, int port) {
     /* Convert host string to address */
     if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0) {
         fprintf(stderr, "Invalid host address: %s\n", host);
-        CLOSE(sockfd);
-        return -1;
+        CLOSE(fd);
+        return SOCKET_INVALID;
     }
     
     /* Connect to server */
-    if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+    if (connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
         fprintf(stderr, "Failed to connect to %s:%d\n", host, port);
-        CLOSE(sockfd);
-        sockfd = SOCKET_INVALID;
+        CLOSE(fd);
+        return SOCKET_INVALID;
+    }
+    return fd;
+}
+
+static sock_t open_socket(const char *host, int port) {
+#ifndef _WIN32
+    /* "unix:/path" reaches a server on the same host through its --unix-socket */
+    if (strncmp(host, "unix:", 5) == 0) {
+        sock_t fd = connect_unix(host + 5);
+        if (fd == SOCKET_INVALID) fprintf(stderr, "Failed to connect to %s\n", host);
+        return fd;
+    }
+#endif
+    return connect_tcp(host, port);
+}
+
+int client_open(const char *host, int port) {
+    /* Initialize network */
+    if (sock_init() != 0) {
+        fprintf(stderr, "Network initialization failed\n");
         return -1;
     }
+
+    sockfd = open_socket(host, port);
+    if (sockfd == SOCKET_INVALID) return -1;
+
+    strncpy(server_host, host, sizeof(server_host) - 1);
+    server_host[sizeof(server_host) - 1] = '\0';
+    server_port = port;
+    return 0;
+}
+
+int client_resume(void) {
+    int delay_ms = 500;
+    char msg[128];
+
+    for (int attempt = 0; attempt < RESUME_ATTEMPTS && client_running; attempt++) {
+        SLEEP_MS(delay_ms);
+        if (delay_ms < 4000) delay_ms *= 2;
+
+        sock_t fd = open_socket(server_host, server_port);
+        if (fd == SOCKET_INVALID) continue;
+
+        sock_t old = sockfd;
+        sockfd = fd;
+        if (old != SOCKET_INVALID) CLOSE(old);
+
+        int len = snprintf(msg, sizeof(msg), "RESUME %s\n", resume_token);
+        WRITE(sockfd, msg, len);
+        api_callback_message("Reconnected - resuming the game");
+        return 0;
+    }
+    return -1;
+}
+
+int client_connect(const char *host, int port) {
+    if (client_open(host, port) != 0) return -1;
     
     /* Initialize grids */
-    memset(own_grid, '.', sizeof(own_grid));
-    memset(opp_grid, '.', sizeof(opp_grid));
+    init_grids();
     my_id = -1;
     
     /* Start receive thread */
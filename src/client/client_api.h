@@ -15,10 +15,20 @@
 
 /* ==================== Connection ==================== */
 
-/* Connect to server and start network thread
+/* Connect to server and start network thread. host "unix:/path" uses a
+ * Unix-domain socket (port is ignored)
  * Returns: 0 on success, -1 on failure */
 int client_connect(const char *host, int port);
 
+/* Connect without starting the network thread (client_connect does both) */
+int client_open(const char *host, int port);
+
+/* Connection dropped while holding a resume token: reconnect to the same
+ * server with backoff and send RESUME. Called from the network thread.
+ * Returns: 0 once a new connection is up, -1 after RESUME_ATTEMPTS failures */
+#define RESUME_ATTEMPTS 8
+int client_resume(void);
+
 /* Disconnect from server */
 void client_disconnect(void);
 
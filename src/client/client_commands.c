@@ -394,6 +394,18 @@ void handle_ready_command(void) {
     printf("Signaled ready. Waiting for opponent...\n");
 }
 
+void handle_clock_command(const char *args) {
+    int turn_s, placement_s;
+    if (sscanf(args, "%d %d", &turn_s, &placement_s) != 2 || turn_s < 0 || placement_s < 0) {
+        printf("Usage: CLOCK <turn seconds> <placement seconds>  (0 = no limit)\n");
+        return;
+    }
+
+    char out[64];
+    snprintf(out, sizeof(out), "CLOCK %d %d\n", turn_s, placement_s);
+    WRITE(sockfd, out, strlen(out));
+}
+
 void handle_help_command(void) {
     printf("\n=== Available Commands ===\n");
     printf("  HELP                   - Show this help message\n");
@@ -405,6 +417,8 @@ void handle_help_command(void) {
     printf("                           (Aliases: RAND, AUTO)\n");
     printf("  READY                  - Signal you're ready to start the game\n");
     printf("  FIRE r c               - Fire at row r, column c\n");
+    printf("  CLOCK turn place       - Set this lobby's turn and placement limits in seconds\n");
+    printf("                           (0 = no limit; only before the game starts)\n");
     printf("  SHOW                   - Display both grids\n");
     printf("  QUIT                   - Exit the game\n");
     printf("\nShip sizes: 2, 3, 3, 4, 5\n");
@@ -20,6 +20,9 @@ void handle_move_command(const char *args);
 /* Handle READY command: signal ready to start game */
 void handle_ready_command(void);
 
+/* Handle CLOCK command: set the lobby's turn and placement time limits */
+void handle_clock_command(const char *args);
+
 /* Handle HELP command: show available commands */
 void handle_help_command(void);
 
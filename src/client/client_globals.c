@@ -1,5 +1,6 @@
 #include "client_state.h"
 #include "common.h"
+#include "game.h"
 #include <string.h>
 
 /* Global client state */
@@ -16,10 +17,22 @@ volatile int awaiting_restart = 0;
 const int allowed_init[6] = {0,0,1,2,1,1};
 int remaining[6];
 char player_names[2][64];
+char resume_token[64];
 /* Track each ship's length (indexed by cell value) */
 int ship_lengths[6] = {0};
 /* Track how many ships we've placed successfully */
 int placed_count = 0;
+uint32_t view_hash = 0;
+
+void set_own_cell(int r, int c, char v) {
+    view_hash ^= view_cell_key(VIEW_OWN, r, c, own_grid[r][c]) ^ view_cell_key(VIEW_OWN, r, c, v);
+    own_grid[r][c] = v;
+}
+
+void set_opp_cell(int r, int c, char v) {
+    view_hash ^= view_cell_key(VIEW_OPP, r, c, opp_grid[r][c]) ^ view_cell_key(VIEW_OPP, r, c, v);
+    opp_grid[r][c] = v;
+}
 
 void init_grids(void) {
     for (int r = 0; r < GRID_ROWS; ++r)
@@ -27,6 +40,7 @@ void init_grids(void) {
             own_grid[r][c] = '.';
             opp_grid[r][c] = '.';
         }
+    view_hash = 0;
     for (int l = 0; l < 6; ++l)
         remaining[l] = allowed_init[l];
 }
@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200112L
 #include "client_recv.h"
 #include "client_state.h"
+#include "client_api.h"
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,14 +39,66 @@ static void log_msg(const char *fmt, ...) {
     api_callback_message(buf);
 }
 
-void *recv_thread(void *arg) {
+/* STATE <seat> <phase> <turn> <own> <opp> <ships> <hash>: replace both boards */
+static void apply_state(const char *buf) {
+    char phase[8], own[GRID_ROWS * GRID_COLS + 2], opp[GRID_ROWS * GRID_COLS + 2], ships[24];
+    int seat, turn;
+    unsigned int hash;
+
+    if (sscanf(buf, "STATE %d %7s %d %64s %64s %23s %x", &seat, phase, &turn, own, opp, ships, &hash) != 7 ||
+        strlen(own) != GRID_ROWS * GRID_COLS || strlen(opp) != GRID_ROWS * GRID_COLS || strlen(ships) != 20) {
+        return;
+    }
+
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            char o = own[r * GRID_COLS + c], t = opp[r * GRID_COLS + c];
+            set_own_cell(r, c, (o >= '1' && o <= '5') ? (char)(o - '0') : (o == 'H' || o == 'M') ? o : '.');
+            set_opp_cell(r, c, (t == 'H' || t == 'M') ? t : '.');
+        }
+    }
+
+    /* Ship layout, 4 characters (row, col, length, dir) per ship id */
+    placed_count = 0;
+    for (int l = 0; l < 6; ++l) {
+        remaining[l] = allowed_init[l];
+        ship_lengths[l] = 0;
+    }
+    for (int id = 1; id <= 5; id++) {
+        int len = ships[(id - 1) * 4 + 2] - '0';
+        if (len < 2 || len > 5) continue;
+        ship_lengths[id] = len;
+        remaining[len]--;
+        placed_count++;
+    }
+
+    pending_turn_player = turn;
+    if (view_hash != hash) {
+        log_msg("Board still differs from the server after resync");
+    } else {
+        log_msg("Board resynchronised with the server");
+    }
+    api_callback_grid_update();
+}
+
+/* Handle server lines until the connection ends.
+ * Returns 1 if the server ended the session (GAME_OVER) */
+static int read_messages(void) {
     char buf[MAX_LINE];
     ssize_t n;
     while ((n = read_line(sockfd, buf, sizeof(buf))) > 0) {
         /* Parse server messages */
         int a, b, ok, who;
 
-        if (sscanf(buf, "ASSIGN %d", &who) == 1) {
+        /* Heartbeat: answer at once so the server keeps the connection */
+        if (strncmp(buf, "PING", 4) == 0) {
+            char pong[MAX_LINE + 8];
+            snprintf(pong, sizeof(pong), "PONG%s", buf + 4);
+            WRITE(sockfd, pong, strlen(pong));
+            continue;
+        }
+
+        if (sscanf(buf, "ASSIGN %d %63s", &who, resume_token) >= 1) {
             my_id = who;
             log_msg("Assigned id %d", my_id);
             init_grids();
@@ -64,7 +117,7 @@ void *recv_thread(void *arg) {
                     int rr = r + (dir == 'V' || dir == 'v' ? i : 0);
                     int cc = c + (dir == 'H' || dir == 'h' ? i : 0);
                     if (rr >= 0 && rr < GRID_ROWS && cc >= 0 && cc < GRID_COLS)
-                        own_grid[rr][cc] = ship_val;
+                        set_own_cell(rr, cc, (char)ship_val);
                 }
                 api_callback_grid_update();
                 log_msg("Placement ok: %d,%d len %d %c", r + 1, c + 1, len, dir);
@@ -182,17 +235,18 @@ void *recv_thread(void *arg) {
                         
                         /* Clear only the connected ship cells */
                         for (int i = 0; i < ship_len; i++) {
-                            own_grid[cells_r[i]][cells_c[i]] = 0;
+                            set_own_cell(cells_r[i], cells_c[i], 0);
                         }
                         
-                        /* Place ship at new location - trust the server! */
+                        /* Place ship at new location - trust the server! A wrong
+                           guess shows up as a view hash mismatch at the next TURN */
                         if (dir == 'H' || dir == 'h') {
                             for (int i = 0; i < ship_len && to_c + i < GRID_COLS; i++) {
-                                own_grid[to_r][to_c + i] = ship_val;
+                                set_own_cell(to_r, to_c + i, (char)ship_val);
                             }
                         } else {
                             for (int i = 0; i < ship_len && to_r + i < GRID_ROWS; i++) {
-                                own_grid[to_r + i][to_c] = ship_val;
+                                set_own_cell(to_r + i, to_c, (char)ship_val);
                             }
                         }
                     }
@@ -239,19 +293,28 @@ void *recv_thread(void *arg) {
             continue;
         }
 
-        if (sscanf(buf, "TURN %d", &who) == 1) {
-            pending_turn_player = who;
-            api_callback_turn_change(who);
+        {
+            unsigned int hash;
+            int fields = sscanf(buf, "TURN %d %x", &who, &hash);
+            if (fields >= 1) {
+                pending_turn_player = who;
+                /* Our boards drifted from the server's: ask for the full state */
+                if (fields == 2 && hash != view_hash) {
+                    WRITE(sockfd, "STATE\n", 6);
+                }
+                api_callback_turn_change(who);
+                continue;
+            }
+        }
+
+        if (strncmp(buf, "STATE ", 6) == 0) {
+            apply_state(buf);
             continue;
         }
 
         if (sscanf(buf, "RESULT %d %d %d", &a, &b, &ok) == 3) {
             /* Target receives RESULT */
-            if (ok) {
-                own_grid[a][b] = 'H';
-            } else {
-                own_grid[a][b] = 'M';
-            }
+            set_own_cell(a, b, ok ? 'H' : 'M');
             api_callback_opponent_fire(a, b, ok);
             api_callback_grid_update();
             continue;
@@ -259,11 +322,7 @@ void *recv_thread(void *arg) {
 
         if (sscanf(buf, "FIRE_ACK %d %d %d", &a, &b, &ok) == 3) {
             /* Attacker receives ack about opponent */
-            if (ok) {
-                opp_grid[a][b] = 'H';
-            } else {
-                opp_grid[a][b] = 'M';
-            }
+            set_opp_cell(a, b, ok ? 'H' : 'M');
             api_callback_fire_result(a, b, ok);
             api_callback_grid_update();
             continue;
@@ -300,7 +359,7 @@ void *recv_thread(void *arg) {
         {
             int r, c, val;
             if (sscanf(buf, "REVEAL %d %d %d", &r, &c, &val) == 3) {
-                opp_grid[r][c] = (char)val;
+                set_opp_cell(r, c, (char)val);
                 api_callback_grid_update();
                 continue;
             }
@@ -346,12 +405,35 @@ void *recv_thread(void *arg) {
             continue;
         }
 
+        /* Seat kept across a dropped connection (ours or the opponent's) */
+        if (sscanf(buf, "RESUMED %d", &who) == 1) {
+            log_msg("Game resumed");
+            continue;
+        }
+
+        if (strncmp(buf, "RESUME_FAIL", 11) == 0) {
+            resume_token[0] = '\0';
+            log_msg("Could not resume the game - it has ended");
+            continue;
+        }
+
+        if (sscanf(buf, "OPPONENT_AWAY %d %d", &who, &a) == 2) {
+            log_msg("Opponent lost connection - waiting up to %d seconds for them", a);
+            continue;
+        }
+
+        if (sscanf(buf, "OPPONENT_BACK %d", &who) == 1) {
+            log_msg("Opponent reconnected");
+            continue;
+        }
+
         if (strncmp(buf, "GAME_OVER", 9) == 0) {
+            resume_token[0] = '\0';
             log_msg("Game over - server ended the session.");
             log_msg("Press Enter to exit.");
             server_disconnected = 1;
             CLOSE(sockfd);
-            return NULL;
+            return 1;
         }
 
         if (strncmp(buf, "NOT_YOUR_TURN", 13) == 0) {
@@ -364,6 +446,40 @@ void *recv_thread(void *arg) {
             continue;
         }
 
+        /* Turn clocks: TIMER <PLACE|TURN> <seat> <seconds>, TIMEOUT <seat> <count> */
+        {
+            char phase[8];
+            int secs;
+            if (sscanf(buf, "TIMER %7s %d %d", phase, &who, &secs) == 3) {
+                if (strcmp(phase, "PLACE") == 0) {
+                    log_msg("%d seconds left to place your ships", secs);
+                } else if (who == my_id) {
+                    log_msg("%d seconds left for your shot", secs);
+                }
+                continue;
+            }
+        }
+
+        if (sscanf(buf, "TIMEOUT %d %d", &who, &a) == 2) {
+            if (who == my_id) {
+                log_msg("Time ran out - the server moved for you (%d in a row)", a);
+            } else {
+                log_msg("Opponent ran out of time (%d in a row)", a);
+            }
+            continue;
+        }
+
+        if (sscanf(buf, "FORFEIT %d", &who) == 1) {
+            log_msg(who == my_id ? "You forfeited the game by running out of time"
+                                 : "Opponent forfeited the game by running out of time");
+            continue;
+        }
+
+        if (sscanf(buf, "CLOCK %d %d", &a, &b) == 2) {
+            log_msg("Time limits: %d s per turn, %d s to place ships (0 = none)", a, b);
+            continue;
+        }
+
         /* If message is of form "PLAYER <id> <rest>", show as client message */
         int pid;
         char rest[MAX_LINE];
@@ -374,6 +490,15 @@ void *recv_thread(void *arg) {
         }
     }
 
+    return 0;
+}
+
+void *recv_thread(void *arg) {
+    /* Dropped mid-game: reconnect and take the seat back */
+    do {
+        if (read_messages()) return NULL;
+    } while (client_running && resume_token[0] && client_resume() == 0);
+
     /* Server disconnected or recv error */
     if (client_running) {
         log_msg("Server disconnected");
@@ -0,0 +1,101 @@
+#include "client_replay.h"
+#include "client_state.h"
+#include "replay.h"
+#include <stdio.h>
+
+extern void api_callback_grid_update(void);
+extern void api_callback_turn_change(int player_id);
+extern void api_callback_fire_result(int row, int col, int hit);
+extern void api_callback_opponent_fire(int row, int col, int hit);
+extern void api_callback_ship_sunk(int player_id, int length);
+extern void api_callback_game_end(int winner_id);
+extern void api_callback_message(const char *msg);
+
+static Replay replay;
+static ReplayBoard board;       /* Position after `position` shots */
+static int position = 0;
+static int viewer = 0;
+
+int client_replay_open(const char *path, int index, int seat) {
+    if (replay_load(&replay, path, index) != 0) return -1;
+    viewer = seat & 1;
+    my_id = viewer;
+    init_grids();
+    client_replay_seek(0);
+    return 0;
+}
+
+int client_replay_length(void) {
+    return replay.game.nshots;
+}
+
+int client_replay_position(void) {
+    return position;
+}
+
+int client_replay_winner(void) {
+    return replay.game.winner;
+}
+
+int client_replay_forfeit(void) {
+    return replay.game.reason == ARCHIVE_END_FORFEIT;
+}
+
+static char shown(unsigned char cell) {
+    return cell ? (char)cell : '.';
+}
+
+static void game_over(void) {
+    if (client_replay_forfeit()) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Player %d forfeits", replay.game.winner ^ 1);
+        api_callback_message(msg);
+    }
+    api_callback_game_end(replay.game.winner);
+}
+
+void client_replay_seek(int move) {
+    replay_seek(&replay, move, &board);
+    position = move < 0 ? 0 : (move > replay.game.nshots ? replay.game.nshots : move);
+
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            set_own_cell(r, c, shown(board.cells[viewer][r][c]));
+            set_opp_cell(r, c, shown(board.cells[viewer ^ 1][r][c]));
+        }
+    }
+    api_callback_grid_update();
+    if (position == replay.game.nshots) {
+        game_over();
+    } else {
+        api_callback_turn_change(replay_turn(&replay, position));
+    }
+}
+
+int client_replay_step(void) {
+    if (position >= replay.game.nshots) return 0;
+
+    uint8_t shot = replay.game.shot[position];
+    int shooter = ARCHIVE_SHOT_SEAT(shot);
+    int r = ARCHIVE_SHOT_CELL(shot) / GRID_COLS, c = ARCHIVE_SHOT_CELL(shot) % GRID_COLS;
+    int sunk;
+    int hit = replay_apply(&replay, &board, position, &sunk);
+    position++;
+
+    if (shooter == viewer) {
+        set_opp_cell(r, c, hit ? 'H' : 'M');
+        api_callback_fire_result(r, c, hit);
+    } else {
+        set_own_cell(r, c, hit ? 'H' : 'M');
+        api_callback_opponent_fire(r, c, hit);
+    }
+    api_callback_grid_update();
+    if (sunk) api_callback_ship_sunk(shooter ^ 1, sunk);
+
+    if (position == replay.game.nshots) {
+        game_over();
+        return 0;
+    }
+    api_callback_turn_change(replay_turn(&replay, position));
+    return 1;
+}
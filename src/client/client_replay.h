@@ -0,0 +1,31 @@
+#ifndef CLIENT_REPLAY_H
+#define CLIENT_REPLAY_H
+
+/*
+ * client_replay.h - Play back a recorded game through the client callbacks
+ *
+ * The replay drives own_grid / opp_grid and the registered ClientCallbacks
+ * exactly like a live game seen from one seat, so the CLI and GUI show it
+ * with their usual rendering. Stepping plays one shot; seeking jumps to any
+ * shot through the replay's keyframes.
+ */
+
+/* Load path (a replay file, or game number index of an archive) and watch
+ * it from seat. Returns 0 on success */
+int client_replay_open(const char *path, int index, int seat);
+
+/* Shots in the game / shots played so far */
+int client_replay_length(void);
+int client_replay_position(void);
+
+/* Show the position after move shots (clamped to the game) */
+void client_replay_seek(int move);
+
+/* Play the next shot. Returns 0 once the game is over */
+int client_replay_step(void);
+
+/* Winner of the recorded game, and whether it ended in a forfeit */
+int client_replay_winner(void);
+int client_replay_forfeit(void);
+
+#endif /* CLIENT_REPLAY_H */
@@ -2,6 +2,7 @@
 #define CLIENT_STATE_H
 
 #include "common.h"
+#include <stdint.h>
 
 /*
  * client_state.h - Global client game state
@@ -30,12 +31,21 @@ extern const int allowed_init[6];
 extern int remaining[6];
 extern char player_names[2][64];
 
+/* Token from ASSIGN that lets a new connection take our seat back (empty = none) */
+extern char resume_token[64];
+
 /* Track each ship's length (indexed by cell value 1-5) */
 extern int ship_lengths[6];
 
 /* Track how many ships we've placed successfully */
 extern int placed_count;
 
+/* Rolling view hash of own_grid and opp_grid, compared with the one in TURN.
+ * Grid cells are written through the setters below so it stays current */
+extern uint32_t view_hash;
+void set_own_cell(int r, int c, char v);
+void set_opp_cell(int r, int c, char v);
+
 /* Initialize/Reset grids and game state */
 void init_grids(void);
 
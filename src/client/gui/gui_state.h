@@ -37,7 +37,8 @@ typedef enum {
     STATE_SHIP_PLACEMENT,
     STATE_WAITING_OPPONENT,
     STATE_PLAYING,
-    STATE_GAME_OVER
+    STATE_GAME_OVER,
+    STATE_REPLAY
 } GameFlowState;
 
 typedef struct {
@@ -104,6 +105,7 @@ extern int my_id;
 extern volatile int current_turn;
 extern volatile int server_disconnected;
 extern int placed_count;
+extern void set_opp_cell(int r, int c, char v);
 
 /* Helper Functions */
 void add_message(const char *fmt, ...);
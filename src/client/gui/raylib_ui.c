@@ -9,6 +9,7 @@
 #include "gui_state.h"
 #include "gui_draw.h"
 #include "gui_input.h"
+#include "client_replay.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -50,10 +51,10 @@ static void on_turn_change(int player_id) {
 
 static void on_fire_result(int row, int col, int hit) {
     if (hit) {
-        opp_grid[row][col] = 'H';
+        set_opp_cell(row, col, 'H');
         add_message("HIT at %c%d!", 'A' + col, row);
     } else {
-        opp_grid[row][col] = 'M';
+        set_opp_cell(row, col, 'M');
         add_message("Miss at %c%d", 'A' + col, row);
     }
 }
@@ -121,25 +122,26 @@ static void on_grid_update(void) {
     /* Grid is updated automatically */
 }
 
+static const ClientCallbacks gui_callbacks = {
+    .on_name_received = on_name_received,
+    .on_grid_update = on_grid_update,
+    .on_placement_start = on_placement_start,
+    .on_player_placed = on_player_placed,
+    .on_game_start = on_game_start,
+    .on_turn_change = on_turn_change,
+    .on_fire_result = on_fire_result,
+    .on_opponent_fire = on_opponent_fire,
+    .on_ship_sunk = on_ship_sunk,
+    .on_game_end = on_game_end,
+    .on_game_reset = on_game_reset,
+    .on_opponent_disconnected = on_opponent_disconnected,
+    .on_message = on_message
+};
+
 /* ==================== Main GUI Loop ==================== */
 
 int gui_main(const char *host, int port) {
-    ClientCallbacks callbacks = {
-        .on_name_received = on_name_received,
-        .on_grid_update = on_grid_update,
-        .on_placement_start = on_placement_start,
-        .on_player_placed = on_player_placed,
-        .on_game_start = on_game_start,
-        .on_turn_change = on_turn_change,
-        .on_fire_result = on_fire_result,
-        .on_opponent_fire = on_opponent_fire,
-        .on_ship_sunk = on_ship_sunk,
-        .on_game_end = on_game_end,
-        .on_game_reset = on_game_reset,
-        .on_opponent_disconnected = on_opponent_disconnected,
-        .on_message = on_message
-    };
-    
+    ClientCallbacks callbacks = gui_callbacks;
     client_set_callbacks(&callbacks);
     
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Battleship - raylib GUI");
@@ -285,6 +287,10 @@ int gui_main(const char *host, int port) {
                 DrawTextBold("Y for rematch | N to quit", 60, info_y + 50, 20, COLOR_TEXT);
                 break;
             }
+
+            case STATE_REPLAY:
+                /* gui_replay_main has its own loop */
+                break;
         }
         
         draw_messages();
@@ -296,3 +302,93 @@ int gui_main(const char *host, int port) {
     client_disconnect();
     return 0;
 }
+
+/* ==================== Replay Viewer ==================== */
+
+#define REPLAY_STEP_SECONDS 0.6f
+#define TIMELINE_X 60
+#define TIMELINE_Y 560
+#define TIMELINE_W 800
+#define TIMELINE_H 24
+
+static void on_replay_end(int winner_id) {
+    ui.winner_id = winner_id;
+    add_message("Player %d WINS", winner_id);
+}
+
+int gui_replay_main(const char *path, int index, int seat) {
+    ClientCallbacks callbacks = gui_callbacks;
+    callbacks.on_game_end = on_replay_end;
+    client_set_callbacks(&callbacks);
+
+    ui.my_id = seat;
+    if (client_replay_open(path, index, seat) != 0) {
+        fprintf(stderr, "Cannot load a replay from %s\n", path);
+        return 1;
+    }
+    ui.state = STATE_REPLAY;
+
+    InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Battleship - replay");
+    SetTargetFPS(FPS);
+
+    int playing = 0;
+    float until_step = REPLAY_STEP_SECONDS;
+    int right_grid_x = GRID_OFFSET_X + (GRID_COLS * (GRID_CELL_SIZE + GRID_SPACING)) + 100;
+
+    while (!WindowShouldClose()) {
+        int length = client_replay_length();
+
+        if (IsKeyPressed(KEY_SPACE)) playing = !playing;
+        if (IsKeyPressed(KEY_RIGHT) || IsKeyPressed(KEY_N)) client_replay_step();
+        if (IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_B)) client_replay_seek(client_replay_position() - 1);
+        if (IsKeyPressed(KEY_HOME)) client_replay_seek(0);
+        if (IsKeyPressed(KEY_END)) client_replay_seek(length);
+        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            /* Click on the timeline to jump there */
+            int mx = GetMouseX(), my = GetMouseY();
+            if (mx >= TIMELINE_X && mx <= TIMELINE_X + TIMELINE_W && my >= TIMELINE_Y && my <= TIMELINE_Y + TIMELINE_H) {
+                client_replay_seek((mx - TIMELINE_X) * length / TIMELINE_W);
+            }
+        }
+        if (playing) {
+            until_step -= GetFrameTime();
+            if (until_step <= 0) {
+                until_step = REPLAY_STEP_SECONDS;
+                if (!client_replay_step()) playing = 0;
+            }
+        }
+
+        for (int i = 0; i < msg_count; i++) {
+            messages[i].fade_time -= GetFrameTime();
+        }
+
+        BeginDrawing();
+        ClearBackground(COLOR_BG);
+
+        DrawTextBold("Battleship replay", 60, 20, 40, COLOR_TEXT);
+        draw_grid(GRID_OFFSET_X, GRID_OFFSET_Y, own_grid, 1);
+        draw_grid(right_grid_x, GRID_OFFSET_Y, opp_grid, 0);
+        DrawTextBold(TextFormat("Player %d", seat), GRID_OFFSET_X + 50, GRID_OFFSET_Y - 70, 24, COLOR_TEXT);
+        DrawTextBold(TextFormat("Player %d", seat ^ 1), right_grid_x + 50, GRID_OFFSET_Y - 70, 24, COLOR_TEXT);
+
+        int pos = client_replay_position();
+        DrawRectangle(TIMELINE_X, TIMELINE_Y, TIMELINE_W, TIMELINE_H, COLOR_EMPTY);
+        if (length > 0) DrawRectangle(TIMELINE_X, TIMELINE_Y, pos * TIMELINE_W / length, TIMELINE_H, COLOR_SHIP);
+        DrawRectangleLines(TIMELINE_X, TIMELINE_Y, TIMELINE_W, TIMELINE_H, COLOR_BORDER);
+        DrawTextBold(TextFormat("Shot %d / %d", pos, length), TIMELINE_X + TIMELINE_W + 20, TIMELINE_Y, 22, COLOR_TEXT);
+        if (pos == length) {
+            DrawTextBold(TextFormat("Player %d wins%s", client_replay_winner(), client_replay_forfeit() ? " by forfeit" : ""),
+                         60, TIMELINE_Y - 40, 26, (Color){0, 160, 0, 255});
+        } else {
+            DrawTextBold(TextFormat("Player %d to fire", current_turn), 60, TIMELINE_Y - 40, 26, COLOR_TEXT);
+        }
+        DrawTextBold("SPACE play/pause | LEFT/RIGHT step | HOME/END | click the bar to seek",
+                     60, TIMELINE_Y + 40, 18, (Color){80, 80, 80, 255});
+
+        draw_messages();
+        EndDrawing();
+    }
+
+    CloseWindow();
+    return 0;
+}
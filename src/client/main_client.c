@@ -3,9 +3,11 @@
 #include <string.h>
 
 int client_run(const char *host, int port);
+int replay_run(const char *path, int index, int seat);
 
 #ifdef BUILD_GUI
 int gui_main(const char *host, int port);
+int gui_replay_main(const char *path, int index, int seat);
 #endif
 
 int main(int argc, char **argv) {
@@ -13,11 +15,18 @@ int main(int argc, char **argv) {
     char host[256] = "127.0.0.1";
     int port = 12345;
     int args_provided = 0;
+    const char *replay = NULL;
+    int replay_game = 0, replay_seat = 0;
     
     /* Check for -cli flag and other args */
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-cli") == 0) {
             use_cli = 1;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            /* --replay FILE [GAME [SEAT]]: GAME picks a game of an archive file */
+            replay = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') replay_game = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') replay_seat = atoi(argv[++i]);
         } else if (!args_provided) {
             /* Assume first non-flag arg is host */
             strncpy(host, argv[i], sizeof(host)-1);
@@ -28,6 +37,13 @@ int main(int argc, char **argv) {
         }
     }
     
+    if (replay) {
+#ifdef BUILD_GUI
+        if (!use_cli) return gui_replay_main(replay, replay_game, replay_seat & 1);
+#endif
+        return replay_run(replay, replay_game, replay_seat & 1);
+    }
+
 #ifdef BUILD_GUI
     if (!use_cli) {
         /* Launch GUI mode */
@@ -6,6 +6,7 @@
 #include <errno.h>
 #else
 #include <errno.h>
+#include <sys/un.h>
 #endif
 
 ssize_t read_line(sock_t fd, char *buf, size_t maxlen) {
@@ -30,6 +31,15 @@ ssize_t read_line(sock_t fd, char *buf, size_t maxlen) {
     return ptr - buf;
 }
 
+int starts_with(const char *line, const char *word) {
+    for (; *word; line++, word++) {
+        char ch = *line;
+        if (ch >= 'a' && ch <= 'z') ch = ch - 'a' + 'A';
+        if (ch != *word) return 0;
+    }
+    return 1;
+}
+
 #ifdef _WIN32
 int sock_init(void) {
     WSADATA wsa;
@@ -64,3 +74,40 @@ void print_utf8(const char *str) {
     /* Fallback to printf on all platforms */
     printf("%s", str);
 }
+
+#ifndef _WIN32
+static int unix_addr(const char *path, struct sockaddr_un *addr) {
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+sock_t listen_unix(const char *path, int backlog) {
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) != 0) return SOCKET_INVALID;
+
+    sock_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == SOCKET_INVALID) return SOCKET_INVALID;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, backlog) < 0) {
+        CLOSE(fd);
+        return SOCKET_INVALID;
+    }
+    return fd;
+}
+
+sock_t connect_unix(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) != 0) return SOCKET_INVALID;
+
+    sock_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == SOCKET_INVALID) return SOCKET_INVALID;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        CLOSE(fd);
+        return SOCKET_INVALID;
+    }
+    return fd;
+}
+#endif
@@ -44,7 +44,19 @@ static inline void sock_cleanup(void) { }
 
 ssize_t read_line(sock_t fd, char *buf, size_t maxlen);
 
+/* Non-zero if line starts with word, ignoring the case of line (word is upper case) */
+int starts_with(const char *line, const char *word);
+
 /* Write UTF-8 string to console (handles Windows console API) */
 void print_utf8(const char *str);
 
+#ifndef _WIN32
+/* Listen on an AF_UNIX stream socket at path, replacing a stale socket file.
+ * Returns SOCKET_INVALID on error */
+sock_t listen_unix(const char *path, int backlog);
+
+/* Connect to the AF_UNIX stream socket at path. Returns SOCKET_INVALID on error */
+sock_t connect_unix(const char *path);
+#endif
+
 #endif /* COMMON_H */
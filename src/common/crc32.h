@@ -0,0 +1,16 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+/*
+ * crc32.h - CRC-32 (IEEE 802.3, the zlib one) for on-disk records
+ *
+ * Shared by the game archive, replays, the player store and snapshots.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC-32 of n bytes at data */
+uint32_t crc32_ieee(const void *data, size_t n);
+
+#endif /* CRC32_H */
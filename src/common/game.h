@@ -2,6 +2,7 @@
 #define GAME_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* Default board size: 7 rows x 9 columns (columns displayed as letters A..I) */
 #define GRID_ROWS 7
@@ -33,4 +34,26 @@ int place_ship(Grid *g, Ship s);         /* Returns 1 if placed, 0 if invalid */
 int fire_at(Grid *g, int r, int c);     /* Returns 1 if hit, 0 if miss, -1 if already fired */
 int grid_has_ships(Grid *g);            /* Returns 1 if any ships remain */
 
+/* View hash: XOR of one key per marked cell a seat can see - its own board
+ * (ships, hits, misses) and its shots at the opponent. Being a XOR, a client
+ * can keep it current one cell change at a time and compare it with the
+ * hash the server sends in TURN. */
+enum { VIEW_OWN = 0, VIEW_OPP = 1 };
+
+/* Key for cell value v (ship id, CELL_HIT, CELL_MISS; anything else is empty) */
+static inline uint32_t view_cell_key(int plane, int r, int c, int v) {
+    uint32_t x;
+    int mark;
+    if (v == CELL_HIT) mark = 1;
+    else if (v == CELL_MISS) mark = 2;
+    else if (plane == VIEW_OWN && v >= 1 && v <= 5) mark = 3;
+    else return 0;
+
+    x = (uint32_t)(((plane * GRID_ROWS + r) * GRID_COLS + c) * 4 + mark);
+    x *= 0x9E3779B1u; x ^= x >> 16;
+    x *= 0x85EBCA6Bu; x ^= x >> 13;
+    x *= 0xC2B2AE35u; x ^= x >> 16;
+    return x;
+}
+
 #endif /* GAME_H */
@@ -0,0 +1,345 @@
+#include "game_archive.h"
+#include "crc32.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENT_MAGIC "BGA1"
+#define HEADER_SIZE (4 + 4 + 4 + ARCHIVE_COLS * 8 + 4)
+
+/* ---- Little helpers ---- */
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int buf_reserve(ByteBuf *b, size_t more) {
+    if (b->len + more <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + more) cap *= 2;
+    uint8_t *d = realloc(b->data, cap);
+    if (!d) return -1;
+    b->data = d;
+    b->cap = cap;
+    return 0;
+}
+
+static int put_byte(ByteBuf *b, uint8_t v) {
+    if (buf_reserve(b, 1) != 0) return -1;
+    b->data[b->len++] = v;
+    return 0;
+}
+
+static int put_varint(ByteBuf *b, uint64_t v) {
+    if (buf_reserve(b, 10) != 0) return -1;
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        b->data[b->len++] = byte | (v ? 0x80 : 0);
+    } while (v);
+    return 0;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int get_varint(ArchiveSegment *s, int col, uint64_t *out) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (s->pos[col] >= s->len[col]) return -1;
+        uint8_t byte = s->col[col][s->pos[col]++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int get_byte(ArchiveSegment *s, int col, uint8_t *out) {
+    if (s->pos[col] >= s->len[col]) return -1;
+    *out = s->col[col][s->pos[col]++];
+    return 0;
+}
+
+/* ---- LZ77 block codec ----
+ * A sequence is a token (literal count << 4 | match length - 4, 15 meaning
+ * "more length bytes follow, 255 each until a smaller one"), the literals,
+ * then a 2-byte offset and any extra match length. The last sequence has
+ * literals only. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static size_t put_len(uint8_t *dst, size_t op, size_t cap, size_t len, int *ok) {
+    while (len >= 255) {
+        if (op >= cap) { *ok = 0; return op; }
+        dst[op++] = 255;
+        len -= 255;
+    }
+    if (op >= cap) { *ok = 0; return op; }
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+static size_t lz_sequence(uint8_t *dst, size_t op, size_t cap, const uint8_t *lit, size_t nlit,
+                          size_t offset, size_t mlen, int *ok) {
+    size_t mcode = mlen ? mlen - LZ_MIN_MATCH : 0;
+    if (op >= cap) { *ok = 0; return op; }
+    dst[op++] = (uint8_t)((nlit < 15 ? nlit : 15) << 4 | (mcode < 15 ? mcode : 15));
+    if (nlit >= 15) op = put_len(dst, op, cap, nlit - 15, ok);
+    if (!*ok || op + nlit > cap) { *ok = 0; return op; }
+    memcpy(dst + op, lit, nlit);
+    op += nlit;
+    if (!mlen) return op;
+    if (op + 2 > cap) { *ok = 0; return op; }
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    if (mcode >= 15) op = put_len(dst, op, cap, mcode - 15, ok);
+    return op;
+}
+
+/* Compressed size, or 0 if the data does not shrink below cap */
+static size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0};   /* Position + 1 of the last 4-byte sequence */
+    size_t ip = 0, anchor = 0, op = 0;
+    int ok = 1;
+
+    while (ip + LZ_MIN_MATCH <= n && ok) {
+        uint32_t seq;
+        memcpy(&seq, src + ip, 4);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t ref = table[h];
+        table[h] = (uint32_t)ip + 1;
+        if (ref && ip - (ref - 1) <= 0xFFFF && memcmp(src + ref - 1, src + ip, 4) == 0) {
+            ref--;
+            size_t mlen = LZ_MIN_MATCH;
+            while (ip + mlen < n && src[ref + mlen] == src[ip + mlen]) mlen++;
+            op = lz_sequence(dst, op, cap, src + anchor, ip - anchor, ip - ref, mlen, &ok);
+            ip += mlen;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+    if (ok) op = lz_sequence(dst, op, cap, src + anchor, n - anchor, 0, 0, &ok);
+    return ok && op < n ? op : 0;
+}
+
+static int get_len(const uint8_t *src, size_t n, size_t *ip, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= n) return -1;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+static int lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_len) {
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t nlit = token >> 4;
+        if (nlit == 15 && get_len(src, n, &ip, &nlit) != 0) return -1;
+        if (ip + nlit > n || op + nlit > raw_len) return -1;
+        memcpy(dst + op, src + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == n) break;
+
+        if (ip + 2 > n) return -1;
+        size_t offset = (size_t)src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && get_len(src, n, &ip, &mlen) != 0) return -1;
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || op + mlen > raw_len) return -1;
+        /* Byte by byte: the match may overlap what it is copying */
+        for (size_t i = 0; i < mlen; i++, op++) dst[op] = dst[op - offset];
+    }
+    return op == raw_len ? 0 : -1;
+}
+
+/* ---- Writing ---- */
+
+int archive_builder_add(ArchiveBuilder *b, const ArchiveGame *g) {
+    size_t mark[ARCHIVE_COLS];
+    int err = 0;
+
+    for (int i = 0; i < ARCHIVE_COLS; i++) mark[i] = b->col[i].len;
+    err |= put_varint(&b->col[COL_START], zigzag((int64_t)(g->start_ms - b->last_start)));
+    err |= put_varint(&b->col[COL_DURATION], g->duration_ms);
+    err |= put_byte(&b->col[COL_RESULT], (uint8_t)(g->winner | g->reason << 1));
+    err |= put_varint(&b->col[COL_NSHOTS], (uint64_t)g->nshots);
+    for (int seat = 0; seat < 2; seat++) {
+        for (int i = 0; i < ARCHIVE_SHIPS; i++) {
+            const Ship *s = &g->ships[seat][i];
+            err |= put_byte(&b->col[COL_SHIPS], (uint8_t)((s->r * GRID_COLS + s->c) | (s->dir == 'V') << 6));
+            err |= put_byte(&b->col[COL_SHIPS], (uint8_t)s->len);
+        }
+    }
+    if (!err && buf_reserve(&b->col[COL_SHOT], (size_t)g->nshots) == 0) {
+        memcpy(b->col[COL_SHOT].data + b->col[COL_SHOT].len, g->shot, (size_t)g->nshots);
+        b->col[COL_SHOT].len += (size_t)g->nshots;
+    } else {
+        err = -1;
+    }
+    for (int i = 0; i < g->nshots && !err; i++) err |= put_varint(&b->col[COL_SHOT_DT], g->shot_dt[i]);
+    if (err) {
+        /* Leave no half-written game behind */
+        for (int i = 0; i < ARCHIVE_COLS; i++) b->col[i].len = mark[i];
+        return -1;
+    }
+
+    b->last_start = g->start_ms;
+    b->games++;
+    b->shots += (uint32_t)g->nshots;
+    return 0;
+}
+
+uint8_t *archive_builder_encode(ArchiveBuilder *b, size_t *size) {
+    if (!b->games) return NULL;
+    size_t total = HEADER_SIZE;
+    for (int i = 0; i < ARCHIVE_COLS; i++) total += b->col[i].len;
+
+    uint8_t *out = malloc(total);
+    if (!out) return NULL;
+    memcpy(out, SEGMENT_MAGIC, 4);
+    put32(out + 4, b->games);
+    put32(out + 8, b->shots);
+
+    size_t op = HEADER_SIZE;
+    for (int i = 0; i < ARCHIVE_COLS; i++) {
+        ByteBuf *c = &b->col[i];
+        size_t stored = c->len ? lz_compress(c->data, c->len, out + op, c->len) : 0;
+        if (!stored) {
+            memcpy(out + op, c->data, c->len);
+            stored = c->len;
+        }
+        put32(out + 12 + i * 8, (uint32_t)c->len);
+        put32(out + 16 + i * 8, (uint32_t)stored);
+        op += stored;
+        c->len = 0;
+    }
+    put32(out + HEADER_SIZE - 4, crc32_ieee(out + HEADER_SIZE, op - HEADER_SIZE));
+
+    b->games = b->shots = 0;
+    b->last_start = 0;
+    *size = op;
+    return out;
+}
+
+void archive_builder_free(ArchiveBuilder *b) {
+    for (int i = 0; i < ARCHIVE_COLS; i++) free(b->col[i].data);
+    memset(b, 0, sizeof(*b));
+}
+
+/* ---- Reading ---- */
+
+size_t archive_segment_size(const uint8_t *p, size_t avail) {
+    if (avail < HEADER_SIZE || memcmp(p, SEGMENT_MAGIC, 4) != 0) return 0;
+    size_t total = HEADER_SIZE;
+    for (int i = 0; i < ARCHIVE_COLS; i++) {
+        uint32_t raw = get32(p + 12 + i * 8), stored = get32(p + 16 + i * 8);
+        if (stored > raw) return 0;
+        total += stored;
+    }
+    return total <= avail ? total : 0;
+}
+
+size_t archive_valid_length(const uint8_t *data, size_t size) {
+    size_t off = 0;
+    for (;;) {
+        size_t n = archive_segment_size(data + off, size - off);
+        if (!n || crc32_ieee(data + off + HEADER_SIZE, n - HEADER_SIZE) != get32(data + off + HEADER_SIZE - 4)) {
+            return off;
+        }
+        off += n;
+    }
+}
+
+int archive_segment_open(ArchiveSegment *s, const uint8_t *p, size_t size) {
+    memset(s, 0, sizeof(*s));
+    if (size < HEADER_SIZE || crc32_ieee(p + HEADER_SIZE, size - HEADER_SIZE) != get32(p + HEADER_SIZE - 4)) {
+        return -1;
+    }
+    s->games = get32(p + 4);
+    s->shots = get32(p + 8);
+
+    const uint8_t *data = p + HEADER_SIZE;
+    for (int i = 0; i < ARCHIVE_COLS; i++) {
+        size_t raw = get32(p + 12 + i * 8), stored = get32(p + 16 + i * 8);
+        s->col[i] = malloc(raw + 1);
+        s->len[i] = raw;
+        if (!s->col[i]) {
+            archive_segment_close(s);
+            return -1;
+        }
+        if (stored == raw) {
+            memcpy(s->col[i], data, raw);
+        } else if (lz_decompress(data, stored, s->col[i], raw) != 0) {
+            archive_segment_close(s);
+            return -1;
+        }
+        data += stored;
+    }
+    return 0;
+}
+
+int archive_segment_next(ArchiveSegment *s, ArchiveGame *g) {
+    if (s->next >= s->games) return 0;
+    uint64_t v;
+    uint8_t byte, len;
+
+    if (get_varint(s, COL_START, &v) != 0) return -1;
+    g->start_ms = s->last_start + (uint64_t)unzigzag(v);
+    s->last_start = g->start_ms;
+    if (get_varint(s, COL_DURATION, &v) != 0) return -1;
+    g->duration_ms = (uint32_t)v;
+    if (get_byte(s, COL_RESULT, &byte) != 0) return -1;
+    g->winner = byte & 1;
+    g->reason = byte >> 1;
+    if (get_varint(s, COL_NSHOTS, &v) != 0 || v > ARCHIVE_MAX_SHOTS) return -1;
+    g->nshots = (int)v;
+
+    for (int seat = 0; seat < 2; seat++) {
+        for (int i = 0; i < ARCHIVE_SHIPS; i++) {
+            if (get_byte(s, COL_SHIPS, &byte) != 0 || get_byte(s, COL_SHIPS, &len) != 0) return -1;
+            Ship *sh = &g->ships[seat][i];
+            int cell = byte & 0x3F;
+            sh->r = cell / GRID_COLS;
+            sh->c = cell % GRID_COLS;
+            sh->dir = (byte & 0x40) ? 'V' : 'H';
+            sh->len = len;
+            sh->id = i + 1;
+        }
+    }
+
+    if (s->pos[COL_SHOT] + (size_t)g->nshots > s->len[COL_SHOT]) return -1;
+    memcpy(g->shot, s->col[COL_SHOT] + s->pos[COL_SHOT], (size_t)g->nshots);
+    s->pos[COL_SHOT] += (size_t)g->nshots;
+    for (int i = 0; i < g->nshots; i++) {
+        if (get_varint(s, COL_SHOT_DT, &v) != 0) return -1;
+        g->shot_dt[i] = (uint32_t)v;
+    }
+    s->next++;
+    return 1;
+}
+
+void archive_segment_close(ArchiveSegment *s) {
+    for (int i = 0; i < ARCHIVE_COLS; i++) free(s->col[i]);
+    memset(s, 0, sizeof(*s));
+}
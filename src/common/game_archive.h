@@ -0,0 +1,97 @@
+#ifndef GAME_ARCHIVE_H
+#define GAME_ARCHIVE_H
+
+/*
+ * game_archive.h - Columnar archive of finished games
+ *
+ * An archive file is a sequence of self-contained segments, each holding
+ * up to a few thousand games stored column by column: start times (delta
+ * from the previous game), durations, results, shot counts, ship layouts,
+ * shots and the time between shots. Integers are zigzag/varint encoded and
+ * every column is compressed on its own with a small LZ77 block codec, so
+ * a reader only decodes what it needs and segments can be processed in
+ * parallel. Each segment carries a CRC-32; a torn segment at the end of a
+ * file is ignored by readers and cut off when the server reopens it.
+ *
+ * Segment layout (little endian):
+ *   "BGA1", u32 games, u32 shots, ARCHIVE_COLS x {u32 raw_len, u32 stored_len},
+ *   u32 crc of the column data, column data (stored_len == raw_len: not compressed)
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+#define ARCHIVE_MAX_SHOTS (2 * GRID_ROWS * GRID_COLS)
+#define ARCHIVE_SHIPS 5                 /* Ships per player */
+
+enum { ARCHIVE_END_SUNK = 0, ARCHIVE_END_FORFEIT = 1 };
+
+typedef struct ArchiveGame {
+    uint64_t start_ms;                  /* Wall clock when firing started, ms since the epoch */
+    uint32_t duration_ms;               /* Start to the deciding shot or forfeit */
+    uint8_t winner;
+    uint8_t reason;                     /* ARCHIVE_END_* */
+    Ship ships[2][ARCHIVE_SHIPS];       /* r, c, len, dir */
+    int nshots;
+    uint8_t shot[ARCHIVE_MAX_SHOTS];    /* ARCHIVE_SHOT(seat, r, c, hit) */
+    uint32_t shot_dt[ARCHIVE_MAX_SHOTS];/* ms since the previous shot (or the start) */
+} ArchiveGame;
+
+#define ARCHIVE_SHOT(seat, r, c, hit) \
+    ((uint8_t)(((r) * GRID_COLS + (c)) | ((seat) << 6) | ((hit) << 7)))
+#define ARCHIVE_SHOT_CELL(s) ((s) & 0x3F)
+#define ARCHIVE_SHOT_SEAT(s) (((s) >> 6) & 1)
+#define ARCHIVE_SHOT_HIT(s) (((s) >> 7) & 1)
+
+enum { COL_START, COL_DURATION, COL_RESULT, COL_NSHOTS, COL_SHIPS, COL_SHOT, COL_SHOT_DT, ARCHIVE_COLS };
+
+typedef struct ByteBuf {
+    uint8_t *data;
+    size_t len, cap;
+} ByteBuf;
+
+/* Games collected column by column until they are encoded as a segment */
+typedef struct ArchiveBuilder {
+    ByteBuf col[ARCHIVE_COLS];
+    uint32_t games, shots;
+    uint64_t last_start;
+} ArchiveBuilder;
+
+/* A decoded segment and a cursor over its games */
+typedef struct ArchiveSegment {
+    uint32_t games, shots;
+    uint8_t *col[ARCHIVE_COLS];
+    size_t len[ARCHIVE_COLS];
+    size_t pos[ARCHIVE_COLS];
+    uint32_t next;                      /* Next game to read */
+    uint64_t last_start;
+} ArchiveSegment;
+
+/* Append a game to the builder. Returns 0, -1 if out of memory */
+int archive_builder_add(ArchiveBuilder *b, const ArchiveGame *g);
+
+/* Encode the collected games as one segment (malloc'd, *size bytes) and
+ * empty the builder. NULL if it holds no games or memory runs out */
+uint8_t *archive_builder_encode(ArchiveBuilder *b, size_t *size);
+
+/* Free the builder's buffers */
+void archive_builder_free(ArchiveBuilder *b);
+
+/* Size of the segment starting at p, 0 if p (with avail bytes) does not
+ * start with a complete segment */
+size_t archive_segment_size(const uint8_t *p, size_t avail);
+
+/* Bytes of data made of complete, intact segments */
+size_t archive_valid_length(const uint8_t *data, size_t size);
+
+/* Decode the segment at p (size from archive_segment_size). Returns 0 on success */
+int archive_segment_open(ArchiveSegment *s, const uint8_t *p, size_t size);
+
+/* Read the next game. Returns 1, 0 at the end, -1 if the data is corrupt */
+int archive_segment_next(ArchiveSegment *s, ArchiveGame *g);
+
+/* Free a decoded segment */
+void archive_segment_close(ArchiveSegment *s);
+
+#endif /* GAME_ARCHIVE_H */
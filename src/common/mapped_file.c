@@ -0,0 +1,100 @@
+#include "mapped_file.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+int mapped_file_open(MappedFile *mf, const char *path) {
+    memset(mf, 0, sizeof(*mf));
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return -1;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        CloseHandle(f);
+        return -1;
+    }
+    HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m) {
+        CloseHandle(f);
+        return -1;
+    }
+    const void *data = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return -1;
+    }
+    mf->data = data;
+    mf->size = (size_t)size.QuadPart;
+    mf->file_handle = f;
+    mf->map_handle = m;
+    return 0;
+}
+
+void mapped_file_close(MappedFile *mf) {
+    if (mf->data) UnmapViewOfFile(mf->data);
+    if (mf->map_handle) CloseHandle(mf->map_handle);
+    if (mf->file_handle) CloseHandle(mf->file_handle);
+    memset(mf, 0, sizeof(*mf));
+}
+#else
+int mapped_file_open(MappedFile *mf, const char *path) {
+    memset(mf, 0, sizeof(*mf));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping keeps the file referenced */
+    if (data == MAP_FAILED) return -1;
+
+    mf->data = data;
+    mf->size = (size_t)st.st_size;
+    return 0;
+}
+
+void mapped_file_close(MappedFile *mf) {
+    if (mf->data) munmap((void *)mf->data, mf->size);
+    memset(mf, 0, sizeof(*mf));
+}
+#endif
+
+int file_replace_atomic(const char *path, const void *data, size_t size) {
+    char tmp[512];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(data, 1, size, f) == size && fflush(f) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    fclose(f);
+    if (!ok) {
+        remove(tmp);
+        return -1;
+    }
+
+#ifdef _WIN32
+    if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) return -1;
+#else
+    if (rename(tmp, path) != 0) return -1;
+#endif
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+/* Read-only memory mapping of a whole file */
+typedef struct MappedFile {
+    const void *data;
+    size_t size;
+#ifdef _WIN32
+    void *file_handle;
+    void *map_handle;
+#endif
+} MappedFile;
+
+/* Map path read-only. Returns 0 on success, -1 if the file is missing, empty or cannot be mapped */
+int mapped_file_open(MappedFile *mf, const char *path);
+
+/* Unmap and release the file */
+void mapped_file_close(MappedFile *mf);
+
+/* Write data to path.tmp, flush it to disk and rename it over path,
+ * so readers only ever see the old or the new file. Returns 0 on success */
+int file_replace_atomic(const char *path, const void *data, size_t size);
+
+#endif /* MAPPED_FILE_H */
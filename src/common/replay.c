@@ -0,0 +1,180 @@
+#include "replay.h"
+#include "mapped_file.h"
+#include "crc32.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC "BRP1"
+#define REPLAY_HEADER_SIZE 12
+
+static void put16(uint8_t *p, unsigned v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+}
+
+static unsigned get16(const uint8_t *p) {
+    return (unsigned)p[0] | (unsigned)p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+int replay_apply(const Replay *rp, ReplayBoard *b, int move, int *sunk) {
+    uint8_t shot = rp->game.shot[move];
+    int target = ARCHIVE_SHOT_SEAT(shot) ^ 1;
+    int cell = ARCHIVE_SHOT_CELL(shot);
+    unsigned char *at = &b->cells[target][cell / GRID_COLS][cell % GRID_COLS];
+
+    *sunk = 0;
+    if (*at >= 1 && *at <= ARCHIVE_SHIPS) {
+        if (--b->left[target][*at] == 0) *sunk = rp->game.ships[target][*at - 1].len;
+        *at = 'H';
+        return 1;
+    }
+    if (*at == 0) *at = 'M';
+    return *at == 'H';
+}
+
+int replay_from_game(Replay *rp, const ArchiveGame *g) {
+    ReplayBoard b;
+    int sunk;
+
+    memset(&b, 0, sizeof(b));
+    rp->game = *g;
+    for (int seat = 0; seat < 2; seat++) {
+        for (int i = 0; i < ARCHIVE_SHIPS; i++) {
+            const Ship *s = &g->ships[seat][i];
+            for (int k = 0; k < s->len; k++) {
+                int r = s->r + (s->dir == 'V' ? k : 0);
+                int c = s->c + (s->dir == 'V' ? 0 : k);
+                if (r >= GRID_ROWS || c >= GRID_COLS || b.cells[seat][r][c]) return -1;
+                b.cells[seat][r][c] = (unsigned char)(i + 1);
+            }
+            b.left[seat][i + 1] = (unsigned char)s->len;
+        }
+    }
+
+    rp->keys[0] = b;
+    for (int m = 0; m < g->nshots; m++) {
+        if (ARCHIVE_SHOT_CELL(g->shot[m]) >= GRID_ROWS * GRID_COLS) return -1;
+        if (replay_apply(rp, &b, m, &sunk) != ARCHIVE_SHOT_HIT(g->shot[m])) return -1;
+        if ((m + 1) % REPLAY_KEYFRAME_EVERY == 0) rp->keys[(m + 1) / REPLAY_KEYFRAME_EVERY] = b;
+    }
+    rp->nkeys = g->nshots / REPLAY_KEYFRAME_EVERY + 1;
+    return 0;
+}
+
+void replay_seek(const Replay *rp, int move, ReplayBoard *out) {
+    int sunk;
+    if (move < 0) move = 0;
+    if (move > rp->game.nshots) move = rp->game.nshots;
+
+    int k = move / REPLAY_KEYFRAME_EVERY;
+    *out = rp->keys[k];
+    for (int m = k * REPLAY_KEYFRAME_EVERY; m < move; m++) replay_apply(rp, out, m, &sunk);
+}
+
+int replay_turn(const Replay *rp, int move) {
+    if (move >= 0 && move < rp->game.nshots) return ARCHIVE_SHOT_SEAT(rp->game.shot[move]);
+    return rp->game.winner;
+}
+
+/* Load game number index of the archive in data */
+static int load_from_archive(Replay *rp, const uint8_t *data, size_t size, int index) {
+    ArchiveSegment seg;
+    size_t off = 0, n;
+
+    while (index >= 0 && (n = archive_segment_size(data + off, size - off)) != 0) {
+        if (archive_segment_open(&seg, data + off, n) != 0) return -1;
+        if ((uint32_t)index < seg.games) {
+            int rc = 0;
+            for (int i = 0; i <= index && rc == 0; i++) {
+                if (archive_segment_next(&seg, &rp->game) != 1) rc = -1;
+            }
+            archive_segment_close(&seg);
+            return rc == 0 ? replay_from_game(rp, &rp->game) : -1;
+        }
+        index -= (int)seg.games;
+        archive_segment_close(&seg);
+        off += n;
+    }
+    return -1;
+}
+
+static int load_replay_file(Replay *rp, const uint8_t *data, size_t size) {
+    ArchiveSegment seg;
+    ArchiveGame *g = &rp->game;
+
+    if (size < REPLAY_HEADER_SIZE || crc32_ieee(data + 8, size - 8) != get32(data + 4)) return -1;
+    unsigned every = get16(data + 8), nkeys = get16(data + 10);
+    size_t keys_size = (size_t)nkeys * sizeof(ReplayBoard);
+    if (nkeys > REPLAY_MAX_KEYFRAMES || REPLAY_HEADER_SIZE + keys_size > size) return -1;
+
+    const uint8_t *p = data + REPLAY_HEADER_SIZE + keys_size;
+    size_t n = archive_segment_size(p, size - REPLAY_HEADER_SIZE - keys_size);
+    if (!n || archive_segment_open(&seg, p, n) != 0) return -1;
+    int rc = archive_segment_next(&seg, g);
+    archive_segment_close(&seg);
+    if (rc != 1) return -1;
+
+    /* Keyframes written with another interval are rebuilt */
+    if (every != REPLAY_KEYFRAME_EVERY || nkeys != (unsigned)(g->nshots / REPLAY_KEYFRAME_EVERY + 1)) {
+        return replay_from_game(rp, g);
+    }
+    memcpy(rp->keys, data + REPLAY_HEADER_SIZE, keys_size);
+    rp->nkeys = (int)nkeys;
+    return 0;
+}
+
+int replay_load(Replay *rp, const char *path, int index) {
+    MappedFile mf;
+    int rc = -1;
+
+    if (mapped_file_open(&mf, path) != 0) return -1;
+    const uint8_t *data = mf.data;
+    if (mf.size >= 4 && memcmp(data, REPLAY_MAGIC, 4) == 0) {
+        rc = load_replay_file(rp, data, mf.size);
+    } else {
+        rc = load_from_archive(rp, data, mf.size, index);
+    }
+    mapped_file_close(&mf);
+    return rc;
+}
+
+int replay_save(const Replay *rp, const char *path) {
+    ArchiveBuilder b = {0};
+    size_t seg_size;
+
+    if (archive_builder_add(&b, &rp->game) != 0) {
+        archive_builder_free(&b);
+        return -1;
+    }
+    uint8_t *seg = archive_builder_encode(&b, &seg_size);
+    archive_builder_free(&b);
+    if (!seg) return -1;
+
+    size_t keys_size = (size_t)rp->nkeys * sizeof(ReplayBoard);
+    size_t size = REPLAY_HEADER_SIZE + keys_size + seg_size;
+    uint8_t *out = malloc(size);
+    if (!out) {
+        free(seg);
+        return -1;
+    }
+    memcpy(out, REPLAY_MAGIC, 4);
+    put16(out + 8, REPLAY_KEYFRAME_EVERY);
+    put16(out + 10, (unsigned)rp->nkeys);
+    memcpy(out + REPLAY_HEADER_SIZE, rp->keys, keys_size);
+    memcpy(out + REPLAY_HEADER_SIZE + keys_size, seg, seg_size);
+    put32(out + 4, crc32_ieee(out + 8, size - 8));
+
+    int rc = file_replace_atomic(path, out, size);
+    free(seg);
+    free(out);
+    return rc;
+}
@@ -0,0 +1,55 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * replay.h - Recorded games with keyframes for seeking
+ *
+ * A replay is one archived game (see game_archive.h) plus a keyframe of
+ * both boards every REPLAY_KEYFRAME_EVERY shots, so the position after any
+ * shot is a keyframe copy and at most REPLAY_KEYFRAME_EVERY - 1 shots
+ * applied on top, however long the game.
+ *
+ * Replay file layout (little endian):
+ *   "BRP1", u32 crc of the rest, u16 keyframe interval, u16 keyframes,
+ *   keyframes x {2 x GRID_ROWS x GRID_COLS cells, 2 x 6 cells left per ship},
+ *   one archive segment holding the game
+ * replay_load also accepts an archive file and takes the game at an index.
+ */
+
+#include "game_archive.h"
+
+#define REPLAY_KEYFRAME_EVERY 16
+#define REPLAY_MAX_KEYFRAMES (ARCHIVE_MAX_SHOTS / REPLAY_KEYFRAME_EVERY + 1)
+
+/* Both boards after some number of shots */
+typedef struct ReplayBoard {
+    unsigned char cells[2][GRID_ROWS][GRID_COLS];  /* Seat's own board: 0 water, 1-5 ship id, 'H', 'M' */
+    unsigned char left[2][6];                       /* Unhit cells per ship id */
+} ReplayBoard;
+
+typedef struct Replay {
+    ArchiveGame game;
+    int nkeys;
+    ReplayBoard keys[REPLAY_MAX_KEYFRAMES];         /* keys[k]: after k * REPLAY_KEYFRAME_EVERY shots */
+} Replay;
+
+/* Build a replay (and its keyframes) from an archived game. Returns 0, -1 if the game is inconsistent */
+int replay_from_game(Replay *rp, const ArchiveGame *g);
+
+/* Load a replay file, or game number index (from 0) of an archive file. Returns 0 on success */
+int replay_load(Replay *rp, const char *path, int index);
+
+/* Write rp as a replay file. Returns 0 on success */
+int replay_save(const Replay *rp, const char *path);
+
+/* Boards after the first move shots (0..nshots) */
+void replay_seek(const Replay *rp, int move, ReplayBoard *out);
+
+/* Apply shot number move to b. Returns 1 for a hit, 0 for a miss; *sunk is
+ * set to the length of the ship it sank, or 0 */
+int replay_apply(const Replay *rp, ReplayBoard *b, int move, int *sunk);
+
+/* Seat to fire after the first move shots (the winner once the game is over) */
+int replay_turn(const Replay *rp, int move);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,234 @@
+#include "shot_solver.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PLACEMENTS (2 * SOLVER_CELLS)
+#define EXACT_FLEETS 1e7                /* Enumerate when about this few fleets fit */
+#define EXACT_WORK 60000000             /* Give up on exact search after trying this many placements */
+#define MC_SAMPLES 20000                /* Consistent fleets a Monte Carlo run aims for */
+#define MC_PILOT 100000                 /* Attempts spent estimating the number of fleets */
+#define MC_ATTEMPTS 4000000
+
+typedef struct Placement {
+    uint64_t mask;
+    int len;
+    uint8_t cells[5];
+} Placement;
+
+typedef struct Candidate {
+    const Placement *p;
+    int claim;                          /* 1 if this is the ship a SHIP_SUNK report was about */
+} Candidate;
+
+typedef struct Search {
+    const Knowledge *k;
+    Candidate cand[SOLVER_SHIPS][MAX_PLACEMENTS];
+    int ncand[SOLVER_SHIPS];
+    int order[SOLVER_SHIPS];            /* Ship to place at each search level */
+    int len_after[SOLVER_SHIPS + 1];    /* Cells in the ships of this level and later */
+    uint64_t count[SOLVER_CELLS];
+    uint64_t work;
+    int aborted;
+} Search;
+
+static const int fleet[SOLVER_SHIPS] = {5, 4, 3, 3, 2};
+static Placement placements[6][MAX_PLACEMENTS];     /* By length */
+static int nplacements[6];
+
+void solver_init(void) {
+    for (int len = 2; len <= 5; len++) {
+        nplacements[len] = 0;
+        for (int vertical = 0; vertical < 2; vertical++) {
+            for (int r = 0; r + (vertical ? len : 1) <= GRID_ROWS; r++) {
+                for (int c = 0; c + (vertical ? 1 : len) <= GRID_COLS; c++) {
+                    Placement *p = &placements[len][nplacements[len]++];
+                    p->mask = 0;
+                    p->len = len;
+                    for (int k = 0; k < len; k++) {
+                        int cell = (r + (vertical ? k : 0)) * GRID_COLS + c + (vertical ? 0 : k);
+                        p->cells[k] = (uint8_t)cell;
+                        p->mask |= 1ull << cell;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void solver_observe(Knowledge *k, int cell, int hit, int sunk_len) {
+    uint64_t bit = 1ull << cell;
+    if (!hit) {
+        k->miss |= bit;
+        return;
+    }
+    k->hit |= bit;
+    if (sunk_len && k->nsunk < SOLVER_SHIPS) {
+        k->sunk[k->nsunk].cell = cell;
+        k->sunk[k->nsunk].len = sunk_len;
+        k->sunk[k->nsunk].hit_before = k->hit;
+        k->nsunk++;
+    }
+}
+
+static int popcount64(uint64_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+}
+
+static uint64_t next_random(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/* Placements of each ship that fit what k says about single ships, most
+ * constrained ship first. Returns the number of ship combinations */
+static double build_candidates(Search *s) {
+    const Knowledge *k = s->k;
+    uint64_t sunk_cells = 0;
+    double combinations = 1;
+
+    for (int i = 0; i < k->nsunk; i++) sunk_cells |= 1ull << k->sunk[i].cell;
+    for (int i = 0; i < SOLVER_SHIPS; i++) {
+        int len = fleet[i], n = 0;
+        for (int j = 0; j < nplacements[len]; j++) {
+            const Placement *p = &placements[len][j];
+            int claim = 0;
+            if (p->mask & k->miss) continue;
+            if (p->mask & sunk_cells) {
+                /* Only the ship that sank there may cover a sinking shot */
+                for (int e = 0; e < k->nsunk; e++) {
+                    if (!(p->mask & (1ull << k->sunk[e].cell))) continue;
+                    if (claim || k->sunk[e].len != len || (p->mask & ~k->sunk[e].hit_before)) claim = -1;
+                    else claim = 1;
+                }
+                if (claim != 1) continue;
+            } else if (!(p->mask & ~k->hit)) {
+                continue;               /* Fully hit but never reported sunk */
+            }
+            s->cand[i][n].p = p;
+            s->cand[i][n].claim = claim;
+            n++;
+        }
+        s->ncand[i] = n;
+        combinations *= n;
+        s->order[i] = i;
+    }
+
+    /* Place the ship with the fewest candidates first (insertion sort on five entries) */
+    for (int i = 1; i < SOLVER_SHIPS; i++) {
+        for (int j = i; j > 0 && s->ncand[s->order[j]] < s->ncand[s->order[j - 1]]; j--) {
+            int t = s->order[j];
+            s->order[j] = s->order[j - 1];
+            s->order[j - 1] = t;
+        }
+    }
+    s->len_after[SOLVER_SHIPS] = 0;
+    for (int i = SOLVER_SHIPS - 1; i >= 0; i--) s->len_after[i] = s->len_after[i + 1] + fleet[s->order[i]];
+    return combinations;
+}
+
+/* Fleets completing the ships placed so far; adds each ship's share to count */
+static uint64_t search(Search *s, int level, uint64_t occ, int claims) {
+    const Knowledge *k = s->k;
+    if (popcount64(k->hit & ~occ) > s->len_after[level]) return 0;
+    if (claims + SOLVER_SHIPS - level < k->nsunk) return 0;
+
+    int ship = s->order[level];
+    uint64_t total = 0;
+    s->work += (uint64_t)s->ncand[ship];
+    if (s->work > EXACT_WORK) {
+        s->aborted = 1;
+        return 0;
+    }
+    if (level == SOLVER_SHIPS - 1) {
+        /* Last ship: it must cover every hit left and make up the claims */
+        uint64_t left = k->hit & ~occ;
+        for (int i = 0; i < s->ncand[ship]; i++) {
+            const Candidate *c = &s->cand[ship][i];
+            if ((c->p->mask & occ) || (left & ~c->p->mask) || claims + c->claim != k->nsunk) continue;
+            total++;
+            for (int j = 0; j < c->p->len; j++) s->count[c->p->cells[j]]++;
+        }
+        return total;
+    }
+    for (int i = 0; i < s->ncand[ship] && !s->aborted; i++) {
+        const Candidate *c = &s->cand[ship][i];
+        if (c->p->mask & occ) continue;
+        uint64_t n = search(s, level + 1, occ | c->p->mask, claims + c->claim);
+        if (!n) continue;
+        total += n;
+        for (int j = 0; j < c->p->len; j++) s->count[c->p->cells[j]] += n;
+    }
+    return total;
+}
+
+/* Random fleets drawn uniformly from the candidates, keeping the consistent
+ * ones. Stops after max_attempts draws or MC_SAMPLES kept; *attempts is set
+ * to the number of draws */
+static uint64_t sample(Search *s, uint64_t *rng, long max_attempts, long *attempts) {
+    const Knowledge *k = s->k;
+    const Candidate *chosen[SOLVER_SHIPS];
+    uint64_t kept = 0;
+    long a;
+
+    for (a = 0; a < max_attempts && kept < MC_SAMPLES; a++) {
+        uint64_t occ = 0;
+        int claims = 0, i;
+        for (i = 0; i < SOLVER_SHIPS; i++) {
+            int ship = s->order[i];
+            const Candidate *c = &s->cand[ship][next_random(rng) % (uint64_t)s->ncand[ship]];
+            if (c->p->mask & occ) break;
+            occ |= c->p->mask;
+            if (popcount64(k->hit & ~occ) > s->len_after[i + 1]) break;
+            claims += c->claim;
+            chosen[i] = c;
+        }
+        if (i < SOLVER_SHIPS || (k->hit & ~occ) || claims != k->nsunk) continue;
+        kept++;
+        for (i = 0; i < SOLVER_SHIPS; i++) {
+            for (int j = 0; j < chosen[i]->p->len; j++) s->count[chosen[i]->p->cells[j]]++;
+        }
+    }
+    *attempts = a;
+    return kept;
+}
+
+int solver_heat(const Knowledge *k, Heat *out, uint64_t *rng) {
+    Search *s = calloc(1, sizeof(Search));     /* ~10 KB of candidates */
+    uint64_t total = 0;
+    int rc = -1;
+
+    if (!s) return -1;
+    s->k = k;
+    double combinations = build_candidates(s);
+
+    out->exact = 0;
+    if (combinations > 0) {
+        /* The share of random draws that fit estimates how many fleets an
+         * exact search would visit */
+        long attempts;
+        total = sample(s, rng, MC_PILOT, &attempts);
+        int enumerate = combinations * (double)(total + 1) / (double)attempts <= EXACT_FLEETS;
+        if (enumerate) {
+            memset(s->count, 0, sizeof(s->count));
+            total = search(s, 0, 0, 0);
+            out->exact = !s->aborted;
+        }
+        if (!out->exact && (enumerate || total < MC_SAMPLES)) {
+            memset(s->count, 0, sizeof(s->count));
+            total = sample(s, rng, MC_ATTEMPTS, &attempts);
+        }
+    }
+    if (total) {
+        out->fleets = total;
+        for (int i = 0; i < SOLVER_CELLS; i++) out->p[i] = (float)((double)s->count[i] / (double)total);
+        rc = 0;
+    }
+    free(s);
+    return rc;
+}
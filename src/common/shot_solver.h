@@ -0,0 +1,55 @@
+#ifndef SHOT_SOLVER_H
+#define SHOT_SOLVER_H
+
+/*
+ * shot_solver.h - Where the opponent's ships can be, given what a player saw
+ *
+ * A player's knowledge of the opponent board is the cells they missed, the
+ * cells they hit and the SHIP_SUNK reports (which shot sank a ship of which
+ * length). The solver counts the fleets of 5, 4, 3, 3 and 2 consistent with
+ * it. A ship must avoid misses and must not cover a reported sinking unless
+ * it is the ship that sank there. That ship was fully hit by then, and every
+ * other ship still has an unhit cell. The result is the chance that each cell
+ * holds a ship, i.e. that a shot there hits.
+ *
+ * A short run of random fleets estimates how many fit. Small positions are
+ * then enumerated exactly: a depth-first search over ship placements, most
+ * constrained ship first, counting completions per cell. Larger ones keep
+ * sampling random fleets and count the consistent ones (Monte Carlo). Safe
+ * to call from several threads at once; each caller passes its own random
+ * state.
+ */
+
+#include <stdint.h>
+#include "game.h"
+
+#define SOLVER_CELLS (GRID_ROWS * GRID_COLS)
+#define SOLVER_SHIPS 5
+
+/* A player's view of the opponent board (bit r * GRID_COLS + c per cell) */
+typedef struct Knowledge {
+    uint64_t miss, hit;
+    int nsunk;
+    struct {
+        int cell, len;          /* Shot that sank a ship, and its length */
+        uint64_t hit_before;    /* Hits up to and including that shot */
+    } sunk[SOLVER_SHIPS];
+} Knowledge;
+
+typedef struct Heat {
+    float p[SOLVER_CELLS];      /* Chance that the cell holds a ship */
+    uint64_t fleets;            /* Fleets counted (exact) or samples kept (Monte Carlo) */
+    int exact;
+} Heat;
+
+/* Build the placement tables. Call once before solver_heat */
+void solver_init(void);
+
+/* Record a shot at cell in k. sunk_len is the length of the ship it sank, or 0 */
+void solver_observe(Knowledge *k, int cell, int hit, int sunk_len);
+
+/* Chance of a ship on every cell given k. Returns 0, -1 if no consistent
+ * fleet was found */
+int solver_heat(const Knowledge *k, Heat *out, uint64_t *rng);
+
+#endif /* SHOT_SOLVER_H */
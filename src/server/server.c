@@ -5,6 +5,28 @@
 #include "server_message.h"
 #include "server_client.h"
 #include "server_commands.h"
+#include "server_trace.h"
+#include "server_admin.h"
+#include "server_config.h"
+#include "server_journal.h"
+#include "server_snapshot.h"
+#include "server_handoff.h"
+#include "server_acceptor.h"
+#include "server_uring.h"
+#include "server_ws.h"
+#include "server_gateway.h"
+#include "server_timer.h"
+#include "server_heartbeat.h"
+#include "server_clock.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_tourney.h"
+#include "server_match.h"
+#include "server_store.h"
+#include "server_archive.h"
+#include "server_log.h"
+#include "server_quota.h"
+#include "server_admission.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +34,7 @@
 #include <pthread.h>
 #include <locale.h>
 #include <time.h>
+#include <signal.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -31,7 +54,7 @@ static void *console_thread(void *arg) {
     sock_t *listen_fd_ptr = (sock_t *)arg;
     char line[256];
     
-    printf("Type 'quit' or 'exit' to stop the server.\n");
+    printf("Type 'quit' or 'exit' to stop the server, 'help' for admin commands.\n");
     
     while (server_running && fgets(line, sizeof(line), stdin)) {
         /* Remove newline */
@@ -52,6 +75,11 @@ static void *console_thread(void *arg) {
             /* Enqueue message to unblock dequeue_msg() if waiting */
             enqueue_msg(my_strdup("SERVER_QUIT"), -2);
             break;
+        } else if (line[0] != '\0') {
+            /* Everything else is an admin command (stats, lobbies, kick, drain, trace...) */
+            char reply[8192];
+            admin_execute(line, reply, sizeof(reply));
+            printf("%s", reply);
         }
     }
     return NULL;
@@ -61,54 +89,35 @@ static void *console_thread(void *arg) {
 static void *accept_thread(void *arg) {
     sock_t listen_fd = *(sock_t *)arg;
     
-    while (server_running) {
+    /* During a handoff nothing is accepted: new connections stay in the
+     * backlog for the process taking over the listener */
+    while (server_running && handoff_accept_wait(listen_fd)) {
         struct sockaddr_in caddr;
         int sl = sizeof(caddr);
         sock_t c = accept(listen_fd, (struct sockaddr *)&caddr, &sl);
         if (c == SOCKET_INVALID) {
+            handoff_accept_end();
             if (!server_running) break;
             continue;
         }
-        
-        pthread_mutex_lock(&g_global_state->lock);
-        
-        int assigned = -1;
-        for (int i = 0; i < MAX_CONNECTIONS; i++) {
-            if (g_global_state->connections[i] == SOCKET_INVALID) {
-                g_global_state->connections[i] = c;
-                assigned = i;
-                break;
-            }
-        }
-        
-        if (assigned != -1) {
-            /* Create Context */
-            ClientCtx *ctx = calloc(1, sizeof(ClientCtx));
-            ctx->fd = c;
-            ctx->connection_id = assigned;
-            ctx->player_id_in_game = -1;
-            ctx->lobby = NULL;
-
-            g_global_state->client_contexts[assigned] = ctx;
-            g_global_state->active_connections++;
-            
-            /* Add detached tracking if needed, or just rely on active_connections */
-            g_global_state->active_threads++;
-            
-            pthread_t th;
-            pthread_create(&th, NULL, client_reader, ctx);
-            pthread_detach(th);
-            
-            printf("Connection accepted: ID %d\n", assigned);
-        } else {
+
+        int held;
+        ClientCtx *ctx = admission_register(c, NULL, NULL, &held);
+        if (ctx) {
+            admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+            log_event(LOG_INFO, "conn_accepted", "conn=%d", ctx->connection_id);
+        } else if (!held) {
             /* Server full */
+            admin_stat_inc(STAT_CONNECTIONS_REJECTED);
+            log_event(LOG_INFO, "conn_rejected", "reason=full");
             const char *msg = "BUSY Server full\n";
-            WRITE(c, msg, (int)strlen(msg));
+            server_send(c, msg, (int)strlen(msg));
             shutdown(c, SHUT_RDWR_FLAG);
             CLOSE(c);
         }
-        
-        pthread_mutex_unlock(&g_global_state->lock);
+
+        if (ctx) client_start_reader(ctx);
+        handoff_accept_end();
     }
     return NULL;
 }
@@ -190,62 +199,7 @@ static void send_lobby_list(ClientCtx *ctx) {
     pthread_mutex_unlock(&g_global_state->lock);
     
     offset += snprintf(buf + offset, sizeof(buf) - offset, "LOBBY_LIST_END\n");
-    WRITE(ctx->fd, buf, offset);
-}
-
-static GameLobby *create_named_lobby(GlobalState *gs, const char *name) {
-    GameLobby *l = create_lobby(gs);
-    if (l) {
-        pthread_mutex_lock(&l->lock);
-        strncpy(l->lobby_name, name, sizeof(l->lobby_name) - 1);
-        l->lobby_name[sizeof(l->lobby_name) - 1] = '\0';
-        pthread_mutex_unlock(&l->lock);
-    }
-    return l;
-}
-
-static void join_lobby_id(ClientCtx *ctx, int lobby_id) {
-    GameLobby *joined_lobby = NULL;
-    int player_idx = -1;
-    
-    pthread_mutex_lock(&g_global_state->lock);
-    if (lobby_id >= 0 && lobby_id < MAX_LOBBIES && g_global_state->lobbies[lobby_id]) {
-        GameLobby *l = g_global_state->lobbies[lobby_id];
-        pthread_mutex_lock(&l->lock);
-        if (l->num_players < MAX_PLAYERS_PER_GAME) {
-            if (l->clients[0] == SOCKET_INVALID) player_idx = 0;
-            else if (l->clients[1] == SOCKET_INVALID) player_idx = 1;
-            
-            if (player_idx != -1) {
-                l->clients[player_idx] = ctx->fd;
-                l->num_players++;
-                joined_lobby = l;
-            }
-        }
-        pthread_mutex_unlock(&l->lock);
-    }
-    pthread_mutex_unlock(&g_global_state->lock);
-    
-    if (joined_lobby && player_idx != -1) {
-        ctx->lobby = joined_lobby;
-        ctx->player_id_in_game = player_idx;
-        
-        char assign[32];
-        int l = snprintf(assign, sizeof(assign), "ASSIGN %d\n", player_idx);
-        WRITE(ctx->fd, assign, l);
-        
-        printf("Client %d joined Lobby %d as Player %d\n", ctx->connection_id, joined_lobby->id, player_idx);
-        
-        /* Send cached name command */
-        if (ctx->pending_name[0] != '\0') {
-            char namecmd[128];
-            snprintf(namecmd, sizeof(namecmd), "NAME %s\n", ctx->pending_name);
-            handle_name_command(joined_lobby, namecmd, player_idx);
-        }
-    } else {
-        const char *msg = "JOIN_FAIL Lobby full or invalid\n";
-        WRITE(ctx->fd, msg, (int)strlen(msg));
-    }
+    server_send(ctx->fd, buf, offset);
 }
 
 /* Updated quick join (now just tries to find ANY open lobby) */
@@ -254,11 +208,24 @@ static void quick_join_lobby(ClientCtx *ctx) {
     /* For now, disabled in favor of manual selection */
 }
 
+/* Client asked to leave: close the socket for reading so its reader sees EOF
+ * and enqueues the DISCONNECT that frees the context */
+static void close_client_input(ClientCtx *ctx) {
+    server_shutdown_client(ctx->fd);
+}
+
 static void handle_client_disconnect(ClientCtx *ctx) {
     if (!ctx) return;
+    heartbeat_detach(ctx);
+    spectate_leave(ctx);
+    tourney_disconnected(ctx);
+    match_cancel(ctx);
     
-    if (ctx->lobby) {
-        printf("Client %d disconnected from Lobby %d\n", ctx->connection_id, ctx->lobby->id);
+    if (ctx->lobby && resume_detach(ctx)) {
+        /* Seat held for RESUME; the grace timer releases it otherwise */
+    } else if (ctx->lobby) {
+        log_event(LOG_INFO, "leave", "conn=%d lobby=%d seat=%d", ctx->connection_id, ctx->lobby->id, ctx->player_id_in_game);
+        journal_append(JE_LEAVE, ctx->lobby->id, ctx->player_id_in_game, NULL, 0);
         /* If in a lobby, use game logic disconnect */
         handle_disconnect(ctx->lobby, ctx->player_id_in_game, NULL);
         
@@ -269,13 +236,13 @@ static void handle_client_disconnect(ClientCtx *ctx) {
         pthread_mutex_unlock(&ctx->lobby->lock);
         
         if (remaining <= 0) {
-            printf("Lobby %d is empty. Destroying...\n", ctx->lobby->id);
+            log_event(LOG_INFO, "lobby_destroyed", "lobby=%d", ctx->lobby->id);
             destroy_lobby(g_global_state, ctx->lobby->id);
         }
     } else {
-        printf("Client %d disconnected\n", ctx->connection_id);
+        log_event(LOG_INFO, "disconnect", "conn=%d", ctx->connection_id);
         /* Just close socket and free slot */
-       CLOSE(ctx->fd); 
+        server_close_client(ctx->fd);
     }
     
     pthread_mutex_lock(&g_global_state->lock);
@@ -283,12 +250,13 @@ static void handle_client_disconnect(ClientCtx *ctx) {
     g_global_state->client_contexts[ctx->connection_id] = NULL;
     g_global_state->active_connections--;
     pthread_mutex_unlock(&g_global_state->lock);
+    admission_slot_freed();
     
     free(ctx);
 }
 
 int server_main(int argc, char **argv) {
-    int port = DEFAULT_PORT;
+    ServerConfig cfg;
     const char *loc = setlocale(LC_ALL, "");
 #ifdef _WIN32
     if (!loc || strstr(loc, "UTF-8") == NULL) loc = setlocale(LC_ALL, ".UTF-8");
@@ -299,33 +267,164 @@ int server_main(int argc, char **argv) {
 #endif
     if (!loc || strstr(loc, "UTF-8") == NULL) loc = setlocale(LC_ALL, "en_US.UTF-8");
 
-    if (argc >= 2) port = atoi(argv[1]);
+    if (server_config_parse(&cfg, argc, argv) != 0) {
+        server_config_usage(argv[0]);
+        return 1;
+    }
+    int port = cfg.port;
     if (sock_init() != 0) return 1;
-
-    sock_t listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd == SOCKET_INVALID) return 1;
-
-    int on = 1;
-    setsockopt((int)listen_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) return 1;
-    if (listen(listen_fd, 50) < 0) return 1; // Increased backlog
-    
-    printf("Server listening on port %d (Lobby System Active)\n", port);
+    if (log_open(cfg.log, cfg.log_level, cfg.log_rate) != 0) {
+        fprintf(stderr, "Failed to open log %s\n", cfg.log);
+        return 1;
+    }
+#ifndef _WIN32
+    /* A peer that vanished must fail the write, not kill the server */
+    signal(SIGPIPE, SIG_IGN);
+#endif
 
     message_queue_init();
+    quota_configure(cfg.rate_limit, cfg.queue_share, cfg.abuse_limit);
+
+    /* Create Global State */
+    g_global_state = global_state_create();
+
+    heartbeat_configure(cfg.heartbeat_interval, cfg.idle_timeout);
+    clock_configure(cfg.turn_time, cfg.placement_time);
+    resume_configure(cfg.resume_grace);
+    spectate_configure(cfg.spectate_delay);
+    if (timers_start() != 0) return 1;
+    if (spectate_start() != 0) return 1;
+    if (match_start() != 0) return 1;
+    if (admission_start(cfg.admission_queue) != 0) return 1;
+
+    /* Readers must see the handoff wake-up pipe from the start */
+    if (cfg.handoff_socket[0] && handoff_init() != 0) {
+        fprintf(stderr, "Failed to set up handoff\n");
+        return 1;
+    }
+
+    sock_t listen_fd = SOCKET_INVALID;
+    uint32_t floors[MAX_LOBBIES] = {0};
+    if (cfg.takeover[0]) {
+        /* Inherit listener, lobbies and clients from the running server */
+        int n = handoff_takeover(cfg.takeover, &listen_fd, floors);
+        if (n < 0) return 1;
+        printf("Took over %d connections from %s\n", n, cfg.takeover);
+    } else if (cfg.acceptors > 0) {
+        if (acceptors_start(port, cfg.acceptors) != 0) return 1;
+        printf("Server listening on port %d with %d SO_REUSEPORT acceptors\n", port, cfg.acceptors);
+    } else {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd == SOCKET_INVALID) return 1;
+
+        int on = 1;
+        setsockopt((int)listen_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) return 1;
+        if (listen(listen_fd, 50) < 0) return 1; // Increased backlog
+
+        printf("Server listening on port %d (Lobby System Active)\n", port);
+    }
 
     pthread_t c_th;
     pthread_create(&c_th, NULL, console_thread, &listen_fd);
 
-    /* Create Global State */
-    g_global_state = global_state_create();
+    if (store_open(cfg.store) != 0) {
+        fprintf(stderr, "Failed to open player store %s\n", cfg.store);
+        return 1;
+    }
+    if (archive_open(cfg.archive) != 0) {
+        fprintf(stderr, "Failed to open game archive %s\n", cfg.archive);
+        return 1;
+    }
+
+    if (cfg.snapshot[0] && !cfg.takeover[0]) {
+        uint64_t t0 = trace_now_us();
+        int n = snapshot_load(cfg.snapshot, floors);
+        if (n < 0) {
+            fprintf(stderr, "Ignoring invalid snapshot %s\n", cfg.snapshot);
+        } else if (n > 0) {
+            printf("Snapshot: restored %d lobbies in %llu us\n", n, (unsigned long long)(trace_now_us() - t0));
+        }
+    }
+
+    if (cfg.journal[0]) {
+        int n = journal_replay(cfg.journal, floors);
+        if (n < 0) {
+            fprintf(stderr, "Failed to read journal %s\n", cfg.journal);
+            return 1;
+        }
+        if (n > 0) printf("Journal: replayed %d events\n", n);
+        if (journal_open(cfg.journal, cfg.journal_commit_ms) != 0) {
+            fprintf(stderr, "Failed to open journal %s\n", cfg.journal);
+            return 1;
+        }
+    }
+    /* Restored players have until the resume grace runs out to come back */
+    if (!cfg.takeover[0]) resume_arm_restored();
+
+    if (cfg.io_uring) {
+        if (uring_start(listen_fd) != 0) return 1;
+        uring_enable_batching();
+        printf("Using io_uring backend\n");
+    } else if (listen_fd != SOCKET_INVALID) {
+        pthread_t acc_th;
+        pthread_create(&acc_th, NULL, accept_thread, &listen_fd);
+    }
+
+    if (cfg.ws_port > 0) {
+        if (ws_start(cfg.ws_port) == 0) {
+            printf("WebSocket endpoint listening on port %d\n", cfg.ws_port);
+        } else {
+            fprintf(stderr, "Failed to open WebSocket port %d\n", cfg.ws_port);
+        }
+    }
+
+    if (cfg.gateway_port > 0 || cfg.gateway_socket[0]) {
+        if (gateway_start(cfg.gateway_port, cfg.gateway_socket) == 0) {
+            printf("Gateway links accepted on %s\n", cfg.gateway_socket[0] ? cfg.gateway_socket : "loopback");
+        } else {
+            fprintf(stderr, "Failed to open gateway listener\n");
+        }
+    }
+
+#ifndef _WIN32
+    /* Local clients on the Unix socket take the same accept/reader path as TCP ones */
+    sock_t unix_fd = SOCKET_INVALID;
+    if (cfg.unix_socket[0]) {
+        unix_fd = listen_unix(cfg.unix_socket, 50);
+        if (unix_fd != SOCKET_INVALID) {
+            pthread_t unix_th;
+            pthread_create(&unix_th, NULL, accept_thread, &unix_fd);
+            printf("Accepting clients on Unix socket %s\n", cfg.unix_socket);
+        } else {
+            fprintf(stderr, "Failed to open Unix socket %s\n", cfg.unix_socket);
+        }
+    }
+#endif
 
-    pthread_t acc_th;
-    pthread_create(&acc_th, NULL, accept_thread, &listen_fd);
+    if (cfg.snapshot[0] && snapshot_start(cfg.snapshot, cfg.snapshot_interval) != 0) {
+        fprintf(stderr, "Failed to start snapshots to %s\n", cfg.snapshot);
+    }
+
+    if (cfg.admin_socket[0]) {
+        if (admin_start(cfg.admin_socket) == 0) {
+            printf("Admin socket listening on %s\n", cfg.admin_socket);
+        } else {
+            fprintf(stderr, "Failed to open admin socket %s\n", cfg.admin_socket);
+        }
+    }
+
+    if (cfg.handoff_socket[0]) {
+        if (handoff_listen(&cfg, listen_fd) == 0) {
+            printf("Handoff socket listening on %s\n", cfg.handoff_socket);
+        } else {
+            fprintf(stderr, "Failed to open handoff socket %s\n", cfg.handoff_socket);
+        }
+    }
 
     while (server_running) {
         MsgEntry e = dequeue_msg();
@@ -333,7 +432,61 @@ int server_main(int argc, char **argv) {
         int sender_conn_id = e.sender;
         if (!m) continue;
 
+        admin_maybe_publish();
+
+        if (sender_conn_id == ADMIN_SENDER) {
+            int done = admin_handle_control(m);
+            server_flush_output();
+            free(e.trace);
+            free(m);
+            if (done) {
+                printf("Drain complete, stopping server\n");
+                break;
+            }
+            continue;
+        }
+
+        if (sender_conn_id == HANDOFF_SENDER) {
+            int handed_off = handoff_handle_control(m);
+            free(e.trace);
+            free(m);
+            if (handed_off) break;
+            continue;
+        }
+
+        if (sender_conn_id == TIMER_SENDER) {
+            timers_handle_tick();
+            server_flush_output();
+            free(e.trace);
+            free(m);
+            continue;
+        }
+
+        if (sender_conn_id == GATEWAY_SENDER) {
+            gateway_handle_control(m);
+            server_flush_output();
+            free(e.trace);
+            free(m);
+            continue;
+        }
+
+        if (sender_conn_id == MATCH_SENDER) {
+            match_handle_control();
+            server_flush_output();
+            free(e.trace);
+            free(m);
+            continue;
+        }
+
+        if (sender_conn_id == SNAPSHOT_SENDER) {
+            snapshot_handle_control(m);
+            free(e.trace);
+            free(m);
+            continue;
+        }
+
         if (sender_conn_id == -2 && strcmp(m, "SERVER_QUIT") == 0) {
+            free(e.trace);
             free(m);
             break;
         }
@@ -346,9 +499,12 @@ int server_main(int argc, char **argv) {
         }
 
         if (!ctx) {
+            free(e.trace);
             free(m);
             continue;
         }
+        /* Client lines count against the queue share; the reader's own notices end in a newline */
+        if (m[0] && m[strlen(m) - 1] != '\n') quota_release(&ctx->quota);
 
         char um[MAX_LINE];
         size_t mi = 0;
@@ -359,8 +515,44 @@ int server_main(int argc, char **argv) {
         }
         um[mi] = '\0';
 
+        trace_begin_dispatch(e.trace, um);
+        admin_stat_inc(STAT_MESSAGES_DISPATCHED);
+
+        /* Readers enqueue "CONNECTED\n", "DISCONNECT\n", "REPLY\n<text>" and "WS_...\n"; lines from clients never keep the newline */
+        if (strcmp(m, "CONNECTED\n") == 0) {
+            heartbeat_attach(ctx);
+
+        } else if (strcmp(m, "DISCONNECT\n") == 0) {
+            handle_client_disconnect(ctx);
+
+        } else if (strncmp(m, "REPLY\n", 6) == 0) {
+            /* A query the reader answered from the store */
+            server_send(ctx->fd, m + 6, (int)strlen(m + 6));
+
+        } else if (strcmp(m, "RATE_LIMITED\n") == 0) {
+            server_send(ctx->fd, "RATE_LIMITED\n", 13);
+
+        } else if (strcmp(m, "ABUSE\n") == 0) {
+            /* Over --abuse-limit refused lines: the seat is not held for RESUME */
+            log_event(LOG_WARN, "abuse_disconnect", "conn=%d", ctx->connection_id);
+            if (ctx->lobby) resume_revoke(ctx->lobby, ctx->player_id_in_game);
+            server_send(ctx->fd, "RATE_LIMITED\n", 13);
+            close_client_input(ctx);
+
+        } else if (ws_on_notice(ctx, m) == 0) {
+            /* WebSocket upgrade or control frame */
+
+        } else if (heartbeat_on_message(ctx, m, um)) {
+            /* PING/PONG: nothing else to do */
+
         /* Lobby Logic */
-        if (ctx->lobby == NULL) {
+        } else if (ctx->lobby == NULL) {
+            /* Taking a seat ends spectating */
+            if (strncmp(um, "NAME ", 5) == 0 || strncmp(um, "RESUME ", 7) == 0 ||
+                strncmp(um, "LOBBY_CREATE ", 13) == 0 || strncmp(um, "LOBBY_JOIN ", 11) == 0) {
+                spectate_leave(ctx);
+            }
+
             /* If sending NAME, treat as auto-join request */
             if (strncmp(um, "NAME ", 5) == 0) {
                 /* Store Name */
@@ -369,21 +561,50 @@ int server_main(int argc, char **argv) {
                     strncpy(ctx->pending_name, namebuf, sizeof(ctx->pending_name) - 1);
                     ctx->pending_name[sizeof(ctx->pending_name) - 1] = '\0';
                 }
-                /* Send Lobby List */
+                /* Restored seats are reclaimed with RESUME <token>, not by name */
                 send_lobby_list(ctx);
                 
             } else if (strncmp(um, "LOBBY_LIST", 10) == 0) {
                 send_lobby_list(ctx);
+
+            } else if (strncmp(um, "SPECTATE ", 9) == 0) {
+                int lid;
+                char mode[8] = "";
+                if (sscanf(um, "SPECTATE %d %7s", &lid, mode) >= 1) {
+                    spectate_join(ctx, lid, strcmp(mode, "FULL") == 0);
+                }
+
+            } else if (strncmp(um, "UNSPECTATE", 10) == 0) {
+                spectate_leave(ctx);
+
+            } else if (strncmp(um, "TOURNEY_", 8) == 0) {
+                tourney_command(ctx, m, um);
+
+            } else if (strncmp(um, "MATCHMAKE", 9) == 0) {
+                match_command(ctx, um);
+
+            } else if (strncmp(um, "RESUME ", 7) == 0) {
+                char token[RESUME_TOKEN_LEN + 2];
+                if (sscanf(m + 7, "%33s", token) != 1 || !resume_attach(ctx, token)) {
+                    const char *msg = "RESUME_FAIL\n";
+                    server_send(ctx->fd, msg, (int)strlen(msg));
+                }
                 
+            } else if ((strncmp(um, "LOBBY_CREATE ", 13) == 0 || strncmp(um, "LOBBY_JOIN ", 11) == 0)
+                       && admin_is_draining()) {
+                const char *msg = "JOIN_FAIL Server draining\n";
+                server_send(ctx->fd, msg, (int)strlen(msg));
+
             } else if (strncmp(um, "LOBBY_CREATE ", 13) == 0) {
                 char lname[64];
                 /* Use m (original case) for name */
                 if (sscanf(m, "LOBBY_CREATE %63[^\r\n]", lname) == 1) {
                     GameLobby *l = create_named_lobby(g_global_state, lname);
                     if (l) {
+                        admin_stat_inc(STAT_LOBBIES_CREATED);
                         join_lobby_id(ctx, l->id);
                     } else {
-                        WRITE(ctx->fd, "CREATE_FAIL Server full\n", 24);
+                        server_send(ctx->fd, "CREATE_FAIL Server full\n", 24);
                     }
                 }
             } else if (strncmp(um, "LOBBY_JOIN ", 11) == 0) {
@@ -392,7 +613,7 @@ int server_main(int argc, char **argv) {
                     join_lobby_id(ctx, lid);
                 }
             } else if (strncmp(um, "QUIT", 4) == 0 || strncmp(um, "DISCONNECT", 10) == 0) {
-                 handle_client_disconnect(ctx);
+                close_client_input(ctx);
             }
         } else {
             /* Game Logic - route to lobby */
@@ -400,6 +621,15 @@ int server_main(int argc, char **argv) {
             int pid = ctx->player_id_in_game;
             GameLobby *lobby = ctx->lobby;
 
+            /* Log before applying so replay sees commands in dispatch order */
+            journal_game_command(lobby->id, pid, m);
+
+            /* A move of their own ends a player's run of timeouts */
+            if (strncmp(um, "PLACE ", 6) == 0 || strncmp(um, "MOVE ", 5) == 0 ||
+                strncmp(um, "READY", 5) == 0 || strncmp(um, "FIRE ", 5) == 0) {
+                clock_player_acted(lobby, pid);
+            }
+
             if (strncmp(um, "NAME ", 5) == 0) {
                 handle_name_command(lobby, m, pid);
             } else if (strncmp(um, "PLACE ", 6) == 0) {
@@ -411,6 +641,17 @@ int server_main(int argc, char **argv) {
             } else if (strncmp(um, "FIRE ", 5) == 0) {
                 /* Check if it's chat or fire */
                 handle_fire_command(lobby, m, pid);
+            } else if (strncmp(um, "CLOCK ", 6) == 0) {
+                int turn_s, placement_s;
+                if (sscanf(um, "CLOCK %d %d", &turn_s, &placement_s) == 2) {
+                    clock_set(lobby, pid, turn_s, placement_s);
+                }
+            } else if (strncmp(um, "STATE", 5) == 0) {
+                handle_state_command(lobby, pid);
+            } else if (strncmp(um, "PLAY_AGAIN ", 11) == 0 && admin_is_draining()) {
+                /* No new games while draining; the lobby is finished, so the drain does not wait for it */
+                server_send(ctx->fd, "GAME_CLOSED\n", 12);
+
             } else if (strncmp(um, "PLAY_AGAIN ", 11) == 0) {
                 char ans[16] = {0};
                 if (sscanf(um, "PLAY_AGAIN %15s", ans) == 1) {
@@ -418,16 +659,46 @@ int server_main(int argc, char **argv) {
                     handle_rematch_response(lobby, pid, resp);
                 }
             } else if (strncmp(um, "DISCONNECT", 10) == 0 || strncmp(um, "QUIT", 4) == 0) {
-                /* Let the global handler do connection cleanup, lobby decrement, and notification */
-                handle_client_disconnect(ctx);
+                /* The reader's DISCONNECT does connection cleanup, lobby decrement, and notification */
+                resume_revoke(lobby, pid);
+                close_client_input(ctx);
             }
         }
         
+        server_flush_output();
+        trace_end_dispatch();
         free(m);
+
+        if (admin_drain_complete()) {
+            printf("Drain complete, stopping server\n");
+            break;
+        }
     }
 
     /* Cleanup */
     // ... existing cleanup logic adapted for global state ...
+    if (!handoff_done()) {
+        tourney_cancel_all();
+        match_cancel_all("Server stopping");
+        server_flush_output();
+    }
+    admin_stop();
+    admission_stop();       /* Before the backends it hands connections to */
+    acceptors_stop();
+    if (cfg.io_uring) uring_stop();
+    ws_stop();
+    gateway_stop();
+#ifndef _WIN32
+    if (unix_fd != SOCKET_INVALID) unlink(cfg.unix_socket);
+#endif
+    snapshot_stop();
+    timers_stop();
+    spectate_stop();
+    match_stop();
+    journal_close();
+    archive_close();
+    store_close();
+    log_close();
     message_queue_cleanup();
     sock_cleanup();
     return 0;
@@ -0,0 +1,202 @@
+#define _DEFAULT_SOURCE
+#include "server_acceptor.h"
+#include "server_client.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_log.h"
+#include "server_admission.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#define MAX_ACCEPTORS 16
+
+#if defined(_WIN32) || !defined(SO_REUSEPORT)
+int acceptors_start(int port, int count) {
+    (void)port;
+    (void)count;
+    fprintf(stderr, "SO_REUSEPORT acceptors are not supported on this platform\n");
+    return -1;
+}
+
+void acceptors_stop(void) { }
+#else
+
+/* Slot 0 is the listener, slot 1 the stop pipe, slot 2 the inbox pipe, the rest are clients */
+#define FIRST_CLIENT 3
+
+typedef struct AcceptorLoop {
+    int index;
+    sock_t listen_fd;
+    int inbox_pipe[2];              /* Written when the inbox gets a connection */
+    pthread_mutex_t inbox_lock;
+    ClientCtx *inbox[MAX_CONNECTIONS];  /* Admitted from the queue, not polled yet */
+    int ninbox;
+    struct pollfd fds[MAX_CONNECTIONS + FIRST_CLIENT];
+    ClientCtx *ctxs[MAX_CONNECTIONS + FIRST_CLIENT];
+    int nfds;
+    pthread_t tid;
+} AcceptorLoop;
+
+static AcceptorLoop loops[MAX_ACCEPTORS];
+static int loop_count = 0;
+static int stop_pipe[2] = {-1, -1};
+
+static sock_t open_listener(int port) {
+    sock_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == SOCKET_INVALID) return SOCKET_INVALID;
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        CLOSE(fd);
+        return SOCKET_INVALID;
+    }
+    /* Several loops may wake for one connection; the losers must not block */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void add_client(AcceptorLoop *loop, ClientCtx *ctx) {
+    loop->fds[loop->nfds] = (struct pollfd){ctx->fd, POLLIN, 0};
+    loop->ctxs[loop->nfds] = ctx;
+    loop->nfds++;
+}
+
+/* Admission thread: a connection this loop accepted left the queue */
+static void admit_to_loop(ClientCtx *ctx, void *arg) {
+    AcceptorLoop *loop = arg;
+    pthread_mutex_lock(&loop->inbox_lock);
+    loop->inbox[loop->ninbox++] = ctx;
+    pthread_mutex_unlock(&loop->inbox_lock);
+    if (write(loop->inbox_pipe[1], "x", 1) < 0) perror("acceptor inbox");
+}
+
+static void take_inbox(AcceptorLoop *loop) {
+    char drain[64];
+    while (read(loop->inbox_pipe[0], drain, sizeof(drain)) > 0) { }
+    pthread_mutex_lock(&loop->inbox_lock);
+    for (int i = 0; i < loop->ninbox; i++) add_client(loop, loop->inbox[i]);
+    loop->ninbox = 0;
+    pthread_mutex_unlock(&loop->inbox_lock);
+}
+
+static void accept_pending(AcceptorLoop *loop) {
+    for (;;) {
+        sock_t c = accept(loop->listen_fd, NULL, NULL);
+        if (c == SOCKET_INVALID) return;
+        /* Some systems pass O_NONBLOCK on to accepted sockets; replies are blocking writes */
+        fcntl(c, F_SETFL, fcntl(c, F_GETFL) & ~O_NONBLOCK);
+
+        /* A full loop has no room to poll it, so it must not take a slot either */
+        int held = 0;
+        ClientCtx *ctx = loop->nfds < MAX_CONNECTIONS + FIRST_CLIENT
+                         ? admission_register(c, admit_to_loop, loop, &held) : NULL;
+        if (held) continue;
+        if (!ctx) {
+            admin_stat_inc(STAT_CONNECTIONS_REJECTED);
+            const char *msg = "BUSY Server full\n";
+            server_send(c, msg, (int)strlen(msg));
+            shutdown(c, SHUT_RDWR_FLAG);
+            CLOSE(c);
+            continue;
+        }
+        admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+        log_event(LOG_INFO, "conn_accepted", "conn=%d acceptor=%d", ctx->connection_id, loop->index);
+        add_client(loop, ctx);
+    }
+}
+
+/* Read once from a readable client; returns 0 when the connection is finished */
+static int read_client(ClientCtx *ctx) {
+    ssize_t n = READ(ctx->fd, ctx->rbuf + ctx->rbuf_len, sizeof(ctx->rbuf) - 1 - ctx->rbuf_len);
+    if (n <= 0) {
+        char *disc = strdup("DISCONNECT\n");
+        if (disc) enqueue_msg(disc, ctx->connection_id);
+        return 0;
+    }
+    client_consume_input(ctx, (size_t)n);
+    return 1;
+}
+
+static void *acceptor_loop(void *arg) {
+    AcceptorLoop *loop = arg;
+
+    for (;;) {
+        int r = poll(loop->fds, (nfds_t)loop->nfds, -1);
+        if (r < 0) continue;
+        if (loop->fds[1].revents) break;
+        if (loop->fds[0].revents & POLLIN) accept_pending(loop);
+        if (loop->fds[2].revents) take_inbox(loop);
+
+        for (int i = FIRST_CLIENT; i < loop->nfds; i++) {
+            if (!loop->fds[i].revents) continue;
+            if (!read_client(loop->ctxs[i])) {
+                /* The dispatcher owns ctx from here; forget it */
+                loop->nfds--;
+                loop->fds[i] = loop->fds[loop->nfds];
+                loop->ctxs[i] = loop->ctxs[loop->nfds];
+                i--;
+            }
+        }
+    }
+    return NULL;
+}
+
+int acceptors_start(int port, int count) {
+    if (count > MAX_ACCEPTORS) count = MAX_ACCEPTORS;
+    if (pipe(stop_pipe) != 0) return -1;
+
+    for (int i = 0; i < count; i++) {
+        AcceptorLoop *loop = &loops[i];
+        loop->index = i;
+        loop->listen_fd = open_listener(port);
+        if (loop->listen_fd == SOCKET_INVALID) {
+            fprintf(stderr, "Acceptor %d: cannot listen on port %d\n", i, port);
+            acceptors_stop();
+            return -1;
+        }
+        if (pipe(loop->inbox_pipe) != 0) {
+            CLOSE(loop->listen_fd);
+            acceptors_stop();
+            return -1;
+        }
+        fcntl(loop->inbox_pipe[0], F_SETFL, O_NONBLOCK);
+        pthread_mutex_init(&loop->inbox_lock, NULL);
+        loop->ninbox = 0;
+        loop->fds[0] = (struct pollfd){loop->listen_fd, POLLIN, 0};
+        loop->fds[1] = (struct pollfd){stop_pipe[0], POLLIN, 0};
+        loop->fds[2] = (struct pollfd){loop->inbox_pipe[0], POLLIN, 0};
+        loop->nfds = FIRST_CLIENT;
+        pthread_create(&loop->tid, NULL, acceptor_loop, loop);
+        loop_count++;
+    }
+    return 0;
+}
+
+void acceptors_stop(void) {
+    if (stop_pipe[1] < 0) return;
+    if (write(stop_pipe[1], "x", 1) < 0) perror("acceptor stop");
+    for (int i = 0; i < loop_count; i++) {
+        pthread_join(loops[i].tid, NULL);
+        CLOSE(loops[i].listen_fd);
+        close(loops[i].inbox_pipe[0]);
+        close(loops[i].inbox_pipe[1]);
+    }
+    loop_count = 0;
+    CLOSE(stop_pipe[0]);
+    CLOSE(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+}
+#endif
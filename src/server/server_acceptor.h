@@ -0,0 +1,20 @@
+#ifndef SERVER_ACCEPTOR_H
+#define SERVER_ACCEPTOR_H
+
+/*
+ * server_acceptor.h - SO_REUSEPORT acceptor loops
+ *
+ * Instead of one accept thread plus a reader thread per client, N loops
+ * each bind their own listener on the same port (SO_REUSEPORT) and poll
+ * their own connections. The kernel spreads new connections across the
+ * loops. All loops feed the one dispatcher, so the lobby directory stays
+ * shared and players on different loops can join each other's lobbies.
+ */
+
+/* Start count acceptor loops on port. Returns 0 on success */
+int acceptors_start(int port, int count);
+
+/* Stop the loops and close their listeners */
+void acceptors_stop(void);
+
+#endif /* SERVER_ACCEPTOR_H */
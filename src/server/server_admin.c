@@ -0,0 +1,480 @@
+#define _DEFAULT_SOURCE
+#include "server_admin.h"
+#include "server_message.h"
+#include "server_trace.h"
+#include "server_journal.h"
+#include "server_snapshot.h"
+#include "server_commands.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_log.h"
+#include "server_quota.h"
+#include "server_admission.h"
+#include "common.h"
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#define SLEEP_MS(ms) Sleep(ms)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define SLEEP_MS(ms) usleep((ms)*1000)
+#endif
+
+/* How long an admin command waits for the dispatcher to publish a fresh snapshot */
+#define SNAPSHOT_WAIT_MS 200
+
+typedef struct LobbyInfo {
+    int id;
+    char name[64];
+    int num_players;
+    char players[MAX_PLAYERS_PER_GAME][64];
+    int phase;          /* 0=waiting, 1=placement, 2=playing */
+    int turn;
+} LobbyInfo;
+
+typedef struct ConnInfo {
+    int id;
+    int lobby_id;
+    int seat;
+    char name[64];
+    unsigned rtt_us;
+} ConnInfo;
+
+/* Point-in-time copy of the dispatcher-owned state, read by admin commands */
+typedef struct AdminSnapshot {
+    uint64_t taken_us;
+    int lobby_count;
+    LobbyInfo lobbies[MAX_LOBBIES];
+    int conn_count;
+    ConnInfo conns[MAX_CONNECTIONS];
+} AdminSnapshot;
+
+static const char *phase_names[] = { "waiting", "placement", "playing" };
+
+static atomic_ulong stats[STAT_COUNT];
+static atomic_int draining;
+static uint64_t start_us;
+
+/* Seqlock: odd while the dispatcher rewrites the snapshot */
+static AdminSnapshot snapshot;
+static atomic_uint snapshot_seq;
+static atomic_int snapshot_wanted;
+
+static sock_t admin_fd = SOCKET_INVALID;
+static char admin_path[108];
+
+void admin_stat_inc(AdminStat stat) {
+    atomic_fetch_add_explicit(&stats[stat], 1, memory_order_relaxed);
+}
+
+int admin_is_draining(void) {
+    return atomic_load_explicit(&draining, memory_order_relaxed);
+}
+
+/* ==================== Dispatcher side ==================== */
+
+static void publish_snapshot(void) {
+    atomic_fetch_add_explicit(&snapshot_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    snapshot.taken_us = trace_now_us();
+    snapshot.lobby_count = 0;
+    snapshot.conn_count = 0;
+
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        GameLobby *l = g_global_state->lobbies[i];
+        if (!l) continue;
+
+        LobbyInfo *li = &snapshot.lobbies[snapshot.lobby_count++];
+        li->id = l->id;
+        memcpy(li->name, l->lobby_name, sizeof(li->name));
+        li->num_players = l->num_players;
+        memcpy(li->players, l->names, sizeof(li->players));
+        li->turn = l->game_state->current_turn;
+        if (l->game_state->ready[0] && l->game_state->ready[1]) li->phase = 2;
+        else if (l->names[0][0] && l->names[1][0]) li->phase = 1;
+        else li->phase = 0;
+    }
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        ClientCtx *ctx = g_global_state->client_contexts[i];
+        if (!ctx) continue;
+
+        ConnInfo *ci = &snapshot.conns[snapshot.conn_count++];
+        ci->id = ctx->connection_id;
+        ci->lobby_id = ctx->lobby ? ctx->lobby->id : -1;
+        ci->seat = ctx->player_id_in_game;
+        memcpy(ci->name, ctx->pending_name, sizeof(ci->name));
+        ci->rtt_us = ctx->rtt_us;
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+
+    atomic_thread_fence(memory_order_release);
+    atomic_fetch_add_explicit(&snapshot_seq, 1, memory_order_release);
+}
+
+void admin_maybe_publish(void) {
+    if (!atomic_load_explicit(&snapshot_wanted, memory_order_relaxed)) return;
+    if (!atomic_exchange_explicit(&snapshot_wanted, 0, memory_order_acquire)) return;
+    publish_snapshot();
+}
+
+/* Both seats are taken and nobody has won yet (placement counts) */
+static int game_in_progress(GameLobby *l) {
+    GameState *gs = l->game_state;
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (l->clients[i] == SOCKET_INVALID && !l->detached[i]) return 0;
+    }
+    if (gs->ready[0] && gs->ready[1]
+        && (!grid_has_ships(gs->grids[0]) || !grid_has_ships(gs->grids[1]))) return 0;
+    return 1;
+}
+
+/* Send the players away; the lobby goes with their DISCONNECTs, or now if nobody is connected */
+static void close_lobby(GameLobby *l) {
+    int id = l->id;
+    int connected = 0;
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        resume_revoke(l, i);
+        if (l->clients[i] != SOCKET_INVALID) {
+            server_send(l->clients[i], "GAME_CLOSED\n", 12);
+            server_shutdown_client(l->clients[i]);
+            connected++;
+        }
+    }
+    if (connected == 0) {
+        journal_append(JE_LOBBY_CLOSE, id, -1, NULL, 0);
+        destroy_lobby(g_global_state, id);
+    } else {
+        /* Seats nobody reclaimed go away with the lobby */
+        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+            if (l->detached[i]) resume_release_seat(l, i);
+        }
+    }
+}
+
+int admin_handle_control(const char *msg) {
+    int id;
+
+    if (sscanf(msg, "ADMIN_KICK %d", &id) == 1) {
+        if (id >= 0 && id < MAX_CONNECTIONS && g_global_state->client_contexts[id]) {
+            ClientCtx *ctx = g_global_state->client_contexts[id];
+            /* A kicked player does not get to resume the seat */
+            if (ctx->lobby) resume_revoke(ctx->lobby, ctx->player_id_in_game);
+            server_send(ctx->fd, "KICKED\n", 7);
+            /* The reader sees EOF and the normal DISCONNECT path cleans up */
+            server_shutdown_client(ctx->fd);
+            log_event(LOG_WARN, "admin_kick", "conn=%d", id);
+        }
+    } else if (sscanf(msg, "ADMIN_CLOSE %d", &id) == 1) {
+        if (id >= 0 && id < MAX_LOBBIES && g_global_state->lobbies[id]) {
+            close_lobby(g_global_state->lobbies[id]);
+            log_event(LOG_WARN, "admin_close_lobby", "lobby=%d", id);
+        }
+    } else if (strcmp(msg, "ADMIN_DRAIN") == 0) {
+        atomic_store(&draining, 1);
+        log_event(LOG_WARN, "drain_started", NULL);
+        /* Only games being played are waited for */
+        for (int i = 0; i < MAX_LOBBIES; i++) {
+            GameLobby *l = g_global_state->lobbies[i];
+            if (l && !game_in_progress(l)) close_lobby(l);
+        }
+    }
+    return admin_drain_complete();
+}
+
+int admin_drain_complete(void) {
+    if (!admin_is_draining()) return 0;
+
+    int playing = 0;
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        if (g_global_state->lobbies[i] && game_in_progress(g_global_state->lobbies[i])) playing++;
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+    return playing == 0;
+}
+
+/* ==================== Admin side ==================== */
+
+static char *dup_str(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = malloc(len);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+/* Ask the dispatcher for a fresh snapshot and copy it out without locking.
+ * Falls back to the previous snapshot if the dispatcher is slow to publish.
+ * Returns -1 if no consistent copy could be read (the dispatcher kept
+ * rewriting it) */
+static int read_snapshot(AdminSnapshot *out) {
+    unsigned before = atomic_load_explicit(&snapshot_seq, memory_order_acquire);
+    atomic_store_explicit(&snapshot_wanted, 1, memory_order_release);
+    enqueue_msg(dup_str("ADMIN_SNAPSHOT"), ADMIN_SENDER);
+
+    for (int waited = 0; waited < SNAPSHOT_WAIT_MS; waited += 2) {
+        unsigned now = atomic_load_explicit(&snapshot_seq, memory_order_acquire);
+        if (now != before && (now & 1) == 0) break;
+        SLEEP_MS(2);
+    }
+
+    for (int attempt = 0; attempt < 64; attempt++) {
+        unsigned s1 = atomic_load_explicit(&snapshot_seq, memory_order_acquire);
+        if (s1 & 1) continue;
+        memcpy(out, &snapshot, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&snapshot_seq, memory_order_relaxed) == s1) return 0;
+    }
+    return -1;
+}
+
+/* snprintf at an offset, clamping so repeated calls never overflow out */
+static int appendf(char *out, size_t cap, int off, const char *fmt, ...) {
+    if (off < 0 || (size_t)off >= cap) return off;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(out + off, cap - off, fmt, args);
+    va_end(args);
+    if (n < 0) return off;
+    return ((size_t)(off + n) >= cap) ? (int)cap - 1 : off + n;
+}
+
+static void trace_command(const char *args, char *out, size_t cap) {
+    char sub[16] = {0};
+    char path[200] = {0};
+    int every = 1;
+
+    if (sscanf(args, "%15s", sub) != 1) {
+        snprintf(out, cap, "tracing %s (1 in %d messages)\nOK\n",
+                 trace_enabled() ? "on" : "off", trace_get_sampling());
+    } else if (strcmp(sub, "on") == 0) {
+        sscanf(args, "%*s %d", &every);
+        if (every < 1) every = 1;
+        trace_set_sampling(every);
+        snprintf(out, cap, "tracing on, sampling 1 in %d messages\nOK\n", every);
+    } else if (strcmp(sub, "off") == 0) {
+        trace_set_sampling(0);
+        snprintf(out, cap, "tracing off\nOK\n");
+    } else if (strcmp(sub, "dump") == 0 && sscanf(args, "%*s %199s", path) == 1) {
+        int n = trace_dump_chrome(path);
+        if (n < 0) snprintf(out, cap, "ERR cannot write %s\n", path);
+        else snprintf(out, cap, "wrote %d trace events to %s\nOK\n", n, path);
+    } else {
+        snprintf(out, cap, "ERR usage: trace on [N] | trace off | trace dump <file>\n");
+    }
+}
+
+static void log_command(const char *args, char *out, size_t cap) {
+    char sub[16] = {0}, name[16] = {0};
+    unsigned long long written, dropped, suppressed;
+
+    if (sscanf(args, "%15s %15s", sub, name) == 2 && strcmp(sub, "level") == 0) {
+        int level = log_level_parse(name);
+        if (level < 0) {
+            snprintf(out, cap, "ERR levels are debug, info, warn, error\n");
+            return;
+        }
+        log_set_level(level);
+        snprintf(out, cap, "log level %s\nOK\n", name);
+    } else if (sub[0]) {
+        snprintf(out, cap, "ERR usage: log | log level <debug|info|warn|error>\n");
+    } else {
+        log_counters(&written, &dropped, &suppressed);
+        snprintf(out, cap, "log level %s, %llu written, %llu dropped, %llu suppressed\nOK\n",
+                 log_level_name(log_get_level()), written, dropped, suppressed);
+    }
+}
+
+void admin_execute(const char *cmd, char *out, size_t cap) {
+    char verb[32] = {0};
+    int id;
+    int off = 0;
+
+    if (start_us == 0) start_us = trace_now_us();
+    if (sscanf(cmd, "%31s", verb) != 1) {
+        snprintf(out, cap, "ERR empty command\n");
+        return;
+    }
+    const char *args = cmd + strlen(verb);
+
+    if (strcmp(verb, "stats") == 0) {
+        AdminSnapshot *s = malloc(sizeof(AdminSnapshot));
+        if (!s) { snprintf(out, cap, "ERR out of memory\n"); return; }
+        if (read_snapshot(s) != 0) {
+            free(s);
+            snprintf(out, cap, "ERR stats unavailable, the server is busy; try again\n");
+            return;
+        }
+        int playing = 0;
+        for (int i = 0; i < s->lobby_count; i++) {
+            if (s->lobbies[i].phase == 2) playing++;
+        }
+        unsigned long long rtt_sum = 0;
+        unsigned rtt_max = 0;
+        int rtt_count = 0;
+        int depths[MSG_LANES];
+        message_queue_depths(depths);
+        for (int i = 0; i < s->conn_count; i++) {
+            if (!s->conns[i].rtt_us) continue;
+            rtt_sum += s->conns[i].rtt_us;
+            if (s->conns[i].rtt_us > rtt_max) rtt_max = s->conns[i].rtt_us;
+            rtt_count++;
+        }
+        off = appendf(out, cap, off, "uptime_s %llu\n",
+                      (unsigned long long)((trace_now_us() - start_us) / 1000000));
+        off = appendf(out, cap, off, "connections %d\n", s->conn_count);
+        off = appendf(out, cap, off, "lobbies %d\n", s->lobby_count);
+        off = appendf(out, cap, off, "games_in_progress %d\n", playing);
+        off = appendf(out, cap, off, "connections_accepted %lu\n", atomic_load(&stats[STAT_CONNECTIONS_ACCEPTED]));
+        off = appendf(out, cap, off, "connections_rejected %lu\n", atomic_load(&stats[STAT_CONNECTIONS_REJECTED]));
+        off = appendf(out, cap, off, "admission_waiting %d\n", admission_waiting());
+        off = appendf(out, cap, off, "admission_admitted %lu\n", admission_admitted());
+        off = appendf(out, cap, off, "messages_dispatched %lu\n", atomic_load(&stats[STAT_MESSAGES_DISPATCHED]));
+        off = appendf(out, cap, off, "lobbies_created %lu\n", atomic_load(&stats[STAT_LOBBIES_CREATED]));
+        off = appendf(out, cap, off, "evictions %lu\n", atomic_load(&stats[STAT_EVICTIONS]));
+        off = appendf(out, cap, off, "queue_control %d\n", depths[MSG_LANE_CONTROL]);
+        off = appendf(out, cap, off, "queue_game %d\n", depths[MSG_LANE_GAME]);
+        off = appendf(out, cap, off, "queue_background %d\n", depths[MSG_LANE_BACKGROUND]);
+        off = appendf(out, cap, off, "lines_rate_limited %lu\n", quota_refused());
+        off = appendf(out, cap, off, "abuse_disconnects %lu\n", quota_disconnects());
+        off = appendf(out, cap, off, "spectators %d\n", spectate_count());
+        off = appendf(out, cap, off, "rtt_avg_us %llu\n", rtt_count ? rtt_sum / rtt_count : 0);
+        off = appendf(out, cap, off, "rtt_max_us %u\n", rtt_max);
+        off = appendf(out, cap, off, "draining %d\n", admin_is_draining());
+        off = appendf(out, cap, off, "trace_sampling %d\n", trace_get_sampling());
+        unsigned long long written, dropped, suppressed;
+        log_counters(&written, &dropped, &suppressed);
+        off = appendf(out, cap, off, "log_dropped %llu\n", dropped);
+        off = appendf(out, cap, off, "log_suppressed %llu\n", suppressed);
+        off = appendf(out, cap, off, "OK\n");
+        free(s);
+    } else if (strcmp(verb, "lobbies") == 0) {
+        AdminSnapshot *s = malloc(sizeof(AdminSnapshot));
+        if (!s) { snprintf(out, cap, "ERR out of memory\n"); return; }
+        if (read_snapshot(s) != 0) {
+            free(s);
+            snprintf(out, cap, "ERR stats unavailable, the server is busy; try again\n");
+            return;
+        }
+        for (int i = 0; i < s->lobby_count; i++) {
+            LobbyInfo *l = &s->lobbies[i];
+            off = appendf(out, cap, off, "LOBBY %d %d/2 %s turn=%d p0=%s p1=%s name=%s\n",
+                          l->id, l->num_players, phase_names[l->phase], l->turn,
+                          l->players[0][0] ? l->players[0] : "-",
+                          l->players[1][0] ? l->players[1] : "-",
+                          l->name[0] ? l->name : "Unnamed");
+        }
+        off = appendf(out, cap, off, "OK\n");
+        free(s);
+    } else if (strcmp(verb, "connections") == 0) {
+        AdminSnapshot *s = malloc(sizeof(AdminSnapshot));
+        if (!s) { snprintf(out, cap, "ERR out of memory\n"); return; }
+        if (read_snapshot(s) != 0) {
+            free(s);
+            snprintf(out, cap, "ERR stats unavailable, the server is busy; try again\n");
+            return;
+        }
+        for (int i = 0; i < s->conn_count; i++) {
+            ConnInfo *c = &s->conns[i];
+            off = appendf(out, cap, off, "CONN %d lobby=%d seat=%d rtt_us=%u name=%s\n",
+                          c->id, c->lobby_id, c->seat, c->rtt_us, c->name[0] ? c->name : "-");
+        }
+        off = appendf(out, cap, off, "OK\n");
+        free(s);
+    } else if (strcmp(verb, "kick") == 0 && sscanf(args, "%d", &id) == 1) {
+        char ctl[32];
+        snprintf(ctl, sizeof(ctl), "ADMIN_KICK %d", id);
+        enqueue_msg(dup_str(ctl), ADMIN_SENDER);
+        snprintf(out, cap, "kick %d queued\nOK\n", id);
+    } else if (strcmp(verb, "close-lobby") == 0 && sscanf(args, "%d", &id) == 1) {
+        char ctl[32];
+        snprintf(ctl, sizeof(ctl), "ADMIN_CLOSE %d", id);
+        enqueue_msg(dup_str(ctl), ADMIN_SENDER);
+        snprintf(out, cap, "close-lobby %d queued\nOK\n", id);
+    } else if (strcmp(verb, "drain") == 0) {
+        enqueue_msg(dup_str("ADMIN_DRAIN"), ADMIN_SENDER);
+        snprintf(out, cap, "draining; server exits when the last game in progress ends\nOK\n");
+    } else if (strcmp(verb, "snapshot") == 0) {
+        if (snapshot_request() == 0) snprintf(out, cap, "snapshot queued\nOK\n");
+        else snprintf(out, cap, "ERR snapshots not enabled (start with --snapshot)\n");
+    } else if (strcmp(verb, "trace") == 0) {
+        trace_command(args, out, cap);
+    } else if (strcmp(verb, "log") == 0) {
+        log_command(args, out, cap);
+    } else if (strcmp(verb, "help") == 0) {
+        snprintf(out, cap,
+                 "stats | lobbies | connections | kick <conn> | close-lobby <lobby> | drain | snapshot\n"
+                 "trace on [N] | trace off | trace dump <file> | log | log level <level>\nOK\n");
+    } else {
+        snprintf(out, cap, "ERR unknown command '%s' (try help)\n", verb);
+    }
+}
+
+#ifndef _WIN32
+static void *admin_thread(void *arg) {
+    (void)arg;
+    char line[256];
+    char *reply = malloc(64 * 1024);
+    if (!reply) return NULL;
+
+    for (;;) {
+        sock_t c = accept(admin_fd, NULL, NULL);
+        if (c == SOCKET_INVALID) {
+            if (admin_fd == SOCKET_INVALID) break;
+            continue;
+        }
+
+        /* One admin client at a time; each line is one command */
+        while (read_line(c, line, sizeof(line)) > 0) {
+            size_t len = strlen(line);
+            while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+            if (len == 0) continue;
+            if (strcmp(line, "quit") == 0) break;
+
+            admin_execute(line, reply, 64 * 1024);
+            if (WRITE(c, reply, strlen(reply)) < 0) break;
+        }
+        CLOSE(c);
+    }
+    free(reply);
+    return NULL;
+}
+#endif
+
+int admin_start(const char *socket_path) {
+    if (start_us == 0) start_us = trace_now_us();
+#ifdef _WIN32
+    (void)socket_path;
+    fprintf(stderr, "Admin socket is not supported on Windows; use the console\n");
+    return -1;
+#else
+    admin_fd = listen_unix(socket_path, 4);
+    if (admin_fd == SOCKET_INVALID) return -1;
+    chmod(socket_path, 0600);
+    strncpy(admin_path, socket_path, sizeof(admin_path) - 1);
+
+    pthread_t th;
+    pthread_create(&th, NULL, admin_thread, NULL);
+    pthread_detach(th);
+    return 0;
+#endif
+}
+
+void admin_stop(void) {
+#ifndef _WIN32
+    if (admin_fd != SOCKET_INVALID) {
+        sock_t fd = admin_fd;
+        admin_fd = SOCKET_INVALID;
+        shutdown(fd, SHUT_RDWR_FLAG);
+        CLOSE(fd);
+        unlink(admin_path);
+    }
+#endif
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_ADMIN_H
+#define SERVER_ADMIN_H
+
+#include "server_state.h"
+#include <stddef.h>
+
+/* Control messages from the admin interface use this sender ID */
+#define ADMIN_SENDER (-3)
+
+/* Live counters, updated with relaxed atomics from any thread */
+typedef enum {
+    STAT_CONNECTIONS_ACCEPTED,
+    STAT_CONNECTIONS_REJECTED,
+    STAT_MESSAGES_DISPATCHED,
+    STAT_LOBBIES_CREATED,
+    STAT_EVICTIONS,
+    STAT_COUNT
+} AdminStat;
+
+void admin_stat_inc(AdminStat stat);
+
+/* Start the admin listener on a Unix-domain socket. Returns 0 on success */
+int admin_start(const char *socket_path);
+
+/* Stop the admin listener and remove its socket file */
+void admin_stop(void);
+
+/* Execute one admin command line and write the reply into out.
+ * Shared by the admin socket and the server console. */
+void admin_execute(const char *cmd, char *out, size_t cap);
+
+/* Non-zero once "drain" was requested: no new games are accepted */
+int admin_is_draining(void);
+
+/* Dispatcher side: handle a control message sent with ADMIN_SENDER.
+ * Returns 1 if the server should stop (drain finished). */
+int admin_handle_control(const char *msg);
+
+/* Dispatcher side: publish a fresh snapshot if an admin reader asked for one */
+void admin_maybe_publish(void);
+
+/* Dispatcher side: returns 1 when a drain is in progress and no game is
+ * being played any more (lobbies that were waiting or finished are closed
+ * when the drain starts) */
+int admin_drain_complete(void);
+
+#endif /* SERVER_ADMIN_H */
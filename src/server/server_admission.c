@@ -0,0 +1,270 @@
+#include "server_admission.h"
+#include "server_client.h"
+#include "server_admin.h"
+#include "server_log.h"
+#include "server_trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+/* A held connection: nothing but the socket and what it was last told */
+typedef struct Waiter {
+    sock_t fd;
+    int told;                   /* Position last sent, 0 = none yet */
+    uint64_t since_us;
+    AdmitFn admit;              /* Backend that takes it once admitted */
+    void *arg;
+} Waiter;
+
+static pthread_mutex_t adm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t adm_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t adm_idle = PTHREAD_COND_INITIALIZER;
+static Waiter *waiters;             /* Oldest first (adm_lock) */
+static int waiting = 0;
+static int capacity = 0;
+static int adm_running = 0;
+static int adm_kicked = 0;          /* A slot freed or a client arrived since the last pass */
+static int adm_held = 0;            /* A handoff froze the queue */
+static int adm_admitting = 0;       /* admit_ready is registering the head */
+static pthread_t adm_tid;
+static unsigned long admitted_total = 0;
+
+static void set_nonblocking(sock_t fd, int on) {
+#ifdef _WIN32
+    u_long mode = on ? 1 : 0;
+    ioctlsocket(fd, FIONBIO, &mode);
+#else
+    int fl = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, on ? fl | O_NONBLOCK : fl & ~O_NONBLOCK);
+#endif
+}
+
+static int would_block(void) {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* The client hung up (held sockets are non-blocking, so this never waits) */
+static int hung_up(sock_t fd) {
+    char b;
+    int n = (int)recv(fd, &b, 1, MSG_PEEK);
+    return n == 0 || (n < 0 && !would_block());
+}
+
+/* Best effort: a client that does not read just misses the update */
+static void tell(sock_t fd, const char *msg) {
+    send(fd, msg, (int)strlen(msg), 0);
+}
+
+static void remove_at(int i) {
+    memmove(&waiters[i], &waiters[i + 1], (size_t)(waiting - i - 1) * sizeof(Waiter));
+    waiting--;
+}
+
+/* Admit from the head of the queue while slots are free. Caller holds adm_lock;
+ * only this thread removes waiters, so the head stays put while it is unlocked */
+static void admit_ready(void) {
+    while (waiting > 0 && adm_running && !adm_held) {
+        Waiter w = waiters[0];
+        adm_admitting = 1;
+        pthread_mutex_unlock(&adm_lock);
+        ClientCtx *ctx = client_register(w.fd);
+        if (ctx) {
+            set_nonblocking(w.fd, 0);
+            admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+            log_event(LOG_INFO, "conn_admitted", "conn=%d waited_ms=%llu", ctx->connection_id,
+                      (unsigned long long)((trace_now_us() - w.since_us) / 1000));
+            if (w.admit) {
+                w.admit(ctx, w.arg);
+            } else {
+                client_start_reader(ctx);
+            }
+        }
+        pthread_mutex_lock(&adm_lock);
+        adm_admitting = 0;
+        pthread_cond_broadcast(&adm_idle);
+        if (!ctx) return;
+        remove_at(0);
+        admitted_total++;
+    }
+}
+
+/* Drop clients that left and send positions that changed (all of them when full) */
+static void update_waiters(int full) {
+    char msg[32];
+    for (int i = 0; i < waiting; i++) {
+        if (hung_up(waiters[i].fd)) {
+            log_event(LOG_INFO, "conn_queue_left", "pos=%d", i + 1);
+            CLOSE(waiters[i].fd);
+            remove_at(i);
+            i--;
+            continue;
+        }
+        if (full || waiters[i].told != i + 1) {
+            waiters[i].told = i + 1;
+            snprintf(msg, sizeof(msg), "QUEUE_POS %d\n", i + 1);
+            tell(waiters[i].fd, msg);
+        }
+    }
+}
+
+static void *admission_thread(void *arg) {
+    (void)arg;
+    uint64_t next_update = trace_now_us() + (uint64_t)ADMISSION_UPDATE_MS * 1000;
+
+    pthread_mutex_lock(&adm_lock);
+    while (adm_running) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)ADMISSION_UPDATE_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        if (!adm_kicked || adm_held) pthread_cond_timedwait(&adm_wake, &adm_lock, &ts);
+        if (!adm_running) break;
+        if (adm_held) continue;
+        adm_kicked = 0;
+
+        admit_ready();
+        uint64_t now = trace_now_us();
+        int full = now >= next_update;
+        update_waiters(full);
+        if (full) next_update = now + (uint64_t)ADMISSION_UPDATE_MS * 1000;
+    }
+    pthread_mutex_unlock(&adm_lock);
+    return NULL;
+}
+
+int admission_start(int max) {
+    if (max <= 0) return 0;
+    waiters = calloc((size_t)max, sizeof(Waiter));
+    if (!waiters) return -1;
+    capacity = max;
+    adm_running = 1;
+    if (pthread_create(&adm_tid, NULL, admission_thread, NULL) != 0) {
+        adm_running = 0;
+        free(waiters);
+        waiters = NULL;
+        capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void admission_stop(void) {
+    if (!adm_running) return;
+    pthread_mutex_lock(&adm_lock);
+    adm_running = 0;
+    pthread_cond_signal(&adm_wake);
+    pthread_mutex_unlock(&adm_lock);
+    pthread_join(adm_tid, NULL);
+
+    for (int i = 0; i < waiting; i++) {
+        tell(waiters[i].fd, "BUSY Server stopping\n");
+        CLOSE(waiters[i].fd);
+    }
+    free(waiters);
+    waiters = NULL;
+    waiting = capacity = 0;
+}
+
+ClientCtx *admission_register(sock_t fd, AdmitFn admit, void *arg, int *held) {
+    *held = 0;
+    pthread_mutex_lock(&adm_lock);
+    int queued = waiting;
+    pthread_mutex_unlock(&adm_lock);
+
+    /* Nobody may overtake the connections already waiting */
+    if (queued == 0) {
+        ClientCtx *ctx = client_register(fd);
+        if (ctx) return ctx;
+    }
+
+    pthread_mutex_lock(&adm_lock);
+    if (adm_running && waiting < capacity) {
+        set_nonblocking(fd, 1);
+        waiters[waiting++] = (Waiter){fd, 0, trace_now_us(), admit, arg};
+        *held = 1;
+        log_event(LOG_INFO, "conn_queued", "pos=%d", waiting);
+        adm_kicked = 1;
+        pthread_cond_signal(&adm_wake);
+    }
+    pthread_mutex_unlock(&adm_lock);
+    return NULL;
+}
+
+int admission_hold(sock_t *fds, uint32_t *waited_ms, int max) {
+    pthread_mutex_lock(&adm_lock);
+    adm_held = 1;
+    while (adm_admitting) pthread_cond_wait(&adm_idle, &adm_lock);
+    uint64_t now = trace_now_us();
+    int n = waiting < max ? waiting : max;
+    for (int i = 0; i < n; i++) {
+        fds[i] = waiters[i].fd;
+        waited_ms[i] = (uint32_t)((now - waiters[i].since_us) / 1000);
+    }
+    pthread_mutex_unlock(&adm_lock);
+    return n;
+}
+
+void admission_release(int handed_off) {
+    pthread_mutex_lock(&adm_lock);
+    if (handed_off) {
+        /* The new process owns the sockets and tells them where they stand */
+        for (int i = 0; i < waiting; i++) CLOSE(waiters[i].fd);
+        waiting = 0;
+    } else {
+        adm_held = 0;
+        adm_kicked = 1;
+        pthread_cond_signal(&adm_wake);
+    }
+    pthread_mutex_unlock(&adm_lock);
+}
+
+int admission_adopt(sock_t fd, uint32_t waited_ms) {
+    pthread_mutex_lock(&adm_lock);
+    int ok = adm_running && waiting < capacity;
+    if (ok) {
+        uint64_t now = trace_now_us(), waited = (uint64_t)waited_ms * 1000;
+        waiters[waiting++] = (Waiter){fd, 0, now > waited ? now - waited : 0, NULL, NULL};
+        adm_kicked = 1;
+        pthread_cond_signal(&adm_wake);
+    }
+    pthread_mutex_unlock(&adm_lock);
+    if (!ok) {
+        tell(fd, "BUSY Server full\n");
+        CLOSE(fd);
+    }
+    return ok ? 0 : -1;
+}
+
+void admission_slot_freed(void) {
+    pthread_mutex_lock(&adm_lock);
+    if (waiting > 0) {
+        adm_kicked = 1;
+        pthread_cond_signal(&adm_wake);
+    }
+    pthread_mutex_unlock(&adm_lock);
+}
+
+int admission_waiting(void) {
+    pthread_mutex_lock(&adm_lock);
+    int n = waiting;
+    pthread_mutex_unlock(&adm_lock);
+    return n;
+}
+
+unsigned long admission_admitted(void) {
+    pthread_mutex_lock(&adm_lock);
+    unsigned long n = admitted_total;
+    pthread_mutex_unlock(&adm_lock);
+    return n;
+}
@@ -0,0 +1,62 @@
+#ifndef SERVER_ADMISSION_H
+#define SERVER_ADMISSION_H
+
+/*
+ * server_admission.h - Waiting room for connections while the server is full
+ *
+ * When every connection slot is taken, a new connection is held instead of
+ * being turned away with BUSY: the queue keeps only its socket and arrival
+ * time, and no reader thread runs for it. One admission thread tells each
+ * waiting client "QUEUE_POS <n>" when it arrives, when its place changes
+ * and every ADMISSION_UPDATE_MS, drops clients that hang up, and admits the
+ * oldest one whenever a slot frees up. Lines a client sends while waiting
+ * stay in the socket and are read once it is admitted.
+ *
+ * An admitted connection goes back to the backend that accepted it: the
+ * acceptor loop or io_uring ring it came from takes it through its inbox,
+ * and the plain accept thread gives it a reader thread. Only when
+ * --admission-queue connections are already waiting is a new one refused
+ * with BUSY.
+ */
+
+#include "server_state.h"
+#include <stdint.h>
+
+#define ADMISSION_UPDATE_MS 2000
+
+/* Start the admission thread; at most max connections wait (0 = never hold) */
+int admission_start(int max);
+
+/* Stop the thread and tell everyone still waiting "BUSY Server stopping" */
+void admission_stop(void);
+
+/* Hands a connection admitted from the queue to the backend that accepted
+ * it (admission thread). NULL gives it a reader thread */
+typedef void (*AdmitFn)(ClientCtx *ctx, void *arg);
+
+/* Take a slot for a new connection, or queue it behind those already
+ * waiting; admit(ctx, arg) takes it once it is admitted from the queue.
+ * Returns the context when admitted straight away; otherwise *held says
+ * whether the queue kept fd (if not, the caller sends BUSY) */
+ClientCtx *admission_register(sock_t fd, AdmitFn admit, void *arg, int *held);
+
+/* Handoff: freeze the queue and store up to max waiting sockets, oldest
+ * first, with how long each has waited. Returns how many were stored */
+int admission_hold(sock_t *fds, uint32_t *waited_ms, int max);
+
+/* End a hold: after a handoff the queue is dropped without telling anyone
+ * (handed_off), otherwise admitting carries on */
+void admission_release(int handed_off);
+
+/* New process: queue a socket handed over from the old one (as if it had
+ * waited waited_ms here). Returns -1 if it was turned away with BUSY */
+int admission_adopt(sock_t fd, uint32_t waited_ms);
+
+/* A connection slot was released (dispatcher) */
+void admission_slot_freed(void);
+
+/* Connections waiting now, and admitted from the queue so far */
+int admission_waiting(void);
+unsigned long admission_admitted(void);
+
+#endif /* SERVER_ADMISSION_H */
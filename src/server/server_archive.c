@@ -0,0 +1,167 @@
+#define _DEFAULT_SOURCE
+#include "server_archive.h"
+#include "server_timer.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#define fsync_file(f) _commit(_fileno(f))
+#define truncate_file(f, len) _chsize(_fileno(f), (long)(len))
+#else
+#include <unistd.h>
+#define fsync_file(f) fsync(fileno(f))
+#define truncate_file(f, len) ftruncate(fileno(f), (off_t)(len))
+#endif
+
+static FILE *archive_file = NULL;
+static pthread_t writer_tid;
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t archive_cond = PTHREAD_COND_INITIALIZER;
+static ArchiveBuilder builder;          /* Finished games not yet written */
+static int writer_running = 0;
+
+/* Game in progress per lobby (dispatcher only) */
+static ArchiveGame games[MAX_LOBBIES];
+static int recording[MAX_LOBBIES];
+static uint64_t started_at[MAX_LOBBIES];
+static uint64_t last_shot_at[MAX_LOBBIES];
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void write_segment(ArchiveBuilder *b) {
+    size_t size;
+    uint8_t *seg = archive_builder_encode(b, &size);
+    if (!seg) return;
+    if (fwrite(seg, 1, size, archive_file) != size || fflush(archive_file) != 0) {
+        fprintf(stderr, "Archive: write failed\n");
+    } else {
+        fsync_file(archive_file);
+    }
+    free(seg);
+}
+
+static void *archive_writer(void *arg) {
+    (void)arg;
+    ArchiveBuilder spare = {0};         /* Keeps the buffers of the last written segment */
+
+    pthread_mutex_lock(&archive_lock);
+    while (writer_running || builder.games > 0) {
+        int rc = 0;
+        if (writer_running && builder.games < ARCHIVE_SEGMENT_GAMES) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += ARCHIVE_FLUSH_MS / 1000;
+            rc = pthread_cond_timedwait(&archive_cond, &archive_lock, &ts);
+        }
+        if (builder.games == 0) continue;
+        if (writer_running && builder.games < ARCHIVE_SEGMENT_GAMES && rc != ETIMEDOUT) continue;
+
+        /* Swap builders so games keep arriving while we encode */
+        ArchiveBuilder full = builder;
+        builder = spare;
+        pthread_mutex_unlock(&archive_lock);
+
+        write_segment(&full);
+        spare = full;
+
+        pthread_mutex_lock(&archive_lock);
+    }
+    pthread_mutex_unlock(&archive_lock);
+    archive_builder_free(&spare);
+    return NULL;
+}
+
+int archive_open(const char *path) {
+    MappedFile mf;
+    size_t keep = 0;
+
+    if (!path || !path[0]) return 0;
+
+    /* Drop a segment torn by a crash so new ones follow intact data */
+    if (mapped_file_open(&mf, path) == 0) {
+        keep = archive_valid_length(mf.data, mf.size);
+        if (keep < mf.size) {
+            fprintf(stderr, "Archive: dropping %zu bytes of torn data\n", mf.size - keep);
+        }
+        mapped_file_close(&mf);
+    }
+    archive_file = fopen(path, "ab");
+    if (!archive_file) return -1;
+    if (truncate_file(archive_file, keep) != 0) {
+        fclose(archive_file);
+        archive_file = NULL;
+        return -1;
+    }
+
+    writer_running = 1;
+    if (pthread_create(&writer_tid, NULL, archive_writer, NULL) != 0) {
+        fclose(archive_file);
+        archive_file = NULL;
+        writer_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void archive_close(void) {
+    if (!archive_file) return;
+
+    pthread_mutex_lock(&archive_lock);
+    writer_running = 0;
+    pthread_cond_signal(&archive_cond);
+    pthread_mutex_unlock(&archive_lock);
+    pthread_join(writer_tid, NULL);
+
+    fclose(archive_file);
+    archive_file = NULL;
+    archive_builder_free(&builder);
+}
+
+void archive_game_started(GameLobby *l) {
+    if (!archive_file) return;
+    ArchiveGame *g = &games[l->id];
+
+    g->start_ms = wall_ms();
+    g->nshots = 0;
+    for (int seat = 0; seat < MAX_PLAYERS_PER_GAME; seat++) {
+        for (int i = 0; i < ARCHIVE_SHIPS; i++) g->ships[seat][i] = l->game_state->ships[seat][i + 1];
+    }
+    started_at[l->id] = last_shot_at[l->id] = timers_now_ms();
+    recording[l->id] = 1;
+}
+
+void archive_shot(GameLobby *l, int seat, int r, int c, int hit) {
+    if (!recording[l->id]) return;
+    ArchiveGame *g = &games[l->id];
+    uint64_t now = timers_now_ms();
+
+    if (g->nshots >= ARCHIVE_MAX_SHOTS) return;
+    g->shot[g->nshots] = ARCHIVE_SHOT(seat, r, c, hit != 0);
+    g->shot_dt[g->nshots] = (uint32_t)(now - last_shot_at[l->id]);
+    g->nshots++;
+    last_shot_at[l->id] = now;
+}
+
+void archive_game_over(GameLobby *l, int winner, int reason) {
+    if (!recording[l->id]) return;
+    ArchiveGame *g = &games[l->id];
+    recording[l->id] = 0;
+
+    g->duration_ms = (uint32_t)(timers_now_ms() - started_at[l->id]);
+    g->winner = (uint8_t)winner;
+    g->reason = (uint8_t)reason;
+
+    pthread_mutex_lock(&archive_lock);
+    if (archive_builder_add(&builder, g) != 0) fprintf(stderr, "Archive: out of memory, game dropped\n");
+    if (builder.games >= ARCHIVE_SEGMENT_GAMES) pthread_cond_signal(&archive_cond);
+    pthread_mutex_unlock(&archive_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef SERVER_ARCHIVE_H
+#define SERVER_ARCHIVE_H
+
+/*
+ * server_archive.h - Append finished games to the game archive
+ *
+ * With --archive every game that ends in a sinking or a forfeit is recorded:
+ * both fleets, each shot with its result and timing, the duration and the
+ * winner. The dispatcher appends the finished game to an in-memory segment
+ * builder; a writer thread encodes a segment (see game_archive.h) and
+ * appends it to the file every ARCHIVE_SEGMENT_GAMES games, after
+ * ARCHIVE_FLUSH_MS, and on shutdown. Abandoned games and games restored
+ * from a snapshot or the journal mid-play are not recorded.
+ */
+
+#include "server_state.h"
+#include "game_archive.h"
+
+#define ARCHIVE_SEGMENT_GAMES 4096
+#define ARCHIVE_FLUSH_MS 60000
+
+/* Open path for appending (a torn segment at the end is cut off) and start
+ * the writer. NULL or "" disables the archive. Returns 0 on success */
+int archive_open(const char *path);
+
+/* Write the remaining games and close the file */
+void archive_close(void);
+
+/* Both players in lobby l are ready: start recording their game */
+void archive_game_started(GameLobby *l);
+
+/* seat fired at (r, c) */
+void archive_shot(GameLobby *l, int seat, int r, int c, int hit);
+
+/* The game in lobby l was decided (reason is ARCHIVE_END_*) */
+void archive_game_over(GameLobby *l, int winner, int reason);
+
+#endif /* SERVER_ARCHIVE_H */
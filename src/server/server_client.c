@@ -1,58 +1,161 @@
 #include "server_client.h"
 #include "server_message.h"
+#include "server_handoff.h"
+#include "server_store.h"
+#include "server_quota.h"
 #include "common.h"
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
 
-void *client_reader(void *arg) {
-    ClientCtx *ctx = arg;
-    char buf[4096];
-    size_t buf_len = 0;
-    ssize_t n;
+/* Block until fd has data (or an error to report). Returns 0 if the reader
+ * should stop because the connection is being handed to another process. */
+static int wait_readable(sock_t fd) {
+#ifndef _WIN32
+    int wake = handoff_wake_fd();
+    if (wake < 0) return 1;
+
+    struct pollfd p[2] = {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+    for (;;) {
+        if (handoff_in_progress()) return 0;
+        int r = poll(p, 2, -1);
+        if (r < 0) continue;
+        if (p[1].revents) return 0;
+        if (p[0].revents) return 1;
+    }
+#else
+    (void)fd;
+    return 1;
+#endif
+}
+
+/* Case-insensitive "line starts with word" (word in upper case) */
+/* Read-only queries are looked up here on the reader, so the store is never
+ * read on the dispatcher. The reader does not own the fd (and a gateway reader
+ * holds gw_lock), so the finished reply goes to the dispatcher as "REPLY\n"
+ * followed by the text to send. Returns 1 if line was one of them */
+static int answer_query(ClientCtx *ctx, const char *line) {
+    char buf[2048];
+    const size_t pfx = 6;
+    int n;
+
+    memcpy(buf, "REPLY\n", pfx);
+    if (starts_with(line, "LEADERBOARD")) {
+        n = store_format_leaderboard(buf + pfx, sizeof(buf) - pfx);
+    } else if (starts_with(line, "STATS ") && line[6]) {
+        n = store_format_stats(line + 6, buf + pfx, sizeof(buf) - pfx);
+    } else {
+        return 0;
+    }
+    /* Replies end in a newline, so the dispatcher tells this from a client line */
+    if (n <= 0 || buf[pfx + (size_t)n - 1] != '\n') return 1;
+
+    char *m = strdup(buf);
+    if (m) enqueue_msg(m, ctx->connection_id);
+    return 1;
+}
+
+/* Apply the quota to line. Returns 1 if it may be queued; otherwise queues
+ * the notice or disconnection for the dispatcher */
+static int admit_line(ClientCtx *ctx, const char *line) {
+    int notify;
+    int verdict = quota_admit(&ctx->quota, line, &notify);
+    if (verdict == QUOTA_ACCEPT) return 1;
+
+    char *m = NULL;
+    if (verdict == QUOTA_DISCONNECT) m = strdup("ABUSE\n");
+    else if (notify) m = strdup("RATE_LIMITED\n");
+    if (m) enqueue_msg(m, ctx->connection_id);
+    return 0;
+}
+
+/* Queue an admitted line, giving its share back if the copy fails */
+static void queue_line(ClientCtx *ctx, const char *line, MsgTrace *tr) {
+    char *m = strdup(line);
+    if (m) {
+        /* The dispatcher may be seating or unseating ctx; a stale answer only affects priority */
+        enqueue_msg_traced(m, ctx->connection_id, ctx->lobby != NULL, tr);
+    } else {
+        free(tr);
+        quota_release(&ctx->quota);
+    }
+}
+
+void client_consume_input(ClientCtx *ctx, size_t n) {
+    char *buf = ctx->rbuf;
+    size_t buf_len = ctx->rbuf_len + n;
+    buf[buf_len] = '\0';
+    uint64_t t_read = trace_enabled() ? trace_now_us() : 0;
     
-    while ((n = READ(ctx->fd, buf + buf_len, sizeof(buf) - 1 - buf_len)) > 0) {
-        buf_len += n;
-        buf[buf_len] = '\0';
-        
-        char *start = buf;
-        char *newline;
+    char *start = buf;
+    char *newline;
+    
+    while ((newline = strchr(start, '\n')) != NULL) {
+        *newline = '\0';
         
-        while ((newline = strchr(start, '\n')) != NULL) {
-            *newline = '\0';
-            
-            /* Handle optional \r before \n */
-            if (newline > start && *(newline - 1) == '\r') {
-                *(newline - 1) = '\0';
-            }
-            
-            /* Only enqueue non-empty lines */
-            if (strlen(start) > 0) {
-                char *m = strdup(start);
-                if (m) enqueue_msg(m, ctx->connection_id);
-            }
-            
-            start = newline + 1;
+        /* Handle optional \r before \n */
+        if (newline > start && *(newline - 1) == '\r') {
+            *(newline - 1) = '\0';
         }
         
-        /* Move remaining data to front */
-        size_t remaining = buf + buf_len - start;
-        if (remaining > 0 && start > buf) {
-            memmove(buf, start, remaining);
+        /* Only enqueue non-empty lines, and only those the quota admits */
+        if (start[0] && admit_line(ctx, start)) {
+            if (answer_query(ctx, start)) quota_release(&ctx->quota);
+            else queue_line(ctx, start, t_read ? trace_start(ctx->connection_id, t_read) : NULL);
         }
-        buf_len = remaining;
         
-        /* Buffer full protection */
-        if (buf_len >= sizeof(buf) - 1) {
-            buf[buf_len] = '\0';
-            char *m = strdup(buf);
-            if (m) enqueue_msg(m, ctx->connection_id);
-            buf_len = 0;
+        start = newline + 1;
+    }
+    
+    /* Move remaining data to front */
+    size_t remaining = buf + buf_len - start;
+    if (remaining > 0 && start > buf) {
+        memmove(buf, start, remaining);
+    }
+    buf_len = remaining;
+    
+    /* Buffer full protection */
+    if (buf_len >= sizeof(ctx->rbuf) - 1) {
+        buf[buf_len] = '\0';
+        if (admit_line(ctx, buf)) queue_line(ctx, buf, NULL);
+        buf_len = 0;
+    }
+    ctx->rbuf_len = buf_len;
+}
+
+void client_feed(ClientCtx *ctx, const char *data, size_t n) {
+    while (n > 0) {
+        size_t space = sizeof(ctx->rbuf) - 1 - ctx->rbuf_len;
+        size_t chunk = n < space ? n : space;
+        memcpy(ctx->rbuf + ctx->rbuf_len, data, chunk);
+        client_consume_input(ctx, chunk);
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+void *client_reader(void *arg) {
+    ClientCtx *ctx = arg;
+    int parked = 0;
+    
+    while (1) {
+        if (!wait_readable(ctx->fd)) {
+            parked = 1;
+            break;
         }
+        /* Partial lines live in ctx so a handoff can carry them over */
+        ssize_t n = READ(ctx->fd, ctx->rbuf + ctx->rbuf_len, sizeof(ctx->rbuf) - 1 - ctx->rbuf_len);
+        if (n <= 0) break;
+        client_consume_input(ctx, (size_t)n);
     }
     
     /* Client disconnected or read error - inform main loop */
-    char *disc = strdup("DISCONNECT\n");
-    if (disc) enqueue_msg(disc, ctx->connection_id);
+    if (!parked) {
+        char *disc = strdup("DISCONNECT\n");
+        if (disc) enqueue_msg(disc, ctx->connection_id);
+    }
     /* Do NOT close fd here, let main thread handle it via handle_disconnect */
     /* CLOSE(ctx->fd); */
     
@@ -72,3 +175,59 @@ void *client_reader(void *arg) {
     return NULL;
 }
 
+ClientCtx *client_register(sock_t fd) {
+    ClientCtx *ctx = NULL;
+
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_global_state->connections[i] == SOCKET_INVALID) {
+            ctx = calloc(1, sizeof(ClientCtx));
+            if (!ctx) break;
+            ctx->fd = fd;
+            ctx->connection_id = i;
+            ctx->player_id_in_game = -1;
+            ctx->lobby = NULL;
+
+            g_global_state->connections[i] = fd;
+            g_global_state->client_contexts[i] = ctx;
+            g_global_state->active_connections++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+    if (ctx) client_announce(ctx);
+    return ctx;
+}
+
+void client_announce(ClientCtx *ctx) {
+    char *m = strdup("CONNECTED\n");
+    if (m) enqueue_msg(m, ctx->connection_id);
+}
+
+int client_start_reader(ClientCtx *ctx) {
+    return client_start_thread(ctx, client_reader);
+}
+
+int client_start_thread(ClientCtx *ctx, void *(*fn)(void *)) {
+    pthread_t th;
+    pthread_mutex_lock(&g_global_state->lock);
+    g_global_state->active_threads++;
+    pthread_mutex_unlock(&g_global_state->lock);
+
+    if (pthread_create(&th, NULL, fn, ctx) != 0) {
+        pthread_mutex_lock(&g_global_state->lock);
+        g_global_state->active_threads--;
+        pthread_mutex_unlock(&g_global_state->lock);
+        return -1;
+    }
+    pthread_detach(th);
+    return 0;
+}
+
+ClientCtx *client_find_fd(sock_t fd) {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        ClientCtx *ctx = g_global_state->client_contexts[i];
+        if (ctx && ctx->fd == fd) return ctx;
+    }
+    return NULL;
+}
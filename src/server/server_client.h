@@ -7,4 +7,28 @@
 /* Client reader thread - reads from client socket and enqueues messages */
 void *client_reader(void *arg);
 
+/* Split the n bytes just read into ctx->rbuf (after rbuf_len) into lines and
+ * enqueue them; an incomplete last line stays buffered */
+void client_consume_input(ClientCtx *ctx, size_t n);
+
+/* Same as client_consume_input for bytes that were read somewhere else */
+void client_feed(ClientCtx *ctx, const char *data, size_t n);
+
+/* Take a free connection slot for fd and create its context. NULL if the server is full */
+ClientCtx *client_register(sock_t fd);
+
+/* Tell the dispatcher about a new connection (client_register does this) */
+void client_announce(ClientCtx *ctx);
+
+/* Start a detached reader thread for ctx and count it in active_threads.
+ * Takes g_global_state->lock, so callers must not hold it. */
+int client_start_reader(ClientCtx *ctx);
+
+/* Same as client_start_reader with a different reader function (e.g. a WebSocket reader).
+ * fn must decrement active_threads when it returns. */
+int client_start_thread(ClientCtx *ctx, void *(*fn)(void *));
+
+/* Find the context that owns fd (NULL if none). Call from the dispatcher */
+ClientCtx *client_find_fd(sock_t fd);
+
 #endif /* SERVER_CLIENT_H */
@@ -0,0 +1,284 @@
+#include "server_clock.h"
+#include "server_commands.h"
+#include "server_message.h"
+#include "server_journal.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_tourney.h"
+#include "server_store.h"
+#include "server_archive.h"
+#include "server_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int default_turn_s = 0;
+static int default_placement_s = 0;
+
+static const char *phase_names[] = { "IDLE", "PLACE", "TURN" };
+
+void clock_configure(int turn_s, int placement_s) {
+    default_turn_s = turn_s > 0 ? (turn_s < CLOCK_MAX_S ? turn_s : CLOCK_MAX_S) : 0;
+    default_placement_s = placement_s > 0 ? (placement_s < CLOCK_MAX_S ? placement_s : CLOCK_MAX_S) : 0;
+    srand((unsigned)time(NULL));
+}
+
+static void broadcast(GameLobby *l, const char *msg, int len) {
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (l->clients[i] != SOCKET_INVALID) server_send(l->clients[i], msg, len);
+    }
+}
+
+/* Seat the running clock belongs to, -1 for placement (both seats) */
+static int clock_seat(GameLobby *l) {
+    return l->clock_phase == CLOCK_TURN ? l->game_state->current_turn : -1;
+}
+
+static int seconds_left(GameLobby *l) {
+    uint64_t now = timers_now_ms();
+    return l->clock_deadline_ms > now ? (int)((l->clock_deadline_ms - now + 999) / 1000) : 0;
+}
+
+static void send_timer(GameLobby *l, sock_t fd) {
+    char msg[48];
+    int n = snprintf(msg, sizeof(msg), "TIMER %s %d %d\n",
+                     phase_names[l->clock_phase], clock_seat(l), seconds_left(l));
+    if (fd == SOCKET_INVALID) {
+        broadcast(l, msg, n);
+    } else {
+        server_send(fd, msg, n);
+    }
+}
+
+static void start_clock(GameLobby *l, ClockPhase phase, int limit_s) {
+    timer_cancel(&l->clock);
+    l->clock_phase = limit_s > 0 ? phase : CLOCK_IDLE;
+    if (l->clock_phase == CLOCK_IDLE) return;
+
+    uint64_t limit_ms = (uint64_t)limit_s * 1000;
+    l->clock_deadline_ms = timers_now_ms() + limit_ms;
+    /* Short clocks get no separate reminder */
+    l->clock_warned = limit_s <= CLOCK_WARN_S;
+    timer_schedule(&l->clock, l->clock_warned ? limit_ms : limit_ms - CLOCK_WARN_S * 1000);
+    send_timer(l, SOCKET_INVALID);
+}
+
+/* Take seat out of the game for good: the opponent wins and the seat is freed.
+ * l may be destroyed when this returns. */
+static void forfeit(GameLobby *l, int seat) {
+    int other = seat ^ 1;
+    char msg[32];
+    int n;
+
+    clock_stop(l);
+    log_event(LOG_INFO, "forfeit", "lobby=%d seat=%d timeouts=%d", l->id, seat, l->timeouts[seat]);
+
+    n = snprintf(msg, sizeof(msg), "FORFEIT %d\n", seat);
+    broadcast(l, msg, n);
+    spectate_event(l, SPEC_ALL, "SPEC_FORFEIT %d\n", seat);
+    spectate_game_over(l, other);
+    if (l->clients[other] != SOCKET_INVALID) {
+        n = snprintf(msg, sizeof(msg), "WIN %d\n", other);
+        server_send(l->clients[other], msg, n);
+    }
+    store_game_over(l, other);
+    archive_game_over(l, other, ARCHIVE_END_FORFEIT);
+    tourney_game_over(l, other);
+    if (l->clients[seat] != SOCKET_INVALID) {
+        n = snprintf(msg, sizeof(msg), "LOSE %d\n", seat);
+        server_send(l->clients[seat], msg, n);
+        /* The reader's EOF DISCONNECT releases the seat like any other leave */
+        resume_revoke(l, seat);
+        server_shutdown_client(l->clients[seat]);
+        return;
+    }
+
+    /* A detached seat has no connection to close: release it here */
+    resume_release_seat(l, seat);
+}
+
+/* Run a command as if seat had sent it, journal included */
+static void act_for(GameLobby *l, int seat, const char *cmd) {
+    journal_game_command(l->id, seat, cmd);
+    if (strncmp(cmd, "PLACE ", 6) == 0) {
+        handle_place_command(l, cmd, seat);
+    } else if (strncmp(cmd, "FIRE ", 5) == 0) {
+        handle_fire_command(l, cmd, seat);
+    } else if (strcmp(cmd, "READY") == 0) {
+        handle_ready_command(l, seat);
+    }
+}
+
+static int fits(Grid *g, int r, int c, int len, char dir) {
+    int dr = dir == 'V', dc = dir == 'H';
+    for (int i = 0; i < len; i++) {
+        int rr = r + i * dr, cc = c + i * dc;
+        unsigned char cell = CELL_EMPTY;
+        if (rr >= GRID_ROWS || cc >= GRID_COLS) return 0;
+        grid_get(g, rr, cc, &cell);
+        if (cell != CELL_EMPTY) return 0;
+    }
+    return 1;
+}
+
+/* Place whatever seat has not placed yet at random, then mark it ready */
+static void auto_place(GameLobby *l, int seat) {
+    GameState *gs = l->game_state;
+    char cmd[64];
+
+    for (int len = 5; len >= 2; len--) {
+        for (int tries = 0; gs->remaining[seat][len] > 0 && tries < 1000; tries++) {
+            char dir = (rand() & 1) ? 'V' : 'H';
+            int r = rand() % GRID_ROWS, c = rand() % GRID_COLS;
+            if (!fits(gs->grids[seat], r, c, len, dir)) continue;
+            snprintf(cmd, sizeof(cmd), "PLACE %d %d %d %c", r, c, len, dir);
+            act_for(l, seat, cmd);
+        }
+    }
+    if (gs->placed_count[seat] == 5 && !gs->ready[seat]) act_for(l, seat, "READY");
+}
+
+/* Fire for seat at a random cell it has not fired at yet */
+static void auto_fire(GameLobby *l, int seat) {
+    Grid *g = l->game_state->grids[seat ^ 1];
+    int open = 0;
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            unsigned char cell = CELL_EMPTY;
+            grid_get(g, r, c, &cell);
+            if (cell != CELL_HIT && cell != CELL_MISS) open++;
+        }
+    }
+    if (open == 0) return;
+
+    int pick = rand() % open;
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            unsigned char cell = CELL_EMPTY;
+            grid_get(g, r, c, &cell);
+            if (cell == CELL_HIT || cell == CELL_MISS || pick-- > 0) continue;
+            char cmd[32];
+            snprintf(cmd, sizeof(cmd), "FIRE %d %d", r, c);
+            act_for(l, seat, cmd);
+            return;
+        }
+    }
+}
+
+/* Count a timeout for seat. Returns 1 if that forfeited the game */
+static int timed_out(GameLobby *l, int seat) {
+    char msg[32];
+    int count = ++l->timeouts[seat];
+    int n = snprintf(msg, sizeof(msg), "TIMEOUT %d %d\n", seat, count);
+    broadcast(l, msg, n);
+    if (count < CLOCK_FORFEIT_TIMEOUTS) return 0;
+    forfeit(l, seat);
+    return 1;
+}
+
+static void clock_due(TimerNode *t) {
+    GameLobby *l = TIMER_OWNER(t, GameLobby, clock);
+    uint64_t now = timers_now_ms();
+
+    if (!l->clock_warned) {
+        l->clock_warned = 1;
+        send_timer(l, SOCKET_INVALID);
+        timer_schedule(&l->clock, l->clock_deadline_ms > now ? l->clock_deadline_ms - now : 0);
+        return;
+    }
+
+    ClockPhase phase = (ClockPhase)l->clock_phase;
+    l->clock_phase = CLOCK_IDLE;
+
+    if (phase == CLOCK_PLACEMENT) {
+        int late[MAX_PLAYERS_PER_GAME];
+        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) late[i] = !l->game_state->ready[i];
+        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+            if (late[i] && timed_out(l, i)) return;
+        }
+        /* The second READY starts the turn clock */
+        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+            if (late[i]) auto_place(l, i);
+        }
+    } else if (phase == CLOCK_TURN) {
+        int seat = l->game_state->current_turn;
+        if (timed_out(l, seat)) return;
+        /* handle_fire_command restarts the clock for whoever moves next */
+        auto_fire(l, seat);
+    }
+}
+
+void clock_init_lobby(GameLobby *l) {
+    timer_init(&l->clock, clock_due);
+    l->clock_phase = CLOCK_IDLE;
+    l->turn_time = default_turn_s;
+    l->placement_time = default_placement_s;
+}
+
+void clock_placement_started(GameLobby *l) {
+    start_clock(l, CLOCK_PLACEMENT, l->placement_time);
+}
+
+void clock_turn_started(GameLobby *l) {
+    start_clock(l, CLOCK_TURN, l->turn_time);
+}
+
+void clock_stop(GameLobby *l) {
+    timer_cancel(&l->clock);
+    l->clock_phase = CLOCK_IDLE;
+}
+
+void clock_player_acted(GameLobby *l, int seat) {
+    l->timeouts[seat] = 0;
+}
+
+static int valid_limit(int s) {
+    return s == 0 || (s >= CLOCK_MIN_S && s <= CLOCK_MAX_S);
+}
+
+void clock_set(GameLobby *l, int seat, int turn_s, int placement_s) {
+    const char *fail = NULL;
+    int other = seat ^ 1;
+    if (!valid_limit(turn_s) || !valid_limit(placement_s)) {
+        fail = "CLOCK_FAIL Limits must be 0 or 5-3600 seconds\n";
+    } else if (l->clients[other] != SOCKET_INVALID || l->detached[other]) {
+        /* The opponent joined on the limits it was shown */
+        fail = "CLOCK_FAIL Opponent already joined\n";
+    }
+    if (fail) {
+        server_send(l->clients[seat], fail, (int)strlen(fail));
+        return;
+    }
+
+    l->turn_time = turn_s;
+    l->placement_time = placement_s;
+    unsigned char p[4] = {(unsigned char)turn_s, (unsigned char)(turn_s >> 8),
+                          (unsigned char)placement_s, (unsigned char)(placement_s >> 8)};
+    journal_append(JE_CLOCK, l->id, seat, p, sizeof(p));
+
+    char msg[48];
+    int n = snprintf(msg, sizeof(msg), "CLOCK %d %d\n", turn_s, placement_s);
+    broadcast(l, msg, n);
+}
+
+void clock_send_state(GameLobby *l, int seat) {
+    sock_t fd = l->clients[seat];
+    if (fd == SOCKET_INVALID) return;
+
+    char msg[48];
+    int n = snprintf(msg, sizeof(msg), "CLOCK %d %d\n", l->turn_time, l->placement_time);
+    server_send(fd, msg, n);
+    if (l->clock_phase != CLOCK_IDLE) send_timer(l, fd);
+}
+
+void clock_resume(GameLobby *l) {
+    GameState *gs = l->game_state;
+    if (l->names[0][0] == '\0' || l->names[1][0] == '\0') return;
+
+    if (!gs->ready[0] || !gs->ready[1]) {
+        clock_placement_started(l);
+    } else if (grid_has_ships(gs->grids[0]) && grid_has_ships(gs->grids[1])) {
+        clock_turn_started(l);
+    }
+}
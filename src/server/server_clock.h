@@ -0,0 +1,59 @@
+#ifndef SERVER_CLOCK_H
+#define SERVER_CLOCK_H
+
+/*
+ * server_clock.h - Placement deadlines and turn clocks
+ *
+ * Every lobby carries its own limits (server defaults, changed with
+ * "CLOCK <turn_s> <placement_s>" by the first player before an opponent
+ * joins, so the opponent sees the limits it agrees to). When placement runs
+ * out, unplaced ships are placed at random and the player is marked ready;
+ * when a turn runs out the server fires at a random open cell for the
+ * player. Each expiry is a timeout for that seat, and CLOCK_FORFEIT_TIMEOUTS
+ * in a row forfeit the game and free the seat. Clients see
+ * "TIMER <PLACE|TURN> <seat> <seconds>" when a clock starts and again
+ * shortly before it runs out, and "TIMEOUT <seat> <count>" on expiry.
+ * Everything here runs on the dispatcher thread.
+ */
+
+#include "server_state.h"
+
+#define CLOCK_FORFEIT_TIMEOUTS 3
+#define CLOCK_WARN_S 10         /* Remind the player this many seconds before expiry */
+#define CLOCK_MIN_S 5           /* Shortest limit other than 0 (no clock) */
+#define CLOCK_MAX_S 3600
+
+typedef enum ClockPhase {
+    CLOCK_IDLE = 0,
+    CLOCK_PLACEMENT,
+    CLOCK_TURN
+} ClockPhase;
+
+/* Default limits for new lobbies, in seconds (0 = no clock) */
+void clock_configure(int turn_s, int placement_s);
+
+/* Give a new lobby the default limits */
+void clock_init_lobby(GameLobby *l);
+
+/* Placement just started for both seats */
+void clock_placement_started(GameLobby *l);
+
+/* It is now current_turn's move */
+void clock_turn_started(GameLobby *l);
+
+/* The game ended or was reset */
+void clock_stop(GameLobby *l);
+
+/* seat made a game move itself, so its timeouts no longer run in a row */
+void clock_player_acted(GameLobby *l, int seat);
+
+/* CLOCK command from seat: change the lobby's limits while seat is alone in it */
+void clock_set(GameLobby *l, int seat, int turn_s, int placement_s);
+
+/* Tell seat the lobby's limits and any running clock (join, reattach) */
+void clock_send_state(GameLobby *l, int seat);
+
+/* Restart the right clock for a lobby restored mid-game (snapshot, takeover) */
+void clock_resume(GameLobby *l);
+
+#endif /* SERVER_CLOCK_H */
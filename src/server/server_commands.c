@@ -1,11 +1,46 @@
 #include "server_commands.h"
 #include "server_message.h"
+#include "server_clock.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_tourney.h"
+#include "server_match.h"
+#include "server_store.h"
+#include "server_archive.h"
+#include "server_journal.h"
+#include "server_log.h"
 #include "common.h"
 #include "game.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* View hash of seat's board and its shots, see view_cell_key */
+static uint32_t seat_view_hash(GameState *gs, int seat) {
+    uint32_t h = 0;
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            unsigned char own = CELL_EMPTY, opp = CELL_EMPTY;
+            grid_get(gs->grids[seat], r, c, &own);
+            grid_get(gs->grids[seat ^ 1], r, c, &opp);
+            h ^= view_cell_key(VIEW_OWN, r, c, own) ^ view_cell_key(VIEW_OPP, r, c, opp);
+        }
+    }
+    return h;
+}
+
+/* TURN <current> <view hash>; the hash differs per seat */
+static void send_turn(ServerState *state) {
+    char tmsg[32];
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (state->clients[i] == SOCKET_INVALID) continue;
+        int n = snprintf(tmsg, sizeof(tmsg), "TURN %d %08x\n", state->game_state->current_turn,
+                         (unsigned)seat_view_hash(state->game_state, i));
+        server_send(state->clients[i], tmsg, n);
+    }
+    spectate_event(state, SPEC_ALL, "SPEC_TURN %d\n", state->game_state->current_turn);
+}
+
 void handle_name_command(ServerState *state, const char *msg, int sender) {
     char namebuf[64];
     if (sscanf(msg, "NAME %63[^\r\n]", namebuf) != 1) return;
@@ -18,7 +53,7 @@ void handle_name_command(ServerState *state, const char *msg, int sender) {
     int nl = snprintf(nmmsg, sizeof(nmmsg), "NAME %d %s\n", sender, state->names[sender]);
     for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
         if (state->clients[i] != SOCKET_INVALID) {
-            WRITE(state->clients[i], nmmsg, nl);
+            server_send(state->clients[i], nmmsg, nl);
         }
     }
     
@@ -27,11 +62,13 @@ void handle_name_command(ServerState *state, const char *msg, int sender) {
     if (state->names[other][0] != '\0' && state->clients[sender] != SOCKET_INVALID) {
         char other_nm_msg[128];
         int onl = snprintf(other_nm_msg, sizeof(other_nm_msg), "NAME %d %s\n", other, state->names[other]);
-        WRITE(state->clients[sender], other_nm_msg, onl);
+        server_send(state->clients[sender], other_nm_msg, onl);
     }
+    spectate_notice(state, "SPEC_NAME %d %s\n", sender, state->names[sender]);
     
     /* If both players have names, start placement phase */
     if (state->names[0][0] != '\0' && state->names[1][0] != '\0') {
+        spectate_reset(state);
         /* Reset ship tracking and clear grids for new game */
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             /* Destroy and recreate grids to clear old data */
@@ -48,6 +85,7 @@ void handle_name_command(ServerState *state, const char *msg, int sender) {
             for (int j = 0; j < 6; j++) {
                 state->game_state->remaining[i][j] = allowed_init[j];
                 state->game_state->ship_lengths[i][j] = 0;
+                memset(&state->game_state->ships[i][j], 0, sizeof(Ship));
             }
         }
         state->game_state->current_turn = 0;
@@ -55,9 +93,10 @@ void handle_name_command(ServerState *state, const char *msg, int sender) {
         const char *pmsg = "START_PLACEMENT 2 3 3 4 5\n";
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], pmsg, (int)strlen(pmsg));
+                server_send(state->clients[i], pmsg, (int)strlen(pmsg));
             }
         }
+        clock_placement_started(state);
     }
 }
 
@@ -88,27 +127,28 @@ void handle_place_command(ServerState *state, const char *msg, int sender) {
             state->game_state->remaining[sender][len]--;
             state->game_state->placed_count[sender]++;
             
-            /* Store ship length for tracking */
+            /* Store ship length and position for tracking */
             state->game_state->ship_lengths[sender][ship_id] = len;
+            state->game_state->ships[sender][ship_id] = s;
             
             /* Send ship info to client so they can display ship lengths */
             char shipinfo[64];
             snprintf(shipinfo, sizeof(shipinfo), "SHIP_INFO %d %d %d\n", r, c, len);
-            WRITE(state->clients[sender], shipinfo, strlen(shipinfo));
+            server_send(state->clients[sender], shipinfo, strlen(shipinfo));
         }
     }
     
     /* Send result to sender */
     char resp[128];
     snprintf(resp, sizeof(resp), "PLACED %d %d %d %c %d\n", r, c, len, dir, ok);
-    WRITE(state->clients[sender], resp, strlen(resp));
+    server_send(state->clients[sender], resp, strlen(resp));
     
     /* Notify both clients on successful placement */
     if (ok) {
         snprintf(resp, sizeof(resp), "PLAYER %d PLACED %d\n", sender, len);
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], resp, strlen(resp));
+                server_send(state->clients[i], resp, strlen(resp));
             }
         }
     }
@@ -119,7 +159,7 @@ void handle_place_command(ServerState *state, const char *msg, int sender) {
                       sender, state->game_state->remaining[sender][2], state->game_state->remaining[sender][3],
                       state->game_state->remaining[sender][4], state->game_state->remaining[sender][5]);
     if (state->clients[sender] != SOCKET_INVALID) {
-        WRITE(state->clients[sender], remmsg, rl);
+        server_send(state->clients[sender], remmsg, rl);
     }
     
     /* Notify both clients when a player finishes placement */
@@ -128,20 +168,20 @@ void handle_place_command(ServerState *state, const char *msg, int sender) {
         snprintf(allmsg, sizeof(allmsg), "ALL_PLACED %d\n", sender);
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], allmsg, strlen(allmsg));
+                server_send(state->clients[i], allmsg, strlen(allmsg));
             }
         }
         
         /* Prompt to use READY command */
         const char *readymsg = "All ships placed. Type READY when you're ready to start.\n";
-        WRITE(state->clients[sender], readymsg, strlen(readymsg));
+        server_send(state->clients[sender], readymsg, strlen(readymsg));
     }
 }
 
 void handle_move_command(ServerState *state, const char *msg, int sender) {
     /* Only allow moves before the game starts (before both players are ready) */
     if (state->game_state->ready[0] && state->game_state->ready[1]) {
-        WRITE(state->clients[sender], "MOVE_FAIL Cannot move ships during an active game\n", 50);
+        server_send(state->clients[sender], "MOVE_FAIL Cannot move ships during an active game\n", 50);
         return;
     }
     
@@ -160,7 +200,7 @@ void handle_move_command(ServerState *state, const char *msg, int sender) {
     
     /* Add space before %c to skip whitespace */
     if (sscanf(um, "MOVE %d %d %d %d %c", &from_r, &from_c, &to_r, &to_c, &dir) < 4) {
-        WRITE(state->clients[sender], "INVALID MOVE format\n", 20);
+        server_send(state->clients[sender], "INVALID MOVE format\n", 20);
         return;
     }
     
@@ -170,7 +210,7 @@ void handle_move_command(ServerState *state, const char *msg, int sender) {
     unsigned char from_cell = 0;
     grid_get(g, from_r, from_c, &from_cell);
     if (from_cell == 0) {
-        WRITE(state->clients[sender], "MOVE_FAIL No ship at source location\n", 38);
+        server_send(state->clients[sender], "MOVE_FAIL No ship at source location\n", 38);
         return;
     }
     
@@ -255,10 +295,11 @@ void handle_move_command(ServerState *state, const char *msg, int sender) {
     if (ok) {
         state->game_state->remaining[sender][ship_len]--;
         state->game_state->placed_count[sender]++;
+        if (ship_val >= 1 && ship_val <= 5) state->game_state->ships[sender][ship_val] = s;
         
         char resp[128];
         snprintf(resp, sizeof(resp), "MOVE_OK %d %d %d %d %c\n", from_r, from_c, to_r, to_c, dir);
-        WRITE(state->clients[sender], resp, strlen(resp));
+        server_send(state->clients[sender], resp, strlen(resp));
     } else {
         /* Restore old ship if move failed with ORIGINAL position and direction */
         Ship old_s = {orig_r, orig_c, ship_len, original_dir, ship_val};
@@ -269,25 +310,26 @@ void handle_move_command(ServerState *state, const char *msg, int sender) {
         /* Debug: send detailed failure info */
         char resp[128];
         snprintf(resp, sizeof(resp), "MOVE_FAIL Cannot place ship at new location (restored=%d)\n", restored);
-        WRITE(state->clients[sender], resp, strlen(resp));
+        server_send(state->clients[sender], resp, strlen(resp));
     }
 }
 
 void handle_ready_command(ServerState *state, int sender) {
     /* Check if player has placed all ships */
     if (state->game_state->placed_count[sender] != 5) {
-        WRITE(state->clients[sender], "NOT_READY You must place all ships first\n", 42);
+        server_send(state->clients[sender], "NOT_READY You must place all ships first\n", 42);
         return;
     }
     
     state->game_state->ready[sender] = 1;
+    spectate_event(state, SPEC_ALL, "SPEC_READY %d\n", sender);
     
     /* Notify both players */
     char readymsg[64];
     snprintf(readymsg, sizeof(readymsg), "PLAYER_READY %d\n", sender);
     for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
         if (state->clients[i] != SOCKET_INVALID) {
-            WRITE(state->clients[i], readymsg, strlen(readymsg));
+            server_send(state->clients[i], readymsg, strlen(readymsg));
         }
     }
     
@@ -295,24 +337,26 @@ void handle_ready_command(ServerState *state, int sender) {
     if (state->game_state->ready[0] && state->game_state->ready[1]) {
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], "START\n", 6);
+                server_send(state->clients[i], "START\n", 6);
             }
         }
-        
-        char tmsg[32];
-        snprintf(tmsg, sizeof(tmsg), "TURN %d\n", state->game_state->current_turn);
-        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
-            if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], tmsg, strlen(tmsg));
+        for (int seat = 0; seat < MAX_PLAYERS_PER_GAME; seat++) {
+            for (int id = 1; id <= 5; id++) {
+                Ship *s = &state->game_state->ships[seat][id];
+                if (s->len) spectate_event(state, SPEC_FULL, "SPEC_SHIP %d %d %d %d %c\n", seat, s->r, s->c, s->len, s->dir);
             }
         }
+        archive_game_started(state);
+        
+        send_turn(state);
         
         /* Send firing instructions */
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], "START_FIRING\n", (int)strlen("START_FIRING\n"));
+                server_send(state->clients[i], "START_FIRING\n", (int)strlen("START_FIRING\n"));
             }
         }
+        clock_turn_started(state);
     }
 }
 
@@ -333,12 +377,12 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
     
     /* Validate game state */
     if (!(state->game_state->placed_count[0] == 5 && state->game_state->placed_count[1] == 5)) {
-        WRITE(state->clients[sender], "NOT_READY\n", 10);
+        server_send(state->clients[sender], "NOT_READY\n", 10);
         return;
     }
     
     if (sender != state->game_state->current_turn) {
-        WRITE(state->clients[sender], "NOT_YOUR_TURN\n", 15);
+        server_send(state->clients[sender], "NOT_YOUR_TURN\n", 15);
         return;
     }
     
@@ -355,7 +399,7 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
         /* Already fired at this cell */
         char already[64];
         snprintf(already, sizeof(already), "ALREADY_FIRED %d %d\n", r, c);
-        WRITE(state->clients[sender], already, (int)strlen(already));
+        server_send(state->clients[sender], already, (int)strlen(already));
         return;
     }
     
@@ -363,11 +407,13 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
     char resp[128];
     snprintf(resp, sizeof(resp), "RESULT %d %d %d\n", r, c, hit);
     if (state->clients[target] != SOCKET_INVALID) {
-        WRITE(state->clients[target], resp, strlen(resp));
+        server_send(state->clients[target], resp, strlen(resp));
     }
     
     snprintf(resp, sizeof(resp), "FIRE_ACK %d %d %d\n", r, c, hit);
-    WRITE(state->clients[sender], resp, strlen(resp));
+    server_send(state->clients[sender], resp, strlen(resp));
+    spectate_event(state, SPEC_ALL, "SPEC_SHOT %d %d %d %d\n", sender, r, c, hit);
+    archive_shot(state, sender, r, c, hit);
     
     /* If hit, check if ship is destroyed */
     if (hit && ship_id_at_target >= 1 && ship_id_at_target <= 5) {
@@ -393,27 +439,30 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
             snprintf(sunkmsg, sizeof(sunkmsg), "SHIP_SUNK %d %d\n", target, sunk_len);
             for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
                 if (state->clients[i] != SOCKET_INVALID) {
-                    WRITE(state->clients[i], sunkmsg, strlen(sunkmsg));
+                    server_send(state->clients[i], sunkmsg, strlen(sunkmsg));
                 }
             }
+            spectate_event(state, SPEC_ALL, "SPEC_SUNK %d %d\n", target, sunk_len);
         }
     }
     
     /* Check for win condition */
     if (!grid_has_ships(state->game_state->grids[target])) {
         /* Sender WON, Target LOST */
+        clock_stop(state);
+        spectate_game_over(state, sender);
         
         if (state->clients[sender] != SOCKET_INVALID) {
             char winmsg[64];
             snprintf(winmsg, sizeof(winmsg), "WIN %d\n", sender);
-            WRITE(state->clients[sender], winmsg, strlen(winmsg)); /* You Win */
+            server_send(state->clients[sender], winmsg, strlen(winmsg)); /* You Win */
         }
         
         if (state->clients[target] != SOCKET_INVALID) {
              /* Send LOSE to loser */
             char losemsg[64];
             snprintf(losemsg, sizeof(losemsg), "LOSE %d\n", target);
-            WRITE(state->clients[target], losemsg, strlen(losemsg));
+            server_send(state->clients[target], losemsg, strlen(losemsg));
         }
 
         /* Reveal grids to opponents */
@@ -429,7 +478,7 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
                     if (cell >= 1 && cell <= 5) {
                         char revmsg[64];
                         snprintf(revmsg, sizeof(revmsg), "REVEAL %d %d %d\n", r, c, cell);
-                        WRITE(state->clients[opponent], revmsg, strlen(revmsg));
+                        server_send(state->clients[opponent], revmsg, strlen(revmsg));
                     }
                 }
             }
@@ -438,52 +487,42 @@ void handle_fire_command(ServerState *state, const char *msg, int sender) {
         /* Ask both players if they want to play again */
         for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
             if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], "PLAY_AGAIN\n", 11);
+                server_send(state->clients[i], "PLAY_AGAIN\n", 11);
             }
         }
+        store_game_over(state, sender);
+        archive_game_over(state, sender, ARCHIVE_END_SUNK);
+        tourney_game_over(state, sender);
         return;
     }
     
     /* Handle turn switching or continuation */
     /* Original logic was Hit = Go Again. */
-    if (hit) {
-        /* If hit, do NOT switch turns.
-           Send TURN command again to reaffirm it is still sender's turn */
-        char tmsg[32];
-        snprintf(tmsg, sizeof(tmsg), "TURN %d\n", sender);
-        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
-            if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], tmsg, strlen(tmsg));
-            }
-        }
-    } else {
-        /* Miss: switch turns */
-        state->game_state->current_turn ^= 1;
-        char tmsg[32];
-        snprintf(tmsg, sizeof(tmsg), "TURN %d\n", state->game_state->current_turn);
-        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
-            if (state->clients[i] != SOCKET_INVALID) {
-                WRITE(state->clients[i], tmsg, strlen(tmsg));
-            }
-        }
-    }
+    /* If hit, do NOT switch turns; TURN again reaffirms it is still sender's turn */
+    if (!hit) state->game_state->current_turn ^= 1;
+    send_turn(state);
+    clock_turn_started(state);
 }
 
 void handle_disconnect(ServerState *state, int sender, sock_t *listen_fd_ptr) {
     pthread_mutex_lock(&state->lock);
+    clock_stop(state);
+    resume_revoke(state, sender);
+    spectate_notice(state, "SPEC_LEFT %d\n", sender);
+    spectate_reset(state);
     
     /* Close the disconnected client */
     if (state->clients[sender] != SOCKET_INVALID) {
-        CLOSE(state->clients[sender]);
+        server_close_client(state->clients[sender]);
         state->clients[sender] = SOCKET_INVALID;
     }
     
-    /* Notify the other client if connected */
+    /* Notify the other client if connected (a detached seat is reset the same way) */
     int other = sender ^ 1;
-    if (state->clients[other] != SOCKET_INVALID) {
+    if (state->clients[other] != SOCKET_INVALID || state->detached[other]) {
         /* Use OPPONENT_LEFT to indicate the game is reset but they are still in lobby */
         const char *msg = "OPPONENT_LEFT\n";
-        WRITE(state->clients[other], msg, (int)strlen(msg));
+        if (state->clients[other] != SOCKET_INVALID) server_send(state->clients[other], msg, (int)strlen(msg));
         
         /* Reset game state for the remaining player */
         if (state->game_state->grids[other]) {
@@ -498,6 +537,7 @@ void handle_disconnect(ServerState *state, int sender, sock_t *listen_fd_ptr) {
         for (int l = 0; l < 6; l++) {
             state->game_state->remaining[other][l] = allowed_init[l];
             state->game_state->ship_lengths[other][l] = 0;
+            memset(&state->game_state->ships[other][l], 0, sizeof(Ship));
         }
     }
     
@@ -512,6 +552,7 @@ void handle_disconnect(ServerState *state, int sender, sock_t *listen_fd_ptr) {
     state->names[sender][0] = '\0';
     
     pthread_mutex_unlock(&state->lock);
+    tourney_seat_left(state, sender);
 }
 
 /* Non-blocking rematch handler */
@@ -525,12 +566,13 @@ void handle_rematch_response(ServerState *state, int sender, int response) {
     
     if (response == 2) {
         /* Player said NO - disconnect them */
-        WRITE(state->clients[sender], "GAME_OVER\n", 10);
-        shutdown(state->clients[sender], SHUT_RDWR_FLAG);
-        CLOSE(state->clients[sender]);
+        server_send(state->clients[sender], "GAME_OVER\n", 10);
+        server_shutdown_client(state->clients[sender]);
+        server_close_client(state->clients[sender]);
         state->clients[sender] = SOCKET_INVALID;
         
         /* Reset their state */
+        resume_revoke(state, sender);
         state->names[sender][0] = '\0';
         state->game_state->rematch_response[sender] = 0;
         
@@ -538,7 +580,7 @@ void handle_rematch_response(ServerState *state, int sender, int response) {
         if (state->clients[other] != SOCKET_INVALID) {
             /* If the game finished naturally and one quits, the lobby should be considered closed for continuation. */
             const char *msg = "GAME_CLOSED\n";
-            WRITE(state->clients[other], msg, (int)strlen(msg));
+            server_send(state->clients[other], msg, (int)strlen(msg));
             
             /* Reset other player's game state (wait for new lobby or kicked out?)
                User logic: "move player to lobby screen".
@@ -558,6 +600,7 @@ void handle_rematch_response(ServerState *state, int sender, int response) {
         }
     } else if (response == 1 && other_resp == 1) {
         /* Both said YES - Restart */
+        spectate_reset(state);
 
         /* 1. ZMENA: Pripravíme si príkaz na štart ukladania */
         const char *pmsg = "START_PLACEMENT 2 3 3 4 5\n";
@@ -575,18 +618,206 @@ void handle_rematch_response(ServerState *state, int sender, int response) {
             for (int l = 0; l < 6; l++) {
                 state->game_state->remaining[i][l] = allowed_init[l];
                 state->game_state->ship_lengths[i][l] = 0;
+                memset(&state->game_state->ships[i][l], 0, sizeof(Ship));
             }
             
             if (state->clients[i] != SOCKET_INVALID) {
                 /* 2. ZMENA: Najprv pošleme RESTART (aby klient vymazal UI) */
-                WRITE(state->clients[i], "RESTART_GAME\n", 13);
+                server_send(state->clients[i], "RESTART_GAME\n", 13);
 
                 /* 3. ZMENA: A hneď potom pošleme START_PLACEMENT (aby začal hru) */
-                WRITE(state->clients[i], pmsg, (int)strlen(pmsg));
+                server_send(state->clients[i], pmsg, (int)strlen(pmsg));
             }
         }
         state->game_state->current_turn = 0;
+        clock_placement_started(state);
     }
     
     pthread_mutex_unlock(&state->lock);
 }
+
+void send_seat_state(ServerState *state, int seat) {
+    sock_t fd = state->clients[seat];
+    GameState *gs = state->game_state;
+    int other = seat ^ 1;
+    char line[128];
+    int n;
+
+    if (fd == SOCKET_INVALID) return;
+
+    if (state->resume[seat].token[0]) {
+        n = snprintf(line, sizeof(line), "ASSIGN %d %s\n", seat, state->resume[seat].token);
+    } else {
+        n = snprintf(line, sizeof(line), "ASSIGN %d\n", seat);
+    }
+    server_send(fd, line, n);
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (state->names[i][0] != '\0') {
+            n = snprintf(line, sizeof(line), "NAME %d %s\n", i, state->names[i]);
+            server_send(fd, line, n);
+        }
+    }
+
+    /* Placement only starts once both players have names */
+    if (state->names[0][0] == '\0' || state->names[1][0] == '\0') return;
+
+    const char *pmsg = "START_PLACEMENT 2 3 3 4 5\n";
+    server_send(fd, pmsg, (int)strlen(pmsg));
+
+    /* Own ships in ID order, so the client assigns the same IDs the server uses */
+    for (int id = 1; id <= 5; id++) {
+        Ship *s = &gs->ships[seat][id];
+        if (s->len == 0) continue;
+        n = snprintf(line, sizeof(line), "PLACED %d %d %d %c 1\n", s->r, s->c, s->len, s->dir);
+        server_send(fd, line, n);
+        n = snprintf(line, sizeof(line), "SHIP_INFO %d %d %d\n", s->r, s->c, s->len);
+        server_send(fd, line, n);
+    }
+    n = snprintf(line, sizeof(line), "REMAIN %d 2 %d 3 %d 4 %d 5 %d\n", seat,
+                 gs->remaining[seat][2], gs->remaining[seat][3],
+                 gs->remaining[seat][4], gs->remaining[seat][5]);
+    server_send(fd, line, n);
+
+    /* Shots received on our grid and shots we fired at the opponent */
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            unsigned char own = 0, opp = 0;
+            grid_get(gs->grids[seat], r, c, &own);
+            grid_get(gs->grids[other], r, c, &opp);
+            if (own == CELL_HIT || own == CELL_MISS) {
+                n = snprintf(line, sizeof(line), "RESULT %d %d %d\n", r, c, own == CELL_HIT);
+                server_send(fd, line, n);
+            }
+            if (opp == CELL_HIT || opp == CELL_MISS) {
+                n = snprintf(line, sizeof(line), "FIRE_ACK %d %d %d\n", r, c, opp == CELL_HIT);
+                server_send(fd, line, n);
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (gs->ready[i]) {
+            n = snprintf(line, sizeof(line), "PLAYER_READY %d\n", i);
+            server_send(fd, line, n);
+        }
+    }
+
+    if (gs->ready[0] && gs->ready[1]) {
+        server_send(fd, "START\n", 6);
+        server_send(fd, "START_FIRING\n", 13);
+        n = snprintf(line, sizeof(line), "TURN %d %08x\n", gs->current_turn,
+                     (unsigned)seat_view_hash(gs, seat));
+        server_send(fd, line, n);
+    }
+    clock_send_state(state, seat);
+}
+
+void handle_state_command(ServerState *state, int seat) {
+    GameState *gs = state->game_state;
+    const char *phase = "FIRE";
+    char own[GRID_ROWS * GRID_COLS + 1], opp[GRID_ROWS * GRID_COLS + 1];
+    char ships[5 * 4 + 1];
+    char line[256];
+
+    if (state->names[0][0] == '\0' || state->names[1][0] == '\0') {
+        phase = "WAIT";
+    } else if (!gs->ready[0] || !gs->ready[1]) {
+        phase = "PLACE";
+    } else if (!grid_has_ships(gs->grids[0]) || !grid_has_ships(gs->grids[1])) {
+        phase = "OVER";
+    }
+
+    for (int r = 0; r < GRID_ROWS; r++) {
+        for (int c = 0; c < GRID_COLS; c++) {
+            unsigned char o = CELL_EMPTY, t = CELL_EMPTY;
+            grid_get(gs->grids[seat], r, c, &o);
+            grid_get(gs->grids[seat ^ 1], r, c, &t);
+            own[r * GRID_COLS + c] = (o >= 1 && o <= 5) ? (char)('0' + o)
+                                   : (o == CELL_HIT || o == CELL_MISS) ? (char)o : '.';
+            opp[r * GRID_COLS + c] = (t == CELL_HIT || t == CELL_MISS) ? (char)t : '.';
+        }
+    }
+    own[GRID_ROWS * GRID_COLS] = opp[GRID_ROWS * GRID_COLS] = '\0';
+
+    /* Hits overwrite ship ids on the grid, so the layout travels separately */
+    for (int id = 1; id <= 5; id++) {
+        Ship *s = &gs->ships[seat][id];
+        char *p = ships + (id - 1) * 4;
+        if (s->len == 0) {
+            memcpy(p, "----", 4);
+        } else {
+            p[0] = (char)('0' + s->r);
+            p[1] = (char)('0' + s->c);
+            p[2] = (char)('0' + s->len);
+            p[3] = s->dir == 'V' || s->dir == 'v' ? 'V' : 'H';
+        }
+    }
+    ships[5 * 4] = '\0';
+
+    int n = snprintf(line, sizeof(line), "STATE %d %s %d %s %s %s %08x\n", seat, phase,
+                     gs->current_turn, own, opp, ships, (unsigned)seat_view_hash(gs, seat));
+    server_send(state->clients[seat], line, n);
+}
+
+GameLobby *create_named_lobby(GlobalState *gs, const char *name) {
+    GameLobby *l = create_lobby(gs);
+    if (l) {
+        pthread_mutex_lock(&l->lock);
+        strncpy(l->lobby_name, name, sizeof(l->lobby_name) - 1);
+        l->lobby_name[sizeof(l->lobby_name) - 1] = '\0';
+        pthread_mutex_unlock(&l->lock);
+        journal_append(JE_LOBBY_CREATE, l->id, -1, l->lobby_name, (int)strlen(l->lobby_name));
+    }
+    return l;
+}
+
+int join_lobby_id(ClientCtx *ctx, int lobby_id) {
+    GameLobby *joined_lobby = NULL;
+    int player_idx = -1;
+    
+    pthread_mutex_lock(&g_global_state->lock);
+    if (lobby_id >= 0 && lobby_id < MAX_LOBBIES && g_global_state->lobbies[lobby_id]) {
+        GameLobby *l = g_global_state->lobbies[lobby_id];
+        pthread_mutex_lock(&l->lock);
+        if (l->num_players < MAX_PLAYERS_PER_GAME) {
+            if (l->clients[0] == SOCKET_INVALID && !l->detached[0]) player_idx = 0;
+            else if (l->clients[1] == SOCKET_INVALID && !l->detached[1]) player_idx = 1;
+            
+            if (player_idx != -1) {
+                l->clients[player_idx] = ctx->fd;
+                l->num_players++;
+                joined_lobby = l;
+            }
+        }
+        pthread_mutex_unlock(&l->lock);
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+    
+    if (joined_lobby && player_idx != -1) {
+        match_cancel(ctx);
+        ctx->lobby = joined_lobby;
+        ctx->player_id_in_game = player_idx;
+        /* The token goes into the journal so a restored seat can only be resumed with it */
+        const char *token = resume_issue(joined_lobby, player_idx);
+        journal_append(JE_JOIN, joined_lobby->id, player_idx, token, RESUME_TOKEN_LEN);
+        
+        char assign[64];
+        int l = snprintf(assign, sizeof(assign), "ASSIGN %d %s\n", player_idx, token);
+        server_send(ctx->fd, assign, l);
+        clock_send_state(joined_lobby, player_idx);
+        
+        log_event(LOG_INFO, "join", "conn=%d lobby=%d seat=%d", ctx->connection_id, joined_lobby->id, player_idx);
+        
+        /* Send cached name command */
+        if (ctx->pending_name[0] != '\0') {
+            char namecmd[128];
+            snprintf(namecmd, sizeof(namecmd), "NAME %s\n", ctx->pending_name);
+            journal_game_command(joined_lobby->id, player_idx, namecmd);
+            handle_name_command(joined_lobby, namecmd, player_idx);
+        }
+        return 1;
+    }
+    const char *msg = "JOIN_FAIL Lobby full or invalid\n";
+    server_send(ctx->fd, msg, (int)strlen(msg));
+    return 0;
+}
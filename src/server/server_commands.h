@@ -3,6 +3,13 @@
 
 #include "server_state.h"
 
+/* Create a lobby called name and journal it. NULL if all lobby slots are taken */
+GameLobby *create_named_lobby(GlobalState *gs, const char *name);
+
+/* Seat ctx in lobby_id (ASSIGN, then its cached NAME). Sends JOIN_FAIL and
+ * returns 0 if the lobby is full or gone */
+int join_lobby_id(ClientCtx *ctx, int lobby_id);
+
 /* Handle NAME command from client */
 void handle_name_command(ServerState *state, const char *msg, int sender);
 
@@ -24,4 +31,11 @@ void handle_disconnect(ServerState *state, int sender, sock_t *listen_fd_ptr);
 /* Handle rematch response */
 void handle_rematch_response(ServerState *state, int sender, int response);
 
+/* Re-send everything a (re)attached player needs to rebuild their view of the game */
+void send_seat_state(ServerState *state, int seat);
+
+/* Handle STATE: reply with seat's board, its shots, the turn and the view hash
+ * ("STATE <seat> <WAIT|PLACE|FIRE|OVER> <turn> <own> <opp> <ships> <hash>") */
+void handle_state_command(ServerState *state, int seat);
+
 #endif /* SERVER_COMMANDS_H */
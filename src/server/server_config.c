@@ -0,0 +1,182 @@
+#include "server_config.h"
+#include "server_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void copy_opt(char *dst, size_t cap, const char *src) {
+    strncpy(dst, src, cap - 1);
+    dst[cap - 1] = '\0';
+}
+
+int server_config_parse(ServerConfig *cfg, int argc, char **argv) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->port = DEFAULT_PORT;
+    cfg->journal_commit_ms = 10;
+    cfg->snapshot_interval = 60;
+    cfg->heartbeat_interval = 10;
+    cfg->turn_time = 60;
+    cfg->placement_time = 180;
+    cfg->resume_grace = 30;
+    cfg->spectate_delay = 30;
+    cfg->log_level = LOG_INFO;
+    cfg->log_rate = 1000;
+    cfg->rate_limit = 50;
+    cfg->queue_share = 64;
+    cfg->abuse_limit = 200;
+    cfg->admission_queue = 256;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--admin-socket") == 0 && val) {
+            copy_opt(cfg->admin_socket, sizeof(cfg->admin_socket), val);
+            i++;
+        } else if (strcmp(arg, "--journal") == 0 && val) {
+            copy_opt(cfg->journal, sizeof(cfg->journal), val);
+            i++;
+        } else if (strcmp(arg, "--journal-commit-ms") == 0 && val) {
+            cfg->journal_commit_ms = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--snapshot") == 0 && val) {
+            copy_opt(cfg->snapshot, sizeof(cfg->snapshot), val);
+            i++;
+        } else if (strcmp(arg, "--snapshot-interval") == 0 && val) {
+            cfg->snapshot_interval = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--handoff-socket") == 0 && val) {
+            copy_opt(cfg->handoff_socket, sizeof(cfg->handoff_socket), val);
+            i++;
+        } else if (strcmp(arg, "--takeover") == 0 && val) {
+            copy_opt(cfg->takeover, sizeof(cfg->takeover), val);
+            i++;
+        } else if (strcmp(arg, "--acceptors") == 0 && val) {
+            cfg->acceptors = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--ws-port") == 0 && val) {
+            cfg->ws_port = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--gateway-port") == 0 && val) {
+            cfg->gateway_port = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--gateway-socket") == 0 && val) {
+            copy_opt(cfg->gateway_socket, sizeof(cfg->gateway_socket), val);
+            i++;
+        } else if (strcmp(arg, "--unix-socket") == 0 && val) {
+            copy_opt(cfg->unix_socket, sizeof(cfg->unix_socket), val);
+            i++;
+        } else if (strcmp(arg, "--heartbeat") == 0 && val) {
+            cfg->heartbeat_interval = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--idle-timeout") == 0 && val) {
+            cfg->idle_timeout = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--turn-time") == 0 && val) {
+            cfg->turn_time = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--resume-grace") == 0 && val) {
+            cfg->resume_grace = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--spectate-delay") == 0 && val) {
+            cfg->spectate_delay = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--store") == 0 && val) {
+            copy_opt(cfg->store, sizeof(cfg->store), val);
+            i++;
+        } else if (strcmp(arg, "--archive") == 0 && val) {
+            copy_opt(cfg->archive, sizeof(cfg->archive), val);
+            i++;
+        } else if (strcmp(arg, "--log") == 0 && val) {
+            copy_opt(cfg->log, sizeof(cfg->log), val);
+            i++;
+        } else if (strcmp(arg, "--log-level") == 0 && val) {
+            cfg->log_level = log_level_parse(val);
+            if (cfg->log_level < 0) {
+                fprintf(stderr, "Unknown log level: %s\n", val);
+                return -1;
+            }
+            i++;
+        } else if (strcmp(arg, "--log-rate") == 0 && val) {
+            cfg->log_rate = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--rate-limit") == 0 && val) {
+            cfg->rate_limit = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--queue-share") == 0 && val) {
+            cfg->queue_share = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--abuse-limit") == 0 && val) {
+            cfg->abuse_limit = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--admission-queue") == 0 && val) {
+            cfg->admission_queue = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--placement-time") == 0 && val) {
+            cfg->placement_time = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--io") == 0 && val) {
+            if (strcmp(val, "uring") == 0) {
+                cfg->io_uring = 1;
+            } else if (strcmp(val, "threads") != 0) {
+                fprintf(stderr, "Unknown I/O backend: %s\n", val);
+                return -1;
+            }
+            i++;
+        } else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            return -1;
+        } else if (arg[0] != '-') {
+            /* Positional port, kept for compatibility with "server <port>" */
+            cfg->port = atoi(arg);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return -1;
+        }
+    }
+    if (cfg->acceptors > 0 && (cfg->handoff_socket[0] || cfg->takeover[0])) {
+        fprintf(stderr, "--acceptors cannot be combined with --handoff-socket or --takeover\n");
+        return -1;
+    }
+    if (cfg->io_uring && (cfg->acceptors > 0 || cfg->handoff_socket[0] || cfg->takeover[0])) {
+        fprintf(stderr, "--io uring cannot be combined with --acceptors, --handoff-socket or --takeover\n");
+        return -1;
+    }
+    if ((cfg->ws_port > 0 || cfg->gateway_port > 0 || cfg->gateway_socket[0])
+        && (cfg->handoff_socket[0] || cfg->takeover[0])) {
+        fprintf(stderr, "--ws-port and --gateway-port cannot be combined with --handoff-socket or --takeover\n");
+        return -1;
+    }
+    return 0;
+}
+
+void server_config_usage(const char *prog) {
+    printf("Usage: %s [port] [options]\n", prog);
+    printf("  --admin-socket PATH   Listen for admin commands on a Unix-domain socket\n");
+    printf("  --journal PATH        Log game events to PATH and restore games from it on start\n");
+    printf("  --journal-commit-ms N Group commit interval for the journal (default 10)\n");
+    printf("  --snapshot PATH       Restore from and periodically write a state snapshot\n");
+    printf("  --snapshot-interval S Seconds between snapshots (default 60, 0 = on request)\n");
+    printf("  --handoff-socket PATH Let a new server process take over sockets and games via PATH\n");
+    printf("  --takeover PATH       Start by taking over from the server on handoff socket PATH\n");
+    printf("  --acceptors N         Use N SO_REUSEPORT listeners, each polling its own clients\n");
+    printf("  --ws-port N           Accept WebSocket clients (browsers) directly on port N\n");
+    printf("  --gateway-port N      Accept multiplexed web gateway links on loopback port N\n");
+    printf("  --gateway-socket PATH Accept gateway links on a Unix-domain socket instead\n");
+    printf("  --unix-socket PATH    Also accept clients on a Unix-domain socket (same protocol)\n");
+    printf("  --heartbeat S         PING clients silent for S seconds, evict after 3 misses (default 10, 0 = off)\n");
+    printf("  --idle-timeout S      Evict connections that send nothing but heartbeats for S seconds (default off)\n");
+    printf("  --turn-time S         Fire for a player whose turn lasts S seconds (default 60, 0 = off)\n");
+    printf("  --placement-time S    Place remaining ships after S seconds of placement (default 180, 0 = off)\n");
+    printf("  --resume-grace S      Hold a dropped player's seat S seconds for RESUME (default 30, 0 = off)\n");
+    printf("  --spectate-delay S    Run the FULL (ships shown) spectator feed S seconds behind (default 30)\n");
+    printf("  --store PATH          Keep player ratings and stats in PATH (default: in memory only)\n");
+    printf("  --archive PATH        Append every finished game to the archive at PATH (see boats_analyze)\n");
+    printf("  --log PATH            Write the event log to PATH instead of stderr\n");
+    printf("  --log-level L         Skip events below L: debug, info (default), warn or error\n");
+    printf("  --log-rate N          Log at most N lines per second of one event per thread (default 1000, 0 = off)\n");
+    printf("  --rate-limit N        Accept N lines per second per connection, plus per-verb limits (default 50, 0 = off)\n");
+    printf("  --queue-share N       Refuse a connection's lines while N of them wait for the dispatcher (default 64, 0 = off)\n");
+    printf("  --abuse-limit N       Disconnect after N refused lines within 10 s (default 200, 0 = never)\n");
+    printf("  --admission-queue N   Hold up to N connections with QUEUE_POS updates while full (default 256, 0 = BUSY)\n");
+    printf("  --io threads|uring    Network backend: reader threads (default) or io_uring (Linux)\n");
+}
@@ -0,0 +1,45 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include "common.h"
+
+/* Startup options for the server process */
+typedef struct ServerConfig {
+    int port;
+    char admin_socket[108];     /* Unix-domain admin socket path, empty = disabled */
+    char journal[260];          /* Game journal path, empty = disabled */
+    int journal_commit_ms;      /* Group commit interval for the journal */
+    char snapshot[260];         /* Snapshot file path, empty = disabled */
+    int snapshot_interval;      /* Seconds between snapshots, 0 = only on request */
+    char handoff_socket[108];   /* Unix-domain socket a new process can take over from */
+    char takeover[108];         /* Take over from the server listening on this handoff socket */
+    int acceptors;              /* SO_REUSEPORT acceptor loops, 0 = one accept thread + reader threads */
+    int io_uring;               /* Use the io_uring backend instead of reader threads */
+    int ws_port;                /* Native WebSocket port, 0 = disabled */
+    int gateway_port;           /* Loopback port for multiplexed web gateway links, 0 = disabled */
+    char gateway_socket[108];   /* Unix-domain socket for gateway links (instead of gateway_port) */
+    char unix_socket[108];      /* Also accept clients on this Unix-domain socket, empty = disabled */
+    int heartbeat_interval;     /* Seconds of silence before a PING, 0 = no heartbeat */
+    int idle_timeout;           /* Evict connections without real traffic after this many seconds, 0 = never */
+    int turn_time;              /* Default seconds per turn before the server fires for the player, 0 = no clock */
+    int placement_time;         /* Default seconds to place ships before they are placed automatically, 0 = no clock */
+    int resume_grace;           /* Seconds a dropped player's seat is held for RESUME, 0 = reset at once */
+    int spectate_delay;         /* Seconds the FULL spectator feed runs behind the game, 0 = live */
+    char store[260];            /* Player store path, empty = records kept in memory only */
+    char archive[260];          /* Finished-game archive path, empty = disabled */
+    char log[260];              /* Event log path, empty = stderr */
+    int log_level;              /* LOG_* below which events are skipped */
+    int log_rate;               /* Lines per second per event and thread, 0 = unlimited */
+    int rate_limit;             /* Lines per second per connection, 0 = no rate limits */
+    int queue_share;            /* Lines one connection may have queued, 0 = unbounded */
+    int abuse_limit;            /* Refused lines that get a connection dropped, 0 = never */
+    int admission_queue;        /* Connections held while the server is full, 0 = answer BUSY */
+} ServerConfig;
+
+/* Parse "server [port] [--option value ...]". Returns 0 on success, -1 on bad usage */
+int server_config_parse(ServerConfig *cfg, int argc, char **argv);
+
+/* Print command line usage */
+void server_config_usage(const char *prog);
+
+#endif /* SERVER_CONFIG_H */
@@ -0,0 +1,535 @@
+#define _DEFAULT_SOURCE
+#include "server_gateway.h"
+#include "server_client.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#if defined(MSG_DONTWAIT) && defined(MSG_NOSIGNAL)
+#define SEND_NOWAIT (MSG_DONTWAIT | MSG_NOSIGNAL)
+#else
+#define SEND_NOWAIT 0
+#endif
+
+/* Virtual fds count down from here so they never collide with real sockets */
+#define GATEWAY_FD_BASE (-1000)
+#define MAX_LINKS 8
+#define LINK_QUEUE_MAX (256 * 1024)  /* Bytes the fan-out may queue on a link */
+
+typedef struct GatewaySession {
+    int in_use;
+    int link;               /* Index into links */
+    uint32_t sid;           /* Session ID chosen by the gateway */
+    int conn_id;
+    int ended;              /* DISCONNECT queued, no more input is fed */
+    int close_sent;         /* Gateway already told the session is over */
+} GatewaySession;
+
+/* Every write to a link goes through its queue, whole frames at a time, so
+ * frames from the dispatcher and the spectator fan-out never interleave */
+typedef struct GatewayLink {
+    sock_t fd;
+    int active;
+    pthread_t tid;
+    pthread_mutex_t write_lock;     /* One writer drains the queue at a time */
+    pthread_mutex_t queue_lock;     /* Guards out; never held across a wait */
+    char *out;
+    size_t out_off;                 /* Bytes of out already written */
+    size_t out_len;
+    size_t out_cap;
+} GatewayLink;
+
+static pthread_mutex_t gw_lock = PTHREAD_MUTEX_INITIALIZER;
+static GatewaySession sessions[MAX_CONNECTIONS];
+static GatewayLink links[MAX_LINKS];
+static volatile int links_ready = 0;    /* Link locks are initialized */
+
+static int fd_slot(sock_t fd) {
+    intptr_t slot = GATEWAY_FD_BASE - (intptr_t)fd;
+    return (slot >= 0 && slot < MAX_CONNECTIONS) ? (int)slot : -1;
+}
+
+static sock_t slot_fd(int slot) {
+    return (sock_t)(intptr_t)(GATEWAY_FD_BASE - slot);
+}
+
+int gateway_is_virtual(sock_t fd) {
+    return fd_slot(fd) >= 0;
+}
+
+static void put_header(unsigned char *h, uint32_t sid, int type, size_t len) {
+    h[0] = (unsigned char)(sid >> 24);
+    h[1] = (unsigned char)(sid >> 16);
+    h[2] = (unsigned char)(sid >> 8);
+    h[3] = (unsigned char)sid;
+    h[4] = (unsigned char)type;
+    h[5] = 0;
+    h[6] = (unsigned char)(len >> 8);
+    h[7] = (unsigned char)len;
+}
+
+/* Queue whole bytes on link, unless that would pass limit. Returns 0 if full */
+static int link_queue(GatewayLink *l, const char *buf, size_t len, size_t limit) {
+    int ok = 0;
+    pthread_mutex_lock(&l->queue_lock);
+    if (l->out_len - l->out_off + len <= limit) {
+        if (l->out_off > 0) {
+            memmove(l->out, l->out + l->out_off, l->out_len - l->out_off);
+            l->out_len -= l->out_off;
+            l->out_off = 0;
+        }
+        if (l->out_len + len > l->out_cap) {
+            size_t cap = l->out_cap ? l->out_cap : 4096;
+            while (cap < l->out_len + len) cap *= 2;
+            char *p = realloc(l->out, cap);
+            if (p) {
+                l->out = p;
+                l->out_cap = cap;
+            }
+        }
+        if (l->out_len + len <= l->out_cap) {
+            memcpy(l->out + l->out_len, buf, len);
+            l->out_len += len;
+            ok = 1;
+        }
+    }
+    pthread_mutex_unlock(&l->queue_lock);
+    return ok;
+}
+
+/* Write what the link's queue holds without waiting. Caller holds write_lock.
+ * Returns 1 when the queue is empty, 0 if the socket is full, -1 on error */
+static int link_push(GatewayLink *l) {
+    for (;;) {
+        pthread_mutex_lock(&l->queue_lock);
+        size_t left = l->out_len - l->out_off;
+        ssize_t n = left > 0 ? send(l->fd, l->out + l->out_off, left, SEND_NOWAIT) : 0;
+        if (n > 0) l->out_off += (size_t)n;
+        pthread_mutex_unlock(&l->queue_lock);
+        if (left == 0) return 1;
+        if (n <= 0) return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) ? 0 : -1;
+    }
+}
+
+/* Queue buf on link and wait until all of it went out (dispatcher only).
+ * Waits hold only this link's write lock */
+static int link_write(int link, const char *buf, size_t len) {
+    GatewayLink *l = &links[link];
+    if (!link_queue(l, buf, len, (size_t)-1)) return -1;
+
+    pthread_mutex_lock(&l->write_lock);
+    int r;
+    while ((r = link_push(l)) == 0) {
+#ifndef _WIN32
+        struct pollfd p = {l->fd, POLLOUT, 0};
+        poll(&p, 1, 1000);
+#endif
+    }
+    pthread_mutex_unlock(&l->write_lock);
+    return r < 0 ? -1 : (int)len;
+}
+
+/* Wrap len bytes for session s in DATA frames. Returns a malloc'd buffer and
+ * its size in *out_len */
+static char *data_frames(uint32_t sid, const char *buf, size_t len, size_t *out_len) {
+    /* Payload length is 16 bits; longer writes become several frames */
+    size_t frames = len / 0xFFFF + 1;
+    char *out = malloc(len + frames * GW_HEADER_SIZE);
+    if (!out) return NULL;
+    size_t o = 0;
+    do {
+        size_t chunk = len > 0xFFFF ? 0xFFFF : len;
+        put_header((unsigned char *)out + o, sid, GW_DATA, chunk);
+        memcpy(out + o + GW_HEADER_SIZE, buf, chunk);
+        o += GW_HEADER_SIZE + chunk;
+        buf += chunk;
+        len -= chunk;
+    } while (len > 0);
+    *out_len = o;
+    return out;
+}
+
+/* Find the live session behind virtual fd: its link and session ID */
+static int session_route(sock_t fd, int *link, uint32_t *sid) {
+    int slot = fd_slot(fd);
+    if (slot < 0) return -1;
+
+    pthread_mutex_lock(&gw_lock);
+    GatewaySession *s = &sessions[slot];
+    int ok = s->in_use && !s->close_sent && links[s->link].active;
+    if (ok) {
+        *link = s->link;
+        *sid = s->sid;
+    }
+    pthread_mutex_unlock(&gw_lock);
+    return ok ? 0 : -1;
+}
+
+int gateway_send(sock_t fd, const char *buf, size_t len) {
+    int link;
+    uint32_t sid;
+    if (session_route(fd, &link, &sid) < 0) return -1;
+
+    size_t flen;
+    char *frame = data_frames(sid, buf, len, &flen);
+    if (!frame) return -1;
+    int n = link_write(link, frame, flen);
+    free(frame);
+    return n < 0 ? -1 : (int)len;
+}
+
+int gateway_send_nowait(sock_t fd, const char *buf, size_t len) {
+    int link;
+    uint32_t sid;
+    if (session_route(fd, &link, &sid) < 0) return -1;
+
+    size_t flen;
+    char *frame = data_frames(sid, buf, len, &flen);
+    if (!frame) return -1;
+    GatewayLink *l = &links[link];
+    int queued = link_queue(l, frame, flen, LINK_QUEUE_MAX);
+    free(frame);
+    if (!queued) return 0;
+
+    /* Whatever the socket cannot take now goes out with the next push */
+    if (pthread_mutex_trylock(&l->write_lock) == 0) {
+        link_push(l);
+        pthread_mutex_unlock(&l->write_lock);
+    }
+    return (int)len;
+}
+
+int gateway_push(void) {
+    int waiting = 0;
+    if (!links_ready) return 0;
+    for (int i = 0; i < MAX_LINKS; i++) {
+        GatewayLink *l = &links[i];
+        if (pthread_mutex_trylock(&l->write_lock) != 0) {
+            waiting = 1;
+            continue;
+        }
+        if (l->fd != SOCKET_INVALID && link_push(l) == 0) waiting = 1;
+        pthread_mutex_unlock(&l->write_lock);
+    }
+    return waiting;
+}
+
+/* Mark a session's end as told. Caller holds gw_lock. Returns the link to send
+ * the CLOSE on once gw_lock is released (no write waits under it), -1 for none */
+static int take_close_locked(GatewaySession *s, uint32_t *sid) {
+    if (s->close_sent) return -1;
+    s->close_sent = 1;
+    if (!links[s->link].active) return -1;
+    *sid = s->sid;
+    return s->link;
+}
+
+/* Tell the gateway a session is over (dispatcher only) */
+static void send_close(int link, uint32_t sid) {
+    if (link < 0) return;
+    unsigned char h[GW_HEADER_SIZE];
+    put_header(h, sid, GW_CLOSE, 0);
+    link_write(link, (const char *)h, GW_HEADER_SIZE);
+}
+
+static void queue_disconnect(int conn_id) {
+    char *disc = strdup("DISCONNECT\n");
+    if (disc) enqueue_msg(disc, conn_id);
+}
+
+void gateway_shutdown(sock_t fd) {
+    int slot = fd_slot(fd);
+    if (slot < 0) return;
+
+    int link = -1;
+    uint32_t sid = 0;
+    pthread_mutex_lock(&gw_lock);
+    GatewaySession *s = &sessions[slot];
+    if (s->in_use) {
+        link = take_close_locked(s, &sid);
+        if (!s->ended) {
+            s->ended = 1;
+            queue_disconnect(s->conn_id);
+        }
+    }
+    pthread_mutex_unlock(&gw_lock);
+    send_close(link, sid);
+}
+
+void gateway_close(sock_t fd) {
+    int slot = fd_slot(fd);
+    if (slot < 0) return;
+
+    int link = -1;
+    uint32_t sid = 0;
+    pthread_mutex_lock(&gw_lock);
+    GatewaySession *s = &sessions[slot];
+    if (s->in_use) {
+        link = take_close_locked(s, &sid);
+        memset(s, 0, sizeof(*s));
+    }
+    pthread_mutex_unlock(&gw_lock);
+    send_close(link, sid);
+}
+
+void gateway_handle_control(const char *msg) {
+    int link;
+    unsigned sid;
+
+    if (sscanf(msg, "GATEWAY_REJECT %d %u", &link, &sid) == 2) {
+        if (link < 0 || link >= MAX_LINKS || !links[link].active) return;
+        const char *busy = "BUSY Server full\n";
+        size_t n = strlen(busy);
+        unsigned char frame[GW_HEADER_SIZE * 2 + 32];
+        put_header(frame, sid, GW_DATA, n);
+        memcpy(frame + GW_HEADER_SIZE, busy, n);
+        put_header(frame + GW_HEADER_SIZE + n, sid, GW_CLOSE, 0);
+        link_write(link, (const char *)frame, 2 * GW_HEADER_SIZE + n);
+    } else if (sscanf(msg, "GATEWAY_LINK_DOWN %d", &link) == 1) {
+        if (link < 0 || link >= MAX_LINKS) return;
+        /* Close here, under the write lock, so no queued write can hit a
+         * reused descriptor */
+        GatewayLink *l = &links[link];
+        pthread_mutex_lock(&gw_lock);
+        pthread_mutex_lock(&l->write_lock);
+        CLOSE(l->fd);
+        l->fd = SOCKET_INVALID;
+        pthread_mutex_lock(&l->queue_lock);
+        l->out_off = l->out_len = 0;
+        pthread_mutex_unlock(&l->queue_lock);
+        pthread_mutex_unlock(&l->write_lock);
+        pthread_mutex_unlock(&gw_lock);
+        log_event(LOG_INFO, "gateway_closed", "link=%d", link);
+    }
+}
+
+#ifdef _WIN32
+int gateway_start(int port, const char *path) {
+    (void)port;
+    (void)path;
+    fprintf(stderr, "Gateway links are not supported on Windows\n");
+    return -1;
+}
+
+void gateway_stop(void) { }
+#else
+
+static sock_t gw_listen_fd = SOCKET_INVALID;
+static pthread_t gw_accept_tid;
+static volatile int gw_running = 0;
+static char gw_path[108];
+
+static void queue_control(const char *fmt, int a, unsigned b) {
+    char *m = malloc(64);
+    if (!m) return;
+    snprintf(m, 64, fmt, a, b);
+    enqueue_msg(m, GATEWAY_SENDER);
+}
+
+static GatewaySession *find_session(int link, uint32_t sid) {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (sessions[i].in_use && sessions[i].link == link && sessions[i].sid == sid) return &sessions[i];
+    }
+    return NULL;
+}
+
+static void open_session(int link, uint32_t sid) {
+    pthread_mutex_lock(&gw_lock);
+    int slot = -1;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (!sessions[i].in_use) {
+            slot = i;
+            break;
+        }
+    }
+    ClientCtx *ctx = (slot >= 0 && !find_session(link, sid)) ? client_register(slot_fd(slot)) : NULL;
+    if (ctx) {
+        GatewaySession *s = &sessions[slot];
+        memset(s, 0, sizeof(*s));
+        s->in_use = 1;
+        s->link = link;
+        s->sid = sid;
+        s->conn_id = ctx->connection_id;
+    }
+    pthread_mutex_unlock(&gw_lock);
+
+    if (ctx) {
+        admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+        log_event(LOG_INFO, "conn_accepted", "conn=%d link=%d session=%u", ctx->connection_id, link, sid);
+    } else {
+        admin_stat_inc(STAT_CONNECTIONS_REJECTED);
+        queue_control("GATEWAY_REJECT %d %u", link, sid);
+    }
+}
+
+static void handle_frame(int link, uint32_t sid, int type, const char *payload, size_t len) {
+    if (type == GW_OPEN) {
+        open_session(link, sid);
+        return;
+    }
+
+    /* Feeding happens under gw_lock so the dispatcher cannot free ctx meanwhile */
+    pthread_mutex_lock(&gw_lock);
+    GatewaySession *s = find_session(link, sid);
+    if (s && !s->ended) {
+        ClientCtx *ctx = g_global_state->client_contexts[s->conn_id];
+        if (type == GW_DATA && ctx) {
+            client_feed(ctx, payload, len);
+        } else if (type == GW_CLOSE) {
+            s->ended = 1;
+            s->close_sent = 1;      /* The gateway already knows */
+            queue_disconnect(s->conn_id);
+        }
+    }
+    pthread_mutex_unlock(&gw_lock);
+}
+
+static void *link_reader(void *arg) {
+    int link = (int)(intptr_t)arg;
+    sock_t fd = links[link].fd;
+    unsigned char *buf = malloc(GW_HEADER_SIZE + 0xFFFF + 4096);
+    size_t cap = GW_HEADER_SIZE + 0xFFFF + 4096, len = 0;
+
+    while (buf) {
+        ssize_t n = READ(fd, buf + len, cap - len);
+        if (n <= 0) break;
+        len += (size_t)n;
+
+        size_t off = 0;
+        while (len - off >= GW_HEADER_SIZE) {
+            const unsigned char *h = buf + off;
+            uint32_t sid = ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | ((uint32_t)h[2] << 8) | h[3];
+            size_t plen = ((size_t)h[6] << 8) | h[7];
+            if (len - off < GW_HEADER_SIZE + plen) break;
+            handle_frame(link, sid, h[4], (const char *)h + GW_HEADER_SIZE, plen);
+            off += GW_HEADER_SIZE + plen;
+        }
+        memmove(buf, buf + off, len - off);
+        len -= off;
+    }
+    free(buf);
+
+    /* Every session on this link is gone with it */
+    pthread_mutex_lock(&gw_lock);
+    links[link].active = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        GatewaySession *s = &sessions[i];
+        if (s->in_use && s->link == link && !s->ended) {
+            s->ended = 1;
+            s->close_sent = 1;
+            queue_disconnect(s->conn_id);
+        }
+    }
+    pthread_mutex_unlock(&gw_lock);
+    queue_control("GATEWAY_LINK_DOWN %d", link, 0);
+    return NULL;
+}
+
+static void *gateway_accept_thread(void *arg) {
+    (void)arg;
+    while (gw_running) {
+        sock_t c = accept(gw_listen_fd, NULL, NULL);
+        if (c == SOCKET_INVALID) {
+            if (!gw_running) break;
+            continue;
+        }
+
+        pthread_mutex_lock(&gw_lock);
+        int link = -1;
+        for (int i = 0; i < MAX_LINKS; i++) {
+            if (!links[i].active && links[i].fd == SOCKET_INVALID) {
+                link = i;
+                break;
+            }
+        }
+        if (link >= 0) {
+            GatewayLink *l = &links[link];
+            pthread_mutex_lock(&l->write_lock);
+            l->fd = c;
+            l->active = 1;
+            pthread_mutex_lock(&l->queue_lock);
+            l->out_off = l->out_len = 0;    /* Nothing meant for the old link */
+            pthread_mutex_unlock(&l->queue_lock);
+            pthread_mutex_unlock(&l->write_lock);
+        }
+        pthread_mutex_unlock(&gw_lock);
+
+        if (link < 0) {
+            fprintf(stderr, "Gateway: too many links, refusing one\n");
+            CLOSE(c);
+            continue;
+        }
+        log_event(LOG_INFO, "gateway_connected", "link=%d", link);
+        if (pthread_create(&links[link].tid, NULL, link_reader, (void *)(intptr_t)link) != 0) {
+            shutdown(c, SHUT_RDWR_FLAG);
+            continue;
+        }
+        pthread_detach(links[link].tid);
+    }
+    return NULL;
+}
+
+static sock_t listen_loopback(int port) {
+    sock_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == SOCKET_INVALID) return SOCKET_INVALID;
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  /* The gateway runs next to the server */
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, MAX_LINKS) < 0) {
+        CLOSE(fd);
+        return SOCKET_INVALID;
+    }
+    return fd;
+}
+
+int gateway_start(int port, const char *path) {
+    for (int i = 0; i < MAX_LINKS; i++) {
+        links[i].fd = SOCKET_INVALID;
+        pthread_mutex_init(&links[i].write_lock, NULL);
+        pthread_mutex_init(&links[i].queue_lock, NULL);
+    }
+    links_ready = 1;
+
+    gw_listen_fd = (path && path[0]) ? listen_unix(path, MAX_LINKS) : listen_loopback(port);
+    if (gw_listen_fd == SOCKET_INVALID) return -1;
+    if (path && path[0]) snprintf(gw_path, sizeof(gw_path), "%s", path);
+
+    gw_running = 1;
+    if (pthread_create(&gw_accept_tid, NULL, gateway_accept_thread, NULL) != 0) {
+        gw_running = 0;
+        CLOSE(gw_listen_fd);
+        gw_listen_fd = SOCKET_INVALID;
+        return -1;
+    }
+    return 0;
+}
+
+void gateway_stop(void) {
+    if (gw_listen_fd == SOCKET_INVALID) return;
+    gw_running = 0;
+    shutdown(gw_listen_fd, SHUT_RDWR_FLAG);
+    pthread_join(gw_accept_tid, NULL);
+    CLOSE(gw_listen_fd);
+    gw_listen_fd = SOCKET_INVALID;
+    if (gw_path[0]) unlink(gw_path);
+
+    pthread_mutex_lock(&gw_lock);
+    for (int i = 0; i < MAX_LINKS; i++) {
+        if (links[i].active) shutdown(links[i].fd, SHUT_RDWR_FLAG);
+    }
+    pthread_mutex_unlock(&gw_lock);
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef SERVER_GATEWAY_H
+#define SERVER_GATEWAY_H
+
+/*
+ * server_gateway.h - Multiplexed links from the web gateway
+ *
+ * The Node gateway keeps a few persistent connections (links) to the
+ * gateway port and carries every browser session over them. Each frame has
+ * an 8-byte header: session ID (u32), type (u8), reserved (u8) and payload
+ * length (u16), all big-endian. Each session becomes a virtual client: it
+ * gets a ClientCtx whose fd is a tag the server_send/close helpers route
+ * back to its link, so game code does not know the difference.
+ * POSIX only.
+ */
+
+#include "common.h"
+#include <stddef.h>
+
+#define GATEWAY_SENDER (-6)     /* Control messages from link readers */
+
+#define GW_HEADER_SIZE 8
+#define GW_OPEN 1               /* Gateway -> server: new browser session */
+#define GW_DATA 2               /* Either direction: protocol bytes for the session */
+#define GW_CLOSE 3              /* Either direction: session ended */
+
+/* Accept gateway links on the Unix-domain socket at path, or on loopback
+ * port if path is NULL or empty. Returns 0 on success */
+int gateway_start(int port, const char *path);
+
+/* Close all links and stop accepting */
+void gateway_stop(void);
+
+/* Non-zero if fd is a virtual session socket */
+int gateway_is_virtual(sock_t fd);
+
+/* Send len bytes to virtual fd as DATA frames, waiting for its link (dispatcher).
+ * Returns len, -1 if the session is gone */
+int gateway_send(sock_t fd, const char *buf, size_t len);
+
+/* Queue len bytes for virtual fd on its link without waiting (spectator
+ * fan-out). Returns len, 0 if the link's queue is full, -1 if the session is gone */
+int gateway_send_nowait(sock_t fd, const char *buf, size_t len);
+
+/* Write what the links have queued without waiting. Non-zero while some
+ * of it is still waiting for a link */
+int gateway_push(void);
+
+/* Dispatcher side: end the session (like shutdown on a real socket);
+ * the client's DISCONNECT follows through the queue */
+void gateway_shutdown(sock_t fd);
+
+/* Dispatcher side: release the session slot (like close on a real socket) */
+void gateway_close(sock_t fd);
+
+/* Dispatcher side: handle a control message sent with GATEWAY_SENDER */
+void gateway_handle_control(const char *msg);
+
+#endif /* SERVER_GATEWAY_H */
@@ -0,0 +1,542 @@
+#define _DEFAULT_SOURCE
+#include "server_handoff.h"
+#include "server_message.h"
+#include "server_client.h"
+#include "server_snapshot.h"
+#include "server_journal.h"
+#include "server_admin.h"
+#include "server_admission.h"
+#include "server_tourney.h"
+#include "server_match.h"
+#include "server_spectate.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+#define HANDOFF_MAGIC "BOATHAND"
+#define HANDOFF_VERSION 2
+
+typedef struct HandoffHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t conn_count;
+    uint32_t image_size;
+    uint32_t record_size;
+    uint32_t waiter_count;      /* Connections in the admission queue, after the clients */
+} HandoffHeader;
+
+/* One client connection; its socket travels with the record */
+typedef struct ConnRecord {
+    int32_t connection_id;
+    int32_t lobby_id;           /* -1 when not in a lobby */
+    int32_t seat;
+    uint32_t rbuf_len;
+    char pending_name[64];
+    char rbuf[4096];
+} ConnRecord;
+
+/* A connection held in the admission queue; its socket travels with the record */
+typedef struct WaiterRecord {
+    uint32_t waited_ms;
+} WaiterRecord;
+
+static atomic_int in_progress;
+static atomic_int done;
+static atomic_int accepting;        /* Accept loops between accept and registering */
+static int wake_pipe[2] = {-1, -1};
+static sock_t handoff_fd = SOCKET_INVALID;
+static sock_t peer_fd = SOCKET_INVALID;
+static sock_t server_listen_fd = SOCKET_INVALID;
+static const ServerConfig *server_cfg = NULL;
+static char handoff_path[108];
+
+int handoff_wake_fd(void) {
+    return wake_pipe[0];
+}
+
+int handoff_in_progress(void) {
+    return atomic_load_explicit(&in_progress, memory_order_acquire);
+}
+
+int handoff_done(void) {
+    return atomic_load_explicit(&done, memory_order_acquire);
+}
+
+void handoff_accept_end(void) {
+    if (wake_pipe[0] >= 0) atomic_fetch_sub(&accepting, 1);
+}
+
+#ifdef _WIN32
+int handoff_init(void) { return -1; }
+
+int handoff_listen(const ServerConfig *cfg, sock_t listen_fd) {
+    (void)cfg;
+    (void)listen_fd;
+    fprintf(stderr, "Socket handoff is not supported on Windows\n");
+    return -1;
+}
+
+void handoff_stop(void) { }
+
+int handoff_takeover(const char *path, sock_t *listen_fd, uint32_t floors[MAX_LOBBIES]) {
+    (void)path;
+    (void)listen_fd;
+    (void)floors;
+    fprintf(stderr, "Socket handoff is not supported on Windows\n");
+    return -1;
+}
+
+int handoff_handle_control(const char *msg) {
+    (void)msg;
+    return 0;
+}
+
+int handoff_accept_wait(sock_t listen_fd) {
+    (void)listen_fd;
+    return 1;
+}
+#else
+
+/* ==================== Socket helpers ==================== */
+
+static int send_all(sock_t s, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(s, p, len, MSG_NOSIGNAL);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_all(sock_t s, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(s, p, len, 0);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Send buf with fd attached as SCM_RIGHTS ancillary data */
+static int send_with_fd(sock_t s, const void *buf, size_t len, int fd) {
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {(void *)buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+    ssize_t n = sendmsg(s, &msg, MSG_NOSIGNAL);
+    if (n <= 0) return -1;
+    return send_all(s, (const char *)buf + n, len - (size_t)n);
+}
+
+/* Receive exactly len bytes; the fd sent with them is stored in *fd */
+static int recv_with_fd(sock_t s, void *buf, size_t len, int *fd) {
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    *fd = -1;
+    ssize_t n = recvmsg(s, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return -1;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(cm), sizeof(int));
+        }
+    }
+    if (*fd < 0) return -1;
+    return recv_all(s, (char *)buf + n, len - (size_t)n);
+}
+
+static char *dup_str(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = malloc(len);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+/* ==================== Old process ==================== */
+
+int handoff_init(void) {
+    if (wake_pipe[0] >= 0) return 0;
+    if (pipe(wake_pipe) != 0) return -1;
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static void wait_readers_parked(void) {
+    for (;;) {
+        pthread_mutex_lock(&g_global_state->lock);
+        int threads = g_global_state->active_threads;
+        pthread_mutex_unlock(&g_global_state->lock);
+        if (threads == 0) return;
+        usleep(2000);
+    }
+}
+
+int handoff_accept_wait(sock_t listen_fd) {
+    if (wake_pipe[0] < 0) return 1;
+
+    struct pollfd p[2] = {{listen_fd, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+    for (;;) {
+        if (handoff_done()) return 0;
+        if (handoff_in_progress()) {
+            /* New connections wait in the backlog for whoever owns the listener next */
+            usleep(10000);
+            continue;
+        }
+        if (poll(p, 2, -1) <= 0 || !p[0].revents) continue;
+        atomic_fetch_add(&accepting, 1);
+        if (!handoff_in_progress()) return 1;
+        atomic_fetch_sub(&accepting, 1);
+    }
+}
+
+/* Handoff failed: give every connection its reader back */
+static void resume_readers(void) {
+    char drain[16];
+    atomic_store_explicit(&in_progress, 0, memory_order_release);
+    while (read(wake_pipe[0], drain, sizeof(drain)) > 0) { }
+
+    ClientCtx *ctxs[MAX_CONNECTIONS];
+    int count = 0;
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_global_state->client_contexts[i]) ctxs[count++] = g_global_state->client_contexts[i];
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+    for (int i = 0; i < count; i++) client_start_reader(ctxs[i]);
+}
+
+static void *handoff_thread(void *arg) {
+    (void)arg;
+    char line[64];
+
+    for (;;) {
+        sock_t c = accept(handoff_fd, NULL, NULL);
+        if (c == SOCKET_INVALID) {
+            if (handoff_fd == SOCKET_INVALID) break;
+            continue;
+        }
+        if (read_line(c, line, sizeof(line)) <= 0 || strncmp(line, "TAKEOVER", 8) != 0) {
+            CLOSE(c);
+            continue;
+        }
+
+        printf("Handoff requested, parking connection readers\n");
+        atomic_store(&in_progress, 1);
+        if (write(wake_pipe[1], "x", 1) < 0) perror("handoff wake");
+        while (atomic_load(&accepting) > 0) usleep(1000);
+        wait_readers_parked();
+
+        /* Everything the readers queued is ahead of the commit */
+        peer_fd = c;
+        enqueue_msg(dup_str("HANDOFF_COMMIT"), HANDOFF_SENDER);
+
+        /* Wait until the dispatcher has either handed off or rolled back */
+        while (handoff_in_progress()) usleep(10000);
+        if (handoff_done()) break;
+    }
+    return NULL;
+}
+
+int handoff_listen(const ServerConfig *cfg, sock_t listen_fd) {
+    struct sockaddr_un addr;
+    const char *path = cfg->handoff_socket;
+    if (strlen(path) >= sizeof(addr.sun_path) || handoff_init() != 0) return -1;
+
+    handoff_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handoff_fd == SOCKET_INVALID) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(handoff_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(handoff_fd, 1) < 0) {
+        CLOSE(handoff_fd);
+        handoff_fd = SOCKET_INVALID;
+        return -1;
+    }
+    chmod(path, 0600);
+    strncpy(handoff_path, path, sizeof(handoff_path) - 1);
+    server_cfg = cfg;
+    server_listen_fd = listen_fd;
+
+    pthread_t th;
+    pthread_create(&th, NULL, handoff_thread, NULL);
+    pthread_detach(th);
+    return 0;
+}
+
+void handoff_stop(void) {
+    if (handoff_fd != SOCKET_INVALID) {
+        sock_t fd = handoff_fd;
+        handoff_fd = SOCKET_INVALID;
+        shutdown(fd, SHUT_RDWR_FLAG);
+        CLOSE(fd);
+        unlink(handoff_path);
+    }
+}
+
+/* Send listener, lobby image, connections and the admission queue. Returns 0
+ * once the peer acknowledged */
+static int send_state(sock_t s) {
+    /* The queue stops admitting first, so nobody turns into a client meanwhile */
+    int queued = admission_waiting();
+    sock_t *waiter_fds = malloc((size_t)(queued + 1) * sizeof(sock_t));
+    uint32_t *waited_ms = malloc((size_t)(queued + 1) * sizeof(uint32_t));
+    if (!waiter_fds || !waited_ms) {
+        free(waiter_fds);
+        free(waited_ms);
+        return -1;
+    }
+    queued = admission_hold(waiter_fds, waited_ms, queued);
+
+    ClientCtx *ctxs[MAX_CONNECTIONS];
+    int count = 0;
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_global_state->client_contexts[i]) ctxs[count++] = g_global_state->client_contexts[i];
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+
+    size_t image_size = snapshot_image_size();
+    void *image = malloc(image_size);
+    ConnRecord *rec = calloc(1, sizeof(ConnRecord));
+    if (!image || !rec) {
+        free(image);
+        free(rec);
+        free(waiter_fds);
+        free(waited_ms);
+        return -1;
+    }
+    snapshot_capture(image);
+
+    HandoffHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HANDOFF_MAGIC, sizeof(hdr.magic));
+    hdr.version = HANDOFF_VERSION;
+    hdr.conn_count = (uint32_t)count;
+    hdr.image_size = (uint32_t)image_size;
+    hdr.record_size = sizeof(ConnRecord);
+    hdr.waiter_count = (uint32_t)queued;
+
+    int rc = send_with_fd(s, &hdr, sizeof(hdr), server_listen_fd);
+    if (rc == 0) rc = send_all(s, image, image_size);
+    for (int i = 0; i < count && rc == 0; i++) {
+        ClientCtx *ctx = ctxs[i];
+        memset(rec, 0, sizeof(*rec));
+        rec->connection_id = ctx->connection_id;
+        rec->lobby_id = ctx->lobby ? ctx->lobby->id : -1;
+        rec->seat = ctx->player_id_in_game;
+        rec->rbuf_len = (uint32_t)ctx->rbuf_len;
+        memcpy(rec->pending_name, ctx->pending_name, sizeof(rec->pending_name));
+        memcpy(rec->rbuf, ctx->rbuf, ctx->rbuf_len);
+        rc = send_with_fd(s, rec, sizeof(*rec), ctx->fd);
+    }
+    for (int i = 0; i < queued && rc == 0; i++) {
+        WaiterRecord w = {waited_ms[i]};
+        rc = send_with_fd(s, &w, sizeof(w), waiter_fds[i]);
+    }
+    free(image);
+    free(rec);
+    free(waiter_fds);
+    free(waited_ms);
+
+    char ack[8];
+    if (rc == 0 && (read_line(s, ack, sizeof(ack)) <= 0 || strncmp(ack, "OK", 2) != 0)) rc = -1;
+    if (rc == 0) printf("Handoff: sent %d connections and %d waiting\n", count, queued);
+    return rc;
+}
+
+int handoff_handle_control(const char *msg) {
+    if (strcmp(msg, "HANDOFF_COMMIT") != 0 || peer_fd == SOCKET_INVALID) return 0;
+
+    sock_t s = peer_fd;
+    peer_fd = SOCKET_INVALID;
+
+    /* Tournaments are not part of the image; the new process is turned away */
+    int tourneys = tourney_count();
+    if (tourneys > 0) {
+        fprintf(stderr, "Handoff refused: %d tournament(s) open or running\n", tourneys);
+        CLOSE(s);
+        resume_readers();
+        return 0;
+    }
+
+    /* The matchmaking queue and spectator subscriptions stay behind: their
+     * players queue or watch again over there */
+    match_cancel_all("Server restarting");
+    spectate_end_all();
+
+    /* Flush the journal so the new process appends after our last event */
+    journal_close();
+
+    if (send_state(s) != 0) {
+        fprintf(stderr, "Handoff failed, resuming\n");
+        CLOSE(s);
+        if (server_cfg->journal[0]) journal_open(server_cfg->journal, server_cfg->journal_commit_ms);
+        admission_release(0);
+        resume_readers();
+        return 0;
+    }
+    admission_release(1);
+
+    /* Release everything the new process will bind, then let it start */
+    admin_stop();
+    snapshot_stop();
+    handoff_stop();
+    atomic_store_explicit(&done, 1, memory_order_release);
+    atomic_store_explicit(&in_progress, 0, memory_order_release);
+    send_all(s, "DONE\n", 5);
+    CLOSE(s);
+    printf("Handoff complete, exiting\n");
+    return 1;
+}
+
+/* ==================== New process ==================== */
+
+static int restore_connection(const ConnRecord *rec, int fd) {
+    int id = rec->connection_id;
+    if (id < 0 || id >= MAX_CONNECTIONS || rec->rbuf_len >= sizeof(rec->rbuf)) return -1;
+
+    ClientCtx *ctx = calloc(1, sizeof(ClientCtx));
+    if (!ctx) return -1;
+    ctx->fd = fd;
+    ctx->connection_id = id;
+    ctx->player_id_in_game = -1;
+    memcpy(ctx->pending_name, rec->pending_name, sizeof(ctx->pending_name));
+    ctx->pending_name[sizeof(ctx->pending_name) - 1] = '\0';
+    memcpy(ctx->rbuf, rec->rbuf, rec->rbuf_len);
+    ctx->rbuf_len = rec->rbuf_len;
+
+    pthread_mutex_lock(&g_global_state->lock);
+    if (rec->lobby_id >= 0 && rec->lobby_id < MAX_LOBBIES && rec->seat >= 0 &&
+        rec->seat < MAX_PLAYERS_PER_GAME && g_global_state->lobbies[rec->lobby_id]) {
+        GameLobby *l = g_global_state->lobbies[rec->lobby_id];
+        l->clients[rec->seat] = fd;
+        l->detached[rec->seat] = 0;
+        ctx->lobby = l;
+        ctx->player_id_in_game = rec->seat;
+    }
+    g_global_state->connections[id] = fd;
+    g_global_state->client_contexts[id] = ctx;
+    g_global_state->active_connections++;
+    pthread_mutex_unlock(&g_global_state->lock);
+    return 0;
+}
+
+int handoff_takeover(const char *path, sock_t *listen_fd, uint32_t floors[MAX_LOBBIES]) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    sock_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == SOCKET_INVALID) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 || send_all(s, "TAKEOVER\n", 9) != 0) {
+        CLOSE(s);
+        return -1;
+    }
+
+    HandoffHeader hdr;
+    int lfd = -1;
+    if (recv_with_fd(s, &hdr, sizeof(hdr), &lfd) != 0 ||
+        memcmp(hdr.magic, HANDOFF_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != HANDOFF_VERSION ||
+        hdr.record_size != sizeof(ConnRecord) || hdr.image_size != snapshot_image_size() ||
+        hdr.conn_count > MAX_CONNECTIONS || hdr.waiter_count > 1000000) {
+        fprintf(stderr, "Handoff: the server on %s refused the takeover or is incompatible\n", path);
+        if (lfd >= 0) CLOSE(lfd);
+        CLOSE(s);
+        return -1;
+    }
+
+    void *image = malloc(hdr.image_size);
+    ConnRecord *rec = malloc(sizeof(ConnRecord));
+    int *waiter_fds = malloc((hdr.waiter_count + 1) * sizeof(int));
+    uint32_t *waited_ms = malloc((hdr.waiter_count + 1) * sizeof(uint32_t));
+    int rc = (image && rec && waiter_fds && waited_ms) ? recv_all(s, image, hdr.image_size) : -1;
+    if (rc == 0 && snapshot_restore(image, hdr.image_size, floors) < 0) rc = -1;
+
+    for (uint32_t i = 0; i < hdr.conn_count && rc == 0; i++) {
+        int fd = -1;
+        rc = recv_with_fd(s, rec, sizeof(*rec), &fd);
+        if (rc == 0) rc = restore_connection(rec, fd);
+    }
+    uint32_t waiters = 0;
+    for (; waiters < hdr.waiter_count && rc == 0; waiters++) {
+        WaiterRecord w;
+        rc = recv_with_fd(s, &w, sizeof(w), &waiter_fds[waiters]);
+        waited_ms[waiters] = w.waited_ms;
+    }
+    free(image);
+    free(rec);
+
+    /* Acknowledge, then wait until the old process has released its sockets */
+    char line[16];
+    if (rc == 0) rc = send_all(s, "OK\n", 3);
+    if (rc == 0 && (read_line(s, line, sizeof(line)) <= 0 || strncmp(line, "DONE", 4) != 0)) rc = -1;
+    CLOSE(s);
+    if (rc != 0) {
+        fprintf(stderr, "Handoff: takeover from %s failed\n", path);
+        free(waiter_fds);
+        free(waited_ms);
+        return -1;
+    }
+
+    /* Waiting connections keep their place, behind nobody new */
+    for (uint32_t i = 0; i < waiters; i++) admission_adopt(waiter_fds[i], waited_ms[i]);
+    if (waiters > 0) printf("Handoff: %u connections still waiting for a slot\n", waiters);
+    free(waiter_fds);
+    free(waited_ms);
+
+    int count = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        ClientCtx *ctx = g_global_state->client_contexts[i];
+        if (ctx) {
+            client_announce(ctx);
+            client_start_reader(ctx);
+            count++;
+        }
+    }
+    *listen_fd = lfd;
+    return count;
+}
+#endif
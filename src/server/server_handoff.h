@@ -0,0 +1,58 @@
+#ifndef SERVER_HANDOFF_H
+#define SERVER_HANDOFF_H
+
+/*
+ * server_handoff.h - Zero-downtime restart by handing sockets to a new process
+ *
+ * The running server listens on a Unix-domain handoff socket. A new server
+ * started with --takeover connects to it; the old process stops accepting
+ * (new connections wait in the listen backlog), parks its reader threads,
+ * lets the dispatcher finish queued messages, then sends the listening
+ * socket, every client socket and every socket in the admission queue
+ * (SCM_RIGHTS) and a snapshot image of all lobbies. Clients keep their TCP
+ * connections throughout.
+ * POSIX only.
+ */
+
+#include "server_state.h"
+#include "server_config.h"
+#include <stdint.h>
+
+/* Control messages from the handoff thread use this sender ID */
+#define HANDOFF_SENDER (-5)
+
+/* Create the wake-up pipe readers watch. Call before any reader starts */
+int handoff_init(void);
+
+/* Old process: accept takeover requests on cfg->handoff_socket */
+int handoff_listen(const ServerConfig *cfg, sock_t listen_fd);
+
+/* Close the handoff socket and remove its file */
+void handoff_stop(void);
+
+/* New process: take over from the server at path. On success stores the
+ * inherited listener in *listen_fd, restores lobbies and connections and
+ * fills floors like snapshot_load. Returns connections taken over, -1 on error */
+int handoff_takeover(const char *path, sock_t *listen_fd, uint32_t floors[MAX_LOBBIES]);
+
+/* Reader side: fd that becomes readable when readers must park (-1 if disabled) */
+int handoff_wake_fd(void);
+
+/* Non-zero while a handoff is parking readers or sending state */
+int handoff_in_progress(void);
+
+/* Non-zero once the new process owns the sockets */
+int handoff_done(void);
+
+/* Accept loops: wait until listen_fd has a connection to accept, holding
+ * off while a handoff is in progress. Returns 0 once the new process owns
+ * the listener. After 1, call handoff_accept_end once the connection is
+ * registered (or refused) */
+int handoff_accept_wait(sock_t listen_fd);
+void handoff_accept_end(void);
+
+/* Dispatcher side: handle a control message sent with HANDOFF_SENDER.
+ * Returns 1 if the handoff succeeded and this process should exit. */
+int handoff_handle_control(const char *msg);
+
+#endif /* SERVER_HANDOFF_H */
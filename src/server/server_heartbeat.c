@@ -0,0 +1,89 @@
+#include "server_heartbeat.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_trace.h"
+#include "server_log.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint64_t interval_ms = 0;
+static uint64_t idle_ms = 0;
+
+void heartbeat_configure(int interval_s, int idle_s) {
+    interval_ms = interval_s > 0 ? (uint64_t)interval_s * 1000 : 0;
+    idle_ms = idle_s > 0 ? (uint64_t)idle_s * 1000 : 0;
+}
+
+static void evict(ClientCtx *ctx, const char *why) {
+    log_event(LOG_INFO, "evict", "conn=%d reason=\"%s\"", ctx->connection_id, why);
+    admin_stat_inc(STAT_EVICTIONS);
+    server_shutdown_client(ctx->fd);
+}
+
+/* Next moment something is due: a ping or the idle deadline */
+static void reschedule(ClientCtx *ctx, uint64_t now) {
+    uint64_t due = UINT64_MAX;
+    if (interval_ms) due = ctx->last_seen_ms + interval_ms;
+    if (ctx->pings_unanswered > 0 && interval_ms) due = now + interval_ms;
+    if (idle_ms && ctx->last_active_ms + idle_ms < due) due = ctx->last_active_ms + idle_ms;
+    if (due == UINT64_MAX) return;
+    timer_schedule(&ctx->heartbeat, due > now ? due - now : 0);
+}
+
+static void heartbeat_due(TimerNode *t) {
+    ClientCtx *ctx = TIMER_OWNER(t, ClientCtx, heartbeat);
+    uint64_t now = timers_now_ms();
+
+    if (idle_ms && now - ctx->last_active_ms >= idle_ms) {
+        server_send(ctx->fd, "IDLE_TIMEOUT\n", 13);
+        evict(ctx, "idle");
+        return;
+    }
+    if (interval_ms && now - ctx->last_seen_ms >= interval_ms) {
+        if (ctx->pings_unanswered >= HEARTBEAT_MISSES) {
+            evict(ctx, "no heartbeat");
+            return;
+        }
+        char ping[32];
+        int n = snprintf(ping, sizeof(ping), "PING %u\n", ++ctx->ping_seq);
+        ctx->ping_sent_us = trace_now_us();
+        ctx->pings_unanswered++;
+        server_send(ctx->fd, ping, n);
+    }
+    reschedule(ctx, now);
+}
+
+void heartbeat_attach(ClientCtx *ctx) {
+    uint64_t now = timers_now_ms();
+    ctx->last_seen_ms = now;
+    ctx->last_active_ms = now;
+    timer_init(&ctx->heartbeat, heartbeat_due);
+    reschedule(ctx, now);
+}
+
+void heartbeat_detach(ClientCtx *ctx) {
+    timer_cancel(&ctx->heartbeat);
+}
+
+int heartbeat_on_message(ClientCtx *ctx, const char *m, const char *um) {
+    uint64_t now = timers_now_ms();
+    ctx->last_seen_ms = now;
+    ctx->pings_unanswered = 0;
+
+    unsigned seq;
+    if (sscanf(um, "PONG %u", &seq) == 1) {
+        if (seq == ctx->ping_seq && ctx->ping_sent_us) {
+            ctx->rtt_us = (unsigned)(trace_now_us() - ctx->ping_sent_us);
+            ctx->ping_sent_us = 0;
+        }
+        return 1;
+    }
+    if (strncmp(um, "PING", 4) == 0 && (um[4] == '\0' || um[4] == ' ')) {
+        char pong[MAX_LINE + 8];
+        int n = snprintf(pong, sizeof(pong), "PONG%s\n", m + 4);
+        server_send(ctx->fd, pong, n);
+        return 1;
+    }
+    ctx->last_active_ms = now;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SERVER_HEARTBEAT_H
+#define SERVER_HEARTBEAT_H
+
+/*
+ * server_heartbeat.h - Liveness checks for client connections
+ *
+ * A client that stays silent for one interval gets "PING <seq>" and must
+ * answer "PONG <seq>"; the round trip is kept per connection for the admin
+ * stats. After HEARTBEAT_MISSES unanswered pings, or when a connection has
+ * sent nothing but heartbeats for the idle timeout, it is shut down and
+ * the usual DISCONNECT path (handle_client_disconnect) cleans it up.
+ * Clients may also send "PING <token>" and get "PONG <token>" back.
+ * Everything here runs on the dispatcher thread.
+ */
+
+#include "server_state.h"
+
+#define HEARTBEAT_MISSES 3
+
+/* Ping after interval_s seconds of silence (0 = never) and evict connections
+ * without real traffic for idle_s seconds (0 = never) */
+void heartbeat_configure(int interval_s, int idle_s);
+
+/* Start watching a newly registered connection */
+void heartbeat_attach(ClientCtx *ctx);
+
+/* Stop watching a connection that is about to be freed */
+void heartbeat_detach(ClientCtx *ctx);
+
+/* Note a line from ctx (m as received, um upper-cased). Returns 1 if it
+ * was a heartbeat that needs no further dispatching */
+int heartbeat_on_message(ClientCtx *ctx, const char *m, const char *um);
+
+#endif /* SERVER_HEARTBEAT_H */
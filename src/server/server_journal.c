@@ -0,0 +1,429 @@
+#define _DEFAULT_SOURCE
+#include "server_journal.h"
+#include "server_state.h"
+#include "server_commands.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#define fsync_file(f) _commit(_fileno(f))
+#define truncate_file(f, len) _chsize(_fileno(f), (long)(len))
+#else
+#include <unistd.h>
+#define fsync_file(f) fsync(fileno(f))
+#define truncate_file(f, len) ftruncate(fileno(f), (off_t)(len))
+#endif
+
+/* Record layout (little endian):
+ *   u8 magic, u8 type, u8 seat, u8 payload_len, u16 lobby, u32 seq, u16 crc, payload */
+#define JOURNAL_MAGIC 0xB7
+#define JOURNAL_HEADER_SIZE 12
+#define JOURNAL_MAX_PAYLOAD 255
+
+/* Writer wakes early once this much is pending */
+#define JOURNAL_FLUSH_BYTES (64 * 1024)
+
+static FILE *journal_file = NULL;
+static char journal_path[260];
+static pthread_t writer_tid;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static unsigned char *pending = NULL;
+static size_t pending_len = 0;
+static size_t pending_cap = 0;
+static int writer_running = 0;
+static int commit_interval_ms = 10;
+static uint32_t next_seq = 1;
+static uint32_t compact_before = 0;     /* Pending compaction request, 0 = none */
+
+/* CRC-16/CCITT-FALSE */
+static uint16_t crc16(uint16_t crc, const unsigned char *p, size_t n) {
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t record_crc(const unsigned char *hdr, const unsigned char *payload, size_t len) {
+    uint16_t crc = crc16(0xFFFF, hdr, 10);
+    return crc16(crc, payload, len);
+}
+
+uint32_t journal_next_seq(void) {
+    pthread_mutex_lock(&journal_lock);
+    uint32_t seq = next_seq;
+    pthread_mutex_unlock(&journal_lock);
+    return seq;
+}
+
+int journal_active(void) {
+    return journal_file != NULL;
+}
+
+/* ==================== Appending ==================== */
+
+void journal_append(JournalEventType type, int lobby_id, int seat, const void *payload, int len) {
+    if (!journal_file) return;
+    if (len < 0) len = 0;
+    if (len > JOURNAL_MAX_PAYLOAD) len = JOURNAL_MAX_PAYLOAD;
+
+    pthread_mutex_lock(&journal_lock);
+    size_t need = pending_len + JOURNAL_HEADER_SIZE + (size_t)len;
+    if (need > pending_cap) {
+        size_t cap = pending_cap ? pending_cap * 2 : 4096;
+        while (cap < need) cap *= 2;
+        unsigned char *p = realloc(pending, cap);
+        if (!p) {
+            pthread_mutex_unlock(&journal_lock);
+            return;
+        }
+        pending = p;
+        pending_cap = cap;
+    }
+
+    unsigned char *h = pending + pending_len;
+    uint32_t seq = next_seq++;
+    h[0] = JOURNAL_MAGIC;
+    h[1] = (unsigned char)type;
+    h[2] = (unsigned char)(seat < 0 ? 0xFF : seat);
+    h[3] = (unsigned char)len;
+    h[4] = (unsigned char)(lobby_id & 0xFF);
+    h[5] = (unsigned char)((lobby_id >> 8) & 0xFF);
+    h[6] = (unsigned char)(seq & 0xFF);
+    h[7] = (unsigned char)((seq >> 8) & 0xFF);
+    h[8] = (unsigned char)((seq >> 16) & 0xFF);
+    h[9] = (unsigned char)((seq >> 24) & 0xFF);
+    if (len) memcpy(h + JOURNAL_HEADER_SIZE, payload, (size_t)len);
+    uint16_t crc = record_crc(h, h + JOURNAL_HEADER_SIZE, (size_t)len);
+    h[10] = (unsigned char)(crc & 0xFF);
+    h[11] = (unsigned char)(crc >> 8);
+    pending_len = need;
+
+    if (pending_len >= JOURNAL_FLUSH_BYTES) pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_lock);
+}
+
+static signed char clamp8(int v) {
+    if (v < -128) return -128;
+    if (v > 127) return 127;
+    return (signed char)v;
+}
+
+void journal_game_command(int lobby_id, int seat, const char *msg) {
+    if (!journal_file) return;
+
+    char um[MAX_LINE];
+    size_t mi = 0;
+    for (size_t i = 0; msg[i] && i + 1 < sizeof(um); i++) {
+        char ch = msg[i];
+        if (ch >= 'a' && ch <= 'z') ch = ch - 'a' + 'A';
+        um[mi++] = ch;
+    }
+    um[mi] = '\0';
+
+    int a, b, c, d;
+    char dir = 'H';
+    signed char p[5];
+
+    if (strncmp(um, "NAME ", 5) == 0) {
+        char name[64];
+        if (sscanf(msg + 5, "%63[^\r\n]", name) == 1) {
+            journal_append(JE_NAME, lobby_id, seat, name, (int)strlen(name));
+        }
+    } else if (strncmp(um, "PLACE ", 6) == 0) {
+        if (sscanf(um, "PLACE %d %d %d %c", &a, &b, &c, &dir) >= 3) {
+            p[0] = clamp8(a); p[1] = clamp8(b); p[2] = clamp8(c); p[3] = dir;
+            journal_append(JE_PLACE, lobby_id, seat, p, 4);
+        }
+    } else if (strncmp(um, "MOVE ", 5) == 0) {
+        if (sscanf(um, "MOVE %d %d %d %d %c", &a, &b, &c, &d, &dir) >= 4) {
+            p[0] = clamp8(a); p[1] = clamp8(b); p[2] = clamp8(c); p[3] = clamp8(d); p[4] = dir;
+            journal_append(JE_MOVE, lobby_id, seat, p, 5);
+        }
+    } else if (strncmp(um, "READY", 5) == 0) {
+        journal_append(JE_READY, lobby_id, seat, NULL, 0);
+    } else if (strncmp(um, "FIRE ", 5) == 0) {
+        if (sscanf(um, "FIRE %d %d", &a, &b) == 2) {
+            p[0] = clamp8(a); p[1] = clamp8(b);
+            journal_append(JE_FIRE, lobby_id, seat, p, 2);
+        }
+    } else if (strncmp(um, "PLAY_AGAIN ", 11) == 0) {
+        char ans[16] = {0};
+        if (sscanf(um, "PLAY_AGAIN %15s", ans) == 1) {
+            p[0] = (strstr(ans, "YES") != NULL) ? 1 : 2;
+            journal_append(JE_REMATCH, lobby_id, seat, p, 1);
+        }
+    }
+}
+
+static uint32_t record_seq(const unsigned char *h) {
+    return (uint32_t)h[6] | ((uint32_t)h[7] << 8) | ((uint32_t)h[8] << 16) | ((uint32_t)h[9] << 24);
+}
+
+/* Rewrite the journal without records older than min_seq. Writer thread only. */
+static void compact_file(uint32_t min_seq) {
+    fclose(journal_file);
+    journal_file = NULL;
+
+    FILE *f = fopen(journal_path, "rb");
+    unsigned char *data = NULL;
+    long size = 0;
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        data = size > 0 ? malloc((size_t)size) : NULL;
+        if (data && fread(data, 1, (size_t)size, f) != (size_t)size) size = 0;
+        fclose(f);
+    }
+
+    if (data && size > 0) {
+        size_t off = 0, keep = 0, kept_from = 0;
+        while (off + JOURNAL_HEADER_SIZE <= (size_t)size) {
+            size_t len = JOURNAL_HEADER_SIZE + data[off + 3];
+            if (off + len > (size_t)size) break;
+            if (record_seq(data + off) < min_seq) kept_from = off + len;
+            off += len;
+        }
+        keep = off - kept_from;
+        if (kept_from > 0 && file_replace_atomic(journal_path, data + kept_from, keep) != 0) {
+            fprintf(stderr, "Journal: compaction failed\n");
+        }
+    }
+    free(data);
+
+    journal_file = fopen(journal_path, "ab");
+    if (!journal_file) fprintf(stderr, "Journal: cannot reopen %s\n", journal_path);
+}
+
+static void *journal_writer(void *arg) {
+    (void)arg;
+    unsigned char *batch = NULL;
+    size_t batch_cap = 0;
+
+    pthread_mutex_lock(&journal_lock);
+    while (writer_running || pending_len > 0) {
+        if (writer_running && pending_len < JOURNAL_FLUSH_BYTES) {
+            /* Collect events from every game for one commit interval */
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += (long)commit_interval_ms * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&journal_cond, &journal_lock, &ts);
+        }
+        if (compact_before) {
+            uint32_t min_seq = compact_before;
+            compact_before = 0;
+            pthread_mutex_unlock(&journal_lock);
+            compact_file(min_seq);
+            pthread_mutex_lock(&journal_lock);
+        }
+        if (pending_len == 0 || !journal_file) continue;
+
+        /* Swap buffers so appends continue while we write */
+        unsigned char *buf = pending;
+        size_t len = pending_len;
+        pending = batch;
+        pending_cap = batch_cap;
+        pending_len = 0;
+        pthread_mutex_unlock(&journal_lock);
+
+        fwrite(buf, 1, len, journal_file);
+        fflush(journal_file);
+        fsync_file(journal_file);
+
+        pthread_mutex_lock(&journal_lock);
+        batch = buf;
+        batch_cap = len > batch_cap ? len : batch_cap;
+    }
+    pthread_mutex_unlock(&journal_lock);
+    free(batch);
+    return NULL;
+}
+
+int journal_open(const char *path, int commit_ms) {
+    journal_file = fopen(path, "ab");
+    if (!journal_file) return -1;
+
+    strncpy(journal_path, path, sizeof(journal_path) - 1);
+
+    commit_interval_ms = commit_ms > 0 ? commit_ms : 10;
+    writer_running = 1;
+    if (pthread_create(&writer_tid, NULL, journal_writer, NULL) != 0) {
+        fclose(journal_file);
+        journal_file = NULL;
+        writer_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void journal_compact(uint32_t min_seq) {
+    if (!journal_file) return;
+    pthread_mutex_lock(&journal_lock);
+    compact_before = min_seq;
+    pthread_mutex_unlock(&journal_lock);
+}
+
+void journal_close(void) {
+    if (!journal_file) return;
+
+    pthread_mutex_lock(&journal_lock);
+    writer_running = 0;
+    pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_lock);
+    pthread_join(writer_tid, NULL);
+
+    fclose(journal_file);
+    journal_file = NULL;
+    free(pending);
+    pending = NULL;
+    pending_len = pending_cap = 0;
+}
+
+/* ==================== Replay ==================== */
+
+static void apply_event(int type, int lobby_id, int seat, const unsigned char *p, int len) {
+    GameLobby *l = NULL;
+    char cmd[128];
+
+    if (lobby_id >= 0 && lobby_id < MAX_LOBBIES) l = g_global_state->lobbies[lobby_id];
+
+    if (type == JE_LOBBY_CREATE) {
+        l = create_lobby_at(g_global_state, lobby_id);
+        if (l) {
+            memcpy(l->lobby_name, p, (size_t)len < sizeof(l->lobby_name) ? (size_t)len : sizeof(l->lobby_name) - 1);
+        }
+        return;
+    }
+    if (!l || seat < 0 || seat >= MAX_PLAYERS_PER_GAME) {
+        if (l && type == JE_LOBBY_CLOSE) destroy_lobby(g_global_state, lobby_id);
+        return;
+    }
+
+    const signed char *v = (const signed char *)p;
+    switch (type) {
+        case JE_JOIN:
+            l->num_players++;
+            l->detached[seat] = 1;
+            /* Journals from before tokens were recorded leave the seat unclaimable */
+            if (len == RESUME_TOKEN_LEN) {
+                memcpy(l->resume[seat].token, p, RESUME_TOKEN_LEN);
+                l->resume[seat].token[RESUME_TOKEN_LEN] = '\0';
+            } else {
+                l->resume[seat].token[0] = '\0';
+            }
+            break;
+        case JE_LEAVE:
+            handle_disconnect(l, seat, NULL);
+            l->detached[seat] = 0;
+            if (--l->num_players <= 0) destroy_lobby(g_global_state, lobby_id);
+            break;
+        case JE_NAME:
+            snprintf(cmd, sizeof(cmd), "NAME %.*s", len, (const char *)p);
+            handle_name_command(l, cmd, seat);
+            break;
+        case JE_PLACE:
+            if (len < 4) break;
+            snprintf(cmd, sizeof(cmd), "PLACE %d %d %d %c", v[0], v[1], v[2], v[3]);
+            handle_place_command(l, cmd, seat);
+            break;
+        case JE_MOVE:
+            if (len < 5) break;
+            snprintf(cmd, sizeof(cmd), "MOVE %d %d %d %d %c", v[0], v[1], v[2], v[3], v[4]);
+            handle_move_command(l, cmd, seat);
+            break;
+        case JE_READY:
+            handle_ready_command(l, seat);
+            break;
+        case JE_FIRE:
+            if (len < 2) break;
+            snprintf(cmd, sizeof(cmd), "FIRE %d %d", v[0], v[1]);
+            handle_fire_command(l, cmd, seat);
+            break;
+        case JE_REMATCH:
+            if (len < 1) break;
+            handle_rematch_response(l, seat, p[0]);
+            break;
+        case JE_LOBBY_CLOSE:
+            destroy_lobby(g_global_state, lobby_id);
+            break;
+        case JE_CLOCK:
+            if (len < 4) break;
+            l->turn_time = p[0] | p[1] << 8;
+            l->placement_time = p[2] | p[3] << 8;
+            break;
+        default:
+            break;
+    }
+}
+
+int journal_replay(const char *path, const uint32_t floors[MAX_LOBBIES]) {
+    if (floors) {
+        /* Sequence numbers continue after the snapshot even if the journal was trimmed */
+        for (int i = 0; i < MAX_LOBBIES; i++) {
+            if (floors[i] > next_seq) next_seq = floors[i];
+        }
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0; /* No journal yet */
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(f);
+        return 0;
+    }
+
+    unsigned char *data = malloc((size_t)size);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    size_t off = 0;
+    int applied = 0;
+    while (off + JOURNAL_HEADER_SIZE <= (size_t)size) {
+        const unsigned char *h = data + off;
+        size_t len = h[3];
+        if (h[0] != JOURNAL_MAGIC || off + JOURNAL_HEADER_SIZE + len > (size_t)size) break;
+
+        uint16_t crc = (uint16_t)(h[10] | (h[11] << 8));
+        if (crc != record_crc(h, h + JOURNAL_HEADER_SIZE, len)) break;
+
+        int lobby_id = h[4] | (h[5] << 8);
+        int seat = (h[2] == 0xFF) ? -1 : h[2];
+        uint32_t seq = record_seq(h);
+
+        if (!floors || lobby_id >= MAX_LOBBIES || seq >= floors[lobby_id]) {
+            apply_event(h[1], lobby_id, seat, h + JOURNAL_HEADER_SIZE, (int)len);
+            applied++;
+        }
+        if (seq >= next_seq) next_seq = seq + 1;
+        off += JOURNAL_HEADER_SIZE + len;
+    }
+    free(data);
+
+    /* Cut off a torn record so new appends start on a record boundary */
+    if (off < (size_t)size) {
+        FILE *t = fopen(path, "r+b");
+        if (t) {
+            if (truncate_file(t, off) != 0) fprintf(stderr, "Failed to truncate journal tail\n");
+            fclose(t);
+        }
+        fprintf(stderr, "Journal: dropped %ld bytes of incomplete records\n", size - (long)off);
+    }
+    return applied;
+}
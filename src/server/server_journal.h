@@ -0,0 +1,59 @@
+#ifndef SERVER_JOURNAL_H
+#define SERVER_JOURNAL_H
+
+/*
+ * server_journal.h - Append-only binary journal of game events
+ *
+ * Every state-changing event is appended as a small binary record.
+ * A background thread writes and fsyncs records in batches (group commit),
+ * so one fsync covers every game that produced events in the window.
+ * On startup the journal is replayed to rebuild lobbies; restored seats
+ * stay detached until their player sends RESUME with the token from its
+ * ASSIGN (kept in the JE_JOIN record) or the resume grace runs out.
+ */
+
+#include "server_state.h"
+#include <stdint.h>
+
+typedef enum {
+    JE_LOBBY_CREATE = 1,    /* payload: lobby name */
+    JE_JOIN,                /* seat taken; payload: resume token */
+    JE_LEAVE,               /* seat released (disconnect) */
+    JE_NAME,                /* payload: player name */
+    JE_PLACE,               /* payload: r c len dir */
+    JE_MOVE,                /* payload: fr fc tr tc dir */
+    JE_READY,
+    JE_FIRE,                /* payload: r c */
+    JE_REMATCH,             /* payload: 1=yes 2=no */
+    JE_LOBBY_CLOSE,         /* lobby destroyed by an admin */
+    JE_CLOCK                /* payload: turn_s placement_s, u16 each */
+} JournalEventType;
+
+/* Replay an existing journal into g_global_state. Returns events applied, -1 on error.
+ * Events for lobby slot i with a sequence number below floors[i] are skipped
+ * (already part of a snapshot); floors may be NULL.
+ * A torn record at the tail (crash mid-write) is cut off. */
+int journal_replay(const char *path, const uint32_t floors[MAX_LOBBIES]);
+
+/* Open the journal for appending and start the group-commit writer */
+int journal_open(const char *path, int commit_ms);
+
+/* Flush, fsync and stop the writer */
+void journal_close(void);
+
+/* Non-zero when a journal is open */
+int journal_active(void);
+
+/* Append an event (no-op when no journal is open) */
+void journal_append(JournalEventType type, int lobby_id, int seat, const void *payload, int len);
+
+/* Append a game command line (PLACE, MOVE, READY, FIRE, NAME, PLAY_AGAIN) in binary form */
+void journal_game_command(int lobby_id, int seat, const char *msg);
+
+/* Sequence number that the next appended event will receive */
+uint32_t journal_next_seq(void);
+
+/* Ask the writer to drop records with a sequence number below min_seq */
+void journal_compact(uint32_t min_seq);
+
+#endif /* SERVER_JOURNAL_H */
@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE
+#include "server_log.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#define SLEEP_MS(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define SLEEP_MS(ms) usleep((ms)*1000)
+#endif
+
+#define RATE_SLOTS 32
+
+enum { RING_FREE, RING_OWNED, RING_RELEASED };
+
+typedef struct LogLine {
+    uint64_t wall_ms;
+    int level;
+    char text[LOG_LINE_MAX];        /* "event key=value ..." */
+} LogLine;
+
+/* One thread's lines. The owner advances head, the writer advances tail */
+typedef struct LogRing {
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_int state;               /* RING_*; a released ring is reused once drained */
+    atomic_ulong dropped;           /* Since the writer last looked */
+    atomic_ulong suppressed;
+    struct {
+        uint32_t event;             /* Hash of the event name */
+        uint64_t second;
+        int count;
+    } rate[RATE_SLOTS];             /* Owner only */
+    LogLine lines[LOG_RING_SIZE];
+} LogRing;
+
+/* Rings are never freed: a thread keeps its pointer until it exits */
+static LogRing *rings[LOG_MAX_RINGS];
+static atomic_int nrings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static int ring_key_made = 0;
+static _Thread_local LogRing *my_ring;
+
+static atomic_int min_level = LOG_INFO;
+static atomic_int rate_limit;
+static atomic_int running;
+static atomic_int stopping;
+static atomic_ulong total_written, total_dropped, total_suppressed;
+
+static FILE *out;
+static pthread_t writer_tid;
+
+static const char *level_names[] = {"debug", "info", "warn", "error"};
+static const char *level_tags[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+static uint32_t event_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static void format_text(char *buf, size_t cap, const char *event, const char *fields, va_list ap) {
+    int n = snprintf(buf, cap, "%s", event);
+    if (fields && n >= 0 && (size_t)n + 1 < cap) {
+        buf[n++] = ' ';
+        vsnprintf(buf + n, cap - (size_t)n, fields, ap);
+    }
+}
+
+/* "2026-01-02T03:04:05.678Z" */
+static void format_time(uint64_t ms, char *buf, size_t cap) {
+    time_t t = (time_t)(ms / 1000);
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    size_t n = strftime(buf, cap, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, cap - n, ".%03uZ", (unsigned)(ms % 1000));
+}
+
+static void release_ring(void *arg) {
+    LogRing *r = arg;
+    atomic_store_explicit(&r->state, RING_RELEASED, memory_order_release);
+}
+
+static LogRing *acquire_ring(void) {
+    int n = atomic_load_explicit(&nrings, memory_order_acquire);
+    LogRing *r = NULL;
+
+    for (int i = 0; i < n && !r; i++) {
+        int expect = RING_FREE;
+        if (atomic_compare_exchange_strong(&rings[i]->state, &expect, RING_OWNED)) r = rings[i];
+    }
+    if (!r) {
+        pthread_mutex_lock(&rings_lock);
+        n = atomic_load_explicit(&nrings, memory_order_relaxed);
+        if (n < LOG_MAX_RINGS && (r = calloc(1, sizeof(*r))) != NULL) {
+            atomic_init(&r->state, RING_OWNED);
+            rings[n] = r;
+            atomic_store_explicit(&nrings, n + 1, memory_order_release);
+        }
+        pthread_mutex_unlock(&rings_lock);
+    }
+    if (!r) return NULL;
+    memset(r->rate, 0, sizeof(r->rate));
+    if (ring_key_made) pthread_setspecific(ring_key, r);
+    return r;
+}
+
+/* Per thread and event: at most rate_limit lines in each wall clock second */
+static int rate_allows(LogRing *r, const char *event, uint64_t now_ms) {
+    int limit = atomic_load_explicit(&rate_limit, memory_order_relaxed);
+    if (limit <= 0) return 1;
+
+    uint32_t h = event_hash(event);
+    uint64_t second = now_ms / 1000;
+    int slot = (int)(h % RATE_SLOTS);
+    if (r->rate[slot].event != h || r->rate[slot].second != second) {
+        r->rate[slot].event = h;
+        r->rate[slot].second = second;
+        r->rate[slot].count = 0;
+    }
+    return ++r->rate[slot].count <= limit;
+}
+
+void log_event(int level, const char *event, const char *fields, ...) {
+    if (level < atomic_load_explicit(&min_level, memory_order_relaxed)) return;
+    uint64_t now = wall_ms();
+    va_list ap;
+
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        char stamp[32], text[LOG_LINE_MAX];
+        va_start(ap, fields);
+        format_text(text, sizeof(text), event, fields, ap);
+        va_end(ap);
+        format_time(now, stamp, sizeof(stamp));
+        fprintf(stderr, "%s %s %s\n", stamp, level_tags[level], text);
+        return;
+    }
+
+    LogRing *r = my_ring;
+    if (!r && (r = my_ring = acquire_ring()) == NULL) {
+        atomic_fetch_add_explicit(&total_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    if (level < LOG_WARN && !rate_allows(r, event, now)) {
+        atomic_fetch_add_explicit(&r->suppressed, 1, memory_order_relaxed);
+        return;
+    }
+
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    LogLine *line = &r->lines[head % LOG_RING_SIZE];
+    line->wall_ms = now;
+    line->level = level;
+    va_start(ap, fields);
+    format_text(line->text, sizeof(line->text), event, fields, ap);
+    va_end(ap);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static void write_line(uint64_t ms, int level, const char *text) {
+    char stamp[32];
+    format_time(ms, stamp, sizeof(stamp));
+    fprintf(out, "%s %s %s\n", stamp, level_tags[level], text);
+    atomic_fetch_add_explicit(&total_written, 1, memory_order_relaxed);
+}
+
+/* Write everything buffered, oldest first across rings. Returns lines written */
+static int drain(void) {
+    int n = atomic_load_explicit(&nrings, memory_order_acquire);
+    unsigned heads[LOG_MAX_RINGS];
+    int written = 0;
+
+    for (int i = 0; i < n; i++) heads[i] = atomic_load_explicit(&rings[i]->head, memory_order_acquire);
+    for (;;) {
+        LogRing *best = NULL;
+        const LogLine *next = NULL;
+        for (int i = 0; i < n; i++) {
+            unsigned tail = atomic_load_explicit(&rings[i]->tail, memory_order_relaxed);
+            if (tail == heads[i]) continue;
+            const LogLine *line = &rings[i]->lines[tail % LOG_RING_SIZE];
+            if (!next || line->wall_ms < next->wall_ms) {
+                best = rings[i];
+                next = line;
+            }
+        }
+        if (!best) break;
+        write_line(next->wall_ms, next->level, next->text);
+        atomic_fetch_add_explicit(&best->tail, 1, memory_order_release);
+        written++;
+    }
+
+    for (int i = 0; i < n; i++) {
+        LogRing *r = rings[i];
+        unsigned long dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+        unsigned long suppressed = atomic_exchange_explicit(&r->suppressed, 0, memory_order_relaxed);
+        char text[64];
+        if (dropped) {
+            atomic_fetch_add_explicit(&total_dropped, dropped, memory_order_relaxed);
+            snprintf(text, sizeof(text), "log_dropped count=%lu", dropped);
+            write_line(wall_ms(), LOG_WARN, text);
+        }
+        if (suppressed) {
+            atomic_fetch_add_explicit(&total_suppressed, suppressed, memory_order_relaxed);
+            snprintf(text, sizeof(text), "log_suppressed count=%lu", suppressed);
+            write_line(wall_ms(), LOG_WARN, text);
+        }
+        int expect = RING_RELEASED;
+        if (atomic_load_explicit(&r->tail, memory_order_relaxed) == atomic_load_explicit(&r->head, memory_order_acquire)) {
+            atomic_compare_exchange_strong(&r->state, &expect, RING_FREE);
+        }
+    }
+    if (written) fflush(out);
+    return written;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        int stop = atomic_load(&stopping);
+        int n = drain();
+        if (stop) break;
+        if (n == 0) SLEEP_MS(LOG_DRAIN_MS);
+    }
+    return NULL;
+}
+
+int log_open(const char *path, int level, int rate) {
+    if (atomic_load(&running)) return -1;
+    if (path && path[0]) {
+        out = fopen(path, "a");
+        if (!out) return -1;
+        setvbuf(out, NULL, _IOFBF, 64 * 1024);
+    } else {
+        out = stderr;
+    }
+    if (!ring_key_made && pthread_key_create(&ring_key, release_ring) == 0) ring_key_made = 1;
+
+    log_set_level(level);
+    atomic_store(&rate_limit, rate);
+    atomic_store(&stopping, 0);
+    atomic_store(&running, 1);
+    if (pthread_create(&writer_tid, NULL, writer_main, NULL) != 0) {
+        atomic_store(&running, 0);
+        if (out != stderr) fclose(out);
+        return -1;
+    }
+    return 0;
+}
+
+void log_close(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&running, 0);
+    atomic_store(&stopping, 1);
+    pthread_join(writer_tid, NULL);
+    if (out != stderr) fclose(out);
+    else fflush(out);
+    out = NULL;
+}
+
+void log_set_level(int level) {
+    if (level < LOG_DEBUG) level = LOG_DEBUG;
+    if (level > LOG_ERROR) level = LOG_ERROR;
+    atomic_store_explicit(&min_level, level, memory_order_relaxed);
+}
+
+int log_get_level(void) {
+    return atomic_load_explicit(&min_level, memory_order_relaxed);
+}
+
+int log_level_parse(const char *name) {
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++) {
+        if (strcmp(name, level_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *log_level_name(int level) {
+    return level >= LOG_DEBUG && level <= LOG_ERROR ? level_names[level] : "?";
+}
+
+void log_counters(unsigned long long *written, unsigned long long *dropped, unsigned long long *suppressed) {
+    *written = atomic_load(&total_written);
+    *dropped = atomic_load(&total_dropped);
+    *suppressed = atomic_load(&total_suppressed);
+}
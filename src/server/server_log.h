@@ -0,0 +1,54 @@
+#ifndef SERVER_LOG_H
+#define SERVER_LOG_H
+
+/*
+ * server_log.h - Asynchronous structured event log
+ *
+ * Each line is an event name followed by key=value fields, stamped with the
+ * wall clock and a level:
+ *
+ *     2026-01-02T03:04:05.678Z INFO  join conn=7 lobby=3 seat=1
+ *
+ * A thread that logs formats the line into a ring of its own (single
+ * producer, single consumer) and returns; it never takes a lock or touches
+ * the output. A writer thread drains every ring to the log file or stderr.
+ * A full ring drops the line instead of waiting. Each thread may write
+ * --log-rate lines per second of one event; further ones are counted and
+ * reported as a "log_suppressed" line. Warnings and errors are never
+ * rate limited.
+ */
+
+enum { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR };
+
+#define LOG_RING_SIZE 512           /* Lines buffered per thread */
+#define LOG_LINE_MAX 232            /* Event and fields, longer lines are cut */
+#define LOG_MAX_RINGS 256           /* Threads logging at the same time */
+#define LOG_DRAIN_MS 10
+
+/* Start the writer. path NULL or "" logs to stderr. Lines below level are
+ * skipped; rate is lines per second per event and thread, 0 = unlimited.
+ * Returns 0 on success. Before log_open (and after log_close) lines go
+ * straight to stderr */
+int log_open(const char *path, int level, int rate);
+
+/* Write out what is buffered, stop the writer and close the file */
+void log_close(void);
+
+/* Log event with printf-style key=value fields (may be NULL) */
+void log_event(int level, const char *event, const char *fields, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
+void log_set_level(int level);
+int log_get_level(void);
+
+/* "debug", "info", "warn" or "error"; -1 if name is none of them */
+int log_level_parse(const char *name);
+const char *log_level_name(int level);
+
+/* Lines written, dropped on a full ring and suppressed by the rate limit */
+void log_counters(unsigned long long *written, unsigned long long *dropped, unsigned long long *suppressed);
+
+#endif /* SERVER_LOG_H */
@@ -0,0 +1,301 @@
+#include "server_match.h"
+#include "server_commands.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_spectate.h"
+#include "server_store.h"
+#include "server_trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct Ticket {
+    int conn;
+    unsigned id;            /* Ticket number, unique for the life of the server */
+    int rating;
+    int cancel;             /* Inbox only: withdraw ticket id */
+    uint64_t since_ms;      /* When the player first queued */
+} Ticket;
+
+typedef struct TicketVec {
+    Ticket *v;
+    int len, cap;
+} TicketVec;
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mm_wake = PTHREAD_COND_INITIALIZER;
+static TicketVec inbox;             /* Joins and cancels from the dispatcher (mm_lock) */
+static TicketVec outbox;            /* Pairs for the dispatcher, two entries each (mm_lock) */
+static int mm_running = 0;
+static pthread_t mm_tid;
+
+/* Matcher thread only */
+static TicketVec pool;
+static unsigned live[MAX_CONNECTIONS];   /* Ticket the pool holds for each connection, 0 = none */
+
+/* Dispatcher only */
+static unsigned queued[MAX_CONNECTIONS]; /* Ticket of each queued connection, 0 = none */
+static unsigned next_ticket = 1;
+static int lobbies_made = 0;
+
+static uint64_t now_ms(void) {
+    return trace_now_us() / 1000;
+}
+
+static int vec_push(TicketVec *q, const Ticket *t) {
+    if (q->len == q->cap) {
+        int cap = q->cap ? q->cap * 2 : 64;
+        Ticket *v = realloc(q->v, (size_t)cap * sizeof(Ticket));
+        if (!v) return -1;
+        q->v = v;
+        q->cap = cap;
+    }
+    q->v[q->len++] = *t;
+    return 0;
+}
+
+/* Hand a whole vector over in O(1): src becomes empty */
+static void vec_take(TicketVec *dst, TicketVec *src) {
+    TicketVec tmp = *dst;
+    *dst = *src;
+    *src = tmp;
+    src->len = 0;
+}
+
+static int by_rating(const void *x, const void *y) {
+    const Ticket *a = x, *b = y;
+    if (a->rating != b->rating) return a->rating < b->rating ? -1 : 1;
+    return a->since_ms < b->since_ms ? -1 : a->since_ms > b->since_ms;
+}
+
+static int window(const Ticket *t, uint64_t now) {
+    uint64_t waited_s = now > t->since_ms ? (now - t->since_ms) / 1000 : 0;
+    return MATCH_WINDOW + (int)waited_s * MATCH_WINDOW_PER_S;
+}
+
+/* One matching pass: fold in the inbox, sort by rating and pair neighbours */
+static void match_batch(TicketVec *in, TicketVec *pairs) {
+    for (int i = 0; i < in->len; i++) {
+        Ticket *t = &in->v[i];
+        if (t->cancel) {
+            if (live[t->conn] == t->id) live[t->conn] = 0;
+        } else {
+            live[t->conn] = t->id;
+            vec_push(&pool, t);
+        }
+    }
+    in->len = 0;
+
+    /* Drop withdrawn tickets, and older ones a connection has replaced */
+    int n = 0;
+    for (int i = 0; i < pool.len; i++) {
+        if (live[pool.v[i].conn] == pool.v[i].id) pool.v[n++] = pool.v[i];
+    }
+    pool.len = n;
+    if (n < 2) return;
+
+    qsort(pool.v, (size_t)n, sizeof(Ticket), by_rating);
+
+    uint64_t now = now_ms();
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        Ticket *a = &pool.v[i];
+        if (i + 1 < n) {
+            Ticket *b = &pool.v[i + 1];
+            int wa = window(a, now), wb = window(b, now);
+            /* The longer wait sets the window, so nobody waits forever */
+            if (b->rating - a->rating <= (wa > wb ? wa : wb)) {
+                live[a->conn] = live[b->conn] = 0;
+                vec_push(pairs, a);
+                vec_push(pairs, b);
+                i++;
+                continue;
+            }
+        }
+        pool.v[kept++] = *a;
+    }
+    pool.len = kept;
+}
+
+static void *matcher_thread(void *arg) {
+    (void)arg;
+    TicketVec in = {0}, pairs = {0};
+
+    pthread_mutex_lock(&mm_lock);
+    while (mm_running) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)MATCH_BATCH_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&mm_wake, &mm_lock, &ts);
+        if (!mm_running) break;
+        if (inbox.len == 0 && pool.len < 2) continue;
+
+        /* Everything that arrived during the interval is matched as one batch */
+        vec_take(&in, &inbox);
+        pthread_mutex_unlock(&mm_lock);
+
+        match_batch(&in, &pairs);
+
+        pthread_mutex_lock(&mm_lock);
+        if (pairs.len > 0) {
+            int notify = outbox.len == 0;
+            for (int i = 0; i < pairs.len; i++) vec_push(&outbox, &pairs.v[i]);
+            pairs.len = 0;
+            if (notify) {
+                char *m = malloc(8);
+                if (m) {
+                    memcpy(m, "MATCHED", 8);
+                    enqueue_msg(m, MATCH_SENDER);
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&mm_lock);
+    free(in.v);
+    free(pairs.v);
+    return NULL;
+}
+
+int match_start(void) {
+    mm_running = 1;
+    if (pthread_create(&mm_tid, NULL, matcher_thread, NULL) != 0) {
+        mm_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void match_stop(void) {
+    if (!mm_running) return;
+    pthread_mutex_lock(&mm_lock);
+    mm_running = 0;
+    pthread_cond_signal(&mm_wake);
+    pthread_mutex_unlock(&mm_lock);
+    pthread_join(mm_tid, NULL);
+    free(pool.v);
+    free(inbox.v);
+    free(outbox.v);
+    memset(&pool, 0, sizeof(pool));
+    memset(&inbox, 0, sizeof(inbox));
+    memset(&outbox, 0, sizeof(outbox));
+}
+
+static void post(const Ticket *t) {
+    pthread_mutex_lock(&mm_lock);
+    vec_push(&inbox, t);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+void match_command(ClientCtx *ctx, const char *um) {
+    int conn = ctx->connection_id;
+    char msg[64];
+    int n;
+
+    if (strncmp(um, "MATCHMAKE_CANCEL", 16) == 0) {
+        if (queued[conn]) {
+            match_cancel(ctx);
+            server_send(ctx->fd, "MATCHMAKE_CANCELLED\n", 20);
+        }
+        return;
+    }
+    if (!ctx->pending_name[0]) {
+        server_send(ctx->fd, "MATCHMAKE_FAIL Set a name first\n", 32);
+        return;
+    }
+    if (admin_is_draining()) {
+        server_send(ctx->fd, "MATCHMAKE_FAIL Server draining\n", 31);
+        return;
+    }
+
+    int rating = store_rating(ctx->pending_name);
+    if (!queued[conn]) {
+        Ticket t = {conn, next_ticket++, rating, 0, now_ms()};
+        if (next_ticket == 0) next_ticket = 1;
+        queued[conn] = t.id;
+        post(&t);
+    }
+    n = snprintf(msg, sizeof(msg), "MATCHMAKING %d\n", rating);
+    server_send(ctx->fd, msg, n);
+}
+
+void match_cancel(ClientCtx *ctx) {
+    int conn = ctx->connection_id;
+    if (!queued[conn]) return;
+    Ticket t = {conn, queued[conn], 0, 1, 0};
+    queued[conn] = 0;
+    post(&t);
+}
+
+void match_cancel_all(const char *why) {
+    char msg[96];
+    int n = snprintf(msg, sizeof(msg), "MATCHMAKE_FAIL %s\n", why);
+    for (int conn = 0; conn < MAX_CONNECTIONS; conn++) {
+        ClientCtx *ctx = g_global_state->client_contexts[conn];
+        if (!queued[conn] || !ctx) continue;
+        match_cancel(ctx);
+        server_send(ctx->fd, msg, n);
+    }
+}
+
+/* A ticket is good if its connection is still there, still queued under it and free */
+static ClientCtx *ticket_ctx(const Ticket *t) {
+    ClientCtx *ctx = g_global_state->client_contexts[t->conn];
+    if (!ctx || queued[t->conn] != t->id) return NULL;
+    if (ctx->lobby) {
+        queued[t->conn] = 0;
+        return NULL;
+    }
+    return ctx;
+}
+
+void match_handle_control(void) {
+    TicketVec pairs = {0};
+    pthread_mutex_lock(&mm_lock);
+    vec_take(&pairs, &outbox);
+    pthread_mutex_unlock(&mm_lock);
+
+    for (int i = 0; i + 1 < pairs.len; i += 2) {
+        Ticket *t[2] = {&pairs.v[i], &pairs.v[i + 1]};
+        ClientCtx *c[2] = {ticket_ctx(t[0]), ticket_ctx(t[1])};
+        GameLobby *l = NULL;
+
+        if (admin_is_draining()) {
+            /* Paired before the drain started: no new games now */
+            for (int k = 0; k < 2; k++) {
+                if (!c[k]) continue;
+                match_cancel(c[k]);
+                server_send(c[k]->fd, "MATCHMAKE_FAIL Server draining\n", 31);
+            }
+            continue;
+        }
+        if (c[0] && c[1]) {
+            char name[32];
+            snprintf(name, sizeof(name), "Match-%d", ++lobbies_made);
+            l = create_named_lobby(g_global_state, name);
+        }
+        if (!l) {
+            /* Partner gone or no lobby free: back in the queue, keeping the wait */
+            for (int k = 0; k < 2; k++) {
+                if (c[k]) post(t[k]);
+            }
+            continue;
+        }
+
+        for (int k = 0; k < 2; k++) {
+            char msg[128];
+            int n = snprintf(msg, sizeof(msg), "MATCH_FOUND %d %s %d\n", l->id,
+                             c[k ^ 1]->pending_name, t[k ^ 1]->rating);
+            queued[t[k]->conn] = 0;
+            spectate_leave(c[k]);
+            server_send(c[k]->fd, msg, n);
+        }
+        admin_stat_inc(STAT_LOBBIES_CREATED);
+        join_lobby_id(c[0], l->id);
+        join_lobby_id(c[1], l->id);
+    }
+    free(pairs.v);
+}
@@ -0,0 +1,45 @@
+#ifndef SERVER_MATCH_H
+#define SERVER_MATCH_H
+
+/*
+ * server_match.h - Rating-based matchmaking queue
+ *
+ * "MATCHMAKE" from a named connection outside any lobby queues it at its
+ * rating ("MATCHMAKING <rating>"); "MATCHMAKE_CANCEL" takes it out again.
+ * The dispatcher only appends the request to an inbox under a lock of its
+ * own; a matcher thread drains the inbox every MATCH_BATCH_MS, sorts the
+ * whole queue by rating and pairs neighbours whose ratings are within a
+ * window that widens the longer either player has waited. Pairs go back to
+ * the dispatcher (MATCH_SENDER), which gives each one a lobby and seats
+ * both players ("MATCH_FOUND <lobby> <opponent> <rating>").
+ *
+ * Ratings come from the player store (server_store.h).
+ */
+
+#include "server_state.h"
+
+/* Pairing messages to the dispatcher use this sender ID */
+#define MATCH_SENDER (-8)
+
+#define MATCH_BATCH_MS 200
+#define MATCH_WINDOW 100            /* Rating gap accepted straight away */
+#define MATCH_WINDOW_PER_S 50       /* Added to the window per second waited */
+
+/* Start / stop the matcher thread */
+int match_start(void);
+void match_stop(void);
+
+/* Handle MATCHMAKE / MATCHMAKE_CANCEL from ctx (not in a lobby) */
+void match_command(ClientCtx *ctx, const char *um);
+
+/* ctx is going away or taking a seat elsewhere: drop its ticket */
+void match_cancel(ClientCtx *ctx);
+
+/* Take every queued connection out of the queue with "MATCHMAKE_FAIL <why>"
+ * (the server is stopping or handing off; the queue is not carried over) */
+void match_cancel_all(const char *why);
+
+/* Dispatcher side: seat the pairs the matcher produced */
+void match_handle_control(void);
+
+#endif /* SERVER_MATCH_H */
@@ -1,42 +1,232 @@
+#define _DEFAULT_SOURCE
 #include "server_message.h"
-#include "generic_queue.h"
+#include "server_uring.h"
+#include "server_ws.h"
+#include "server_gateway.h"
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
-static GenericQueue msg_queue;
+#if defined(MSG_DONTWAIT) && defined(MSG_NOSIGNAL)
+#define SEND_NOWAIT (MSG_DONTWAIT | MSG_NOSIGNAL)
+#else
+#define SEND_NOWAIT 0   /* Windows: the send may block */
+#endif
+
+typedef struct MsgNode {
+    MsgEntry entry;
+    struct MsgNode *next;
+} MsgNode;
+
+static struct {
+    MsgNode *head[MSG_LANES];
+    MsgNode *tail[MSG_LANES];
+    int depth[MSG_LANES];
+    int pending[MAX_CONNECTIONS][MSG_LANES];   /* Per connection, to keep its lines in order */
+    int game_run;                               /* Game messages since the last background one */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} mq;
+
+/* Write locks, striped by fd: held around every write to a client socket so
+ * a write from the spectator fan-out never lands in the middle of one from
+ * the dispatcher. Recursive because one io_uring flush covers many fds */
+#define OUT_LOCKS 256
+static pthread_mutex_t out_locks[OUT_LOCKS];
+
+/* Verbs of a game in progress; matched case-insensitively at the start of the line */
+static const char *const game_verbs[] = {
+    "FIRE ", "PLACE ", "MOVE ", "READY", "STATE", "CLOCK ", "PLAY_AGAIN ", "RESUME ", "PING", "PONG",
+};
+
+static int classify(const char *msg, int sender, int seated) {
+    size_t len = strlen(msg);
+    if (sender < 0 || (len > 0 && msg[len - 1] == '\n')) return MSG_LANE_CONTROL;
+    /* Only a seated player's moves are urgent; the rest waits its turn */
+    if (!seated) return MSG_LANE_BACKGROUND;
+    for (size_t i = 0; i < sizeof(game_verbs) / sizeof(game_verbs[0]); i++) {
+        if (starts_with(msg, game_verbs[i])) return MSG_LANE_GAME;
+    }
+    return MSG_LANE_BACKGROUND;
+}
 
 void message_queue_init(void) {
-    queue_init(&msg_queue);
+    memset(mq.head, 0, sizeof(mq.head));
+    memset(mq.tail, 0, sizeof(mq.tail));
+    memset(mq.depth, 0, sizeof(mq.depth));
+    memset(mq.pending, 0, sizeof(mq.pending));
+    mq.game_run = 0;
+    pthread_mutex_init(&mq.lock, NULL);
+    pthread_cond_init(&mq.cond, NULL);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < OUT_LOCKS; i++) pthread_mutex_init(&out_locks[i], &attr);
+    pthread_mutexattr_destroy(&attr);
 }
 
 void enqueue_msg(char *msg, int sender) {
-    MsgEntry *entry = (MsgEntry *)malloc(sizeof(MsgEntry));
-    if (entry) {
-        entry->msg = msg;
-        entry->sender = sender;
-        queue_push(&msg_queue, entry);
+    enqueue_msg_traced(msg, sender, 0, NULL);
+}
+
+void enqueue_msg_traced(char *msg, int sender, int seated, MsgTrace *trace) {
+    MsgNode *node = (MsgNode *)malloc(sizeof(MsgNode));
+    if (!node) {
+        free(trace);
+        return;
+    }
+    node->entry.msg = msg;
+    node->entry.sender = sender;
+    node->entry.trace = trace;
+    node->next = NULL;
+    if (trace) trace->t_enqueue = trace_now_us();
+    int lane = msg ? classify(msg, sender, seated) : MSG_LANE_CONTROL;
+    int conn = sender >= 0 && sender < MAX_CONNECTIONS ? sender : -1;
+
+    pthread_mutex_lock(&mq.lock);
+    if (conn >= 0) {
+        /* Behind the connection's lowest priority line still waiting */
+        for (int l = MSG_LANES - 1; l > lane; l--) {
+            if (mq.pending[conn][l]) {
+                lane = l;
+                break;
+            }
+        }
+        mq.pending[conn][lane]++;
     }
+    if (mq.tail[lane]) mq.tail[lane]->next = node;
+    else mq.head[lane] = node;
+    mq.tail[lane] = node;
+    mq.depth[lane]++;
+    pthread_cond_signal(&mq.cond);
+    pthread_mutex_unlock(&mq.lock);
+}
+
+/* Next lane to serve; caller holds the lock and something is queued */
+static int pick_lane(void) {
+    if (mq.head[MSG_LANE_CONTROL]) return MSG_LANE_CONTROL;
+    if (!mq.head[MSG_LANE_BACKGROUND]) return MSG_LANE_GAME;
+    if (!mq.head[MSG_LANE_GAME] || mq.game_run >= DISPATCH_GAME_WEIGHT) return MSG_LANE_BACKGROUND;
+    return MSG_LANE_GAME;
 }
 
 MsgEntry dequeue_msg(void) {
-    MsgEntry *ptr = (MsgEntry *)queue_pop(&msg_queue);
-    MsgEntry e = *ptr;
-    free(ptr); /* Free the container, but not the message content (caller handles that) */
+    pthread_mutex_lock(&mq.lock);
+    while (!mq.head[MSG_LANE_CONTROL] && !mq.head[MSG_LANE_GAME] && !mq.head[MSG_LANE_BACKGROUND]) {
+        pthread_cond_wait(&mq.cond, &mq.lock);
+    }
+    int lane = pick_lane();
+    MsgNode *node = mq.head[lane];
+    mq.head[lane] = node->next;
+    if (!mq.head[lane]) mq.tail[lane] = NULL;
+    mq.depth[lane]--;
+    if (lane == MSG_LANE_GAME) mq.game_run++;
+    else if (lane == MSG_LANE_BACKGROUND) mq.game_run = 0;
+    int sender = node->entry.sender;
+    if (sender >= 0 && sender < MAX_CONNECTIONS) mq.pending[sender][lane]--;
+    pthread_mutex_unlock(&mq.lock);
+
+    MsgEntry e = node->entry;
+    free(node); /* Free the container, but not the message content (caller handles that) */
+    if (e.trace) e.trace->t_dequeue = trace_now_us();
     return e;
 }
 
+void message_queue_depths(int depths[MSG_LANES]) {
+    pthread_mutex_lock(&mq.lock);
+    for (int l = 0; l < MSG_LANES; l++) depths[l] = mq.depth[l];
+    pthread_mutex_unlock(&mq.lock);
+}
+
 void message_queue_cleanup(void) {
-    /* Iterate manually to free data before destroying nodes */
-    pthread_mutex_lock(&msg_queue.lock);
-    QueueNode *current = msg_queue.head;
-    while (current != NULL) {
-        MsgEntry *entry = (MsgEntry *)current->data;
-        if (entry) {
-            if (entry->msg) free(entry->msg);
-            free(entry);
+    pthread_mutex_lock(&mq.lock);
+    for (int l = 0; l < MSG_LANES; l++) {
+        MsgNode *node = mq.head[l];
+        while (node) {
+            MsgNode *next = node->next;
+            free(node->entry.msg);
+            free(node->entry.trace);
+            free(node);
+            node = next;
         }
-        current = current->next;
+        mq.head[l] = mq.tail[l] = NULL;
+        mq.depth[l] = 0;
+    }
+    pthread_mutex_unlock(&mq.lock);
+
+    pthread_mutex_destroy(&mq.lock);
+    pthread_cond_destroy(&mq.cond);
+}
+
+static pthread_mutex_t *out_lock(sock_t fd) {
+    return &out_locks[(uintptr_t)fd % OUT_LOCKS];
+}
+
+void server_out_lock(sock_t fd) {
+    pthread_mutex_lock(out_lock(fd));
+}
+
+void server_out_unlock(sock_t fd) {
+    pthread_mutex_unlock(out_lock(fd));
+}
+
+int server_send_raw(sock_t fd, const char *buf, int len) {
+    if (uring_send_batched(fd, buf, len)) return len;
+
+    int n;
+    server_out_lock(fd);
+    if (!trace_enabled()) {
+        n = (int)WRITE(fd, buf, len);
+    } else {
+        uint64_t start = trace_now_us();
+        n = (int)WRITE(fd, buf, len);
+        trace_record_write(start, trace_now_us());
+    }
+    server_out_unlock(fd);
+    return n;
+}
+
+int server_send(sock_t fd, const char *buf, int len) {
+    if (gateway_is_virtual(fd)) return gateway_send(fd, buf, (size_t)len);
+    if (len > 0 && ws_is_client(fd)) {
+        size_t flen;
+        char *frame = ws_frame(WS_OP_TEXT, buf, (size_t)len, &flen);
+        if (!frame) return -1;
+        int n = server_send_raw(fd, frame, (int)flen);
+        free(frame);
+        return n < 0 ? n : len;
+    }
+    return server_send_raw(fd, buf, len);
+}
+
+int server_send_nowait(sock_t fd, const char *buf, int len) {
+    if (gateway_is_virtual(fd)) return gateway_send_nowait(fd, buf, (size_t)len);
+    if (pthread_mutex_trylock(out_lock(fd)) != 0) return 0;
+    int ok = send(fd, buf, len, SEND_NOWAIT) == len;
+    server_out_unlock(fd);
+    return ok ? len : -1;
+}
+
+void server_flush_output(void) {
+    uring_flush_sends();
+}
+
+void server_shutdown_client(sock_t fd) {
+    server_flush_output();
+    if (gateway_is_virtual(fd)) {
+        gateway_shutdown(fd);
+    } else {
+        shutdown(fd, SHUT_RDWR_FLAG);
+    }
+}
+
+void server_close_client(sock_t fd) {
+    server_flush_output();
+    if (gateway_is_virtual(fd)) {
+        gateway_close(fd);
+    } else {
+        ws_forget(fd);
+        CLOSE(fd);
     }
-    pthread_mutex_unlock(&msg_queue.lock);
-    
-    queue_destroy(&msg_queue);
 }
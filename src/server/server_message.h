@@ -1,12 +1,34 @@
 #ifndef SERVER_MESSAGE_H
 #define SERVER_MESSAGE_H
 
+#include "common.h"
+#include "server_trace.h"
 #include <pthread.h>
 
+/*
+ * The dispatcher queue has three lanes:
+ *
+ *   - control: internal senders (admin, timers, gateway, ...) and the
+ *     readers' newline-terminated notices (CONNECTED, DISCONNECT, ...);
+ *   - game: game commands (FIRE, PLACE, READY, ...) from a player who
+ *     holds a seat in a lobby;
+ *   - background: everything else (LOBBY_LIST, NAME, MATCHMAKE, and any
+ *     line from a connection without a seat).
+ *
+ * Control always goes first. When game and background are both waiting, the
+ * dispatcher takes up to DISPATCH_GAME_WEIGHT game messages per background
+ * one. A connection's lines stay in order: a line never goes to a higher
+ * priority lane than one of the same connection still waiting.
+ */
+enum { MSG_LANE_CONTROL, MSG_LANE_GAME, MSG_LANE_BACKGROUND, MSG_LANES };
+
+#define DISPATCH_GAME_WEIGHT 8
+
 /* Message queue entry */
 typedef struct MsgEntry {
     char *msg;
     int sender;
+    MsgTrace *trace;    /* Stage timestamps, NULL unless sampled */
 } MsgEntry;
 
 /* Initialize message queue */
@@ -15,10 +37,43 @@ void message_queue_init(void);
 /* Enqueue a message from a client */
 void enqueue_msg(char *msg, int sender);
 
+/* Enqueue a client line carrying a (possibly NULL) trace record; seated
+ * says whether the sender holds a seat in a lobby */
+void enqueue_msg_traced(char *msg, int sender, int seated, MsgTrace *trace);
+
 /* Dequeue and return next message (blocks if queue empty) */
 MsgEntry dequeue_msg(void);
 
+/* Messages waiting in each lane */
+void message_queue_depths(int depths[MSG_LANES]);
+
 /* Cleanup message queue and free remaining messages */
 void message_queue_cleanup(void);
 
+/* Write to a client socket; attributes the write to the traced message being dispatched */
+int server_send(sock_t fd, const char *buf, int len);
+
+/* Write bytes to a socket as they are, without WebSocket or gateway framing */
+int server_send_raw(sock_t fd, const char *buf, int len);
+
+/* Write to a client from a thread other than the dispatcher without waiting
+ * for it: returns len when all of buf went out (or was queued on its gateway
+ * link), 0 if another write was in progress or the link's queue is full
+ * (nothing was sent, try again), -1 if the socket could not take it all at
+ * once (part of it may have been sent) */
+int server_send_nowait(sock_t fd, const char *buf, int len);
+
+/* Take or release the write lock of fd's socket (striped, recursive) */
+void server_out_lock(sock_t fd);
+void server_out_unlock(sock_t fd);
+
+/* Push out replies batched by the io_uring backend */
+void server_flush_output(void);
+
+/* End a client's connection; its reader (or gateway link) then queues the DISCONNECT */
+void server_shutdown_client(sock_t fd);
+
+/* Close a client socket once its DISCONNECT is handled (works for gateway sessions too) */
+void server_close_client(sock_t fd);
+
 #endif /* SERVER_MESSAGE_H */
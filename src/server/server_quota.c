@@ -0,0 +1,104 @@
+#include "server_quota.h"
+#include "server_trace.h"
+#include "common.h"
+#include <stddef.h>
+
+/* Verbs that cost the server more than a line's worth of work, with their
+ * own limits (lines per second, burst) */
+static const struct {
+    const char *verb;
+    int rate, burst;
+} verb_limits[QUOTA_VERBS] = {
+    {"LOBBY_LIST", 5, 10},
+    {"LEADERBOARD", 2, 5},
+    {"STATS ", 5, 10},
+    {"FIRE ", 10, 20},
+    {"MATCHMAKE", 2, 5},
+    {"LOBBY_CREATE ", 1, 3},
+    {"SPECTATE ", 2, 5},
+    {"TOURNEY_", 2, 5},
+};
+
+static atomic_int conn_rate = 50;
+static atomic_int queue_share = 64;
+static atomic_int abuse_limit = 200;
+static atomic_ulong refused_total, disconnects_total;
+
+void quota_configure(int rate, int share, int abuse) {
+    atomic_store(&conn_rate, rate > 0 ? rate : 0);
+    atomic_store(&queue_share, share > 0 ? share : 0);
+    atomic_store(&abuse_limit, abuse > 0 ? abuse : 0);
+}
+
+/* Case-insensitive "line starts with word" (word in upper case) */
+/* Refill b for the time since it was last used and take one line */
+static int bucket_take(TokenBucket *b, int rate, int burst, uint64_t now) {
+    int64_t cap = (int64_t)burst * 1000;
+    if (b->last_us == 0) {
+        b->tokens = cap;
+        b->last_us = now;
+    } else {
+        /* Keep last_us until at least a thousandth has accrued, so lines
+         * arriving microseconds apart still refill the bucket */
+        int64_t gained = (int64_t)((now - b->last_us) * (uint64_t)rate / 1000);
+        if (gained > 0) {
+            b->tokens = b->tokens + gained > cap ? cap : b->tokens + gained;
+            b->last_us = now;
+        }
+    }
+    if (b->tokens < 1000) return 0;
+    b->tokens -= 1000;
+    return 1;
+}
+
+static int refuse(ClientQuota *q, uint64_t now, int *notify) {
+    int abuse = atomic_load_explicit(&abuse_limit, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&refused_total, 1, memory_order_relaxed);
+    *notify = !q->limited;
+    q->limited = 1;
+    if (now - q->window_us >= (uint64_t)QUOTA_ABUSE_WINDOW_MS * 1000) {
+        q->window_us = now;
+        q->strikes = 0;
+    }
+    if (abuse && ++q->strikes >= abuse) {
+        q->cut = 1;
+        atomic_fetch_add_explicit(&disconnects_total, 1, memory_order_relaxed);
+        return QUOTA_DISCONNECT;
+    }
+    return QUOTA_REFUSE;
+}
+
+int quota_admit(ClientQuota *q, const char *line, int *notify) {
+    int rate = atomic_load_explicit(&conn_rate, memory_order_relaxed);
+    int share = atomic_load_explicit(&queue_share, memory_order_relaxed);
+    uint64_t now = trace_now_us();
+
+    *notify = 0;
+    if (q->cut) return QUOTA_REFUSE;
+    if (share && atomic_load_explicit(&q->queued, memory_order_relaxed) >= share) return refuse(q, now, notify);
+    if (rate) {
+        /* Check the verb first so a refused verb does not use up the connection's tokens */
+        for (int i = 0; i < QUOTA_VERBS; i++) {
+            if (!starts_with(line, verb_limits[i].verb)) continue;
+            if (!bucket_take(&q->verb[i], verb_limits[i].rate, verb_limits[i].burst, now)) return refuse(q, now, notify);
+            break;
+        }
+        if (!bucket_take(&q->conn, rate, 2 * rate, now)) return refuse(q, now, notify);
+    }
+    q->limited = 0;
+    atomic_fetch_add_explicit(&q->queued, 1, memory_order_relaxed);
+    return QUOTA_ACCEPT;
+}
+
+void quota_release(ClientQuota *q) {
+    atomic_fetch_sub_explicit(&q->queued, 1, memory_order_relaxed);
+}
+
+unsigned long quota_refused(void) {
+    return atomic_load(&refused_total);
+}
+
+unsigned long quota_disconnects(void) {
+    return atomic_load(&disconnects_total);
+}
@@ -0,0 +1,62 @@
+#ifndef SERVER_QUOTA_H
+#define SERVER_QUOTA_H
+
+/*
+ * server_quota.h - Per-connection rate limits and queue share
+ *
+ * Every line a client sends is checked on the thread that read it, before
+ * it is copied or queued:
+ *
+ *   - a token bucket per connection (--rate-limit lines per second, bursts
+ *     of twice that) and one per expensive verb (LOBBY_LIST, FIRE, ...);
+ *   - the connection's share of the dispatcher queue: at most --queue-share
+ *     of its lines may be waiting at once.
+ *
+ * A refused line is dropped; the client is told RATE_LIMITED once per run
+ * of refusals. A connection with --abuse-limit refusals within
+ * QUOTA_ABUSE_WINDOW_MS is disconnected. The reader only decides: it hands
+ * the notice and the disconnection to the dispatcher as "RATE_LIMITED\n"
+ * and "ABUSE\n" lines (newline-terminated like CONNECTED and DISCONNECT).
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define QUOTA_VERBS 8
+#define QUOTA_ABUSE_WINDOW_MS 10000
+
+typedef struct TokenBucket {
+    int64_t tokens;             /* In thousandths of a line; full when last_us is 0 */
+    uint64_t last_us;
+} TokenBucket;
+
+/* Quota state of one connection (reader side, except queued) */
+typedef struct ClientQuota {
+    TokenBucket conn;
+    TokenBucket verb[QUOTA_VERBS];
+    atomic_int queued;          /* Lines waiting for the dispatcher */
+    int limited;                /* Last line was refused */
+    int cut;                    /* Disconnect ordered: refuse everything */
+    int strikes;                /* Refusals in the current abuse window */
+    uint64_t window_us;
+} ClientQuota;
+
+enum { QUOTA_ACCEPT, QUOTA_REFUSE, QUOTA_DISCONNECT };
+
+/* Limits for all connections. rate 0 disables the rate limits, share 0 the
+ * queue bound, abuse 0 disconnection */
+void quota_configure(int rate, int share, int abuse);
+
+/* Check a line before it is copied or queued. QUOTA_ACCEPT counts it in the
+ * queue share; *notify is set when the client should be told RATE_LIMITED.
+ * After QUOTA_DISCONNECT every line is refused */
+int quota_admit(ClientQuota *q, const char *line, int *notify);
+
+/* The dispatcher took one of the connection's lines off the queue */
+void quota_release(ClientQuota *q);
+
+/* Lines refused and connections dropped so far */
+unsigned long quota_refused(void);
+unsigned long quota_disconnects(void);
+
+#endif /* SERVER_QUOTA_H */
@@ -0,0 +1,162 @@
+#include "server_resume.h"
+#include "server_commands.h"
+#include "server_message.h"
+#include "server_journal.h"
+#include "server_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t grace_ms = 0;
+
+void resume_configure(int grace_s) {
+    grace_ms = grace_s > 0 ? (uint64_t)grace_s * 1000 : 0;
+}
+
+static void random_bytes(unsigned char *p, size_t n) {
+#ifndef _WIN32
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f) {
+        size_t got = fread(p, 1, n, f);
+        fclose(f);
+        if (got == n) return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) p[i] = (unsigned char)(rand() & 0xFF);
+}
+
+static void grace_expired(TimerNode *t) {
+    SeatResume *rs = TIMER_OWNER(t, SeatResume, grace);
+    log_event(LOG_INFO, "resume_expired", "lobby=%d seat=%d", rs->lobby->id, rs->seat);
+    resume_release_seat(rs->lobby, rs->seat);
+}
+
+void resume_init_lobby(GameLobby *l) {
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        SeatResume *rs = &l->resume[i];
+        rs->token[0] = '\0';
+        rs->lobby = l;
+        rs->seat = i;
+        timer_init(&rs->grace, grace_expired);
+    }
+}
+
+const char *resume_issue(GameLobby *l, int seat) {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char raw[RESUME_TOKEN_LEN / 2];
+    char *tok = l->resume[seat].token;
+
+    random_bytes(raw, sizeof(raw));
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        tok[2 * i] = hex[raw[i] >> 4];
+        tok[2 * i + 1] = hex[raw[i] & 0xF];
+    }
+    tok[RESUME_TOKEN_LEN] = '\0';
+    return tok;
+}
+
+void resume_revoke(GameLobby *l, int seat) {
+    timer_cancel(&l->resume[seat].grace);
+    l->resume[seat].token[0] = '\0';
+}
+
+int resume_detach(ClientCtx *ctx) {
+    GameLobby *l = ctx->lobby;
+    int seat = ctx->player_id_in_game;
+    int other = seat ^ 1;
+
+    if (!grace_ms || !l->resume[seat].token[0] || l->clients[seat] != ctx->fd) return 0;
+    /* Only a match is worth holding; a lone player just leaves */
+    if (l->clients[other] == SOCKET_INVALID && !l->detached[other]) return 0;
+
+    pthread_mutex_lock(&l->lock);
+    server_close_client(ctx->fd);
+    l->clients[seat] = SOCKET_INVALID;
+    l->detached[seat] = 1;
+    pthread_mutex_unlock(&l->lock);
+    timer_schedule(&l->resume[seat].grace, grace_ms);
+
+    if (l->clients[other] != SOCKET_INVALID) {
+        char msg[48];
+        int n = snprintf(msg, sizeof(msg), "OPPONENT_AWAY %d %d\n", seat, (int)(grace_ms / 1000));
+        server_send(l->clients[other], msg, n);
+    }
+    log_event(LOG_INFO, "seat_held", "conn=%d lobby=%d seat=%d grace_s=%d",
+              ctx->connection_id, l->id, seat, (int)(grace_ms / 1000));
+    return 1;
+}
+
+int resume_attach(ClientCtx *ctx, const char *token) {
+    GameLobby *found = NULL;
+    int seat = -1;
+
+    if (strlen(token) != RESUME_TOKEN_LEN) return 0;
+
+    pthread_mutex_lock(&g_global_state->lock);
+    for (int i = 0; i < MAX_LOBBIES && !found; i++) {
+        GameLobby *l = g_global_state->lobbies[i];
+        if (!l) continue;
+        pthread_mutex_lock(&l->lock);
+        for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+            if (l->detached[s] && l->resume[s].token[0] && strcmp(l->resume[s].token, token) == 0) {
+                l->detached[s] = 0;
+                l->clients[s] = ctx->fd;
+                found = l;
+                seat = s;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&l->lock);
+    }
+    pthread_mutex_unlock(&g_global_state->lock);
+
+    if (!found) return 0;
+
+    timer_cancel(&found->resume[seat].grace);
+    ctx->lobby = found;
+    ctx->player_id_in_game = seat;
+    memcpy(ctx->pending_name, found->names[seat], sizeof(ctx->pending_name));
+    log_event(LOG_INFO, "resumed", "conn=%d lobby=%d seat=%d", ctx->connection_id, found->id, seat);
+
+    char msg[32];
+    int n = snprintf(msg, sizeof(msg), "RESUMED %d\n", seat);
+    pthread_mutex_lock(&found->lock);
+    server_send(ctx->fd, msg, n);
+    send_seat_state(found, seat);
+    n = snprintf(msg, sizeof(msg), "OPPONENT_BACK %d\n", seat);
+    if (found->clients[seat ^ 1] != SOCKET_INVALID) server_send(found->clients[seat ^ 1], msg, n);
+    pthread_mutex_unlock(&found->lock);
+    return 1;
+}
+
+void resume_arm_restored(void) {
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+            GameLobby *l = g_global_state->lobbies[i];
+            if (!l || !l->detached[s]) continue;
+            if (grace_ms && l->resume[s].token[0]) {
+                timer_schedule(&l->resume[s].grace, grace_ms);
+                log_event(LOG_INFO, "seat_restored", "lobby=%d seat=%d grace_s=%d", i, s, (int)(grace_ms / 1000));
+            } else {
+                log_event(LOG_INFO, "seat_released", "lobby=%d seat=%d reason=restored", i, s);
+                resume_release_seat(l, s);
+            }
+        }
+    }
+}
+
+int resume_release_seat(GameLobby *l, int seat) {
+    int id = l->id;
+
+    journal_append(JE_LEAVE, id, seat, NULL, 0);
+    handle_disconnect(l, seat, NULL);
+    pthread_mutex_lock(&l->lock);
+    l->detached[seat] = 0;
+    int remaining = --l->num_players;
+    pthread_mutex_unlock(&l->lock);
+
+    if (remaining > 0) return 0;
+    log_event(LOG_INFO, "lobby_destroyed", "lobby=%d", id);
+    destroy_lobby(g_global_state, id);
+    return 1;
+}
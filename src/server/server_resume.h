@@ -0,0 +1,46 @@
+#ifndef SERVER_RESUME_H
+#define SERVER_RESUME_H
+
+/*
+ * server_resume.h - Keeping a seat across a dropped connection
+ *
+ * Every seat gets a random token with its ASSIGN ("ASSIGN <seat> <token>").
+ * When a connection in a running match drops without QUIT, the seat is
+ * detached instead of reset: the opponent sees "OPPONENT_AWAY <seat> <s>"
+ * and the board stays as it is. "RESUME <token>" from any new connection
+ * within the grace period re-attaches it ("RESUMED <seat>" followed by the
+ * seat state, like a reclaimed journal seat); otherwise the grace timer
+ * releases the seat as an ordinary leave. Dispatcher thread only.
+ */
+
+#include "server_state.h"
+
+/* Hold dropped seats for grace_s seconds (0 = reset at once, as before) */
+void resume_configure(int grace_s);
+
+/* Prepare the resume state of a new lobby */
+void resume_init_lobby(GameLobby *l);
+
+/* Give seat a fresh token (returned; also sent by send_seat_state) */
+const char *resume_issue(GameLobby *l, int seat);
+
+/* Forget seat's token and stop its grace timer; the seat can no longer be resumed */
+void resume_revoke(GameLobby *l, int seat);
+
+/* ctx's connection is gone. Returns 1 if its seat is now held for RESUME
+ * (the socket is closed), 0 if the caller should release it as usual */
+int resume_detach(ClientCtx *ctx);
+
+/* RESUME <token> from a connection not in a lobby. Returns 1 on success */
+int resume_attach(ClientCtx *ctx, const char *token);
+
+/* After a restore from snapshot or journal: start the grace timer of every
+ * detached seat (or release it at once when resuming is off or it has no token) */
+void resume_arm_restored(void);
+
+/* Release a seat that has no connection: journal the leave, reset the game
+ * for the opponent and destroy the lobby once empty. Returns 1 if the lobby
+ * was destroyed */
+int resume_release_seat(GameLobby *l, int seat);
+
+#endif /* SERVER_RESUME_H */
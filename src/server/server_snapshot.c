@@ -0,0 +1,327 @@
+#define _DEFAULT_SOURCE
+#include "server_snapshot.h"
+#include "server_clock.h"
+#include "server_journal.h"
+#include "server_log.h"
+#include "server_message.h"
+#include "server_trace.h"
+#include "mapped_file.h"
+#include "crc32.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SNAPSHOT_MAGIC "BOATSNAP"
+#define SNAPSHOT_VERSION 3
+#define SNAP_CELLS (GRID_ROWS * GRID_COLS)
+
+/* On-disk layout; only fixed-width fields so the file can be read in place */
+typedef struct SnapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t lobby_count;
+    uint32_t record_size;
+    uint32_t grid_cells;
+    uint64_t taken_unix;
+} SnapHeader;
+
+typedef struct SnapShip {
+    int8_t r, c, len, dir, id;
+    int8_t pad[3];
+} SnapShip;
+
+typedef struct SnapLobby {
+    uint32_t journal_seq;           /* First journal event not reflected here */
+    uint8_t present;
+    uint8_t seats;                  /* Bit per seat held by a player */
+    uint8_t num_players;
+    uint8_t current_turn;
+    uint16_t turn_time;             /* Clock limits in seconds */
+    uint16_t placement_time;
+    char lobby_name[64];
+    char names[MAX_PLAYERS_PER_GAME][64];
+    char tokens[MAX_PLAYERS_PER_GAME][RESUME_TOKEN_LEN + 1];   /* Resume tokens, "" = none */
+    uint8_t ready[MAX_PLAYERS_PER_GAME];
+    uint8_t rematch[MAX_PLAYERS_PER_GAME];
+    uint8_t placed_count[MAX_PLAYERS_PER_GAME];
+    uint8_t remaining[MAX_PLAYERS_PER_GAME][6];
+    uint8_t ship_lengths[MAX_PLAYERS_PER_GAME][6];
+    SnapShip ships[MAX_PLAYERS_PER_GAME][6];
+    uint8_t cells[MAX_PLAYERS_PER_GAME][SNAP_CELLS];
+    uint32_t crc;
+} SnapLobby;
+
+typedef struct SnapFile {
+    SnapHeader header;
+    SnapLobby lobbies[MAX_LOBBIES];
+} SnapFile;
+
+static SnapFile *image = NULL;
+static char snapshot_path[260];
+static int snapshot_interval = 0;
+static pthread_t snapshot_tid;
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t snap_cond = PTHREAD_COND_INITIALIZER;
+static int snap_running = 0;
+static int snap_requested = 0;
+static int capture_done = 0;
+
+/* ==================== Dispatcher side ==================== */
+
+static void capture_lobby(SnapFile *img, int idx) {
+    SnapLobby *rec = &img->lobbies[idx];
+    GameLobby *l = g_global_state->lobbies[idx];
+
+    memset(rec, 0, sizeof(*rec));
+    rec->journal_seq = journal_next_seq();
+
+    if (l) {
+        GameState *gs = l->game_state;
+        pthread_mutex_lock(&l->lock);
+        rec->present = 1;
+        rec->num_players = (uint8_t)l->num_players;
+        rec->current_turn = (uint8_t)gs->current_turn;
+        rec->turn_time = (uint16_t)l->turn_time;
+        rec->placement_time = (uint16_t)l->placement_time;
+        memcpy(rec->lobby_name, l->lobby_name, sizeof(rec->lobby_name));
+        for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+            if (l->clients[s] != SOCKET_INVALID || l->detached[s]) rec->seats |= (uint8_t)(1 << s);
+            memcpy(rec->names[s], l->names[s], sizeof(rec->names[s]));
+            memcpy(rec->tokens[s], l->resume[s].token, sizeof(rec->tokens[s]));
+            rec->ready[s] = (uint8_t)gs->ready[s];
+            rec->rematch[s] = (uint8_t)gs->rematch_response[s];
+            rec->placed_count[s] = (uint8_t)gs->placed_count[s];
+            for (int k = 0; k < 6; k++) {
+                const Ship *sh = &gs->ships[s][k];
+                rec->remaining[s][k] = (uint8_t)gs->remaining[s][k];
+                rec->ship_lengths[s][k] = (uint8_t)gs->ship_lengths[s][k];
+                rec->ships[s][k] = (SnapShip){(int8_t)sh->r, (int8_t)sh->c, (int8_t)sh->len,
+                                              (int8_t)sh->dir, (int8_t)sh->id, {0}};
+            }
+            if (gs->grids[s]) memcpy(rec->cells[s], gs->grids[s]->cells, SNAP_CELLS);
+        }
+        pthread_mutex_unlock(&l->lock);
+    }
+    rec->crc = crc32_ieee(rec, offsetof(SnapLobby, crc));
+}
+
+static char *dup_str(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = malloc(len);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+void snapshot_handle_control(const char *msg) {
+    int idx;
+    if (!image || sscanf(msg, "SNAPSHOT_SHARD %d", &idx) != 1) return;
+    if (idx < 0 || idx >= MAX_LOBBIES) return;
+
+    capture_lobby(image, idx);
+
+    if (idx + 1 < MAX_LOBBIES) {
+        /* Queue the next shard behind whatever clients sent meanwhile */
+        char next[32];
+        snprintf(next, sizeof(next), "SNAPSHOT_SHARD %d", idx + 1);
+        enqueue_msg(dup_str(next), SNAPSHOT_SENDER);
+    } else {
+        pthread_mutex_lock(&snap_lock);
+        capture_done = 1;
+        pthread_cond_broadcast(&snap_cond);
+        pthread_mutex_unlock(&snap_lock);
+    }
+}
+
+/* ==================== Snapshot thread ==================== */
+
+static void fill_header(SnapFile *img) {
+    SnapHeader *h = &img->header;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+    h->version = SNAPSHOT_VERSION;
+    h->lobby_count = MAX_LOBBIES;
+    h->record_size = sizeof(SnapLobby);
+    h->grid_cells = SNAP_CELLS;
+    h->taken_unix = (uint64_t)time(NULL);
+}
+
+size_t snapshot_image_size(void) {
+    return sizeof(SnapFile);
+}
+
+void snapshot_capture(void *buf) {
+    SnapFile *img = buf;
+    for (int i = 0; i < MAX_LOBBIES; i++) capture_lobby(img, i);
+    fill_header(img);
+}
+
+static void write_snapshot(void) {
+    uint64_t start = trace_now_us();
+
+    pthread_mutex_lock(&snap_lock);
+    capture_done = 0;
+    pthread_mutex_unlock(&snap_lock);
+    enqueue_msg(dup_str("SNAPSHOT_SHARD 0"), SNAPSHOT_SENDER);
+
+    pthread_mutex_lock(&snap_lock);
+    while (!capture_done && snap_running) pthread_cond_wait(&snap_cond, &snap_lock);
+    int done = capture_done;
+    pthread_mutex_unlock(&snap_lock);
+    if (!done) return;
+
+    fill_header(image);
+    if (file_replace_atomic(snapshot_path, image, sizeof(*image)) != 0) {
+        fprintf(stderr, "Snapshot: failed to write %s\n", snapshot_path);
+        return;
+    }
+
+    /* Journal events older than every shard are now redundant */
+    uint32_t min_seq = image->lobbies[0].journal_seq;
+    int lobbies = 0;
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        if (image->lobbies[i].journal_seq < min_seq) min_seq = image->lobbies[i].journal_seq;
+        lobbies += image->lobbies[i].present;
+    }
+    journal_compact(min_seq);
+
+    log_event(LOG_INFO, "snapshot", "lobbies=%d path=%s us=%llu", lobbies, snapshot_path,
+              (unsigned long long)(trace_now_us() - start));
+}
+
+static void *snapshot_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&snap_lock);
+    while (snap_running) {
+        if (!snap_requested) {
+            if (snapshot_interval > 0) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_sec += snapshot_interval;
+                if (pthread_cond_timedwait(&snap_cond, &snap_lock, &ts) != 0) snap_requested = 1;
+            } else {
+                pthread_cond_wait(&snap_cond, &snap_lock);
+            }
+            continue;
+        }
+        snap_requested = 0;
+        pthread_mutex_unlock(&snap_lock);
+        write_snapshot();
+        pthread_mutex_lock(&snap_lock);
+    }
+    pthread_mutex_unlock(&snap_lock);
+    return NULL;
+}
+
+int snapshot_start(const char *path, int interval_sec) {
+    image = calloc(1, sizeof(SnapFile));
+    if (!image) return -1;
+
+    strncpy(snapshot_path, path, sizeof(snapshot_path) - 1);
+    snapshot_interval = interval_sec;
+    snap_running = 1;
+    if (pthread_create(&snapshot_tid, NULL, snapshot_thread, NULL) != 0) {
+        snap_running = 0;
+        free(image);
+        image = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void snapshot_stop(void) {
+    if (!image) return;
+
+    pthread_mutex_lock(&snap_lock);
+    snap_running = 0;
+    pthread_cond_broadcast(&snap_cond);
+    pthread_mutex_unlock(&snap_lock);
+    pthread_join(snapshot_tid, NULL);
+
+    free(image);
+    image = NULL;
+}
+
+int snapshot_request(void) {
+    if (!image) return -1;
+    pthread_mutex_lock(&snap_lock);
+    snap_requested = 1;
+    pthread_cond_broadcast(&snap_cond);
+    pthread_mutex_unlock(&snap_lock);
+    return 0;
+}
+
+/* ==================== Restore ==================== */
+
+static void restore_lobby(int idx, const SnapLobby *rec) {
+    GameLobby *l = create_lobby_at(g_global_state, idx);
+    if (!l) return;
+
+    GameState *gs = l->game_state;
+    memcpy(l->lobby_name, rec->lobby_name, sizeof(l->lobby_name));
+    l->lobby_name[sizeof(l->lobby_name) - 1] = '\0';
+    l->num_players = rec->num_players;
+    gs->current_turn = rec->current_turn;
+    l->turn_time = rec->turn_time;
+    l->placement_time = rec->placement_time;
+
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        /* Restored players have no connection until they come back */
+        l->detached[s] = (rec->seats >> s) & 1;
+        memcpy(l->names[s], rec->names[s], sizeof(l->names[s]));
+        l->names[s][sizeof(l->names[s]) - 1] = '\0';
+        memcpy(l->resume[s].token, rec->tokens[s], sizeof(l->resume[s].token));
+        l->resume[s].token[RESUME_TOKEN_LEN] = '\0';
+        gs->ready[s] = rec->ready[s];
+        gs->rematch_response[s] = rec->rematch[s];
+        gs->placed_count[s] = rec->placed_count[s];
+        for (int k = 0; k < 6; k++) {
+            const SnapShip *sh = &rec->ships[s][k];
+            gs->remaining[s][k] = rec->remaining[s][k];
+            gs->ship_lengths[s][k] = rec->ship_lengths[s][k];
+            gs->ships[s][k] = (Ship){sh->r, sh->c, sh->len, (char)sh->dir, sh->id};
+        }
+        memcpy(gs->grids[s]->cells, rec->cells[s], SNAP_CELLS);
+    }
+    clock_resume(l);
+}
+
+int snapshot_restore(const void *data, size_t size, uint32_t floors[MAX_LOBBIES]) {
+    const SnapFile *f = data;
+    memset(floors, 0, sizeof(uint32_t) * MAX_LOBBIES);
+    if (size != sizeof(SnapFile) ||
+        memcmp(f->header.magic, SNAPSHOT_MAGIC, sizeof(f->header.magic)) != 0 ||
+        f->header.version != SNAPSHOT_VERSION || f->header.lobby_count != MAX_LOBBIES ||
+        f->header.record_size != sizeof(SnapLobby) || f->header.grid_cells != SNAP_CELLS) {
+        return -1;
+    }
+
+    /* Validate everything before touching the global state */
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        const SnapLobby *rec = &f->lobbies[i];
+        if (rec->crc != crc32_ieee(rec, offsetof(SnapLobby, crc))) return -1;
+    }
+
+    int restored = 0;
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        const SnapLobby *rec = &f->lobbies[i];
+        floors[i] = rec->journal_seq;
+        if (rec->present) {
+            restore_lobby(i, rec);
+            restored++;
+        }
+    }
+    return restored;
+}
+
+int snapshot_load(const char *path, uint32_t floors[MAX_LOBBIES]) {
+    MappedFile mf;
+    memset(floors, 0, sizeof(uint32_t) * MAX_LOBBIES);
+    if (mapped_file_open(&mf, path) != 0) return 0;
+
+    int restored = snapshot_restore(mf.data, mf.size, floors);
+    mapped_file_close(&mf);
+    return restored;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_SNAPSHOT_H
+#define SERVER_SNAPSHOT_H
+
+/*
+ * server_snapshot.h - Point-in-time snapshots of all lobbies
+ *
+ * The file is a fixed header followed by one fixed-size record per lobby
+ * slot, so it can be mapped and read in place on restart. The dispatcher
+ * copies one lobby per SNAPSHOT_SHARD message, letting client messages run
+ * in between; a background thread writes the file and trims the journal.
+ * Each record carries the journal sequence number it is consistent with.
+ */
+
+#include "server_state.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shard copy requests to the dispatcher use this sender ID */
+#define SNAPSHOT_SENDER (-4)
+
+/* Restore lobbies from the snapshot at path. floors[i] receives the first
+ * journal sequence number that still applies to lobby slot i.
+ * Returns lobbies restored, 0 if there is no snapshot, -1 if it is invalid. */
+int snapshot_load(const char *path, uint32_t floors[MAX_LOBBIES]);
+
+/* Restore lobbies from an in-memory snapshot image (same layout as the file) */
+int snapshot_restore(const void *data, size_t size, uint32_t floors[MAX_LOBBIES]);
+
+/* Size of a complete snapshot image */
+size_t snapshot_image_size(void);
+
+/* Dispatcher side: copy every lobby into buf (snapshot_image_size() bytes) in one go */
+void snapshot_capture(void *buf);
+
+/* Start taking a snapshot every interval_sec seconds (0 = only on request) */
+int snapshot_start(const char *path, int interval_sec);
+
+/* Stop the snapshot thread */
+void snapshot_stop(void);
+
+/* Ask for a snapshot now. Returns -1 if snapshots are not configured */
+int snapshot_request(void);
+
+/* Dispatcher side: handle a control message sent with SNAPSHOT_SENDER */
+void snapshot_handle_control(const char *msg);
+
+#endif /* SERVER_SNAPSHOT_H */
@@ -0,0 +1,468 @@
+#include "server_spectate.h"
+#include "server_message.h"
+#include "server_gateway.h"
+#include "server_ws.h"
+#include "server_log.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* One formatted event, shared by every watcher it is queued to */
+typedef struct SpecBuf {
+    atomic_int refs;
+    int len;
+    char *ws;               /* WebSocket frame of data, built by the fan-out thread on first use */
+    size_t ws_len;
+    char data[];
+} SpecBuf;
+
+typedef struct LogEntry {
+    uint64_t at_ms;
+    int audience;
+    SpecBuf *buf;
+} LogEntry;
+
+/* Spectator side of a lobby, indexed by lobby id (dispatcher only) */
+typedef struct Channel {
+    int id;
+    int first;              /* First watcher (connection id), -1 = none */
+    LogEntry *log;          /* Events of the current game, one reference each */
+    int log_len, log_cap;
+    int full_next;          /* First log entry the FULL feed has not had yet */
+    TimerNode release;      /* Releases log entries to the FULL feed once they are old enough */
+} Channel;
+
+enum { OUT_PLAIN, OUT_WS, OUT_GATEWAY };
+
+/* A watching connection, indexed by connection id */
+typedef struct Watcher {
+    int lobby;              /* Watched lobby, -1 = none */
+    int next;               /* Next watcher of the same lobby */
+    int full;
+    sock_t fd;
+    int out;                /* OUT_* framing */
+    SpecBuf *queue[SPECTATE_QUEUE];
+    unsigned head, tail;    /* Queue and the flags below are guarded by fan_lock */
+    int busy;               /* The fan-out thread is writing to fd */
+    int failed;             /* Dropped: nothing more is written */
+    int drop;               /* Failed in push: shut down once fan_lock is released */
+} Watcher;
+
+static Channel channels[MAX_LOBBIES];
+static Watcher watchers[MAX_CONNECTIONS];
+static uint64_t delay_ms = 0;
+static int watching = 0;
+
+static pthread_mutex_t fan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fan_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fan_idle = PTHREAD_COND_INITIALIZER;
+static int fan_pending = 0;
+static int fan_running = 0;
+static pthread_t fan_tid;
+
+void spectate_configure(int delay_s) {
+    delay_ms = delay_s > 0 ? (uint64_t)delay_s * 1000 : 0;
+}
+
+static SpecBuf *buf_vformat(const char *fmt, va_list ap) {
+    va_list ap2;
+    va_copy(ap2, ap);
+    int len = vsnprintf(NULL, 0, fmt, ap2);
+    va_end(ap2);
+    if (len < 0) return NULL;
+
+    SpecBuf *b = malloc(sizeof(SpecBuf) + (size_t)len + 1);
+    if (!b) return NULL;
+    atomic_init(&b->refs, 1);
+    b->len = len;
+    b->ws = NULL;
+    b->ws_len = 0;
+    vsnprintf(b->data, (size_t)len + 1, fmt, ap);
+    return b;
+}
+
+static void buf_unref(SpecBuf *b) {
+    if (atomic_fetch_sub(&b->refs, 1) != 1) return;
+    free(b->ws);
+    free(b);
+}
+
+/* Queue b to w. Call with fan_lock held */
+static void push(Watcher *w, SpecBuf *b) {
+    if (w->failed) return;
+    if (w->tail - w->head >= SPECTATE_QUEUE) {
+        /* Too slow to keep up: deliver shuts it down */
+        log_event(LOG_INFO, "spectator_dropped", "lobby=%d behind=%d", w->lobby, SPECTATE_QUEUE);
+        w->failed = 1;
+        w->drop = 1;
+        return;
+    }
+    atomic_fetch_add(&b->refs, 1);
+    w->queue[w->tail++ % SPECTATE_QUEUE] = b;
+    fan_pending++;
+}
+
+/* Queue b to the channel's watchers: fog ones if fog, full ones if full */
+static void deliver(Channel *ch, SpecBuf *b, int fog, int full) {
+    if (ch->first < 0) return;
+    pthread_mutex_lock(&fan_lock);
+    for (int i = ch->first; i >= 0; i = watchers[i].next) {
+        if (watchers[i].full ? full : fog) push(&watchers[i], b);
+    }
+    pthread_cond_signal(&fan_work);
+    pthread_mutex_unlock(&fan_lock);
+
+    /* Its reader's DISCONNECT cleans up; shutting down may wait for a write */
+    for (int i = ch->first; i >= 0; i = watchers[i].next) {
+        if (!watchers[i].drop) continue;
+        watchers[i].drop = 0;
+        server_shutdown_client(watchers[i].fd);
+    }
+}
+
+/* Hand the FULL feed every logged event up to log entry end */
+static void release_until(Channel *ch, int end) {
+    for (; ch->full_next < end; ch->full_next++) {
+        LogEntry *e = &ch->log[ch->full_next];
+        if (e->audience & SPEC_FULL) deliver(ch, e->buf, 0, 1);
+    }
+}
+
+static void release_due(TimerNode *t) {
+    Channel *ch = TIMER_OWNER(t, Channel, release);
+    uint64_t now = timers_now_ms();
+    int end = ch->full_next;
+    while (end < ch->log_len && ch->log[end].at_ms + delay_ms <= now) end++;
+    release_until(ch, end);
+    if (ch->full_next < ch->log_len) {
+        uint64_t due = ch->log[ch->full_next].at_ms + delay_ms;
+        timer_schedule(&ch->release, due > now ? due - now : 0);
+    }
+}
+
+/* Wait a millisecond for writes to make room. Call with fan_lock held */
+static void fan_nap(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(&fan_work, &fan_lock, &ts);
+}
+
+static void *fan_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&fan_lock);
+    while (fan_running) {
+        int linked = gateway_push();    /* Frames still queued on gateway links */
+        if (fan_pending == 0) {
+            if (linked) {
+                fan_nap();
+            } else {
+                pthread_cond_wait(&fan_work, &fan_lock);
+            }
+            continue;
+        }
+        /* One buffer per watcher per pass, and no send waits for a socket,
+         * so one slow watcher does not starve the rest */
+        int progress = 0;
+        for (int i = 0; i < MAX_CONNECTIONS; i++) {
+            Watcher *w = &watchers[i];
+            if (w->head == w->tail) continue;
+            unsigned at = w->head;
+            SpecBuf *b = w->queue[at % SPECTATE_QUEUE];
+            if (w->failed) {
+                w->head++;
+                fan_pending--;
+                buf_unref(b);
+                progress = 1;
+                pthread_cond_broadcast(&fan_idle);
+                continue;
+            }
+            sock_t fd = w->fd;
+            int out = w->out;
+            atomic_fetch_add(&b->refs, 1);      /* spectate_leave may drop the queue meanwhile */
+            w->busy = 1;
+            pthread_mutex_unlock(&fan_lock);
+
+            int n;
+            if (out == OUT_WS) {
+                if (!b->ws) b->ws = ws_frame(WS_OP_TEXT, b->data, (size_t)b->len, &b->ws_len);
+                n = b->ws ? server_send_nowait(fd, b->ws, (int)b->ws_len) : -1;
+            } else {
+                n = server_send_nowait(fd, b->data, b->len);
+            }
+            if (n < 0 && out != OUT_GATEWAY) {
+                /* Its window is full, or a line went out cut short: its reader's DISCONNECT cleans up */
+                shutdown(fd, SHUT_RDWR_FLAG);
+            }
+
+            pthread_mutex_lock(&fan_lock);
+            w->busy = 0;
+            if (n != 0 && w->head == at) {
+                /* Sent or failed; a write in progress or a full link queue (0) keeps it queued */
+                w->head++;
+                fan_pending--;
+                buf_unref(b);
+                progress = 1;
+            }
+            if (n < 0 && !w->failed) {
+                log_event(LOG_INFO, "spectator_dropped", "lobby=%d reason=blocked", w->lobby);
+                w->failed = 1;
+            }
+            buf_unref(b);
+            pthread_cond_broadcast(&fan_idle);
+        }
+        if (!progress && fan_pending > 0) {
+            /* Every queued watcher is waiting for another write or a full link queue */
+            fan_nap();
+        }
+    }
+    pthread_mutex_unlock(&fan_lock);
+    return NULL;
+}
+
+int spectate_start(void) {
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        channels[i].id = i;
+        channels[i].first = -1;
+        timer_init(&channels[i].release, release_due);
+    }
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        watchers[i].lobby = -1;
+        watchers[i].next = -1;
+    }
+    fan_running = 1;
+    if (pthread_create(&fan_tid, NULL, fan_thread, NULL) != 0) {
+        fan_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void spectate_stop(void) {
+    if (!fan_running) return;
+    pthread_mutex_lock(&fan_lock);
+    fan_running = 0;
+    pthread_cond_signal(&fan_work);
+    pthread_mutex_unlock(&fan_lock);
+    pthread_join(fan_tid, NULL);
+}
+
+static void unlink_watcher(Channel *ch, int conn) {
+    for (int *p = &ch->first; *p >= 0; p = &watchers[*p].next) {
+        if (*p == conn) {
+            *p = watchers[conn].next;
+            break;
+        }
+    }
+    watchers[conn].next = -1;
+    watchers[conn].lobby = -1;
+    watching--;
+}
+
+void spectate_leave(ClientCtx *ctx) {
+    int conn = ctx->connection_id;
+    Watcher *w = &watchers[conn];
+
+    pthread_mutex_lock(&fan_lock);
+    if (w->lobby >= 0) unlink_watcher(&channels[w->lobby], conn);
+    while (w->head != w->tail) {
+        buf_unref(w->queue[w->head++ % SPECTATE_QUEUE]);
+        fan_pending--;
+    }
+    while (w->busy) pthread_cond_wait(&fan_idle, &fan_lock);
+    pthread_mutex_unlock(&fan_lock);
+}
+
+/* Append printf output to a growing catch-up buffer */
+static void appendf(char **buf, size_t *len, size_t *cap, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (*len + (size_t)n + 1 > *cap) {
+        size_t c = *cap ? *cap : 1024;
+        while (c < *len + (size_t)n + 1) c *= 2;
+        char *p = realloc(*buf, c);
+        if (!p) return;
+        *buf = p;
+        *cap = c;
+    }
+    va_start(ap, fmt);
+    vsnprintf(*buf + *len, *cap - *len, fmt, ap);
+    va_end(ap);
+    *len += (size_t)n;
+}
+
+void spectate_join(ClientCtx *ctx, int lobby_id, int full) {
+    GameLobby *l = (lobby_id >= 0 && lobby_id < MAX_LOBBIES) ? g_global_state->lobbies[lobby_id] : NULL;
+    if (!l) {
+        const char *msg = "SPECTATE_FAIL No such lobby\n";
+        server_send(ctx->fd, msg, (int)strlen(msg));
+        return;
+    }
+    spectate_leave(ctx);
+
+    Channel *ch = &channels[lobby_id];
+    Watcher *w = &watchers[ctx->connection_id];
+    w->fd = ctx->fd;
+    w->out = gateway_is_virtual(ctx->fd) ? OUT_GATEWAY
+           : ctx->transport == TRANSPORT_WEBSOCKET ? OUT_WS : OUT_PLAIN;
+    w->full = full;
+    w->failed = 0;
+
+    /* Catch up in one private buffer: header, names, then the game so far */
+    char *cu = NULL;
+    size_t len = 0, cap = 0;
+    appendf(&cu, &len, &cap, "SPECTATING %d %s %d\n", lobby_id, full ? "FULL" : "FOG",
+            full ? (int)(delay_ms / 1000) : 0);
+    for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) {
+        if (l->names[i][0]) appendf(&cu, &len, &cap, "SPEC_NAME %d %s\n", i, l->names[i]);
+    }
+    int end = full ? ch->full_next : ch->log_len;
+    for (int i = 0; i < end; i++) {
+        if (ch->log[i].audience & (full ? SPEC_FULL : SPEC_FOG)) {
+            appendf(&cu, &len, &cap, "%s", ch->log[i].buf->data);
+        }
+    }
+    SpecBuf *b = cu ? malloc(sizeof(SpecBuf) + len + 1) : NULL;
+    if (b) {
+        atomic_init(&b->refs, 1);
+        b->len = (int)len;
+        b->ws = NULL;
+        b->ws_len = 0;
+        memcpy(b->data, cu, len + 1);
+    }
+    free(cu);
+    if (!b) return;
+
+    pthread_mutex_lock(&fan_lock);
+    w->lobby = lobby_id;
+    w->next = ch->first;
+    ch->first = ctx->connection_id;
+    watching++;
+    push(w, b);
+    pthread_cond_signal(&fan_work);
+    pthread_mutex_unlock(&fan_lock);
+    buf_unref(b);
+    log_event(LOG_INFO, "spectate", "conn=%d lobby=%d feed=%s", ctx->connection_id, lobby_id, full ? "full" : "fog");
+}
+
+int spectate_count(void) {
+    pthread_mutex_lock(&fan_lock);
+    int n = watching;
+    pthread_mutex_unlock(&fan_lock);
+    return n;
+}
+
+void spectate_event(GameLobby *l, int audience, const char *fmt, ...) {
+    Channel *ch = &channels[l->id];
+    if (ch->log_len == ch->log_cap) {
+        int cap = ch->log_cap ? ch->log_cap * 2 : 64;
+        LogEntry *p = realloc(ch->log, (size_t)cap * sizeof(LogEntry));
+        if (!p) return;
+        ch->log = p;
+        ch->log_cap = cap;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    SpecBuf *b = buf_vformat(fmt, ap);
+    va_end(ap);
+    if (!b) return;
+
+    LogEntry *e = &ch->log[ch->log_len++];
+    e->at_ms = timers_now_ms();
+    e->audience = audience;
+    e->buf = b;
+
+    if (audience & SPEC_FOG) deliver(ch, b, 1, 0);
+    if (delay_ms == 0) {
+        release_until(ch, ch->log_len);
+    } else if (!timer_pending(&ch->release)) {
+        timer_schedule(&ch->release, delay_ms);
+    }
+}
+
+void spectate_notice(GameLobby *l, const char *fmt, ...) {
+    Channel *ch = &channels[l->id];
+    if (ch->first < 0) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    SpecBuf *b = buf_vformat(fmt, ap);
+    va_end(ap);
+    if (!b) return;
+    deliver(ch, b, 1, 1);
+    buf_unref(b);
+}
+
+void spectate_game_over(GameLobby *l, int winner) {
+    Channel *ch = &channels[l->id];
+    GameState *gs = l->game_state;
+
+    spectate_event(l, SPEC_ALL, "SPEC_WIN %d\n", winner);
+    /* FULL watchers had the ships from the start */
+    for (int seat = 0; seat < MAX_PLAYERS_PER_GAME; seat++) {
+        for (int id = 1; id <= 5; id++) {
+            Ship *s = &gs->ships[seat][id];
+            if (s->len) spectate_event(l, SPEC_FOG, "SPEC_SHIP %d %d %d %d %c\n", seat, s->r, s->c, s->len, s->dir);
+        }
+    }
+    /* Nothing left to hide: the delayed feed catches up */
+    timer_cancel(&ch->release);
+    release_until(ch, ch->log_len);
+}
+
+/* Flush the delayed feed, then forget the game's events */
+static void clear_log(Channel *ch) {
+    timer_cancel(&ch->release);
+    release_until(ch, ch->log_len);
+    for (int i = 0; i < ch->log_len; i++) buf_unref(ch->log[i].buf);
+    ch->log_len = 0;
+    ch->full_next = 0;
+}
+
+void spectate_reset(GameLobby *l) {
+    clear_log(&channels[l->id]);
+    spectate_notice(l, "SPEC_RESET\n");
+}
+
+void spectate_end_all(void) {
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        Channel *ch = &channels[i];
+        GameLobby *l = g_global_state->lobbies[i];
+        if (ch->first < 0) continue;
+        /* The delayed feed is not released: the game goes on over there */
+        if (l) spectate_notice(l, "SPEC_END\n");
+        pthread_mutex_lock(&fan_lock);
+        while (ch->first >= 0) unlink_watcher(ch, ch->first);
+        pthread_mutex_unlock(&fan_lock);
+    }
+
+    /* Every queued line is written or dropped before the sockets change hands */
+    pthread_mutex_lock(&fan_lock);
+    while (fan_pending > 0) pthread_cond_wait(&fan_idle, &fan_lock);
+    pthread_mutex_unlock(&fan_lock);
+}
+
+void spectate_lobby_closed(GameLobby *l) {
+    Channel *ch = &channels[l->id];
+
+    clear_log(ch);
+    spectate_notice(l, "SPEC_END\n");
+    free(ch->log);
+    ch->log = NULL;
+    ch->log_cap = 0;
+
+    /* Queued lines still go out; the connections are ordinary clients again */
+    pthread_mutex_lock(&fan_lock);
+    while (ch->first >= 0) unlink_watcher(ch, ch->first);
+    pthread_mutex_unlock(&fan_lock);
+}
@@ -0,0 +1,67 @@
+#ifndef SERVER_SPECTATE_H
+#define SERVER_SPECTATE_H
+
+/*
+ * server_spectate.h - Read-only spectators of a lobby
+ *
+ * "SPECTATE <lobby> [FULL]" from a connection outside any lobby makes it a
+ * watcher until UNSPECTATE, taking a seat somewhere, or the lobby closing
+ * ("SPEC_END"). The default feed keeps the fog of war: readiness, shots,
+ * sinkings, turns and the result, with the ships shown once the game is
+ * over. FULL watchers see every ship from the start, but their whole feed
+ * runs --spectate-delay seconds behind the game.
+ *
+ * An event is formatted once into a refcounted buffer, kept in the lobby's
+ * event log for watchers who join late, and queued by reference to every
+ * watcher; a fan-out thread does the writes, so the dispatcher pays one
+ * pointer per watcher and event. The fan-out never waits on a socket: a
+ * watcher that cannot take an event at once, or is SPECTATE_QUEUE events
+ * behind, is dropped. Everything except the fan-out thread runs on the
+ * dispatcher.
+ */
+
+#include "server_state.h"
+
+#define SPECTATE_QUEUE 256
+
+/* Who an event is for */
+enum { SPEC_FOG = 1, SPEC_FULL = 2, SPEC_ALL = SPEC_FOG | SPEC_FULL };
+
+/* Delay the FULL feed by delay_s seconds (0 = live) */
+void spectate_configure(int delay_s);
+
+/* Start / stop the fan-out thread */
+int spectate_start(void);
+void spectate_stop(void);
+
+/* SPECTATE: start watching lobby_id; replies SPECTATING or SPECTATE_FAIL */
+void spectate_join(ClientCtx *ctx, int lobby_id, int full);
+
+/* Stop watching (no-op if ctx is not a watcher). Once this returns the
+ * fan-out thread no longer touches ctx->fd, so it may be closed */
+void spectate_leave(ClientCtx *ctx);
+
+/* Number of connections watching a lobby */
+int spectate_count(void);
+
+/* Log a game event and send it to the watchers in audience (SPEC_*) */
+void spectate_event(GameLobby *l, int audience, const char *fmt, ...);
+
+/* Send a line to every current watcher without logging it */
+void spectate_notice(GameLobby *l, const char *fmt, ...);
+
+/* The game is decided: log the result, show the ships to the fog feed and
+ * catch the delayed feed up */
+void spectate_game_over(GameLobby *l, int winner);
+
+/* The lobby starts over (rematch, or a player left): drop the event log */
+void spectate_reset(GameLobby *l);
+
+/* Before a handoff: send SPEC_END to every watcher, release them all and
+ * wait until the fan-out has nothing left to write */
+void spectate_end_all(void);
+
+/* The lobby is being destroyed: send SPEC_END and release its watchers */
+void spectate_lobby_closed(GameLobby *l);
+
+#endif /* SERVER_SPECTATE_H */
@@ -1,4 +1,8 @@
 #include "server_state.h"
+#include "server_clock.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_tourney.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -20,6 +24,7 @@ static GameState* create_game_state(void) {
         for (int l = 0; l < 6; l++) {
             gs->remaining[i][l] = allowed_init[l];
             gs->ship_lengths[i][l] = 0;
+            memset(&gs->ships[i][l], 0, sizeof(Ship));
         }
     }
     gs->current_turn = 0;
@@ -46,6 +51,8 @@ GlobalState *global_state_create(void) {
     return gs;
 }
 
+static GameLobby *create_lobby_locked(GlobalState *gs, int idx);
+
 GameLobby *create_lobby(GlobalState *gs) {
     pthread_mutex_lock(&gs->lock);
     int idx = -1;
@@ -56,8 +63,24 @@ GameLobby *create_lobby(GlobalState *gs) {
         }
     }
 
+    GameLobby *lobby = create_lobby_locked(gs, idx);
+    pthread_mutex_unlock(&gs->lock);
+    return lobby;
+}
+
+GameLobby *create_lobby_at(GlobalState *gs, int lobby_id) {
+    pthread_mutex_lock(&gs->lock);
+    GameLobby *lobby = NULL;
+    if (lobby_id >= 0 && lobby_id < MAX_LOBBIES && gs->lobbies[lobby_id] == NULL) {
+        lobby = create_lobby_locked(gs, lobby_id);
+    }
+    pthread_mutex_unlock(&gs->lock);
+    return lobby;
+}
+
+/* Allocate a lobby in slot idx; caller holds gs->lock */
+static GameLobby *create_lobby_locked(GlobalState *gs, int idx) {
     if (idx == -1) {
-        pthread_mutex_unlock(&gs->lock);
         return NULL;
     }
 
@@ -71,9 +94,10 @@ GameLobby *create_lobby(GlobalState *gs) {
     }
 
     lobby->game_state = create_game_state();
+    clock_init_lobby(lobby);
+    resume_init_lobby(lobby);
     gs->lobbies[idx] = lobby;
     
-    pthread_mutex_unlock(&gs->lock);
     return lobby;
 }
 
@@ -83,6 +107,10 @@ void destroy_lobby(GlobalState *gs, int lobby_id) {
         GameLobby *l = gs->lobbies[lobby_id];
         
         pthread_mutex_lock(&l->lock);
+        timer_cancel(&l->clock);
+        for (int i = 0; i < MAX_PLAYERS_PER_GAME; i++) resume_revoke(l, i);
+        spectate_lobby_closed(l);
+        tourney_lobby_closed(l);
         destroy_game_state(l->game_state);
         pthread_mutex_destroy(&l->lock); // This might be risky if held, but we're destroying it
         
@@ -3,7 +3,10 @@
 
 #include "common.h"
 #include "game.h"
+#include "server_timer.h"
+#include "server_quota.h"
 #include <pthread.h>
+#include <stdint.h>
 
 #define MAX_PLAYERS_PER_GAME 2
 /* Alias MAX_CLIENTS for older code compatibility */
@@ -12,16 +15,43 @@
 #define MAX_LOBBIES 50
 #define MAX_CONNECTIONS 100
 
+#define RESUME_TOKEN_LEN 32
+
 /* Forward declaration */
 struct GameLobby;
 
+/* Reconnect state of one seat (see server_resume.h) */
+typedef struct SeatResume {
+    char token[RESUME_TOKEN_LEN + 1]; /* Empty = the seat cannot be resumed */
+    TimerNode grace;                  /* Releases a dropped seat nobody resumed */
+    struct GameLobby *lobby;
+    int seat;
+} SeatResume;
+
+/* How replies to a client are framed on its socket */
+typedef enum ClientTransport {
+    TRANSPORT_TCP = 0,      /* Plain text lines */
+    TRANSPORT_WEBSOCKET     /* Each write is one WebSocket text frame */
+} ClientTransport;
+
 /* Client context for threading */
 typedef struct ClientCtx {
     sock_t fd;
+    int transport;          // ClientTransport
     int connection_id;      // Unique ID on the server (0 to MAX_CONNECTIONS-1)
     int player_id_in_game;  // 0 or 1 within a game
     struct GameLobby *lobby; // NULL if not in a game
     char pending_name[64];   // Name stored before joining a lobby
+    char rbuf[4096];         // Bytes read but not yet split into lines
+    size_t rbuf_len;
+    TimerNode heartbeat;     // Ping / idle eviction timer (dispatcher only)
+    uint64_t last_seen_ms;   // Last line received, PONG included
+    uint64_t last_active_ms; // Last line other than PING/PONG
+    uint64_t ping_sent_us;
+    unsigned ping_seq;
+    int pings_unanswered;
+    unsigned rtt_us;         // Last measured round trip, 0 = not measured yet
+    ClientQuota quota;       // Rate limits and queue share (reader side)
 } ClientCtx;
 
 /* Game State (One instance of a game) */
@@ -32,6 +62,7 @@ typedef struct GameState {
     int ready[MAX_PLAYERS_PER_GAME];
     int current_turn;
     int ship_lengths[MAX_PLAYERS_PER_GAME][6];
+    Ship ships[MAX_PLAYERS_PER_GAME][6];        /* Placed ships by ship ID (1-5), to rebuild a player's view */
     int rematch_response[MAX_PLAYERS_PER_GAME]; /* 0=none, 1=yes, 2=no */
 } GameState;
 
@@ -42,7 +73,16 @@ typedef struct GameLobby {
     int num_players;
     sock_t clients[MAX_PLAYERS_PER_GAME];
     char names[MAX_PLAYERS_PER_GAME][64];
+    int detached[MAX_PLAYERS_PER_GAME]; /* Seat kept for a player with no connection (e.g. restored from the journal) */
     GameState *game_state;
+    TimerNode clock;        /* Placement / turn deadline (dispatcher only) */
+    int clock_phase;        /* ClockPhase, see server_clock.h */
+    int clock_warned;       /* Last-seconds TIMER already sent for this deadline */
+    uint64_t clock_deadline_ms;
+    int turn_time;          /* Seconds per turn, 0 = no turn clock */
+    int placement_time;     /* Seconds to place ships, 0 = no placement clock */
+    int timeouts[MAX_PLAYERS_PER_GAME]; /* Clocks run out in a row per seat */
+    SeatResume resume[MAX_PLAYERS_PER_GAME];
     pthread_mutex_t lock;
 } GameLobby;
 
@@ -60,6 +100,7 @@ extern GlobalState *g_global_state;
 
 GlobalState *global_state_create(void);
 struct GameLobby *create_lobby(GlobalState *gs);
+struct GameLobby *create_lobby_at(GlobalState *gs, int lobby_id); /* Used by journal replay */
 void destroy_lobby(GlobalState *gs, int lobby_id);
 
 /* OLD API COMPATIBILITY MAPPING */
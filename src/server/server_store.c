@@ -0,0 +1,461 @@
+#include "server_store.h"
+#include "mapped_file.h"
+#include "crc32.h"
+#include "game.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define STORE_MAGIC "BOATSPS1"
+#define STORE_START_RATING 1200
+#define STORE_K 32
+#define STORE_MIN_RECORDS 1024      /* Records the file is sized for at first */
+
+typedef struct StoreHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved[5];
+} StoreHeader;
+
+typedef struct PlayerRec {
+    char name[64];
+    int32_t rating;
+    uint32_t games, wins, losses;
+    uint32_t shots, hits;
+    uint32_t reserved;
+    uint32_t crc;           /* CRC-32 of the fields above */
+} PlayerRec;
+
+typedef struct IndexSlot {
+    uint32_t hash;
+    uint32_t rec;           /* Record number + 1, 0 = empty */
+} IndexSlot;
+
+static pthread_rwlock_t store_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned char *base;         /* Header, then the records */
+static size_t mapped;
+static uint32_t nrecs, caprecs;
+static char store_path[260];
+#ifndef _WIN32
+static int store_fd = -1;
+#endif
+
+static IndexSlot *slots;
+static uint32_t nslots, live;
+static uint32_t top[STORE_TOP_K];   /* Record numbers, best first */
+static int ntop;
+
+#define REC(i) ((PlayerRec *)(base + sizeof(StoreHeader)) + (i))
+
+static uint32_t rec_crc(const PlayerRec *r) {
+    return crc32_ieee(r, offsetof(PlayerRec, crc));
+}
+
+static uint32_t name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+    return h;
+}
+
+static int file_backed(void) {
+#ifndef _WIN32
+    return store_fd >= 0;
+#else
+    return 0;
+#endif
+}
+
+/* Make room for recs records: grow the file mapping, or the heap copy without a file */
+static int reserve(uint32_t recs) {
+    size_t want = sizeof(StoreHeader) + (size_t)recs * sizeof(PlayerRec);
+#ifndef _WIN32
+    if (store_fd >= 0) {
+        if (ftruncate(store_fd, (off_t)want) != 0) return -1;
+        void *p = mmap(NULL, want, PROT_READ | PROT_WRITE, MAP_SHARED, store_fd, 0);
+        if (p == MAP_FAILED) return -1;
+        if (base) munmap(base, mapped);
+        base = p;
+        mapped = want;
+        caprecs = recs;
+        return 0;
+    }
+#endif
+    unsigned char *p = realloc(base, want);
+    if (!p) return -1;
+    memset(p + mapped, 0, want - mapped);
+    base = p;
+    mapped = want;
+    caprecs = recs;
+    return 0;
+}
+
+/* Push an appended record towards the file; a crash before it lands is caught by the CRC */
+static void sync_rec(uint32_t i) {
+#ifndef _WIN32
+    if (store_fd < 0) return;
+    static size_t page = 0;
+    if (!page) page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t off = (size_t)((unsigned char *)REC(i) - base);
+    size_t start = off / page * page;
+    msync(base + start, off + sizeof(PlayerRec) - start, MS_ASYNC);
+#else
+    (void)i;
+#endif
+}
+
+/* Index slot holding name, or the empty slot it would go in */
+static IndexSlot *find_slot(const char *name, uint32_t hash) {
+    uint32_t mask = nslots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        IndexSlot *s = &slots[i];
+        if (!s->rec) return s;
+        if (s->hash == hash && strcmp(REC(s->rec - 1)->name, name) == 0) return s;
+    }
+}
+
+static int index_grow(void) {
+    uint32_t old_n = nslots;
+    IndexSlot *old = slots;
+    uint32_t n = old_n ? old_n * 2 : 1024;
+    IndexSlot *s = calloc(n, sizeof(IndexSlot));
+    if (!s) return -1;
+    slots = s;
+    nslots = n;
+    for (uint32_t i = 0; i < old_n; i++) {
+        if (old[i].rec) *find_slot(REC(old[i].rec - 1)->name, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/* Point the name of record i at it */
+static void index_put(uint32_t i) {
+    if ((live + 1) * 10 > nslots * 7 && index_grow() != 0) return;
+    const char *name = REC(i)->name;
+    uint32_t hash = name_hash(name);
+    IndexSlot *s = find_slot(name, hash);
+    if (!s->rec) live++;
+    s->hash = hash;
+    s->rec = i + 1;
+}
+
+static const PlayerRec *lookup(const char *name) {
+    if (!nslots) return NULL;
+    IndexSlot *s = find_slot(name, name_hash(name));
+    return s->rec ? REC(s->rec - 1) : NULL;
+}
+
+static int better(uint32_t a, uint32_t b) {
+    const PlayerRec *x = REC(a), *y = REC(b);
+    if (x->rating != y->rating) return x->rating > y->rating;
+    return strcmp(x->name, y->name) < 0;
+}
+
+static void top_settle(int pos) {
+    while (pos > 0 && better(top[pos], top[pos - 1])) {
+        uint32_t t = top[pos];
+        top[pos] = top[pos - 1];
+        top[--pos] = t;
+    }
+    while (pos + 1 < ntop && better(top[pos + 1], top[pos])) {
+        uint32_t t = top[pos];
+        top[pos] = top[pos + 1];
+        top[++pos] = t;
+    }
+}
+
+/* Record r (not on the board) may have earned a place */
+static void top_offer(uint32_t r) {
+    if (ntop < STORE_TOP_K) {
+        top[ntop++] = r;
+    } else if (better(r, top[ntop - 1])) {
+        top[ntop - 1] = r;
+    } else {
+        return;
+    }
+    top_settle(ntop - 1);
+}
+
+static void top_rebuild(void) {
+    ntop = 0;
+    for (uint32_t i = 0; i < nslots; i++) {
+        if (slots[i].rec) top_offer(slots[i].rec - 1);
+    }
+}
+
+/* The player of record old (UINT32_MAX = new player) is now record r */
+static void top_update(uint32_t old, uint32_t r, int dropped) {
+    int pos = -1;
+    for (int i = 0; i < ntop && old != UINT32_MAX; i++) {
+        if (top[i] == old) pos = i;
+    }
+    if (pos < 0) {
+        top_offer(r);
+        return;
+    }
+    top[pos] = r;
+    top_settle(pos);
+    /* Fallen to last place: someone off the board may be better now */
+    if (dropped && top[ntop - 1] == r && live > (uint32_t)ntop) top_rebuild();
+}
+
+static uint32_t append(const PlayerRec *src) {
+    if (nrecs == caprecs && reserve(caprecs * 2) != 0) return UINT32_MAX;
+    PlayerRec *r = REC(nrecs);
+    *r = *src;
+    r->crc = rec_crc(r);
+    sync_rec(nrecs);
+    return nrecs++;
+}
+
+/* Rewrite the store with only the latest version of each player */
+static void compact(void) {
+    size_t size = sizeof(StoreHeader) + (size_t)live * sizeof(PlayerRec);
+    unsigned char *buf = malloc(size);
+    if (!buf) return;
+    memcpy(buf, base, sizeof(StoreHeader));
+    PlayerRec *out = (PlayerRec *)(buf + sizeof(StoreHeader));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nslots; i++) {
+        if (slots[i].rec) out[n++] = *REC(slots[i].rec - 1);
+    }
+
+#ifndef _WIN32
+    if (store_fd >= 0) {
+        /* A crash here leaves either the old file or the new one */
+        if (file_replace_atomic(store_path, buf, size) != 0) {
+            fprintf(stderr, "Player store: compaction failed\n");
+            free(buf);
+            return;
+        }
+        munmap(base, mapped);
+        close(store_fd);
+        base = NULL;
+        mapped = 0;
+        store_fd = open(store_path, O_RDWR);
+        if (store_fd >= 0 && reserve(n * 2 > STORE_MIN_RECORDS ? n * 2 : STORE_MIN_RECORDS) == 0) {
+            free(buf);
+        } else {
+            fprintf(stderr, "Player store: cannot reopen %s, keeping records in memory\n", store_path);
+            if (store_fd >= 0) close(store_fd);
+            store_fd = -1;
+        }
+    }
+#endif
+    if (!base) {
+        base = buf;
+        mapped = size;
+        caprecs = n;
+    } else if (base != buf && !file_backed()) {
+        free(base);
+        base = buf;
+        mapped = size;
+        caprecs = n;
+    }
+    nrecs = n;
+    n = 0;
+    for (uint32_t i = 0; i < nslots; i++) {
+        if (slots[i].rec) slots[i].rec = ++n;
+    }
+    top_rebuild();
+}
+
+int store_open(const char *path) {
+    StoreHeader fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    memcpy(fresh.magic, STORE_MAGIC, 8);
+    fresh.record_size = sizeof(PlayerRec);
+
+    uint32_t found = 0;
+    if (path && path[0]) {
+#ifndef _WIN32
+        snprintf(store_path, sizeof(store_path), "%s", path);
+        store_fd = open(path, O_RDWR | O_CREAT, 0644);
+        struct stat st;
+        if (store_fd < 0 || fstat(store_fd, &st) != 0) {
+            fprintf(stderr, "Player store: cannot open %s\n", path);
+            if (store_fd >= 0) close(store_fd);
+            store_fd = -1;
+            return -1;
+        }
+        if ((size_t)st.st_size >= sizeof(StoreHeader)) {
+            found = (uint32_t)(((size_t)st.st_size - sizeof(StoreHeader)) / sizeof(PlayerRec));
+        }
+#else
+        fprintf(stderr, "Player store: --store needs mmap, keeping records in memory\n");
+#endif
+    }
+
+    if (reserve(found > STORE_MIN_RECORDS ? found : STORE_MIN_RECORDS) != 0 || index_grow() != 0) {
+        fprintf(stderr, "Player store: out of memory\n");
+        return -1;
+    }
+    StoreHeader *h = (StoreHeader *)base;
+    if (found == 0 && h->magic[0] == '\0') {
+        memcpy(h, &fresh, sizeof(fresh));
+    } else if (memcmp(h->magic, STORE_MAGIC, 8) != 0 || h->record_size != sizeof(PlayerRec)) {
+        fprintf(stderr, "Player store: %s is not a player store\n", path);
+        store_close();
+        return -1;
+    }
+
+    /* Later versions of a name replace earlier ones; stop at the first bad record */
+    uint32_t i;
+    for (i = 0; i < caprecs; i++) {
+        PlayerRec *r = REC(i);
+        if (!r->name[0] && !r->crc) break;
+        if (r->crc != rec_crc(r)) {
+            fprintf(stderr, "Player store: dropping torn record %u\n", i);
+            memset(r, 0, (size_t)(caprecs - i) * sizeof(PlayerRec));
+            break;
+        }
+        index_put(i);
+    }
+    nrecs = i;
+    top_rebuild();
+    if (path && path[0]) printf("Player store: %u players (%u records) in %s\n", live, nrecs, path);
+    return 0;
+}
+
+void store_close(void) {
+    pthread_rwlock_wrlock(&store_lock);
+#ifndef _WIN32
+    if (store_fd >= 0) {
+        msync(base, mapped, MS_SYNC);
+        munmap(base, mapped);
+        close(store_fd);
+        store_fd = -1;
+        base = NULL;
+    }
+#endif
+    free(base);
+    base = NULL;
+    mapped = 0;
+    nrecs = caprecs = 0;
+    free(slots);
+    slots = NULL;
+    nslots = live = 0;
+    ntop = 0;
+    pthread_rwlock_unlock(&store_lock);
+}
+
+/* Expected score (per mille) of the weaker side, every 50 rating points */
+static const int expected_pm[] = {500, 429, 360, 297, 240, 192, 151, 118, 91,
+                                  69, 53, 40, 31, 23, 17, 13, 10};
+
+static int expected(int gap) {
+    int g = gap < 0 ? -gap : gap;
+    int i = g / 50, last = (int)(sizeof(expected_pm) / sizeof(expected_pm[0])) - 1;
+    int e = i >= last ? expected_pm[last]
+                      : expected_pm[i] + (expected_pm[i + 1] - expected_pm[i]) * (g % 50) / 50;
+    return gap <= 0 ? e : 1000 - e;
+}
+
+void store_game_over(GameLobby *l, int winner) {
+    GameState *gs = l->game_state;
+    if (!l->names[0][0] || !l->names[1][0] || strcmp(l->names[0], l->names[1]) == 0) return;
+
+    /* A player's shots are the marks on the other board */
+    uint32_t shots[2] = {0, 0}, hits[2] = {0, 0};
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        for (int r = 0; r < GRID_ROWS; r++) {
+            for (int c = 0; c < GRID_COLS; c++) {
+                unsigned char cell = 0;
+                grid_get(gs->grids[s ^ 1], r, c, &cell);
+                if (cell == 'H') hits[s]++;
+                if (cell == 'H' || cell == 'M') shots[s]++;
+            }
+        }
+    }
+
+    pthread_rwlock_wrlock(&store_lock);
+    if (!base) {
+        pthread_rwlock_unlock(&store_lock);
+        return;
+    }
+    PlayerRec p[2];
+    uint32_t old[2];
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        const PlayerRec *cur = lookup(l->names[s]);
+        if (cur) {
+            p[s] = *cur;
+            old[s] = (uint32_t)(cur - REC(0));
+        } else {
+            memset(&p[s], 0, sizeof(p[s]));
+            snprintf(p[s].name, sizeof(p[s].name), "%s", l->names[s]);
+            p[s].rating = STORE_START_RATING;
+            old[s] = UINT32_MAX;
+        }
+    }
+
+    int loser = winner ^ 1;
+    int delta = STORE_K * (1000 - expected(p[winner].rating - p[loser].rating)) / 1000;
+    if (delta < 1) delta = 1;
+    p[winner].rating += delta;
+    p[loser].rating -= delta;
+    p[winner].wins++;
+    p[loser].losses++;
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        p[s].games++;
+        p[s].shots += shots[s];
+        p[s].hits += hits[s];
+        uint32_t r = append(&p[s]);
+        if (r == UINT32_MAX) break;
+        index_put(r);
+        top_update(old[s], r, s == loser);
+    }
+    if (nrecs >= STORE_MIN_RECORDS && nrecs > live * 2) compact();
+    pthread_rwlock_unlock(&store_lock);
+}
+
+int store_rating(const char *name) {
+    int rating = STORE_START_RATING;
+    pthread_rwlock_rdlock(&store_lock);
+    const PlayerRec *r = base ? lookup(name) : NULL;
+    if (r) rating = r->rating;
+    pthread_rwlock_unlock(&store_lock);
+    return rating;
+}
+
+int store_format_stats(const char *name, char *buf, int cap) {
+    PlayerRec r;
+    int known = 0;
+    pthread_rwlock_rdlock(&store_lock);
+    const PlayerRec *cur = base ? lookup(name) : NULL;
+    if (cur) {
+        r = *cur;
+        known = 1;
+    }
+    pthread_rwlock_unlock(&store_lock);
+
+    if (!known) return snprintf(buf, (size_t)cap, "STATS_FAIL Unknown player\n");
+    unsigned acc = r.shots ? (unsigned)((uint64_t)r.hits * 1000 / r.shots) : 0;
+    return snprintf(buf, (size_t)cap, "STATS %d %u %u %u %u %u %u.%u %s\n", r.rating, r.games, r.wins,
+                    r.losses, r.shots, r.hits, acc / 10, acc % 10, r.name);
+}
+
+int store_format_leaderboard(char *buf, int cap) {
+    PlayerRec rows[STORE_TOP_K];
+    int n;
+    pthread_rwlock_rdlock(&store_lock);
+    n = ntop;
+    for (int i = 0; i < n; i++) rows[i] = *REC(top[i]);
+    pthread_rwlock_unlock(&store_lock);
+
+    int off = snprintf(buf, (size_t)cap, "LEADERBOARD_START\n");
+    for (int i = 0; i < n && off < cap; i++) {
+        off += snprintf(buf + off, (size_t)(cap - off), "LEADER %d %d %u %u %s\n", i + 1, rows[i].rating,
+                        rows[i].wins, rows[i].losses, rows[i].name);
+    }
+    if (off < cap) off += snprintf(buf + off, (size_t)(cap - off), "LEADERBOARD_END\n");
+    return off < cap ? off : cap - 1;
+}
@@ -0,0 +1,42 @@
+#ifndef SERVER_STORE_H
+#define SERVER_STORE_H
+
+/*
+ * server_store.h - Persistent player records and the leaderboard
+ *
+ * Every finished game updates both players' rating (Elo), wins, losses,
+ * shots and hits. A record is never changed in place: the new version is
+ * appended to the store file, which is memory-mapped, and an open-addressing
+ * index maps each name to its latest version. Each record carries a CRC, so
+ * a record torn by a crash is dropped when the file is scanned on start.
+ * Once most of the file is old versions it is rewritten with the live ones.
+ * Without --store the same structures live in memory only.
+ *
+ * The top STORE_TOP_K players are kept sorted as records change.
+ * "STATS <name>" and "LEADERBOARD" are answered by the connection's reader
+ * under a read lock; only game results (on the dispatcher) take it for
+ * writing.
+ */
+
+#include "server_state.h"
+
+#define STORE_TOP_K 10
+
+/* Open (or create) the store at path; NULL or "" keeps it in memory. Returns 0 on success */
+int store_open(const char *path);
+
+/* Flush and unmap the store */
+void store_close(void);
+
+/* A game in lobby l was decided: update both players' records */
+void store_game_over(GameLobby *l, int winner);
+
+/* Current rating of a player (the starting rating if unknown) */
+int store_rating(const char *name);
+
+/* Reply to "STATS <name>" / "LEADERBOARD" into buf. Returns the length.
+ * Safe from any thread */
+int store_format_stats(const char *name, char *buf, int cap);
+int store_format_leaderboard(char *buf, int cap);
+
+#endif /* SERVER_STORE_H */
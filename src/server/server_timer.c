@@ -0,0 +1,165 @@
+#define _DEFAULT_SOURCE
+#include "server_timer.h"
+#include "server_message.h"
+#include "server_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <windows.h>
+#define SLEEP_MS(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define SLEEP_MS(ms) usleep((ms)*1000)
+#endif
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX_DELTA ((1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Slot heads are sentinels: an empty slot points at itself */
+static TimerNode wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t current;        /* Last tick processed */
+static uint64_t base_us;
+
+static pthread_t ticker_tid;
+static atomic_int ticker_running;
+static atomic_int tick_queued;
+
+static void wheel_init(void) {
+    if (base_us) return;
+    base_us = trace_now_us();
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int s = 0; s < WHEEL_SLOTS; s++) wheel[l][s].next = wheel[l][s].prev = &wheel[l][s];
+    }
+}
+
+uint64_t timers_now_ms(void) {
+    wheel_init();
+    return (trace_now_us() - base_us) / 1000;
+}
+
+static void link_tail(TimerNode *head, TimerNode *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+/* Put t in the slot its expiry falls into, relative to the current tick */
+static void place(TimerNode *t) {
+    uint64_t e = t->expires > current ? t->expires : current + 1;
+    uint64_t delta = e - current;
+    if (delta > WHEEL_MAX_DELTA) {
+        delta = WHEEL_MAX_DELTA;
+        e = current + delta;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1)))) level++;
+    int slot = (int)((e >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    link_tail(&wheel[level][slot], t);
+}
+
+void timer_init(TimerNode *t, TimerFn fn) {
+    memset(t, 0, sizeof(*t));
+    t->fn = fn;
+}
+
+void timer_cancel(TimerNode *t) {
+    if (!t->prev) return;
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+int timer_pending(const TimerNode *t) {
+    return t->prev != NULL;
+}
+
+void timer_schedule(TimerNode *t, uint64_t delay_ms) {
+    wheel_init();
+    timer_cancel(t);
+    /* Expiry counts from the wall clock, not from the last processed tick */
+    t->expires = (timers_now_ms() + delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    place(t);
+}
+
+/* Move every timer of one higher-level slot down to where it now belongs */
+static void cascade(int level, int slot) {
+    TimerNode *head = &wheel[level][slot];
+    TimerNode *t = head->next;
+    head->next = head->prev = head;
+    while (t != head) {
+        TimerNode *next = t->next;
+        place(t);
+        t = next;
+    }
+}
+
+static void run_tick(void) {
+    current++;
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if ((current & ((1ull << (WHEEL_BITS * level)) - 1)) != 0) break;
+        cascade(level, (int)((current >> (WHEEL_BITS * level)) & WHEEL_MASK));
+    }
+
+    /* Detach the slot first: callbacks may reschedule into it */
+    TimerNode *head = &wheel[0][current & WHEEL_MASK];
+    TimerNode list = {0};
+    if (head->next == head) return;
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head->prev = head;
+
+    while (list.next != &list) {
+        TimerNode *t = list.next;
+        timer_cancel(t);
+        if (t->expires > current) {
+            place(t);
+        } else {
+            t->fn(t);
+        }
+    }
+}
+
+void timers_handle_tick(void) {
+    atomic_store(&tick_queued, 0);
+    uint64_t target = timers_now_ms() / TIMER_TICK_MS;
+    while (current < target) run_tick();
+}
+
+static void *ticker_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&ticker_running)) {
+        SLEEP_MS(TIMER_TICK_MS);
+        /* One tick in the queue at a time; a busy dispatcher catches up in one go */
+        if (atomic_exchange(&tick_queued, 1)) continue;
+        char *m = malloc(5);
+        if (!m) continue;
+        memcpy(m, "TICK", 5);
+        enqueue_msg(m, TIMER_SENDER);
+    }
+    return NULL;
+}
+
+int timers_start(void) {
+    wheel_init();
+    atomic_store(&ticker_running, 1);
+    if (pthread_create(&ticker_tid, NULL, ticker_thread, NULL) != 0) {
+        atomic_store(&ticker_running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void timers_stop(void) {
+    if (!atomic_exchange(&ticker_running, 0)) return;
+    pthread_join(ticker_tid, NULL);
+}
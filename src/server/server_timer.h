@@ -0,0 +1,59 @@
+#ifndef SERVER_TIMER_H
+#define SERVER_TIMER_H
+
+/*
+ * server_timer.h - Hierarchical timer wheel owned by the dispatcher
+ *
+ * Four levels of 64 slots with a 100 ms tick cover about 19 days. Timers
+ * are intrusive list nodes embedded in the object they belong to, so adding
+ * and cancelling are O(1) with no allocation. A ticker thread enqueues a
+ * TICK message with TIMER_SENDER; the dispatcher then advances the wheel and
+ * runs expired callbacks, so callbacks may touch game state freely.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Tick messages to the dispatcher use this sender ID */
+#define TIMER_SENDER (-7)
+
+#define TIMER_TICK_MS 100
+
+struct TimerNode;
+typedef void (*TimerFn)(struct TimerNode *t);
+
+typedef struct TimerNode {
+    struct TimerNode *next;
+    struct TimerNode *prev;     /* NULL when not scheduled */
+    uint64_t expires;           /* Tick at which the timer fires */
+    TimerFn fn;
+} TimerNode;
+
+/* Recover the structure that embeds a timer */
+#define TIMER_OWNER(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Prepare a timer that calls fn when it expires */
+void timer_init(TimerNode *t, TimerFn fn);
+
+/* (Re)schedule t to fire delay_ms from now */
+void timer_schedule(TimerNode *t, uint64_t delay_ms);
+
+/* Unschedule t; harmless if it is not scheduled */
+void timer_cancel(TimerNode *t);
+
+/* Non-zero while t is scheduled */
+int timer_pending(const TimerNode *t);
+
+/* Start the ticker thread */
+int timers_start(void);
+
+/* Stop the ticker thread */
+void timers_stop(void);
+
+/* Dispatcher side: handle a TICK message sent with TIMER_SENDER */
+void timers_handle_tick(void);
+
+/* Milliseconds on the dispatcher's clock */
+uint64_t timers_now_ms(void);
+
+#endif /* SERVER_TIMER_H */
@@ -0,0 +1,580 @@
+#include "server_tourney.h"
+#include "server_commands.h"
+#include "server_message.h"
+#include "server_client.h"
+#include "server_resume.h"
+#include "server_spectate.h"
+#include "server_log.h"
+#include "server_admin.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { FORMAT_SWISS, FORMAT_ELIM };
+
+typedef struct TPlayer {
+    char name[64];
+    int conn;               /* Connection id, -1 = withdrawn */
+    int seed;               /* Registration order, the last tie-break */
+    int points;             /* Wins, byes included */
+    int out;                /* Knocked out (ELIM) */
+    int had_bye;
+    int opp[TOURNEY_MAX_ROUNDS];
+    int nopp;
+} TPlayer;
+
+typedef struct TMatch {
+    int a, b;               /* Player indices; a takes seat 0 */
+    int lobby;              /* -1 until the match has a lobby */
+    int winner;             /* Player index, -1 while undecided */
+} TMatch;
+
+typedef struct Tourney {
+    int id;
+    int format;
+    int rounds;             /* Swiss: rounds to play */
+    int round;              /* Current round, 0 = still registering */
+    int organizer;          /* Connection id of the creator */
+    char name[64];
+    TPlayer *players;
+    int nplayers;
+    TMatch matches[TOURNEY_MAX_PLAYERS / 2];
+    int nmatches;
+    int undecided;
+    int order[TOURNEY_MAX_PLAYERS]; /* ELIM: who is still in, bracket order */
+    int norder;
+    int next[TOURNEY_MAX_PLAYERS];  /* ELIM: order of the next round, byes first */
+    int nnext;
+} Tourney;
+
+static Tourney *tourneys[TOURNEY_MAX];
+
+/* Tournament (+1, 0 = none) and match of each lobby / tournament and player of each connection */
+static int lobby_tourney[MAX_LOBBIES], lobby_match[MAX_LOBBIES];
+static uint64_t vacate_at[MAX_LOBBIES]; /* When to send a finished match's players back, 0 = never */
+static int conn_tourney[MAX_CONNECTIONS], conn_player[MAX_CONNECTIONS];
+
+static TimerNode tick;
+static int tick_ready = 0;
+
+static void start_round(Tourney *t);
+static void schedule_matches(Tourney *t);
+
+static void sendf(int conn, const char *fmt, ...) {
+    ClientCtx *ctx = conn >= 0 ? g_global_state->client_contexts[conn] : NULL;
+    if (!ctx) return;
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) server_send(ctx->fd, buf, n < (int)sizeof(buf) ? n : (int)sizeof(buf) - 1);
+}
+
+static void fail(ClientCtx *ctx, const char *why) {
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "TOURNEY_FAIL %s\n", why);
+    server_send(ctx->fd, buf, n);
+}
+
+static void tick_due(TimerNode *n);
+
+static void want_tick(void) {
+    if (!tick_ready) {
+        timer_init(&tick, tick_due);
+        tick_ready = 1;
+    }
+    if (!timer_pending(&tick)) timer_schedule(&tick, TOURNEY_TICK_MS);
+}
+
+static Tourney *tourney_of(ClientCtx *ctx, int *player) {
+    int t = conn_tourney[ctx->connection_id] - 1;
+    if (t < 0 || !tourneys[t]) return NULL;
+    if (player) *player = conn_player[ctx->connection_id];
+    return tourneys[t];
+}
+
+static void destroy(Tourney *t) {
+    for (int i = 0; i < t->nplayers; i++) {
+        if (t->players[i].conn >= 0) conn_tourney[t->players[i].conn] = 0;
+    }
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        if (lobby_tourney[i] == t->id + 1) lobby_tourney[i] = 0;
+    }
+    tourneys[t->id] = NULL;
+    free(t->players);
+    free(t);
+}
+
+static int add_player(Tourney *t, ClientCtx *ctx) {
+    if (t->nplayers >= TOURNEY_MAX_PLAYERS) return 0;
+    TPlayer *p = &t->players[t->nplayers];
+    memset(p, 0, sizeof(*p));
+    memcpy(p->name, ctx->pending_name, sizeof(p->name));
+    p->conn = ctx->connection_id;
+    p->seed = t->nplayers;
+    conn_tourney[p->conn] = t->id + 1;
+    conn_player[p->conn] = t->nplayers++;
+
+    for (int i = 0; i < t->nplayers; i++) {
+        sendf(t->players[i].conn, "TOURNEY_JOINED %d %d %s\n", t->id, t->nplayers, p->name);
+    }
+    return 1;
+}
+
+static int played(const TPlayer *p, int other) {
+    for (int i = 0; i < p->nopp; i++) {
+        if (p->opp[i] == other) return 1;
+    }
+    return 0;
+}
+
+static void add_match(Tourney *t, int a, int b) {
+    TMatch *m = &t->matches[t->nmatches++];
+    m->a = a;
+    m->b = b;
+    m->lobby = -1;
+    m->winner = -1;
+    t->undecided++;
+    TPlayer *pa = &t->players[a], *pb = &t->players[b];
+    if (pa->nopp < TOURNEY_MAX_ROUNDS) pa->opp[pa->nopp++] = b;
+    if (pb->nopp < TOURNEY_MAX_ROUNDS) pb->opp[pb->nopp++] = a;
+}
+
+static void give_bye(Tourney *t, int p) {
+    t->players[p].points++;
+    t->players[p].had_bye = 1;
+    sendf(t->players[p].conn, "TOURNEY_BYE %d %d\n", t->id, t->round);
+}
+
+/* Standings order: points, then registration */
+static const TPlayer *sort_players;
+
+static int by_standing(const void *x, const void *y) {
+    const TPlayer *a = &sort_players[*(const int *)x], *b = &sort_players[*(const int *)y];
+    if (a->points != b->points) return b->points - a->points;
+    return a->seed - b->seed;
+}
+
+/* Swiss: sort by score, give the lowest player without one a bye, then pair
+ * each player with the next one down they have not met yet */
+static void pair_swiss(Tourney *t) {
+    int idx[TOURNEY_MAX_PLAYERS], n = 0;
+    char paired[TOURNEY_MAX_PLAYERS] = {0};
+
+    for (int i = 0; i < t->nplayers; i++) {
+        if (t->players[i].conn >= 0) idx[n++] = i;
+    }
+    sort_players = t->players;
+    qsort(idx, (size_t)n, sizeof(int), by_standing);
+
+    if (n % 2) {
+        int bye = n - 1;
+        for (int i = n - 1; i >= 0; i--) {
+            if (!t->players[idx[i]].had_bye) {
+                bye = i;
+                break;
+            }
+        }
+        give_bye(t, idx[bye]);
+        paired[bye] = 1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (paired[i]) continue;
+        int pick = -1;
+        for (int j = i + 1; j < n; j++) {
+            if (paired[j]) continue;
+            if (pick < 0) pick = j;    /* A rematch only if nobody else is left */
+            if (!played(&t->players[idx[i]], idx[j])) {
+                pick = j;
+                break;
+            }
+        }
+        if (pick < 0) break;
+        paired[i] = paired[pick] = 1;
+        add_match(t, idx[i], idx[pick]);
+    }
+}
+
+/* Single elimination: byes fill the field up to a power of two, then the
+ * top of the order meets the bottom */
+static void pair_elim(Tourney *t) {
+    int field[TOURNEY_MAX_PLAYERS], n = 0;
+    for (int i = 0; i < t->norder; i++) {
+        if (!t->players[t->order[i]].out) field[n++] = t->order[i];
+    }
+
+    int size = 1;
+    while (size < n) size *= 2;
+    int byes = size - n;
+
+    t->nnext = 0;
+    for (int i = 0; i < byes; i++) {
+        give_bye(t, field[i]);
+        t->next[t->nnext++] = field[i];
+    }
+    for (int lo = byes, hi = n - 1; lo < hi; lo++, hi--) add_match(t, field[lo], field[hi]);
+}
+
+static int active_players(Tourney *t) {
+    int n = 0;
+    for (int i = 0; i < t->nplayers; i++) {
+        if (t->players[i].conn >= 0 && !t->players[i].out) n++;
+    }
+    return n;
+}
+
+static void finish(Tourney *t) {
+    int idx[TOURNEY_MAX_PLAYERS];
+    for (int i = 0; i < t->nplayers; i++) idx[i] = i;
+    sort_players = t->players;
+    qsort(idx, (size_t)t->nplayers, sizeof(int), by_standing);
+
+    /* The last one standing wins a knockout whatever the points say */
+    if (t->format == FORMAT_ELIM && t->norder > 0) {
+        int w = 0;
+        while (idx[w] != t->order[0]) w++;
+        memmove(idx + 1, idx, (size_t)w * sizeof(int));
+        idx[0] = t->order[0];
+    }
+
+    const char *winner = t->players[idx[0]].name;
+    log_event(LOG_INFO, "tourney_won", "tourney=%d name=\"%s\" winner=\"%s\"", t->id, t->name, winner);
+    for (int r = 0; r < t->nplayers; r++) {
+        TPlayer *p = &t->players[idx[r]];
+        sendf(p->conn, "TOURNEY_END %d %s\n", t->id, winner);
+        sendf(p->conn, "TOURNEY_RANK %d %d %d %d\n", t->id, r + 1, t->nplayers, p->points);
+    }
+    destroy(t);
+}
+
+static void round_done(Tourney *t) {
+    if (t->format == FORMAT_ELIM) {
+        for (int i = 0; i < t->nmatches; i++) {
+            TMatch *m = &t->matches[i];
+            t->next[t->nnext++] = m->winner;
+            t->players[m->winner == m->a ? m->b : m->a].out = 1;
+        }
+        memcpy(t->order, t->next, (size_t)t->nnext * sizeof(int));
+        t->norder = t->nnext;
+        if (t->norder <= 1 || active_players(t) <= 1) {
+            finish(t);
+            return;
+        }
+    } else if (t->round >= t->rounds || active_players(t) < 2) {
+        finish(t);
+        return;
+    }
+    start_round(t);
+}
+
+/* Record the result of match mi; the round moves on once every match is decided */
+static void decide(Tourney *t, int mi, int winner) {
+    TMatch *m = &t->matches[mi];
+    if (m->winner >= 0) return;
+    m->winner = winner;
+    t->players[winner].points++;
+    int loser = winner == m->a ? m->b : m->a;
+    for (int i = 0; i < 2; i++) {
+        sendf(t->players[i ? m->b : m->a].conn, "TOURNEY_RESULT %d %d %s %s\n",
+              t->id, t->round, t->players[winner].name, t->players[loser].name);
+    }
+    if (--t->undecided == 0) round_done(t);
+}
+
+static void start_round(Tourney *t) {
+    t->round++;
+    t->nmatches = 0;
+    t->undecided = 0;
+    if (t->format == FORMAT_SWISS) {
+        pair_swiss(t);
+    } else {
+        pair_elim(t);
+    }
+    log_event(LOG_INFO, "tourney_round", "tourney=%d round=%d matches=%d", t->id, t->round, t->nmatches);
+    for (int i = 0; i < t->nplayers; i++) {
+        sendf(t->players[i].conn, "TOURNEY_ROUND %d %d %d\n", t->id, t->round, t->nmatches);
+    }
+
+    if (t->nmatches == 0) {
+        round_done(t);
+        return;
+    }
+    /* Withdrawn players in an ELIM bracket lose by walkover; t may be gone after this */
+    int id = t->id;
+    for (int i = 0; i < t->nmatches && tourneys[id] == t; i++) {
+        TMatch *m = &t->matches[i];
+        if (t->players[m->a].conn < 0) {
+            decide(t, i, m->b);
+        } else if (t->players[m->b].conn < 0) {
+            decide(t, i, m->a);
+        }
+    }
+    if (tourneys[id] == t) schedule_matches(t);
+}
+
+/* Give every undecided match whose players are both free a lobby */
+static void schedule_matches(Tourney *t) {
+    int waiting = 0;
+
+    /* No new games while draining, so the drain can finish */
+    if (admin_is_draining()) return;
+    for (int i = 0; i < t->nmatches; i++) {
+        TMatch *m = &t->matches[i];
+        if (m->winner >= 0 || m->lobby >= 0) continue;
+
+        TPlayer *pa = &t->players[m->a], *pb = &t->players[m->b];
+        ClientCtx *a = pa->conn >= 0 ? g_global_state->client_contexts[pa->conn] : NULL;
+        ClientCtx *b = pb->conn >= 0 ? g_global_state->client_contexts[pb->conn] : NULL;
+        if (!a || !b || a->lobby || b->lobby) {
+            waiting = 1;
+            continue;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "T%d-R%d-M%d", t->id, t->round, i + 1);
+        GameLobby *l = create_named_lobby(g_global_state, name);
+        if (!l) {
+            /* Every lobby slot is taken; try again on the next tick */
+            waiting = 1;
+            break;
+        }
+        m->lobby = l->id;
+        lobby_tourney[l->id] = t->id + 1;
+        lobby_match[l->id] = i;
+        vacate_at[l->id] = 0;
+
+        spectate_leave(a);
+        spectate_leave(b);
+        sendf(pa->conn, "TOURNEY_MATCH %d %d %d %s\n", t->id, t->round, l->id, pb->name);
+        sendf(pb->conn, "TOURNEY_MATCH %d %d %d %s\n", t->id, t->round, l->id, pa->name);
+        join_lobby_id(a, l->id);
+        join_lobby_id(b, l->id);
+    }
+    if (waiting) want_tick();
+}
+
+/* Send the players of a finished match back to the lobby-less state */
+static void vacate(int lobby_id) {
+    GameLobby *l = g_global_state->lobbies[lobby_id];
+    int seated[MAX_PLAYERS_PER_GAME] = {0};
+
+    vacate_at[lobby_id] = 0;
+    if (!l) return;
+
+    pthread_mutex_lock(&l->lock);
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        seated[s] = l->clients[s] != SOCKET_INVALID || l->detached[s];
+        if (l->clients[s] == SOCKET_INVALID) continue;
+        ClientCtx *ctx = client_find_fd(l->clients[s]);
+        if (ctx) ctx->lobby = NULL;
+        l->clients[s] = SOCKET_INVALID;
+        l->detached[s] = 1;
+    }
+    pthread_mutex_unlock(&l->lock);
+
+    /* Both seats are off the board first, so neither gets OPPONENT_LEFT */
+    for (int s = 0; s < MAX_PLAYERS_PER_GAME; s++) {
+        if (seated[s] && resume_release_seat(l, s)) break;
+    }
+}
+
+static void tick_due(TimerNode *n) {
+    (void)n;
+    uint64_t now = timers_now_ms();
+    int again = 0;
+
+    for (int i = 0; i < MAX_LOBBIES; i++) {
+        if (!vacate_at[i]) continue;
+        if (vacate_at[i] <= now) {
+            vacate(i);
+        } else {
+            again = 1;
+        }
+    }
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        if (tourneys[i] && tourneys[i]->round > 0) schedule_matches(tourneys[i]);
+    }
+    if (again) want_tick();
+}
+
+/* The match in lobby l ended with winner (player index) */
+static void match_over(GameLobby *l, int winner_seat) {
+    int ti = lobby_tourney[l->id] - 1;
+    if (ti < 0 || !tourneys[ti]) return;
+    Tourney *t = tourneys[ti];
+    TMatch *m = &t->matches[lobby_match[l->id]];
+
+    lobby_tourney[l->id] = 0;
+    vacate_at[l->id] = timers_now_ms() + TOURNEY_TICK_MS;
+    want_tick();
+    decide(t, lobby_match[l->id], winner_seat == 0 ? m->a : m->b);
+}
+
+void tourney_game_over(GameLobby *l, int winner) {
+    match_over(l, winner);
+}
+
+void tourney_seat_left(GameLobby *l, int seat) {
+    match_over(l, seat ^ 1);
+}
+
+void tourney_lobby_closed(GameLobby *l) {
+    lobby_tourney[l->id] = 0;
+    vacate_at[l->id] = 0;
+}
+
+static void withdraw(Tourney *t, int pi) {
+    TPlayer *p = &t->players[pi];
+    conn_tourney[p->conn] = 0;
+
+    if (t->round == 0) {
+        /* Still registering: just drop the entry */
+        memmove(p, p + 1, (size_t)(t->nplayers - pi - 1) * sizeof(TPlayer));
+        t->nplayers--;
+        for (int i = pi; i < t->nplayers; i++) {
+            t->players[i].seed = i;
+            conn_player[t->players[i].conn] = i;
+        }
+        if (t->nplayers == 0) destroy(t);
+        return;
+    }
+
+    p->conn = -1;
+    /* A match still waiting for its lobby goes to the opponent */
+    for (int i = 0; i < t->nmatches; i++) {
+        TMatch *m = &t->matches[i];
+        if (m->winner < 0 && m->lobby < 0 && (m->a == pi || m->b == pi)) {
+            decide(t, i, m->a == pi ? m->b : m->a);
+            return;
+        }
+    }
+}
+
+void tourney_disconnected(ClientCtx *ctx) {
+    int pi;
+    Tourney *t = tourney_of(ctx, &pi);
+    if (t) withdraw(t, pi);
+}
+
+int tourney_count(void) {
+    int n = 0;
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        if (tourneys[i]) n++;
+    }
+    return n;
+}
+
+void tourney_cancel_all(void) {
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        Tourney *t = tourneys[i];
+        if (!t) continue;
+        log_event(LOG_INFO, "tourney_cancelled", "tourney=%d name=\"%s\" round=%d", t->id, t->name, t->round);
+        for (int p = 0; p < t->nplayers; p++) sendf(t->players[p].conn, "TOURNEY_CANCEL %d\n", t->id);
+        destroy(t);
+    }
+}
+
+static void list(ClientCtx *ctx) {
+    char buf[2048];
+    int off = snprintf(buf, sizeof(buf), "TOURNEY_LIST_START\n");
+    for (int i = 0; i < TOURNEY_MAX; i++) {
+        Tourney *t = tourneys[i];
+        if (!t) continue;
+        char status[16];
+        if (t->round == 0) {
+            snprintf(status, sizeof(status), "OPEN");
+        } else {
+            snprintf(status, sizeof(status), "ROUND_%d", t->round);
+        }
+        off += snprintf(buf + off, sizeof(buf) - (size_t)off, "TOURNEY %d %s %d %s %s\n", t->id,
+                        t->format == FORMAT_SWISS ? "SWISS" : "ELIM", t->nplayers, status, t->name);
+    }
+    off += snprintf(buf + off, sizeof(buf) - (size_t)off, "TOURNEY_LIST_END\n");
+    server_send(ctx->fd, buf, off);
+}
+
+void tourney_command(ClientCtx *ctx, const char *m, const char *um) {
+    int pi;
+    Tourney *mine = tourney_of(ctx, &pi);
+
+    if (strncmp(um, "TOURNEY_LIST", 12) == 0) {
+        list(ctx);
+
+    } else if (strncmp(um, "TOURNEY_CREATE ", 15) == 0) {
+        char format[8], name[64];
+        int rounds = 0;
+        if (sscanf(um, "TOURNEY_CREATE %7s %d", format, &rounds) != 2 ||
+            sscanf(m + 15, "%*s %*d %63[^\r\n]", name) != 1 ||
+            (strcmp(format, "SWISS") != 0 && strcmp(format, "ELIM") != 0)) {
+            fail(ctx, "Usage: TOURNEY_CREATE <SWISS|ELIM> <rounds> <name>");
+            return;
+        }
+        if (!ctx->pending_name[0]) { fail(ctx, "Set a name first"); return; }
+        if (mine) { fail(ctx, "Already registered"); return; }
+        if (admin_is_draining()) { fail(ctx, "Server draining"); return; }
+
+        int id = -1;
+        for (int i = 0; i < TOURNEY_MAX && id < 0; i++) {
+            if (!tourneys[i]) id = i;
+        }
+        Tourney *t = id >= 0 ? calloc(1, sizeof(Tourney)) : NULL;
+        TPlayer *players = t ? calloc(TOURNEY_MAX_PLAYERS, sizeof(TPlayer)) : NULL;
+        if (!players) {
+            free(t);
+            fail(ctx, "No tournament slot free");
+            return;
+        }
+        t->id = id;
+        t->players = players;
+        t->format = strcmp(format, "SWISS") == 0 ? FORMAT_SWISS : FORMAT_ELIM;
+        t->rounds = rounds > TOURNEY_MAX_ROUNDS ? TOURNEY_MAX_ROUNDS : (rounds > 0 ? rounds : 0);
+        t->organizer = ctx->connection_id;
+        memcpy(t->name, name, sizeof(t->name));
+        tourneys[id] = t;
+
+        char msg[32];
+        int n = snprintf(msg, sizeof(msg), "TOURNEY_CREATED %d\n", id);
+        server_send(ctx->fd, msg, n);
+        add_player(t, ctx);
+        log_event(LOG_INFO, "tourney_created", "tourney=%d name=\"%s\" conn=%d", id, t->name, ctx->connection_id);
+
+    } else if (strncmp(um, "TOURNEY_JOIN ", 13) == 0) {
+        int id;
+        Tourney *t = NULL;
+        if (sscanf(um, "TOURNEY_JOIN %d", &id) == 1 && id >= 0 && id < TOURNEY_MAX) t = tourneys[id];
+        if (!t) { fail(ctx, "No such tournament"); return; }
+        if (mine) { fail(ctx, "Already registered"); return; }
+        if (t->round > 0) { fail(ctx, "Already started"); return; }
+        if (!ctx->pending_name[0]) { fail(ctx, "Set a name first"); return; }
+        if (!add_player(t, ctx)) fail(ctx, "Tournament full");
+
+    } else if (strncmp(um, "TOURNEY_LEAVE", 13) == 0) {
+        if (!mine) { fail(ctx, "Not registered"); return; }
+        server_send(ctx->fd, "TOURNEY_LEFT\n", 13);
+        withdraw(mine, pi);
+
+    } else if (strncmp(um, "TOURNEY_START", 13) == 0) {
+        if (!mine || mine->organizer != ctx->connection_id) { fail(ctx, "Only the organizer can start"); return; }
+        if (mine->round > 0) { fail(ctx, "Already started"); return; }
+        if (mine->nplayers < 2) { fail(ctx, "Need at least two players"); return; }
+        if (admin_is_draining()) { fail(ctx, "Server draining"); return; }
+
+        if (mine->format == FORMAT_SWISS) {
+            /* Enough rounds to separate a single winner, and no more than there are opponents */
+            int need = 0;
+            while ((1 << need) < mine->nplayers) need++;
+            if (mine->rounds == 0) mine->rounds = need;
+            if (mine->rounds > mine->nplayers - 1) mine->rounds = mine->nplayers - 1;
+        } else {
+            for (int i = 0; i < mine->nplayers; i++) mine->order[i] = i;
+            mine->norder = mine->nplayers;
+        }
+        start_round(mine);
+
+    } else {
+        fail(ctx, "Unknown command");
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SERVER_TOURNEY_H
+#define SERVER_TOURNEY_H
+
+/*
+ * server_tourney.h - Swiss and single-elimination tournaments
+ *
+ * A connection outside any lobby creates an event with
+ * "TOURNEY_CREATE <SWISS|ELIM> <rounds> <name>" (rounds 0 = enough to find
+ * a winner; ignored for ELIM), others register with "TOURNEY_JOIN <id>"
+ * under the name they set with NAME, and the organizer starts it with
+ * "TOURNEY_START". Each round is paired at once, then every match gets its
+ * own lobby from create_lobby and both players are seated in it
+ * ("TOURNEY_MATCH <id> <round> <lobby> <opponent>"). The WIN of a match
+ * records the result and, a moment later, returns both players to the
+ * lobby-less state for the next round. Matches wait when no lobby slot is
+ * free or a player is still busy, and are retried on the next tick.
+ * A player who leaves the server forfeits what is left. While the server
+ * drains, tournaments are neither created nor started and no new match gets
+ * a lobby. Tournaments live only in this process: a handoff is refused while
+ * one exists, and when the server stops every player is told
+ * "TOURNEY_CANCEL <id>". Dispatcher only.
+ */
+
+#include "server_state.h"
+
+#define TOURNEY_MAX 8
+#define TOURNEY_MAX_PLAYERS 512
+#define TOURNEY_MAX_ROUNDS 16
+#define TOURNEY_TICK_MS 1000
+
+/* Handle a TOURNEY_* command from ctx (not in a lobby) */
+void tourney_command(ClientCtx *ctx, const char *m, const char *um);
+
+/* A game in lobby l was decided; winner is the winning seat */
+void tourney_game_over(GameLobby *l, int winner);
+
+/* seat left lobby l for good (called from handle_disconnect) */
+void tourney_seat_left(GameLobby *l, int seat);
+
+/* Lobby l is being destroyed */
+void tourney_lobby_closed(GameLobby *l);
+
+/* ctx's connection is gone: withdraw it from its tournament */
+void tourney_disconnected(ClientCtx *ctx);
+
+/* Tournaments open for registration or running */
+int tourney_count(void);
+
+/* The server is stopping: cancel every tournament and tell its players */
+void tourney_cancel_all(void);
+
+#endif /* SERVER_TOURNEY_H */
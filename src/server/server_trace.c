@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200112L
+#include "server_trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* Number of completed traces kept; older ones are overwritten */
+#define TRACE_RING_SIZE 4096
+
+/* Each slot is guarded by a sequence number: odd while being written,
+ * even once complete. Readers copy the record and re-check the sequence,
+ * so the dispatcher never waits on a dump in progress. */
+typedef struct TraceSlot {
+    atomic_uint_fast64_t seq;
+    MsgTrace rec;
+} TraceSlot;
+
+static TraceSlot ring[TRACE_RING_SIZE];
+static atomic_uint_fast64_t ring_head;
+static atomic_int sample_every;
+static atomic_uint sample_counter;
+
+/* Trace of the message currently being dispatched on this thread */
+static _Thread_local MsgTrace *current_trace;
+
+uint64_t trace_now_us(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)(ts.tv_nsec / 1000);
+#endif
+}
+
+void trace_set_sampling(int every_n) {
+    if (every_n < 0) every_n = 0;
+    atomic_store_explicit(&sample_every, every_n, memory_order_relaxed);
+}
+
+int trace_get_sampling(void) {
+    return atomic_load_explicit(&sample_every, memory_order_relaxed);
+}
+
+int trace_enabled(void) {
+    return atomic_load_explicit(&sample_every, memory_order_relaxed) != 0;
+}
+
+MsgTrace *trace_start(int conn_id, uint64_t t_read) {
+    int every = atomic_load_explicit(&sample_every, memory_order_relaxed);
+    if (every <= 0) return NULL;
+
+    unsigned n = atomic_fetch_add_explicit(&sample_counter, 1, memory_order_relaxed);
+    if (n % (unsigned)every != 0) return NULL;
+
+    MsgTrace *t = calloc(1, sizeof(MsgTrace));
+    if (!t) return NULL;
+    t->conn_id = conn_id;
+    t->t_read = t_read;
+    return t;
+}
+
+void trace_begin_dispatch(MsgTrace *t, const char *msg) {
+    current_trace = t;
+    if (!t) return;
+
+    /* Only [A-Z_]: the verb goes into the JSON dump unescaped */
+    size_t i = 0;
+    while (msg && ((msg[i] >= 'A' && msg[i] <= 'Z') || msg[i] == '_') && i + 1 < sizeof(t->verb)) {
+        t->verb[i] = msg[i];
+        i++;
+    }
+    t->verb[i] = '\0';
+    t->t_handler_start = trace_now_us();
+}
+
+static void trace_commit(const MsgTrace *t) {
+    uint_fast64_t idx = atomic_fetch_add_explicit(&ring_head, 1, memory_order_relaxed);
+    TraceSlot *slot = &ring[idx % TRACE_RING_SIZE];
+
+    atomic_store_explicit(&slot->seq, 2 * idx + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->rec = *t;
+    atomic_store_explicit(&slot->seq, 2 * idx + 2, memory_order_release);
+}
+
+void trace_end_dispatch(void) {
+    MsgTrace *t = current_trace;
+    current_trace = NULL;
+    if (!t) return;
+
+    t->t_handler_end = trace_now_us();
+    trace_commit(t);
+    free(t);
+}
+
+void trace_record_write(uint64_t start, uint64_t end) {
+    MsgTrace *t = current_trace;
+    if (!t) return;
+    if (t->t_write_start == 0) t->t_write_start = start;
+    t->t_write_end = end;
+    t->write_total += end - start;
+    t->write_count++;
+}
+
+static void emit_span(FILE *f, int *count, const MsgTrace *t, const char *name,
+                      uint64_t start, uint64_t end) {
+    if (start == 0 || end < start) return;
+    fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+               "\"pid\":1,\"tid\":%d,\"args\":{\"verb\":\"%s\"}}",
+            *count ? ",\n" : "", name, t->verb,
+            (unsigned long long)start, (unsigned long long)(end - start),
+            t->conn_id, t->verb);
+    (*count)++;
+}
+
+int trace_dump_chrome(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    uint_fast64_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint_fast64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    int count = 0;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (uint_fast64_t idx = first; idx < head; idx++) {
+        TraceSlot *slot = &ring[idx % TRACE_RING_SIZE];
+        uint_fast64_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before != 2 * idx + 2) continue; /* Being written or already overwritten */
+
+        MsgTrace t = slot->rec;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != before) continue;
+
+        emit_span(f, &count, &t, "read", t.t_read, t.t_enqueue);
+        emit_span(f, &count, &t, "queue", t.t_enqueue, t.t_dequeue);
+        emit_span(f, &count, &t, "dispatch", t.t_dequeue, t.t_handler_start);
+        emit_span(f, &count, &t, "handler", t.t_handler_start, t.t_handler_end);
+        emit_span(f, &count, &t, "write", t.t_write_start, t.t_write_end);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return count;
+}
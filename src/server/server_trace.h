@@ -0,0 +1,45 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <stdint.h>
+
+/* Per-message stage timestamps (microseconds, monotonic clock).
+ * Only sampled messages carry one of these; untraced messages pass NULL. */
+typedef struct MsgTrace {
+    uint64_t t_read;          /* READ() returned the bytes containing the line */
+    uint64_t t_enqueue;       /* Line pushed to the message queue */
+    uint64_t t_dequeue;       /* Dispatcher popped the line */
+    uint64_t t_handler_start; /* Command handler entered */
+    uint64_t t_handler_end;   /* Command handler returned */
+    uint64_t t_write_start;   /* First socket write for this message (0 if none) */
+    uint64_t t_write_end;     /* Last socket write for this message returned */
+    uint64_t write_total;     /* Time spent blocked inside socket writes */
+    int write_count;
+    int conn_id;
+    char verb[16];
+} MsgTrace;
+
+/* Current monotonic time in microseconds */
+uint64_t trace_now_us(void);
+
+/* Sample one message out of every_n (0 disables tracing) */
+void trace_set_sampling(int every_n);
+int trace_get_sampling(void);
+
+/* Cheap check used on the read path; returns non-zero when tracing is on */
+int trace_enabled(void);
+
+/* Start a trace for a freshly read line if it is sampled, otherwise NULL */
+MsgTrace *trace_start(int conn_id, uint64_t t_read);
+
+/* Dispatcher hooks: mark the trace being handled so writes can be attributed */
+void trace_begin_dispatch(MsgTrace *t, const char *msg);
+void trace_end_dispatch(void);
+
+/* Record a socket write performed while dispatching the current message */
+void trace_record_write(uint64_t start, uint64_t end);
+
+/* Dump the ring buffer as Chrome trace JSON. Returns number of events or -1 */
+int trace_dump_chrome(const char *path);
+
+#endif /* SERVER_TRACE_H */
@@ -0,0 +1,459 @@
+#define _DEFAULT_SOURCE
+#include "server_uring.h"
+#include "server_client.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_trace.h"
+#include "server_log.h"
+#include "server_admission.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifndef HAVE_IO_URING
+int uring_start(sock_t listen_fd) {
+    (void)listen_fd;
+    fprintf(stderr, "io_uring backend not available in this build\n");
+    return -1;
+}
+
+void uring_stop(void) { }
+void uring_enable_batching(void) { }
+
+int uring_send_batched(sock_t fd, const char *buf, int len) {
+    (void)fd;
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+void uring_flush_sends(void) { }
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define RING_ENTRIES 256
+#define BUF_GROUP 1
+#define BUF_COUNT 256           /* Must be a power of two */
+#define BUF_SIZE 2048
+
+/* user_data: kind in the high half, connection ID in the low half */
+#define UD_ACCEPT 1ull
+#define UD_RECV 2ull
+#define UD_STOP 3ull
+#define UD_INBOX 4ull
+#define UD(kind, id) (((kind) << 32) | (uint32_t)(id))
+
+/* Minimal io_uring wrapper over the raw syscalls (no liburing dependency) */
+typedef struct Ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned sq_entries;
+    unsigned local_tail;
+    unsigned pending;
+} Ring;
+
+static int ring_init(Ring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    r->cq_ptr = single ? r->sq_ptr
+                       : mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              r->fd, IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+        close(r->fd);
+        return -1;
+    }
+
+    char *sq = r->sq_ptr, *cq = r->cq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->local_tail = *r->sq_tail;
+    return 0;
+}
+
+static void ring_free(Ring *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+}
+
+/* Publish queued SQEs and optionally wait for wait_nr completions */
+static int ring_enter(Ring *r, unsigned wait_nr) {
+    __atomic_store_n(r->sq_tail, r->local_tail, __ATOMIC_RELEASE);
+    unsigned n = r->pending;
+    r->pending = 0;
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, r->fd, n, wait_nr,
+                           wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        n = 0;
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static struct io_uring_sqe *ring_sqe(Ring *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->local_tail - head >= r->sq_entries) {
+        ring_enter(r, 0);
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->local_tail - head >= r->sq_entries) return NULL;
+    }
+    unsigned idx = r->local_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->local_tail++;
+    r->pending++;
+    return sqe;
+}
+
+static struct io_uring_cqe *ring_peek(Ring *r) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &r->cqes[head & *r->cq_mask];
+}
+
+static void ring_seen(Ring *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* ==================== Ring thread: accept + recv ==================== */
+
+static Ring io_ring;
+static pthread_t ring_tid;
+static int ring_running = 0;
+static sock_t ring_listen_fd = SOCKET_INVALID;
+static int stop_pipe[2] = {-1, -1};
+static ClientCtx *ring_conns[MAX_CONNECTIONS];
+
+/* Connections admitted from the queue, handed over by the admission thread */
+static int inbox_pipe[2] = {-1, -1};
+static pthread_mutex_t inbox_lock = PTHREAD_MUTEX_INITIALIZER;
+static ClientCtx *inbox[MAX_CONNECTIONS];
+static int ninbox = 0;
+
+static struct io_uring_buf_ring *buf_ring = NULL;
+static char *buf_pool = NULL;
+static unsigned buf_tail = 0;
+
+static void buf_recycle(unsigned bid) {
+    struct io_uring_buf *b = &buf_ring->bufs[buf_tail & (BUF_COUNT - 1)];
+    b->addr = (uint64_t)(uintptr_t)(buf_pool + (size_t)bid * BUF_SIZE);
+    b->len = BUF_SIZE;
+    b->bid = (uint16_t)bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, (uint16_t)buf_tail, __ATOMIC_RELEASE);
+}
+
+static int setup_buffers(void) {
+    if (posix_memalign((void **)&buf_ring, 4096, BUF_COUNT * sizeof(struct io_uring_buf)) != 0) return -1;
+    memset(buf_ring, 0, BUF_COUNT * sizeof(struct io_uring_buf));
+    buf_pool = malloc((size_t)BUF_COUNT * BUF_SIZE);
+    if (!buf_pool) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, io_ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+
+    for (unsigned i = 0; i < BUF_COUNT; i++) buf_recycle(i);
+    return 0;
+}
+
+static void arm_accept(void) {
+    struct io_uring_sqe *sqe = ring_sqe(&io_ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = ring_listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = UD(UD_ACCEPT, 0);
+}
+
+static void arm_recv(ClientCtx *ctx) {
+    struct io_uring_sqe *sqe = ring_sqe(&io_ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ctx->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = UD(UD_RECV, ctx->connection_id);
+}
+
+static void arm_stop(void) {
+    struct io_uring_sqe *sqe = ring_sqe(&io_ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = stop_pipe[0];
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = UD(UD_STOP, 0);
+}
+
+static void arm_inbox(void) {
+    struct io_uring_sqe *sqe = ring_sqe(&io_ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = inbox_pipe[0];
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = UD(UD_INBOX, 0);
+}
+
+/* Admission thread: a connection the ring accepted left the queue */
+static void admit_to_ring(ClientCtx *ctx, void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&inbox_lock);
+    inbox[ninbox++] = ctx;
+    pthread_mutex_unlock(&inbox_lock);
+    if (write(inbox_pipe[1], "x", 1) < 0) perror("io_uring inbox");
+}
+
+static void take_inbox(void) {
+    char drain[64];
+    while (read(inbox_pipe[0], drain, sizeof(drain)) > 0) { }
+    pthread_mutex_lock(&inbox_lock);
+    for (int i = 0; i < ninbox; i++) {
+        ring_conns[inbox[i]->connection_id] = inbox[i];
+        arm_recv(inbox[i]);
+    }
+    ninbox = 0;
+    pthread_mutex_unlock(&inbox_lock);
+    if (ring_running) arm_inbox();
+}
+
+static void on_accept(const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        sock_t c = cqe->res;
+        int held;
+        ClientCtx *ctx = admission_register(c, admit_to_ring, NULL, &held);
+        if (ctx) {
+            admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+            log_event(LOG_INFO, "conn_accepted", "conn=%d io=uring", ctx->connection_id);
+            ring_conns[ctx->connection_id] = ctx;
+            arm_recv(ctx);
+        } else if (!held) {
+            admin_stat_inc(STAT_CONNECTIONS_REJECTED);
+            const char *msg = "BUSY Server full\n";
+            server_send(c, msg, (int)strlen(msg));
+            shutdown(c, SHUT_RDWR_FLAG);
+            CLOSE(c);
+        }
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE) && ring_running) arm_accept();
+}
+
+static void on_recv(const struct io_uring_cqe *cqe, int id) {
+    ClientCtx *ctx = (id >= 0 && id < MAX_CONNECTIONS) ? ring_conns[id] : NULL;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (ctx && cqe->res > 0) client_feed(ctx, buf_pool + (size_t)bid * BUF_SIZE, (size_t)cqe->res);
+        buf_recycle(bid);
+    }
+    if (!ctx || (cqe->flags & IORING_CQE_F_MORE)) return;
+
+    if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+        /* Multishot ended (or ran out of buffers) but the connection is fine */
+        arm_recv(ctx);
+    } else {
+        /* EOF or error: the dispatcher owns ctx from here */
+        ring_conns[id] = NULL;
+        char *disc = strdup("DISCONNECT\n");
+        if (disc) enqueue_msg(disc, id);
+    }
+}
+
+static void *ring_thread(void *arg) {
+    (void)arg;
+    arm_accept();
+    arm_stop();
+    arm_inbox();
+
+    while (ring_running) {
+        if (ring_enter(&io_ring, 1) < 0 && errno != EAGAIN && errno != EBUSY) break;
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = ring_peek(&io_ring)) != NULL) {
+            uint64_t kind = cqe->user_data >> 32;
+            int id = (int)(cqe->user_data & 0xFFFFFFFFu);
+            if (kind == UD_ACCEPT) on_accept(cqe);
+            else if (kind == UD_RECV) on_recv(cqe, id);
+            else if (kind == UD_STOP) ring_running = 0;
+            else if (kind == UD_INBOX) take_inbox();
+            ring_seen(&io_ring);
+        }
+    }
+    return NULL;
+}
+
+int uring_start(sock_t listen_fd) {
+    if (ring_init(&io_ring, RING_ENTRIES) != 0) {
+        fprintf(stderr, "io_uring setup failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (setup_buffers() != 0 || pipe(stop_pipe) != 0) {
+        fprintf(stderr, "io_uring: provided buffer ring not supported by this kernel\n");
+        ring_free(&io_ring);
+        return -1;
+    }
+    if (pipe(inbox_pipe) != 0) {
+        ring_free(&io_ring);
+        return -1;
+    }
+    fcntl(inbox_pipe[0], F_SETFL, O_NONBLOCK);
+    ring_listen_fd = listen_fd;
+    ring_running = 1;
+    if (pthread_create(&ring_tid, NULL, ring_thread, NULL) != 0) {
+        ring_running = 0;
+        ring_free(&io_ring);
+        return -1;
+    }
+    return 0;
+}
+
+void uring_stop(void) {
+    if (stop_pipe[1] < 0) return;
+    if (write(stop_pipe[1], "x", 1) < 0) perror("io_uring stop");
+    pthread_join(ring_tid, NULL);
+    ring_free(&io_ring);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+    close(inbox_pipe[0]);
+    close(inbox_pipe[1]);
+    inbox_pipe[0] = inbox_pipe[1] = -1;
+}
+
+/* ==================== Dispatcher: batched sends ==================== */
+
+typedef struct OutBatch {
+    sock_t fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+} OutBatch;
+
+static _Thread_local int batching = 0;
+static Ring send_ring;
+static OutBatch batches[MAX_CONNECTIONS];
+static int batch_count = 0;
+
+void uring_enable_batching(void) {
+    if (ring_init(&send_ring, RING_ENTRIES) != 0) {
+        fprintf(stderr, "io_uring send ring unavailable, using plain writes\n");
+        return;
+    }
+    batching = 1;
+}
+
+int uring_send_batched(sock_t fd, const char *buf, int len) {
+    if (!batching || len <= 0) return 0;
+
+    /* One buffer per client per dispatched message keeps replies in order */
+    OutBatch *b = NULL;
+    for (int i = 0; i < batch_count; i++) {
+        if (batches[i].fd == fd) {
+            b = &batches[i];
+            break;
+        }
+    }
+    if (!b) {
+        if (batch_count >= MAX_CONNECTIONS) uring_flush_sends();
+        b = &batches[batch_count++];
+        b->fd = fd;
+        b->len = 0;
+    }
+    if (b->len + (size_t)len > b->cap) {
+        size_t cap = b->cap ? b->cap : 1024;
+        while (cap < b->len + (size_t)len) cap *= 2;
+        char *p = realloc(b->buf, cap);
+        if (!p) return 0;
+        b->buf = p;
+        b->cap = cap;
+    }
+    memcpy(b->buf + b->len, buf, (size_t)len);
+    b->len += (size_t)len;
+    return 1;
+}
+
+void uring_flush_sends(void) {
+    if (!batching || batch_count == 0) return;
+    uint64_t start = trace_enabled() ? trace_now_us() : 0;
+
+    /* Only these sockets' locks are held while the sends complete */
+    for (int i = 0; i < batch_count; i++) server_out_lock(batches[i].fd);
+
+    int submitted = 0;
+    for (int i = 0; i < batch_count; i++) {
+        struct io_uring_sqe *sqe = ring_sqe(&send_ring);
+        if (!sqe) break;
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = batches[i].fd;
+        sqe->addr = (uint64_t)(uintptr_t)batches[i].buf;
+        sqe->len = (unsigned)batches[i].len;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uint64_t)i;
+        submitted++;
+    }
+    ring_enter(&send_ring, (unsigned)submitted);
+
+    /* Buffers stay ours until every send completed; finish short sends by hand */
+    int reaped = 0;
+    while (reaped < submitted) {
+        struct io_uring_cqe *cqe = ring_peek(&send_ring);
+        if (!cqe) {
+            if (ring_enter(&send_ring, 1) < 0 && errno != EAGAIN) break;
+            continue;
+        }
+        OutBatch *b = &batches[cqe->user_data];
+        if (cqe->res >= 0 && (size_t)cqe->res < b->len) {
+            WRITE(b->fd, b->buf + cqe->res, b->len - (size_t)cqe->res);
+        }
+        ring_seen(&send_ring);
+        reaped++;
+    }
+    for (int i = submitted; i < batch_count; i++) WRITE(batches[i].fd, batches[i].buf, batches[i].len);
+    for (int i = 0; i < batch_count; i++) server_out_unlock(batches[i].fd);
+    batch_count = 0;
+
+    if (start) trace_record_write(start, trace_now_us());
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef SERVER_URING_H
+#define SERVER_URING_H
+
+/*
+ * server_uring.h - Linux io_uring networking backend
+ *
+ * One ring thread runs a multishot accept on the listener and a multishot
+ * recv per client, with data landing in a provided buffer ring, so reads
+ * need no syscall per message. Replies written by the dispatcher are
+ * batched per client and sent with one io_uring_enter per dispatched
+ * message. Built when the kernel headers provide io_uring (HAVE_IO_URING).
+ */
+
+#include "common.h"
+
+/* Start the ring thread on an already listening socket. Returns 0 on success */
+int uring_start(sock_t listen_fd);
+
+/* Stop the ring thread */
+void uring_stop(void);
+
+/* Dispatcher side: batch replies on this thread from now on */
+void uring_enable_batching(void);
+
+/* Queue a reply if this thread batches. Returns 0 if the caller must write it itself */
+int uring_send_batched(sock_t fd, const char *buf, int len);
+
+/* Send all batched replies (one submit for every client) */
+void uring_flush_sends(void);
+
+#endif /* SERVER_URING_H */
@@ -0,0 +1,464 @@
+#define _DEFAULT_SOURCE
+#include "server_ws.h"
+#include "server_client.h"
+#include "server_message.h"
+#include "server_admin.h"
+#include "server_log.h"
+#include "server_trace.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <strings.h>
+#endif
+
+char *ws_frame(int opcode, const char *payload, size_t len, size_t *out_len) {
+    unsigned char hdr[10];
+    size_t h = 0;
+    hdr[h++] = (unsigned char)(0x80 | opcode);  /* FIN, never fragmented */
+    if (len < 126) {
+        hdr[h++] = (unsigned char)len;
+    } else if (len <= 0xFFFF) {
+        hdr[h++] = 126;
+        hdr[h++] = (unsigned char)(len >> 8);
+        hdr[h++] = (unsigned char)len;
+    } else {
+        hdr[h++] = 127;
+        for (int i = 7; i >= 0; i--) hdr[h++] = (unsigned char)((uint64_t)len >> (8 * i));
+    }
+
+    char *out = malloc(h + len);
+    if (!out) return NULL;
+    memcpy(out, hdr, h);
+    if (len) memcpy(out + h, payload, len);
+    *out_len = h + len;
+    return out;
+}
+
+#ifdef _WIN32
+int ws_start(int port) {
+    (void)port;
+    fprintf(stderr, "WebSocket endpoint is not supported on Windows\n");
+    return -1;
+}
+
+void ws_stop(void) { }
+
+int ws_is_client(sock_t fd) {
+    (void)fd;
+    return 0;
+}
+
+void ws_forget(sock_t fd) {
+    (void)fd;
+}
+
+int ws_on_notice(ClientCtx *ctx, const char *msg) {
+    (void)ctx;
+    (void)msg;
+    return -1;
+}
+#else
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_PAYLOAD 4096
+#define WS_PING_MS 30000        /* Ping a peer that sent nothing for this long */
+#define WS_HANDSHAKE_MS 5000    /* Time allowed for the whole upgrade request */
+#define WS_MAX_FD 65536         /* Higher descriptors are refused at accept */
+
+static sock_t ws_listen_fd = SOCKET_INVALID;
+static pthread_t ws_accept_tid;
+static atomic_int ws_running;
+static unsigned char ws_fds[WS_MAX_FD];     /* Upgraded sockets, by fd (dispatcher) */
+
+int ws_is_client(sock_t fd) {
+    return fd >= 0 && fd < WS_MAX_FD && ws_fds[fd];
+}
+
+void ws_forget(sock_t fd) {
+    if (fd >= 0 && fd < WS_MAX_FD) ws_fds[fd] = 0;
+}
+
+/* ==================== Handshake ==================== */
+
+static uint32_t rol32(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1(const unsigned char *data, size_t len, unsigned char out[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    unsigned char *msg = calloc(1, total);
+    if (!msg) {
+        memset(out, 0, 20);
+        return;
+    }
+    memcpy(msg, data, len);
+    msg[len] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) msg[total - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t off = 0; off < total; off += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char *p = msg + off + 4 * i;
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; i++) w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = rol32(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol32(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    free(msg);
+    for (int i = 0; i < 5; i++) {
+        out[4 * i] = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+static void base64(const unsigned char *in, size_t len, char *out) {
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = tbl[(v >> 18) & 63];
+        out[o++] = tbl[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? tbl[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? tbl[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+/* Value of header name in the request head, copied into val. Returns 0 if present */
+static int header_value(const char *head, const char *name, char *val, size_t cap) {
+    size_t nlen = strlen(name);
+    for (const char *line = strstr(head, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, nlen) != 0 || line[nlen] != ':') continue;
+        const char *v = line + nlen + 1;
+        while (*v == ' ' || *v == '\t') v++;
+        size_t n = strcspn(v, "\r\n");
+        if (n >= cap) n = cap - 1;
+        memcpy(val, v, n);
+        while (n > 0 && (val[n - 1] == ' ' || val[n - 1] == '\t')) n--;
+        val[n] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+static int write_all(sock_t fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = WRITE(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Read the HTTP upgrade request and answer it. Bytes after the request head
+ * (the first frames, if the client pipelined them) are left in buf.
+ * Returns the number of leftover bytes, or -1 if this is not a WebSocket client
+ * or the request did not arrive within WS_HANDSHAKE_MS. */
+static int handshake(sock_t fd, unsigned char *buf, size_t cap) {
+    uint64_t deadline = trace_now_us() + (uint64_t)WS_HANDSHAKE_MS * 1000;
+    size_t len = 0;
+    char *end = NULL;
+    while (!end) {
+        if (len >= cap - 1) return -1;
+        uint64_t now = trace_now_us();
+        struct pollfd p = {fd, POLLIN, 0};
+        if (now >= deadline || poll(&p, 1, (int)((deadline - now + 999) / 1000)) <= 0) return -1;
+        ssize_t n = READ(fd, buf + len, cap - 1 - len);
+        if (n <= 0) return -1;
+        len += (size_t)n;
+        buf[len] = '\0';
+        end = strstr((char *)buf, "\r\n\r\n");
+    }
+    *end = '\0';
+    const char *head = (const char *)buf;
+
+    char upgrade[32], key[64];
+    if (strncmp(head, "GET ", 4) != 0
+        || header_value(head, "Upgrade", upgrade, sizeof(upgrade)) != 0
+        || strcasecmp(upgrade, "websocket") != 0
+        || header_value(head, "Sec-WebSocket-Key", key, sizeof(key)) != 0) {
+        const char *resp = "HTTP/1.1 426 Upgrade Required\r\n"
+                           "Upgrade: websocket\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        write_all(fd, resp, strlen(resp));
+        return -1;
+    }
+
+    char concat[128];
+    unsigned char digest[20];
+    char accept_key[32];
+    snprintf(concat, sizeof(concat), "%s%s", key, WS_GUID);
+    sha1((const unsigned char *)concat, strlen(concat), digest);
+    base64(digest, sizeof(digest), accept_key);
+
+    char resp[256];
+    int rn = snprintf(resp, sizeof(resp),
+                      "HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: %s\r\n\r\n", accept_key);
+    if (write_all(fd, resp, (size_t)rn) != 0) return -1;
+
+    size_t used = (size_t)(end + 4 - (char *)buf);
+    memmove(buf, buf + used, len - used);
+    return (int)(len - used);
+}
+
+/* ==================== Frames ==================== */
+
+/* After the handshake only the dispatcher writes to the socket: the reader
+ * queues "WS_OPEN\n", "WS_PING\n", "WS_PONG <hex>\n" and "WS_CLOSE <code>\n"
+ * so control frames never interleave with the text frames it sends */
+static void notify(ClientCtx *ctx, const char *fmt, ...) {
+    char buf[16 + 2 * 125];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    char *m = strdup(buf);
+    if (m) enqueue_msg(m, ctx->connection_id);
+}
+
+static void send_close(ClientCtx *ctx, int code) {
+    notify(ctx, "WS_CLOSE %d\n", code);
+}
+
+static int send_frame(sock_t fd, int opcode, const char *payload, size_t len) {
+    size_t flen;
+    char *f = ws_frame(opcode, payload, len, &flen);
+    if (!f) return -1;
+    int n = server_send_raw(fd, f, (int)flen);
+    free(f);
+    return n < 0 ? -1 : 0;
+}
+
+int ws_on_notice(ClientCtx *ctx, const char *msg) {
+    size_t len = strlen(msg);
+    if (len == 0 || msg[len - 1] != '\n') return -1;      /* A client line */
+
+    if (strcmp(msg, "WS_OPEN\n") == 0) {
+        ctx->transport = TRANSPORT_WEBSOCKET;
+        ws_fds[ctx->fd] = 1;
+        /* The web client waits for the greeting the gateway used to send */
+        server_send(ctx->fd, "PROXY_HELLO\n", 12);
+    } else if (strcmp(msg, "WS_PING\n") == 0) {
+        send_frame(ctx->fd, WS_OP_PING, NULL, 0);
+    } else if (strncmp(msg, "WS_PONG ", 8) == 0) {
+        char data[125];
+        size_t n = 0;
+        unsigned int byte;
+        for (const char *h = msg + 8; n < sizeof(data) && sscanf(h, "%2x", &byte) == 1; h += 2)
+            data[n++] = (char)byte;
+        send_frame(ctx->fd, WS_OP_PONG, data, n);
+    } else if (strncmp(msg, "WS_CLOSE ", 9) == 0) {
+        /* Code 0 echoes a close frame that carried no status */
+        int code = atoi(msg + 9);
+        char body[2] = {(char)(code >> 8), (char)(code & 0xFF)};
+        send_frame(ctx->fd, WS_OP_CLOSE, body, code ? sizeof(body) : 0);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Handle every complete frame in buf. Returns bytes consumed, or -1 to close */
+static int process_frames(ClientCtx *ctx, unsigned char *buf, size_t len) {
+    size_t off = 0;
+    for (;;) {
+        unsigned char *p = buf + off;
+        size_t avail = len - off;
+        if (avail < 2) break;
+
+        int fin = p[0] & 0x80;
+        int opcode = p[0] & 0x0F;
+        int masked = p[1] & 0x80;
+        uint64_t plen = p[1] & 0x7F;
+        size_t h = 2;
+        if (plen == 126) {
+            if (avail < 4) break;
+            plen = ((uint64_t)p[2] << 8) | p[3];
+            h = 4;
+        } else if (plen == 127) {
+            if (avail < 10) break;
+            plen = 0;
+            for (int i = 0; i < 8; i++) plen = (plen << 8) | p[2 + i];
+            h = 10;
+        }
+        if (!masked) {
+            send_close(ctx, 1002);      /* Clients must mask */
+            return -1;
+        }
+        if (plen > WS_MAX_PAYLOAD) {
+            send_close(ctx, 1009);
+            return -1;
+        }
+        if (avail < h + 4 + plen) break;
+
+        unsigned char *mask = p + h;
+        char *data = (char *)p + h + 4;
+        for (uint64_t i = 0; i < plen; i++) data[i] ^= mask[i & 3];
+
+        switch (opcode) {
+        case 0x0:   /* Continuation */
+        case 0x1:   /* Text */
+        case 0x2:   /* Binary */
+            client_feed(ctx, data, (size_t)plen);
+            /* One message is one protocol line, like the gateway did */
+            if (fin && (plen == 0 || data[plen - 1] != '\n')) client_feed(ctx, "\n", 1);
+            break;
+        case WS_OP_CLOSE:
+            send_close(ctx, plen >= 2 ? ((unsigned char)data[0] << 8) | (unsigned char)data[1] : 0);
+            return -1;
+        case WS_OP_PING: {
+            char hex[2 * 125 + 1];
+            for (uint64_t i = 0; i < plen && i < 125; i++)
+                snprintf(hex + 2 * i, 3, "%02x", (unsigned char)data[i]);
+            hex[2 * (plen < 125 ? plen : 125)] = '\0';
+            notify(ctx, "WS_PONG %s\n", hex);
+            break;
+        }
+        case WS_OP_PONG:
+            break;
+        default:
+            send_close(ctx, 1002);
+            return -1;
+        }
+        off += h + 4 + (size_t)plen;
+    }
+    return (int)off;
+}
+
+static void *ws_reader(void *arg) {
+    ClientCtx *ctx = arg;
+    unsigned char buf[WS_MAX_PAYLOAD + 16];
+    int pinged = 0;
+
+    int n = handshake(ctx->fd, buf, sizeof(buf));
+    size_t len = n > 0 ? (size_t)n : 0;
+    if (n >= 0) {
+        notify(ctx, "WS_OPEN\n");
+
+        for (;;) {
+            int used = process_frames(ctx, buf, len);
+            if (used < 0) break;
+            memmove(buf, buf + used, len - (size_t)used);
+            len -= (size_t)used;
+
+            struct pollfd p = {ctx->fd, POLLIN, 0};
+            int r = poll(&p, 1, WS_PING_MS);
+            if (r == 0) {
+                /* Idle: ping once, give up if the next interval is silent too */
+                if (pinged) break;
+                notify(ctx, "WS_PING\n");
+                pinged = 1;
+                continue;
+            }
+            if (r < 0) continue;
+            ssize_t got = READ(ctx->fd, buf + len, sizeof(buf) - len);
+            if (got <= 0) break;
+            len += (size_t)got;
+            pinged = 0;
+        }
+    }
+
+    /* Same cleanup path as a TCP client; the dispatcher closes the socket */
+    char *disc = strdup("DISCONNECT\n");
+    if (disc) enqueue_msg(disc, ctx->connection_id);
+
+    pthread_mutex_lock(&g_global_state->lock);
+    g_global_state->active_threads--;
+    pthread_mutex_unlock(&g_global_state->lock);
+    return NULL;
+}
+
+/* ==================== Listener ==================== */
+
+static void *ws_accept_thread(void *arg) {
+    (void)arg;
+    while (atomic_load(&ws_running)) {
+        sock_t c = accept(ws_listen_fd, NULL, NULL);
+        if (c == SOCKET_INVALID) {
+            if (!atomic_load(&ws_running)) break;
+            continue;
+        }
+        ClientCtx *ctx = c < WS_MAX_FD ? client_register(c) : NULL;
+        if (!ctx) {
+            admin_stat_inc(STAT_CONNECTIONS_REJECTED);
+            const char *resp = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            write_all(c, resp, strlen(resp));
+            CLOSE(c);
+            continue;
+        }
+        admin_stat_inc(STAT_CONNECTIONS_ACCEPTED);
+        log_event(LOG_INFO, "conn_accepted", "conn=%d io=websocket", ctx->connection_id);
+        if (client_start_thread(ctx, ws_reader) != 0) {
+            char *disc = strdup("DISCONNECT\n");
+            if (disc) enqueue_msg(disc, ctx->connection_id);
+        }
+    }
+    return NULL;
+}
+
+int ws_start(int port) {
+    ws_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (ws_listen_fd == SOCKET_INVALID) return -1;
+
+    int on = 1;
+    setsockopt(ws_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(ws_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(ws_listen_fd, 50) < 0) {
+        CLOSE(ws_listen_fd);
+        ws_listen_fd = SOCKET_INVALID;
+        return -1;
+    }
+
+    atomic_store(&ws_running, 1);
+    if (pthread_create(&ws_accept_tid, NULL, ws_accept_thread, NULL) != 0) {
+        atomic_store(&ws_running, 0);
+        CLOSE(ws_listen_fd);
+        ws_listen_fd = SOCKET_INVALID;
+        return -1;
+    }
+    return 0;
+}
+
+void ws_stop(void) {
+    if (ws_listen_fd == SOCKET_INVALID) return;
+    atomic_store(&ws_running, 0);
+    shutdown(ws_listen_fd, SHUT_RDWR_FLAG);
+    pthread_join(ws_accept_tid, NULL);
+    CLOSE(ws_listen_fd);
+    ws_listen_fd = SOCKET_INVALID;
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef SERVER_WS_H
+#define SERVER_WS_H
+
+/*
+ * server_ws.h - Native WebSocket endpoint
+ *
+ * Browsers connect straight to the server on an optional port instead of
+ * going through the Node gateway. The endpoint performs the HTTP upgrade,
+ * unmasks client frames and feeds their payload to the normal line parser
+ * (one text message = one protocol line), answers pings and sends a ping
+ * to idle peers. Every server_send to a WebSocket client becomes one text
+ * frame, so the text protocol is unchanged. Once the upgrade is answered the
+ * dispatcher does all the writing, control frames included. POSIX only.
+ */
+
+#include "common.h"
+#include "server_state.h"
+#include <stddef.h>
+
+/* Listen for WebSocket clients on port. Returns 0 on success */
+int ws_start(int port);
+
+/* Stop accepting WebSocket clients */
+void ws_stop(void);
+
+/* Non-zero if fd is an upgraded WebSocket client (dispatcher) */
+int ws_is_client(sock_t fd);
+
+/* fd is being closed and may be reused by another connection (dispatcher) */
+void ws_forget(sock_t fd);
+
+/* Send the frame a WebSocket reader asked for (dispatcher). Returns 0 if
+ * msg was one of its notices, -1 for anything else */
+int ws_on_notice(ClientCtx *ctx, const char *msg);
+
+/* Build an unmasked server frame around payload. Returns a malloc'd buffer
+ * and stores its size in *out_len, NULL on allocation failure */
+char *ws_frame(int opcode, const char *payload, size_t len, size_t *out_len);
+
+#define WS_OP_TEXT 0x1
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+#endif /* SERVER_WS_H */
@@ -0,0 +1,244 @@
+#define _DEFAULT_SOURCE
+/*
+ * boats_analyze.c - Scan game archives written by the server's --archive
+ *
+ * Segments are independent, so the files are indexed by walking segment
+ * headers and worker threads then decode segments in any order, each into
+ * its own counters, which are summed at the end. Reports where ships are
+ * placed, where each side fires first and how long games last.
+ *
+ *     boats_analyze [-j threads] archive...
+ *     boats_analyze -x game replay archive    (export a game as a replay file)
+ */
+
+#include "game_archive.h"
+#include "mapped_file.h"
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CELLS (GRID_ROWS * GRID_COLS)
+#define DURATION_BUCKETS 3600           /* One per second; longer games land in the last */
+
+typedef struct SegmentRef {
+    const uint8_t *data;
+    size_t size;
+} SegmentRef;
+
+typedef struct Stats {
+    uint64_t games, shots, forfeits, corrupt;
+    uint64_t first_mover_wins;
+    uint64_t ship_cells[CELLS];         /* Fleets with a ship on the cell */
+    uint64_t first_shot[CELLS];         /* Each side's opening shot */
+    uint64_t duration[DURATION_BUCKETS];
+    uint64_t duration_sum_ms;
+} Stats;
+
+static SegmentRef *segments = NULL;
+static size_t nsegments = 0;
+static atomic_size_t next_segment;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void add_game(Stats *st, const ArchiveGame *g) {
+    int opened[2] = {0, 0};
+
+    st->games++;
+    st->shots += (uint64_t)g->nshots;
+    if (g->reason == ARCHIVE_END_FORFEIT) st->forfeits++;
+
+    for (int seat = 0; seat < 2; seat++) {
+        for (int i = 0; i < ARCHIVE_SHIPS; i++) {
+            const Ship *s = &g->ships[seat][i];
+            for (int k = 0; k < s->len; k++) {
+                int r = s->r + (s->dir == 'V' ? k : 0);
+                int c = s->c + (s->dir == 'V' ? 0 : k);
+                if (r < GRID_ROWS && c < GRID_COLS) st->ship_cells[r * GRID_COLS + c]++;
+            }
+        }
+    }
+    for (int i = 0; i < g->nshots && !(opened[0] && opened[1]); i++) {
+        int seat = ARCHIVE_SHOT_SEAT(g->shot[i]);
+        int cell = ARCHIVE_SHOT_CELL(g->shot[i]);
+        if (i == 0 && seat == g->winner) st->first_mover_wins++;
+        if (!opened[seat] && cell < CELLS) {
+            st->first_shot[cell]++;
+            opened[seat] = 1;
+        }
+    }
+
+    uint32_t sec = g->duration_ms / 1000;
+    st->duration[sec < DURATION_BUCKETS ? sec : DURATION_BUCKETS - 1]++;
+    st->duration_sum_ms += g->duration_ms;
+}
+
+static void *worker_main(void *arg) {
+    Stats *st = arg;
+    ArchiveGame *g = malloc(sizeof(*g));
+    ArchiveSegment seg;
+    if (!g) return NULL;
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&next_segment, 1);
+        if (i >= nsegments) break;
+        if (archive_segment_open(&seg, segments[i].data, segments[i].size) != 0) {
+            st->corrupt++;
+            continue;
+        }
+        int rc;
+        while ((rc = archive_segment_next(&seg, g)) == 1) add_game(st, g);
+        if (rc < 0) st->corrupt++;
+        archive_segment_close(&seg);
+    }
+    free(g);
+    return NULL;
+}
+
+/* Append the segments of a mapped file to the index. Returns the bytes not covered */
+static size_t index_file(const MappedFile *mf) {
+    const uint8_t *p = mf->data;
+    size_t off = 0, cap = nsegments;
+
+    for (;;) {
+        size_t n = archive_segment_size(p + off, mf->size - off);
+        if (!n) break;
+        if (nsegments == cap) {
+            cap = cap ? cap * 2 : 1024;
+            SegmentRef *grown = realloc(segments, cap * sizeof(SegmentRef));
+            if (!grown) break;
+            segments = grown;
+        }
+        segments[nsegments].data = p + off;
+        segments[nsegments].size = n;
+        nsegments++;
+        off += n;
+    }
+    return mf->size - off;
+}
+
+static void print_heatmap(const char *title, const uint64_t *cells, uint64_t total) {
+    printf("\n%s\n     ", title);
+    for (int c = 0; c < GRID_COLS; c++) printf("    %c ", 'A' + c);
+    printf("\n");
+    for (int r = 0; r < GRID_ROWS; r++) {
+        printf(" %2d |", r + 1);
+        for (int c = 0; c < GRID_COLS; c++) {
+            printf(" %5.1f", total ? 100.0 * (double)cells[r * GRID_COLS + c] / (double)total : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+/* Smallest duration (s) with at least q of the games at or below it */
+static int duration_quantile(const Stats *st, double q) {
+    uint64_t want = (uint64_t)(q * (double)st->games), seen = 0;
+    for (int i = 0; i < DURATION_BUCKETS; i++) {
+        seen += st->duration[i];
+        if (seen > want) return i;
+    }
+    return DURATION_BUCKETS - 1;
+}
+
+/* Write game number index of archive to out as a replay file */
+static int export_replay(const char *archive, int index, const char *out) {
+    static Replay rp;
+    if (replay_load(&rp, archive, index) != 0) {
+        fprintf(stderr, "No game %d in %s\n", index, archive);
+        return 1;
+    }
+    if (replay_save(&rp, out) != 0) {
+        fprintf(stderr, "Cannot write %s\n", out);
+        return 1;
+    }
+    printf("Game %d: %d shots, player %d won, written to %s\n", index, rp.game.nshots, rp.game.winner, out);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+
+    if (argc == 5 && strcmp(argv[1], "-x") == 0) return export_replay(argv[4], atoi(argv[2]), argv[3]);
+
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        threads = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || threads <= 0) {
+        fprintf(stderr, "Usage: %s [-j threads] archive...\n", argv[0]);
+        fprintf(stderr, "       %s -x game replay archive\n", argv[0]);
+        return 1;
+    }
+
+    int nfiles = argc - first;
+    MappedFile *files = calloc((size_t)nfiles, sizeof(MappedFile));
+    if (!files) return 1;
+    uint64_t t0 = now_us();
+    for (int i = 0; i < nfiles; i++) {
+        if (mapped_file_open(&files[i], argv[first + i]) != 0) {
+            fprintf(stderr, "Cannot read %s\n", argv[first + i]);
+            continue;
+        }
+        size_t torn = index_file(&files[i]);
+        if (torn) fprintf(stderr, "%s: ignoring %zu trailing bytes\n", argv[first + i], torn);
+    }
+
+    Stats *stats = calloc((size_t)threads, sizeof(Stats));
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    if (!stats || !tids) return 1;
+    atomic_init(&next_segment, 0);
+    for (int i = 0; i < threads; i++) pthread_create(&tids[i], NULL, worker_main, &stats[i]);
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+
+    Stats *all = &stats[0];
+    for (int t = 1; t < threads; t++) {
+        Stats *st = &stats[t];
+        all->games += st->games;
+        all->shots += st->shots;
+        all->forfeits += st->forfeits;
+        all->corrupt += st->corrupt;
+        all->first_mover_wins += st->first_mover_wins;
+        all->duration_sum_ms += st->duration_sum_ms;
+        for (int i = 0; i < CELLS; i++) {
+            all->ship_cells[i] += st->ship_cells[i];
+            all->first_shot[i] += st->first_shot[i];
+        }
+        for (int i = 0; i < DURATION_BUCKETS; i++) all->duration[i] += st->duration[i];
+    }
+    uint64_t elapsed = now_us() - t0;
+
+    printf("%llu games in %zu segments, %d threads, %.3f s\n",
+           (unsigned long long)all->games, nsegments, threads, elapsed / 1e6);
+    if (all->corrupt) printf("%llu corrupt segments skipped\n", (unsigned long long)all->corrupt);
+    if (all->games) {
+        printf("shots/game %.1f, forfeits %.1f%%, first shooter wins %.1f%%\n",
+               (double)all->shots / (double)all->games,
+               100.0 * (double)all->forfeits / (double)all->games,
+               100.0 * (double)all->first_mover_wins / (double)all->games);
+        printf("duration mean %.1f s, p10 %d s, p50 %d s, p90 %d s, p99 %d s\n",
+               (double)all->duration_sum_ms / 1000.0 / (double)all->games,
+               duration_quantile(all, 0.10), duration_quantile(all, 0.50),
+               duration_quantile(all, 0.90), duration_quantile(all, 0.99));
+    }
+    print_heatmap("Ship placement (% of fleets covering the cell):", all->ship_cells, 2 * all->games);
+    print_heatmap("Opening shot (% of first shots per side):", all->first_shot, 2 * all->games);
+
+    int rc = all->corrupt ? 2 : 0;
+    for (int i = 0; i < nfiles; i++) {
+        if (files[i].data) mapped_file_close(&files[i]);
+    }
+    free(files);
+    free(segments);
+    free(stats);
+    free(tids);
+    return rc;
+}
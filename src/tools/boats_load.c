@@ -0,0 +1,138 @@
+#define _DEFAULT_SOURCE
+/*
+ * boats_load.c - Load generator for the server
+ *
+ * Opens C connections, each doing R LOBBY_LIST round trips (one request in
+ * flight per connection), and reports throughput and latency percentiles.
+ *
+ *     boats_load [host] [port] [connections] [requests]
+ *
+ * host may be unix:/path to use a server's --unix-socket. Start the server
+ * with --rate-limit 0, or its per-connection limits refuse most requests.
+ */
+
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <time.h>
+
+static const char *host = "127.0.0.1";
+static int port = DEFAULT_PORT;
+static int requests = 1000;
+static pthread_barrier_t start_barrier;
+
+typedef struct Worker {
+    pthread_t th;
+    uint64_t *lat_us;
+    int done;
+} Worker;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static int connect_server(void) {
+    if (strncmp(host, "unix:", 5) == 0) return connect_unix(host + 5);
+
+    struct addrinfo hints = {0}, *res;
+    char portstr[16];
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, portstr, &hints, &res) != 0) return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+/* Read until the reply ends with LOBBY_LIST_END. Returns 0 on success */
+static int read_reply(int fd, char *buf, size_t cap) {
+    size_t len = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf + len, cap - 1 - len);
+        if (n <= 0) return -1;
+        len += (size_t)n;
+        buf[len] = '\0';
+        if (strstr(buf, "LOBBY_LIST_END\n")) return 0;
+        if (strstr(buf, "BUSY")) return -1;
+        if (len >= cap - 1) len = 0;
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    char buf[8192];
+    int fd = connect_server();
+    pthread_barrier_wait(&start_barrier);
+    if (fd < 0) return NULL;
+
+    const char *req = "LOBBY_LIST\n";
+    for (int i = 0; i < requests; i++) {
+        uint64_t t0 = now_us();
+        if (write(fd, req, strlen(req)) < 0 || read_reply(fd, buf, sizeof(buf)) != 0) break;
+        w->lat_us[w->done++] = now_us() - t0;
+    }
+    close(fd);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int conns = 50;
+    if (argc > 1) host = argv[1];
+    if (argc > 2) port = atoi(argv[2]);
+    if (argc > 3) conns = atoi(argv[3]);
+    if (argc > 4) requests = atoi(argv[4]);
+    if (conns <= 0 || requests <= 0) {
+        fprintf(stderr, "Usage: %s [host] [port] [connections] [requests]\n", argv[0]);
+        return 1;
+    }
+
+    Worker *workers = calloc((size_t)conns, sizeof(Worker));
+    if (!workers) return 1;
+    pthread_barrier_init(&start_barrier, NULL, (unsigned)conns + 1);
+    for (int i = 0; i < conns; i++) {
+        workers[i].lat_us = malloc((size_t)requests * sizeof(uint64_t));
+        pthread_create(&workers[i].th, NULL, worker_main, &workers[i]);
+    }
+    pthread_barrier_wait(&start_barrier);
+    uint64_t t0 = now_us();
+    for (int i = 0; i < conns; i++) pthread_join(workers[i].th, NULL);
+    uint64_t elapsed = now_us() - t0;
+
+    size_t total = 0;
+    for (int i = 0; i < conns; i++) total += (size_t)workers[i].done;
+    uint64_t *all = malloc((total ? total : 1) * sizeof(uint64_t));
+    size_t k = 0;
+    for (int i = 0; i < conns; i++) {
+        memcpy(all + k, workers[i].lat_us, (size_t)workers[i].done * sizeof(uint64_t));
+        k += (size_t)workers[i].done;
+        free(workers[i].lat_us);
+    }
+    qsort(all, total, sizeof(uint64_t), cmp_u64);
+
+    printf("%zu round trips over %d connections in %.3f s\n", total, conns, elapsed / 1e6);
+    if (total > 0) {
+        printf("throughput %.0f req/s, latency p50 %llu us, p99 %llu us, max %llu us\n",
+               total / (elapsed / 1e6),
+               (unsigned long long)all[total / 2],
+               (unsigned long long)all[total * 99 / 100],
+               (unsigned long long)all[total - 1]);
+    }
+    free(all);
+    free(workers);
+    return total == (size_t)conns * (size_t)requests ? 0 : 1;
+}
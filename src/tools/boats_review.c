@@ -0,0 +1,384 @@
+#define _DEFAULT_SOURCE
+/*
+ * boats_review.c - Score every shot of finished games against the best shot
+ *
+ * For each shot the position is what the shooter knew at that moment:
+ * their misses, hits and the SHIP_SUNK reports. The solver (shot_solver.h)
+ * gives the chance of a ship on every unexplored cell. The shot is compared
+ * with the most likely cell: it is "best" if nothing else was clearly more
+ * likely to hit.
+ *
+ * Every position is a job on a GenericQueue shared by a pool of worker
+ * threads, so one long game and a queue of many games both use every core.
+ * Early positions (few shots fired) recur across games: their heat maps are
+ * kept in a cache, and a worker that needs a position another worker is
+ * already solving waits for that result instead of solving it again.
+ *
+ *     boats_review [-j threads] [-s] source...
+ *
+ * A source is a replay file, an archive written by the server's --archive
+ * (every game) or archive:N (game N only). -s prints one line per game.
+ */
+
+#include "game_archive.h"
+#include "generic_queue.h"
+#include "mapped_file.h"
+#include "replay.h"
+#include "shot_solver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REVIEW_BATCH 64                 /* Games loaded and solved together */
+#define CACHE_SLOTS 65536
+#define CACHE_MAX_SHOTS 8               /* Only positions this early are cached */
+#define EXACT_TOLERANCE 1e-6f
+
+typedef struct ShotScore {
+    float chosen, best;                 /* Chance the shot / the best shot would hit */
+    int best_cell;
+    int status;                         /* 0 not solved, 1 exact, 2 sampled */
+    uint64_t fleets;
+} ShotScore;
+
+typedef struct Review {
+    char source[300];
+    int index;
+    ArchiveGame game;
+    ShotScore score[ARCHIVE_MAX_SHOTS];
+} Review;
+
+typedef struct Job {
+    Review *rv;
+    int move;
+    Knowledge k;
+} Job;
+
+typedef struct CacheEntry {
+    Knowledge key;
+    Heat heat;
+    int state;                          /* 0 being solved, 1 solved, -1 no consistent fleet */
+} CacheEntry;
+
+static GenericQueue jobs;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_done = PTHREAD_COND_INITIALIZER;
+static int batch_left = 0;
+
+static CacheEntry *cache[CACHE_SLOTS];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_solved = PTHREAD_COND_INITIALIZER;
+static unsigned long cache_hits = 0, positions = 0, exact_positions = 0;
+
+static int summary_only = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static int popcount64(uint64_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+}
+
+static uint32_t knowledge_hash(const Knowledge *k) {
+    const unsigned char *p = (const unsigned char *)k;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*k); i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+/* Heat map for k, from the cache when the position is early enough to recur */
+static int position_heat(const Knowledge *k, Heat *out, uint64_t *rng) {
+    if (popcount64(k->miss | k->hit) > CACHE_MAX_SHOTS) return solver_heat(k, out, rng);
+
+    uint32_t slot = knowledge_hash(k) & (CACHE_SLOTS - 1);
+    CacheEntry *e = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    for (int probe = 0; probe < CACHE_SLOTS; probe++, slot = (slot + 1) & (CACHE_SLOTS - 1)) {
+        if (!cache[slot]) {
+            /* First to need this position: solve it and publish the result */
+            e = calloc(1, sizeof(*e));
+            if (e) {
+                e->key = *k;
+                cache[slot] = e;
+            }
+            break;
+        }
+        if (memcmp(&cache[slot]->key, k, sizeof(*k)) == 0) {
+            CacheEntry *hit = cache[slot];
+            while (hit->state == 0) pthread_cond_wait(&cache_solved, &cache_lock);
+            cache_hits++;
+            *out = hit->heat;
+            int rc = hit->state == 1 ? 0 : -1;
+            pthread_mutex_unlock(&cache_lock);
+            return rc;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    int rc = solver_heat(k, out, rng);
+    if (!e) return rc;              /* Cache full */
+
+    pthread_mutex_lock(&cache_lock);
+    e->heat = *out;
+    e->state = rc == 0 ? 1 : -1;
+    pthread_cond_broadcast(&cache_solved);
+    pthread_mutex_unlock(&cache_lock);
+    return rc;
+}
+
+static void solve(Job *job, uint64_t *rng) {
+    ShotScore *sc = &job->rv->score[job->move];
+    uint64_t known = job->k.miss | job->k.hit;
+    Heat heat;
+
+    if (position_heat(&job->k, &heat, rng) != 0) return;
+
+    int cell = ARCHIVE_SHOT_CELL(job->rv->game.shot[job->move]);
+    sc->chosen = heat.p[cell];
+    sc->best = -1;
+    for (int i = 0; i < SOLVER_CELLS; i++) {
+        if (!(known & (1ull << i)) && heat.p[i] > sc->best) {
+            sc->best = heat.p[i];
+            sc->best_cell = i;
+        }
+    }
+    sc->status = heat.exact ? 1 : 2;
+    sc->fleets = heat.fleets;
+}
+
+static void *worker_main(void *arg) {
+    uint64_t rng = 0x9E3779B97F4A7C15ull ^ (uint64_t)(uintptr_t)arg;
+    Job *job;
+
+    while ((job = queue_pop(&jobs)) != NULL) {
+        solve(job, &rng);
+        pthread_mutex_lock(&batch_lock);
+        positions++;
+        if (job->rv->score[job->move].status == 1) exact_positions++;
+        if (--batch_left == 0) pthread_cond_signal(&batch_done);
+        pthread_mutex_unlock(&batch_lock);
+        free(job);
+    }
+    return NULL;
+}
+
+/* Queue a job for every shot of rv, each with what the shooter knew before it */
+static int queue_game(Review *rv) {
+    static Replay rp;
+    ReplayBoard board;
+    Knowledge known[2];
+    int queued = 0;
+
+    if (replay_from_game(&rp, &rv->game) != 0) return 0;
+    board = rp.keys[0];
+    memset(known, 0, sizeof(known));
+    memset(rv->score, 0, sizeof(rv->score));
+
+    for (int m = 0; m < rv->game.nshots; m++) {
+        int seat = ARCHIVE_SHOT_SEAT(rv->game.shot[m]), sunk;
+        Job *job = malloc(sizeof(*job));
+        if (job) {
+            job->rv = rv;
+            job->move = m;
+            job->k = known[seat];
+            queue_push(&jobs, job);
+            queued++;
+        }
+        int hit = replay_apply(&rp, &board, m, &sunk);
+        solver_observe(&known[seat], ARCHIVE_SHOT_CELL(rv->game.shot[m]), hit, sunk);
+    }
+    return queued;
+}
+
+static void cell_name(int cell, char *out) {
+    sprintf(out, "%c%d", 'A' + cell % GRID_COLS, cell / GRID_COLS + 1);
+}
+
+/* Sampled chances are only known to about 0.5 / sqrt(samples); allow for
+ * the noise of both cells before calling a shot worse */
+static int is_best(const ShotScore *sc) {
+    double gap = sc->best - sc->chosen;
+    if (sc->status == 1) return gap <= EXACT_TOLERANCE;
+    return gap <= 0 || gap * gap * (double)sc->fleets <= 4.0;      /* gap <= 2 / sqrt(samples) */
+}
+
+static void print_review(const Review *rv) {
+    const ArchiveGame *g = &rv->game;
+    int shots[2] = {0, 0}, best[2] = {0, 0}, solved[2] = {0, 0};
+    double loss[2] = {0, 0};
+    char a[4], b[4];
+
+    if (!summary_only) {
+        printf("\n== %s #%d: player %d won in %d shots%s ==\n", rv->source, rv->index, g->winner, g->nshots,
+               g->reason == ARCHIVE_END_FORFEIT ? " (forfeit)" : "");
+    }
+    for (int m = 0; m < g->nshots; m++) {
+        const ShotScore *sc = &rv->score[m];
+        int seat = ARCHIVE_SHOT_SEAT(g->shot[m]);
+        shots[seat]++;
+        if (sc->status) {
+            solved[seat]++;
+            best[seat] += is_best(sc);
+            loss[seat] += sc->best - sc->chosen;
+        }
+        if (summary_only) continue;
+
+        cell_name(ARCHIVE_SHOT_CELL(g->shot[m]), a);
+        printf("%4d  P%d  %-3s %-4s", m + 1, seat, a, ARCHIVE_SHOT_HIT(g->shot[m]) ? "hit" : "miss");
+        if (!sc->status) {
+            printf("  (no consistent fleet)\n");
+            continue;
+        }
+        cell_name(sc->best_cell, b);
+        printf("  p=%5.1f%%  best %-3s %5.1f%%%s%s\n", 100 * sc->chosen, b, 100 * sc->best,
+               sc->status == 2 ? " ~" : "", is_best(sc) ? "" : "  <- missed a better shot");
+    }
+    if (!summary_only) printf("\n");
+    for (int seat = 0; seat < 2; seat++) {
+        if (summary_only && seat == 0) printf("%s #%d:", rv->source, rv->index);
+        printf(summary_only ? "  P%d %d/%d best, mean loss %.1f%%" : "player %d: %d of %d shots best, mean loss %.1f%%\n",
+               seat, best[seat], shots[seat], solved[seat] ? 100 * loss[seat] / solved[seat] : 0.0);
+    }
+    if (summary_only) printf("\n");
+}
+
+/* Solve and print the games in batch[0..n) */
+static void run_batch(Review **batch, int n) {
+    int queued = 0;
+
+    pthread_mutex_lock(&batch_lock);
+    batch_left = 1;                     /* Held until every job is queued */
+    pthread_mutex_unlock(&batch_lock);
+    for (int i = 0; i < n; i++) queued += queue_game(batch[i]);
+
+    pthread_mutex_lock(&batch_lock);
+    batch_left += queued - 1;
+    while (batch_left > 0) pthread_cond_wait(&batch_done, &batch_lock);
+    pthread_mutex_unlock(&batch_lock);
+
+    for (int i = 0; i < n; i++) print_review(batch[i]);
+}
+
+/* Feed the games of one source through the batch */
+static int review_source(const char *arg, Review **batch, int *n, int *games) {
+    char path[300];
+    int only = -1;
+    const char *colon = strrchr(arg, ':');
+
+    snprintf(path, sizeof(path), "%s", arg);
+    if (colon && colon[1] >= '0' && colon[1] <= '9') {
+        only = atoi(colon + 1);
+        path[colon - arg] = '\0';
+    }
+
+    MappedFile mf;
+    if (mapped_file_open(&mf, path) != 0) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return -1;
+    }
+    const uint8_t *data = mf.data;
+    int is_archive = mf.size >= 4 && memcmp(data, "BGA1", 4) == 0;
+
+    if (!is_archive || only >= 0) {
+        static Replay rp;
+        mapped_file_close(&mf);
+        if (replay_load(&rp, path, only < 0 ? 0 : only) != 0) {
+            fprintf(stderr, "No game in %s\n", arg);
+            return -1;
+        }
+        Review *rv = batch[(*n)++];
+        snprintf(rv->source, sizeof(rv->source), "%s", path);
+        rv->index = only < 0 ? 0 : only;
+        rv->game = rp.game;
+        (*games)++;
+        if (*n == REVIEW_BATCH) {
+            run_batch(batch, *n);
+            *n = 0;
+        }
+        return 0;
+    }
+
+    size_t off = 0, size;
+    int index = 0;
+    while ((size = archive_segment_size(data + off, mf.size - off)) != 0) {
+        ArchiveSegment seg;
+        if (archive_segment_open(&seg, data + off, size) == 0) {
+            Review *rv = batch[*n];
+            while (archive_segment_next(&seg, &rv->game) == 1) {
+                snprintf(rv->source, sizeof(rv->source), "%s", path);
+                rv->index = index++;
+                (*games)++;
+                if (++*n == REVIEW_BATCH) {
+                    run_batch(batch, *n);
+                    *n = 0;
+                }
+                rv = batch[*n];
+            }
+            archive_segment_close(&seg);
+        }
+        off += size;
+    }
+    mapped_file_close(&mf);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+            threads = atoi(argv[first + 1]);
+            first += 2;
+        } else if (strcmp(argv[first], "-s") == 0) {
+            summary_only = 1;
+            first++;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc || threads <= 0) {
+        fprintf(stderr, "Usage: %s [-j threads] [-s] replay|archive|archive:N...\n", argv[0]);
+        return 1;
+    }
+
+    solver_init();
+    queue_init(&jobs);
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    Review **batch = calloc(REVIEW_BATCH, sizeof(Review *));
+    if (!tids || !batch) return 1;
+    for (int i = 0; i < REVIEW_BATCH; i++) {
+        batch[i] = malloc(sizeof(Review));
+        if (!batch[i]) return 1;
+    }
+    for (int i = 0; i < threads; i++) pthread_create(&tids[i], NULL, worker_main, (void *)(uintptr_t)(i + 1));
+
+    uint64_t t0 = now_us();
+    int n = 0, games = 0, rc = 0;
+    for (int i = first; i < argc; i++) {
+        if (review_source(argv[i], batch, &n, &games) != 0) rc = 1;
+    }
+    if (n) run_batch(batch, n);
+
+    for (int i = 0; i < threads; i++) queue_push(&jobs, NULL);
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+
+    fprintf(stderr, "%d games, %lu positions (%lu exact), %lu cache hits, %d threads, %.3f s\n",
+            games, positions, exact_positions, cache_hits, threads, (now_us() - t0) / 1e6);
+
+    queue_destroy(&jobs);
+    for (int i = 0; i < CACHE_SLOTS; i++) free(cache[i]);
+    for (int i = 0; i < REVIEW_BATCH; i++) free(batch[i]);
+    free(batch);
+    free(tids);
+    return rc;
+}
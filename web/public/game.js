@@ -1,12 +1,41 @@
 const statusDiv = document.getElementById('status');
+const clockDiv = document.getElementById('clock');
 const messagesDiv = document.getElementById('messages');
 const myGrid = document.getElementById('my-grid');
 const opGrid = document.getElementById('op-grid');
 
 const protocol = window.location.protocol === 'https:' ? 'wss://' : 'ws://';
-const wsUrl = protocol + window.location.host;
+// ?server=host:port connects straight to the game server's WebSocket port (--ws-port),
+// otherwise go through the gateway that served this page
+const directServer = new URLSearchParams(window.location.search).get('server');
+const wsUrl = protocol + (directServer || window.location.host);
 let ws;
 let connected = false;
+let resumeToken = ''; // From ASSIGN; lets a new connection take our seat back
+let lobbyRefresh = null;
+
+// Show the lobby list (fresh connection, or a game that could not be resumed)
+function enterLobby() {
+    statusDiv.innerHTML = "Connected! Select a Lobby...";
+    statusDiv.style.color = '#4CAF50';
+
+    // Send default name to satisfy server
+    ws.send("NAME Player");
+
+    // Auto-list lobbies and show lobby screen directly
+    ws.send("LOBBY_LIST");
+    // Auto-refresh lobbies
+    if (!lobbyRefresh) {
+        lobbyRefresh = setInterval(() => {
+            if (document.getElementById('lobby-screen').style.display === 'block') {
+                ws.send("LOBBY_LIST");
+            }
+        }, 1000);
+    }
+
+    document.getElementById('setup-screen').style.display = 'none';
+    document.getElementById('lobby-screen').style.display = 'block';
+}
 
 function connectWebSocket() {
     statusDiv.innerText = "Connecting...";
@@ -46,23 +75,13 @@ function connectWebSocket() {
 
             if (line === "PROXY_HELLO") {
                 connected = true;
-                statusDiv.innerHTML = "Connected! Select a Lobby...";
-                statusDiv.style.color = '#4CAF50';
-
-                // Send default name to satisfy server
-                ws.send("NAME Player");
-
-                // Auto-list lobbies and show lobby screen directly
-                ws.send("LOBBY_LIST");
-                // Auto-refresh lobbies
-                setInterval(() => {
-                    if (document.getElementById('lobby-screen').style.display === 'block') {
-                        ws.send("LOBBY_LIST");
-                    }
-                }, 1000);
-
-                document.getElementById('setup-screen').style.display = 'none';
-                document.getElementById('lobby-screen').style.display = 'block';
+                if (resumeToken) {
+                    // Reconnected mid-game: ask for our seat back
+                    statusDiv.innerText = "Reconnected. Resuming game...";
+                    ws.send("RESUME " + resumeToken);
+                } else {
+                    enterLobby();
+                }
                 return;
             }
 
@@ -85,6 +104,14 @@ window.isLocalPlacementMode = true;
 
 let tempLobbyList = [];
 
+// Server-side placement / turn clock (TIMER messages)
+let clockEnd = 0;
+let clockLabel = '';
+setInterval(() => {
+    const left = Math.max(0, Math.ceil((clockEnd - Date.now()) / 1000));
+    clockDiv.innerText = clockEnd && left > 0 ? `${clockLabel}: ${left}s` : '';
+}, 250);
+
 // Helper for chat
 function logToChat(msg, color = '#eee') {
     const p = document.createElement('div');
@@ -583,12 +610,66 @@ createGrid(opGrid, true, (x, y) => {
 });
 
 
+// View hash, same as view_cell_key() in src/common/game.h: XOR of one key per
+// marked cell (0 = own board, 1 = shots at the opponent; 1 hit, 2 miss, 3 ship)
+function viewCellKey(plane, r, c, mark) {
+    let x = (((plane * 7 + r) * 9 + c) * 4 + mark) >>> 0;
+    x = Math.imul(x, 0x9E3779B1); x = (x ^ (x >>> 16)) >>> 0;
+    x = Math.imul(x, 0x85EBCA6B); x = (x ^ (x >>> 13)) >>> 0;
+    x = Math.imul(x, 0xC2B2AE35); x = (x ^ (x >>> 16)) >>> 0;
+    return x;
+}
+
+function viewHash() {
+    let h = 0;
+    for (let i = 0; i < 63; i++) {
+        const r = Math.floor(i / 9), c = i % 9;
+        const own = myGrid.children[i].classList;
+        const opp = opGrid.children[i].classList;
+        if (own.contains('hit')) h ^= viewCellKey(0, r, c, 1);
+        else if (own.contains('miss')) h ^= viewCellKey(0, r, c, 2);
+        else if (own.contains('ship')) h ^= viewCellKey(0, r, c, 3);
+        if (opp.contains('hit') || opp.contains('sunk')) h ^= viewCellKey(1, r, c, 1);
+        else if (opp.contains('miss')) h ^= viewCellKey(1, r, c, 2);
+    }
+    return h >>> 0;
+}
+
+// STATE <seat> <phase> <turn> <own> <opp> <ships> <hash>: redraw both boards
+function applyState(parts) {
+    const own = parts[4], opp = parts[5], ships = parts[6];
+    if (!own || own.length !== 63 || !opp || opp.length !== 63 || !ships) return;
+
+    placedShips = [];
+    for (let i = 0; i + 4 <= ships.length; i += 4) {
+        if (ships[i] === '-') continue;
+        placedShips.push({ r: +ships[i], c: +ships[i + 1], len: +ships[i + 2], dir: ships[i + 3] });
+    }
+    drawAllMyShips();
+    for (let i = 0; i < 63; i++) {
+        const mine = myGrid.children[i].classList;
+        mine.remove('hit', 'miss');
+        if (own[i] === 'H') mine.add('hit');
+        else if (own[i] === 'M') mine.add('miss');
+        opGrid.children[i].className = 'cell';
+        if (opp[i] === 'H') opGrid.children[i].classList.add('hit');
+        else if (opp[i] === 'M') opGrid.children[i].classList.add('miss');
+    }
+    logToChat("Board resynchronised with the server.", '#aaa');
+}
+
 function handleServerMessage(line) {
     line = line.trim();
     if (!line) return;
     const parts = line.split(' ');
     const cmd = parts[0];
 
+    // Heartbeat: the server evicts clients that stop answering
+    if (cmd === 'PING') {
+        ws.send('PONG' + line.substring(4));
+        return;
+    }
+
     if (cmd === 'PROXY_HELLO') {
         // Handled in main loop
     } else if (cmd === 'HELLO') {
@@ -608,6 +689,7 @@ function handleServerMessage(line) {
         renderLobbies();
     } else if (cmd === 'YOU' || cmd === 'ASSIGN') {
         myPlayerId = parseInt(parts[1]);
+        if (parts[2]) resumeToken = parts[2];
         statusDiv.innerHTML = `Joined as Player ${myPlayerId}. Waiting for opponent...`;
 
         // Add Big Back Button at bottom for Mobile ease
@@ -749,9 +831,12 @@ function handleServerMessage(line) {
             else if (type === 'M') cell.classList.add('miss');
             else if (type === 'K') cell.classList.add('sunk');
         }
+    } else if (cmd === 'STATE') {
+        applyState(parts);
     } else if (cmd === 'TURN') {
-        // TURN <player_id>
+        // TURN <player_id> <view hash>
         const turnPid = parseInt(parts[1]);
+        if (parts[2] && parseInt(parts[2], 16) !== viewHash()) ws.send('STATE');
         if (turnPid === myPlayerId) {
             gameState = 'FIRING';
             statusDiv.innerText = "YOUR TURN! Fire at will.";
@@ -774,12 +859,44 @@ function handleServerMessage(line) {
         statusDiv.innerText = "Waiting for opponent...";
         document.getElementById('place-controls').style.display = 'none';
         document.getElementById('fire-controls').style.display = 'none';
+    } else if (cmd === 'RESUMED') {
+        // The server replays our seat (ASSIGN, placements, shots, turn) next
+        resetGameUI();
+        logToChat("Connection restored - game resumed.", '#4CAF50');
+    } else if (cmd === 'RESUME_FAIL') {
+        resumeToken = '';
+        logToChat("The game could not be resumed.", '#ff9800');
+        document.getElementById('game-ui').style.display = 'none';
+        enterLobby();
+    } else if (cmd === 'OPPONENT_AWAY') {
+        logToChat(`Opponent lost connection. Waiting up to ${parts[2]}s for them...`, '#ff9800');
+    } else if (cmd === 'OPPONENT_BACK') {
+        logToChat("Opponent reconnected.", '#4CAF50');
+    } else if (cmd === 'TIMER') {
+        // TIMER <PLACE|TURN> <seat> <seconds>
+        const seat = parseInt(parts[2]);
+        clockEnd = Date.now() + parseInt(parts[3]) * 1000;
+        if (parts[1] === 'PLACE') clockLabel = 'Placement';
+        else clockLabel = seat === myPlayerId ? 'Your turn' : "Opponent's turn";
+    } else if (cmd === 'TIMEOUT') {
+        // TIMEOUT <seat> <count>: the server placed or fired for that player
+        const seat = parseInt(parts[1]);
+        if (seat === myPlayerId) logToChat(`Time ran out - the server moved for you (${parts[2]} in a row)`, '#ff9800');
+        else logToChat(`Opponent ran out of time (${parts[2]} in a row)`, '#aaa');
+    } else if (cmd === 'FORFEIT') {
+        clockEnd = 0;
+        const seat = parseInt(parts[1]);
+        logToChat(seat === myPlayerId ? "You forfeited by running out of time." : "Opponent forfeited by running out of time.", '#ff9800');
+    } else if (cmd === 'CLOCK') {
+        logToChat(`Time limits: ${parts[1]}s per turn, ${parts[2]}s to place ships (0 = none)`, '#aaa');
     } else if (cmd === 'WIN') {
         gameState = 'GAMEOVER';
+        clockEnd = 0;
         statusDiv.innerText = "YOU WIN!";
         logToChat("VICTORY! - You won the game.", '#4CAF50');
     } else if (cmd === 'LOSE') {
         gameState = 'GAMEOVER';
+        clockEnd = 0;
         statusDiv.innerText = "YOU LOSE!";
         logToChat("DEFEAT! - You lost the game.", '#f44336');
     } else if (cmd === 'PLAY_AGAIN') {
@@ -845,6 +962,7 @@ function handleServerMessage(line) {
         logToChat("Opponent Disconnected! Refreshing in 3s...");
         setTimeout(() => location.reload(), 3000);
     } else if (cmd === 'OPPONENT_LEFT') {
+        clockEnd = 0;
         const pab = document.getElementById('play-again-box');
         // Only treat as HOST RECOVERY if mid-game (no play again box visible)
         // Actually, if we are in GAMEOVER state, and opponent left, we should prob go to lobby too?
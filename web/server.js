@@ -8,16 +8,121 @@ const app = express();
 const server = http.createServer(app);
 const wss = new WebSocket.Server({ 
     server,
-    perMessageDeflate: false // Disable compression for mobile compatibility
+    perMessageDeflate: false, // Disable compression for mobile compatibility
+    maxPayload: 64 * 1024     // Protocol lines are short; bigger messages close the socket
 });
 
 const GAME_SERVER_HOST = '127.0.0.1';
-const GAME_SERVER_PORT = 12345;
 const WEB_PORT = process.env.PORT || 3001;
 
-// Track active clients (ws -> tcpClient mappings)
-const clients = new Set();
-const maxClients = 50; // Limit active connections
+// Browser sessions are multiplexed over a few persistent links to the game
+// server's gateway port (server --gateway-port). Each frame is an 8-byte
+// header: session ID (u32), type (u8), reserved (u8), payload length (u16).
+// GATEWAY_SOCKET=/path uses the server's --gateway-socket instead of TCP loopback.
+const GATEWAY_PORT = parseInt(process.env.GATEWAY_PORT || '12347', 10);
+const GATEWAY_SOCKET = process.env.GATEWAY_SOCKET || '';
+const LINK_COUNT = parseInt(process.env.GATEWAY_LINKS || '2', 10);
+const FRAME_OPEN = 1;
+const FRAME_DATA = 2;
+const FRAME_CLOSE = 3;
+
+// Track active clients (session ID -> client)
+const clients = new Map();
+const maxClients = parseInt(process.env.MAX_CLIENTS || '1000', 10); // Limit active connections
+let nextSessionId = 1;
+
+// The length field is 16 bits: longer payloads go out as several frames of
+// the same type, as the server does (only DATA ever carries a payload).
+const MAX_FRAME_PAYLOAD = 0xFFFF;
+
+function encodeFrame(sid, type, payload) {
+    const body = payload ? Buffer.from(payload) : Buffer.alloc(0);
+    const parts = [];
+    let off = 0;
+    do {
+        const chunk = body.subarray(off, off + MAX_FRAME_PAYLOAD);
+        const header = Buffer.alloc(8);
+        header.writeUInt32BE(sid, 0);
+        header.writeUInt8(type, 4);
+        header.writeUInt16BE(chunk.length, 6);
+        parts.push(header, chunk);
+        off += chunk.length;
+    } while (off < body.length);
+    return Buffer.concat(parts);
+}
+
+class Link {
+    constructor(index) {
+        this.index = index;
+        this.socket = null;
+        this.ready = false;
+        this.pending = Buffer.alloc(0);
+        this.connect();
+    }
+
+    connect() {
+        const socket = new net.Socket();
+        this.socket = socket;
+        const onConnect = () => {
+            console.log(`Gateway link ${this.index} connected`);
+            if (!GATEWAY_SOCKET) socket.setNoDelay(true);
+            this.ready = true;
+        };
+        if (GATEWAY_SOCKET) {
+            socket.connect(GATEWAY_SOCKET, onConnect);
+        } else {
+            socket.connect(GATEWAY_PORT, GAME_SERVER_HOST, onConnect);
+        }
+        socket.on('data', (data) => this.onData(data));
+        socket.on('error', (err) => console.error(`Gateway link ${this.index} error:`, err.message));
+        socket.on('close', () => {
+            this.ready = false;
+            this.pending = Buffer.alloc(0);
+            // Sessions cannot survive their link; browsers reconnect on their own
+            for (const client of clients.values()) {
+                if (client.link === this) client.cleanup(false);
+            }
+            setTimeout(() => this.connect(), 1000);
+        });
+    }
+
+    send(sid, type, payload) {
+        if (this.ready) this.socket.write(encodeFrame(sid, type, payload));
+    }
+
+    onData(data) {
+        this.pending = Buffer.concat([this.pending, data]);
+        while (this.pending.length >= 8) {
+            const len = this.pending.readUInt16BE(6);
+            if (this.pending.length < 8 + len) break;
+            const sid = this.pending.readUInt32BE(0);
+            const type = this.pending.readUInt8(4);
+            const payload = this.pending.subarray(8, 8 + len);
+            this.pending = this.pending.subarray(8 + len);
+
+            const client = clients.get(sid);
+            if (!client) continue;
+            if (type === FRAME_DATA) {
+                try {
+                    if (client.ws.readyState === WebSocket.OPEN) client.ws.send(payload.toString());
+                } catch (e) {
+                    console.error("WS Send Error:", e);
+                }
+            } else if (type === FRAME_CLOSE) {
+                console.log(`Game Server closed session ${sid}`);
+                client.cleanup(false);
+            }
+        }
+    }
+}
+
+const links = [];
+for (let i = 0; i < LINK_COUNT; i++) links.push(new Link(i));
+
+function pickLink(sid) {
+    const ready = links.filter(l => l.ready);
+    return ready.length ? ready[sid % ready.length] : null;
+}
 
 // Heartbeat interval to clean dead connections
 const heartbeat = setInterval(() => {
@@ -26,7 +131,7 @@ const heartbeat = setInterval(() => {
             client.ws.ping(); // Send low-level PING
         } else if (client.ws.readyState === WebSocket.CLOSED || client.ws.readyState === WebSocket.CLOSING) {
              // Force cleanup if stuck in closing
-             client.cleanup();
+             client.cleanup(true);
         }
     });
 }, 10000);
@@ -49,96 +154,50 @@ server.on('upgrade', (request, socket, head) => {
 
 wss.on('connection', (ws, req) => {
     const ip = req.socket.remoteAddress;
-    console.log(`Web client connected from ${ip} (Total: ${clients.size + 1})`);
-    
-    // Connect to C Game Server
-    const tcpClient = new net.Socket();
-    // tcpClient.setNoDelay(true); // Optional: try disabling if issues persist
-    
-    // Track this connection
-    const clientData = { ws, tcpClient, cleanup: null };
-    
-    const cleanup = () => {
-        if (clients.has(clientData)) {
-            clients.delete(clientData);
+    const sid = nextSessionId++;
+    const link = pickLink(sid);
+    if (!link || clients.size >= maxClients) {
+        console.log(`Refusing web client from ${ip}: ${link ? 'too many clients' : 'game server unavailable'}`);
+        ws.close();
+        return;
+    }
+    console.log(`Web client connected from ${ip} as session ${sid} on link ${link.index} (Total: ${clients.size + 1})`);
+
+    // Track this session
+    const clientData = { ws, link, cleanup: null };
+
+    const cleanup = (notifyServer) => {
+        if (clients.get(sid) === clientData) {
+            clients.delete(sid);
+            if (notifyServer) link.send(sid, FRAME_CLOSE);
             try { ws.close(); } catch(e){}
-            try { tcpClient.destroy(); } catch(e){}
         }
     };
     clientData.cleanup = cleanup;
-    clients.add(clientData);
-
-    ws.on('close', (code, reason) => {
-        console.log(`Web client disconnected (Code: ${code}, Reason: ${reason})`);
-        cleanup();
-    });
-
-    ws.on('error', (e) => {
-        console.error("WS Error:", e);
-        cleanup();
-    })
+    clients.set(sid, clientData);
+    link.send(sid, FRAME_OPEN);
 
     // Immediate Hello
     if (ws.readyState === WebSocket.OPEN) {
         ws.send("PROXY_HELLO\n");
     }
-    
-    tcpClient.connect(GAME_SERVER_PORT, GAME_SERVER_HOST, () => {
-        console.log('Connected to Game Server via TCP');
-    });
-
-    // TCP -> Web
-
-    // TCP -> Web
-    tcpClient.on('data', (data) => {
-        // ... (data handling code) ...
-        // We buffer or direct send. 
-        // For game protocol line-based is best handled by client JS generally if simple
-        // but here we just pass raw chunks.
-        try {
-            if (ws.readyState === WebSocket.OPEN) {
-                ws.send(data.toString());
-            }
-        } catch (e) {
-            console.error("WS Send Error:", e);
-        }
-    });
-
-    tcpClient.on('close', () => {
-        console.log('Game Server closed connection');
-        cleanup();
-    });
-
-    tcpClient.on('error', (err) => {
-        console.error('Game Server connection error:', err.message);
-        cleanup();
-    });
 
-    // Web -> TCP
+    // Web -> Game Server
     ws.on('message', (message) => {
-        const msgStr = message.toString();
-        try {
-            // Ensure newline
-             if (!tcpClient.destroyed && tcpClient.writable) {
-                if (!msgStr.endsWith('\n')) {
-                    tcpClient.write(msgStr + '\n');
-                } else {
-                    tcpClient.write(msgStr);
-                }
-             }
-        } catch (e) {
-             console.error("TCP Write Error:", e);
-        }
+        // One WebSocket message is one protocol line
+        let msgStr = message.toString();
+        if (!msgStr.endsWith('\n')) msgStr += '\n';
+        link.send(sid, FRAME_DATA, msgStr);
     });
 
-    ws.on('close', () => {
-        console.log('Web client disconnected');
-        cleanup();
+    ws.on('close', (code, reason) => {
+        console.log(`Web client disconnected (Code: ${code}, Reason: ${reason})`);
+        cleanup(true);
     });
-    
+
     ws.on('error', (err) => {
         console.error('Web Socket error:', err);
-        cleanup();
+        cleanup(true);
     });
 });
 
@@ -156,17 +215,18 @@ if (process.platform === "win32") {
 
 function shutdown() {
     console.log('\nShutting down web server...');
-    const quitMsg = "QUIT\n";
-    
-    for (const client of clients) {
+    for (const client of clients.values()) {
         try {
-            // Force close TCP connection
-            client.tcpClient.end(); 
-            client.ws.close();
+            // End the session on the game server, then the browser side
+            client.cleanup(true);
         } catch (e) {
             console.error("Error closing client:", e);
         }
     }
+    for (const link of links) {
+        link.socket.removeAllListeners('close');
+        link.socket.end();
+    }
     
     server.close(() => {
         console.log('Server closed.');